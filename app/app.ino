@@ -15,485 +15,1915 @@
 #include <P1AM.h>
 #include <ArduinoModbus.h>
 #include <ArduinoJson.h>
-#include "src/Message.h"
-#include <cppQueue.h>
 #include "src/ConfigurationManager.h"
 #include "src/RemoteConnectionManager.h"
+#include "src/Scheduler.h"
+#include "src/CommandQueue.h"
+#include "src/CommandParser.h"
+#include "src/TelemetryFilter.h"
+#include "src/TelemetryJournal.h"
+#include "src/Diagnostics.h"
+#include "src/Log.h"
+#include "src/ModbusTcpTransport.h"
+#include "src/Health.h"
+#include "src/RtuTiming.h"
 
 Config* config = new Config{};
 char *filename = "conf.txt";
+char *journalFilename = "journal.bin";
 String mqttMessage;
 uint8_t lastSentReading = 0; //Stores last Input Reading sent to the broker
 unsigned long lastMillis = 0; // The time at which the sensors were last read.
 unsigned long lastStatusMillis = 0; // The time at which the sensors were last read.
-int telemetryFrequency = 15000;
-//queue stores cmd messages to be published - messages in queue are overwritten to prevent duplication
-// DynamicJsonDocument cmd(512);
-//can queue up to 5 commands
-cppQueue cmdQ(sizeof(Message), 20, FIFO, true);
+unsigned long telemetryFrequency = 15000;
 int errorCode = 0;
+//report by exception results
+struct TelemetryStats
+{
+  unsigned long sent;
+  unsigned long suppressed;
+  //held in the journal while the broker was unreachable
+  unsigned long journaled;
+  //read while offline with no journal to hold them
+  unsigned long lost;
+  //publish counters at the start of the current cycle
+  unsigned long cyclePublishes;
+  unsigned long cycleBytes;
+  //cycle timing, bus time is spent waiting on block reads
+  unsigned long cycleStartedAt;
+  unsigned long cycleBusMicros;
+  //free ram at the start of the cycle, it shrinks if the cycle allocates
+  int cycleFreeRam;
+};
+TelemetryStats telemetryStats = {0, 0, 0, 0, 0, 0, 0, 0, 0};
+//per device telemetry messages, registers are marked during the cycle and each device's message is
+//assembled once every rtu span and tcp response is in, as the two interleave
+StaticJsonDocument<1024> batchDoc;
+int batchCount = 0;
+//position in the read order of the next device to send and the first error while sending
+int batchNext = 0;
+int batchError = 0;
+//outgoing messages are assembled in place, nothing on the publish paths touches the heap
+char topicBuffer[128];
+char payloadBuffer[1024];
+//holding register values returned by the most recent block read
+long spanValues[MODBUS_MAX_READ_REGISTERS];
+//micros() once the t3.5 silent interval after the last frame has passed, the bus is busy until then
+unsigned long busIdleAt = 0;
+bool remoteConnected = false;
+//the configuration is only read from the card once, a remount keeps it
+bool configLoaded = false;
+//the journal was opened, losing it afterwards means the card has failed
+bool journalOpened = false;
+//dhcp lease obtained and the broker client set up, a dropped link does not clear it
+bool networkReady = false;
+//a DHCP attempt blocks for up to REMOTE_DHCP_TIMEOUT_MS, failed attempts are spaced out by a doubling backoff
+#define NETWORK_MIN_BACKOFF_MS 5000
+#define NETWORK_MAX_BACKOFF_MS 60000
+unsigned long networkRetryAt = 0;
+unsigned long networkBackoffMs = 0;
+//last time health was published, it is also sent whenever it changes
+unsigned long healthPublishedAt = 0;
+//last time journal records were replayed, replay is paced by replay_rate_per_sec
+unsigned long replayAt = 0;
+//most journal records replayed in a single scheduler pass
+#define JOURNAL_REPLAY_BURST 4
+//set by a message on cmd/vfdctl/<device_name>/log, the log ring is published by logTask
+bool logDumpRequested = false;
+//set by a message on cmd/vfdctl/<device_name>/config/reload, staged by reloadTask a few registers per pass
+bool reloadRequested = false;
+//configuration staged next to the live one, nullptr while no reload is in progress
+ConfigReload* pendingReload = nullptr;
+unsigned long reloadStart = 0;
+//a patch refused inside the mqtt callback, the result is published by reloadTask
+int reloadRejected = 0;
+//body of a message on cmd/vfdctl/<device_name>/config/patch, copied out of the mqtt buffer and staged by reloadTask
+char patchPayload[CONFIG_PATCH_DOC_SIZE];
+int patchLength = 0;
+
+//telemetry poll progress, one block read is issued per scheduler pass
+enum class TelemetryState { IDLE, READING };
+TelemetryState telemetryState = TelemetryState::IDLE;
+//serial bus driven by ModbusRTUClient, the configuration may list further buses for other controllers
+#define CONTROLLER_SERIAL_BUS 0
+//next span read over the serial bus
+int telemetrySpan = 0;
+//next span to request from each tcp slave, a slave's spans are contiguous in the read plan
+struct TcpReadCursor
+{
+  int next;
+  int end;
+};
+TcpReadCursor tcpReads[MODBUS_MAX_TCP_DEVICES];
+int tcpReadCount = 0;
+//tag of modbus tcp requests sent by commands, telemetry requests are tagged with their span
+#define MODBUS_TCP_COMMAND_TAG -1
+//sample reads are tagged with their span plus this
+#define MODBUS_TCP_SAMPLE_TAG 0x10000
+//next register whose retained schema message is published, msgpack payloads only
+int schemaNext = 0;
+//most schema messages published in a single scheduler pass
+#define SCHEMA_PUBLISH_BURST 4
+//earliest sample due across every sampled span, spans are only scanned once it has passed
+unsigned long samplingDueAt = 0;
+//most modbus tcp responses handled in a single scheduler pass
+#define MODBUS_TCP_RESPONSE_BURST 4
+
+//command write progress, a batch issues one bus transaction per scheduler pass
+//writes to modbus tcp slaves wait for their response without holding the loop
+enum class CommandState { IDLE, WRITING, AWAITING_TCP };
+CommandState commandState = CommandState::IDLE;
+Command activeCommand;
+//activeCommand.writes ordered by device, then address, and the outcome of each write
+uint8_t writeOrder[COMMAND_MAX_WRITES];
+uint8_t writeResults[COMMAND_MAX_WRITES];
+int writeCount = 0;
+int writeNext = 0;
+//registers covered by the write awaiting a modbus tcp response
+int writeGroupLength = 0;
+struct CommandStats
+{
+  unsigned long batches;
+  unsigned long transactions;
+  //time from the message arriving to its last register being written
+  unsigned long lastLatencyMs;
+  unsigned long maxLatencyMs;
+};
+CommandStats commandStats = {0, 0, 0, 0};
+//requesters of single writes replaced in the queue, answered by commandTask rather than from the mqtt callback
+struct SupersededReply
+{
+  eContentType content_type;
+  int32_t value;
+  char res_topic[64];
+  char session_id[32];
+};
+#define SUPERSEDED_REPLY_CAPACITY 4
+SupersededReply supersededReplies[SUPERSEDED_REPLY_CAPACITY];
+int supersededCount = 0;
+
+//error recovery progress, the error is displayed before the failed subsystems are started again
+enum class RecoveryState { IDLE, SIGNALLING, WAITING };
+RecoveryState recoveryState = RecoveryState::IDLE;
+unsigned long recoveryAt = 0;
+
+//status led pattern currently being played
+struct LedPattern
+{
+  bool level;
+  bool startState;
+  int togglesLeft;
+  unsigned long duration;
+  unsigned long lastToggle;
+  bool active;
+};
+LedPattern led = {false, false, 0, 0, 0, false};
 
 void setup() {
   Serial.begin(115200);
   Serial.println(F("Freshly booted, welcome aboard"));
+  Diagnostics::PaintStack();
 
   //Wait for module sign-on
   // while(!P1.init());
   //status led
   pinMode(LED_BUILTIN, OUTPUT);
+
+  //every task runs once per loop() pass and returns without blocking
+  TaskScheduler.Add(ledTask, 0);
+  TaskScheduler.Add(recoveryTask, 0);
+  TaskScheduler.Add(keepaliveTask, 0);
+  TaskScheduler.Add(commandTask, 0);
+  TaskScheduler.Add(telemetryTask, 0);
+  TaskScheduler.Add(journalTask, 0);
+  TaskScheduler.Add(diagnosticsTask, DIAG_PUBLISH_INTERVAL_MS);
+  TaskScheduler.Add(logTask, 0);
+  TaskScheduler.Add(modbusTcpTask, 0);
+  TaskScheduler.Add(healthTask, 0);
+  TaskScheduler.Add(reloadTask, 0);
+  TaskScheduler.Add(samplingTask, 0);
+  TaskScheduler.Add(schemaTask, 0);
+
   //startup sequence beginning flash
   pulseStatus(false, 10);
 
-  Serial.println(F("Initializing SD hardware..."));
-  //P1AM shares an SS pin with Ethernet - reset mode of pin to guarantee setup
-  // while(ConfigMgr.Init(true, SDCARD_SS_PIN) != 0);
-  errorCode = ConfigMgr.Init(true, SDCARD_SS_PIN);
+  errorCode = initStorage();
   if (errorCode < 0){
-    errorCode = -13;
+    //the bus and network are configured from the card, recovery starts them once it is readable
+    Health.Fail(eSubsystem::subsystem_modbus);
+    Health.Fail(eSubsystem::subsystem_ethernet);
     return;
-  }else{
-    Serial.println("Success.");
   }
 
-  // Should load default config if run for the first time
-  Serial.println(F("Loading configuration..."));
-  errorCode = ConfigMgr.Load(filename, config);
-  if (errorCode < 0){
-    errorCode = -14;
-    return;
-  }else{
-    Serial.println("Success.");
-  }
-  Serial.println("Config register 9 comparison:");
-  Serial.println(config->modbus.configuration_registers[10].name);
-  Serial.println(config->modbus.configuration_registers[10].limit_comparison);
-
-  Serial.println("Success.");
-  Serial.print("Mac address: ");
-  // Serial.println(config->broker.broker_retry_interval_sec);
-  char hexCar[2];
-  sprintf(hexCar, "%02X", config->device.device_mac.b1);
-  Serial.print(hexCar);
-  sprintf(hexCar, "%02X", config->device.device_mac.b2);
-  Serial.print(hexCar);
-  sprintf(hexCar, "%02X", config->device.device_mac.b3);
-  Serial.print(hexCar);
-  sprintf(hexCar, "%02X", config->device.device_mac.b4);
-  Serial.print(hexCar);
-  sprintf(hexCar, "%02X", config->device.device_mac.b5);
-  Serial.print(hexCar);
-  sprintf(hexCar, "%02X", config->device.device_mac.b6);
-  Serial.print(hexCar);
-  Serial.println("");
-
-  Serial.println("Initializing modbus ...");
-  errorCode = ModbusRTUClient.begin(config->modbus.serial_port.baud_rate);
-  if (errorCode < 0){
-    errorCode = -15;
-    return;
-  }else{
-    Serial.println("Success.");
+  //the bus and network fail independently, one being down doesn't hold up the other
+  errorCode = initModbus();
+  int networkRes = initNetwork();
+  if (networkRes < 0){
+    errorCode = networkRes;
   }
+  resetSampling();
+}
 
-  Serial.println("Initializing remote connections ...");
-  errorCode = RemoteConnMgr.Init(config->broker, config->device);
-  if (errorCode < 0){
-    errorCode = -4;
-    return;
-  }else{
-    Serial.println("Success.");
+/// @brief Mount the SD card, load the configuration and open the telemetry journal
+/// @return 0 = success, -13 = SD failure, -14 = configuration failure
+int initStorage(){
+  LOG_INFO("Initializing SD hardware...");
+  //P1AM shares an SS pin with Ethernet - reset mode of pin to guarantee setup
+  // while(ConfigMgr.Init(true, SDCARD_SS_PIN) != 0);
+  if (ConfigMgr.Init(true, SDCARD_SS_PIN) < 0){
+    Health.Fail(eSubsystem::subsystem_storage);
+    return -13;
+  }
+
+  //a remounted card keeps the configuration already in use
+  if (!configLoaded){
+    // Should load default config if run for the first time
+    LOG_INFO("Loading configuration...");
+    if (ConfigMgr.Load(filename, config) < 0){
+      Health.Fail(eSubsystem::subsystem_storage);
+      return -14;
+    }
+    configLoaded = true;
+    MacAddress* mac = &config->device.device_mac;
+    LOG_INFO("Mac address: %02X%02X%02X%02X%02X%02X", mac->b1, mac->b2, mac->b3, mac->b4, mac->b5, mac->b6);
+
+    telemetryFrequency = config->modbus.telemetry_interval_sec * 1000UL;
+  }
+
+  journalOpened = Journal.Open(journalFilename, config->journal, config->source_hash) >= 0;
+  if (!journalOpened){
+    //not fatal, telemetry is only lost while the broker is unreachable
+    LOG_WARN("Journal disabled.");
+  }
+  Health.Recover(eSubsystem::subsystem_storage);
+  return 0;
+}
+
+/// @brief Open the serial port of the RTU bus, the first one listed in the configuration
+/// @return 0 = success, -15 = serial port failure
+int initModbus(){
+  LOG_INFO("Initializing modbus ...");
+  BusTiming.Begin(config->modbus);
+  logUnpolledBuses();
+  SerialPortConfiguration* port = &config->modbus.serial_ports[CONTROLLER_SERIAL_BUS];
+  //begin() returns 0 on failure
+  if (!ModbusRTUClient.begin(port->baud_rate, serialConfig(port))){
+    Health.Fail(eSubsystem::subsystem_modbus);
+    return -15;
+  }
+  Health.Recover(eSubsystem::subsystem_modbus);
+  return 0;
+}
+
+/// @brief Warn about registers on serial buses this controller has no port for, their slaves are never polled
+void logUnpolledBuses(){
+  ModbusReadPlan* plan = &config->modbus.read_plan;
+  for (int bus = 0; bus < config->modbus.serial_port_count; bus++)
+  {
+    if (bus == CONTROLLER_SERIAL_BUS){
+      continue;
+    }
+    int registers = 0;
+    for (int s = 0; s < plan->span_count; s++)
+    {
+      if (plan->spans[s].bus == bus && !ModbusTcp.IsTcp(plan->spans[s].device_id)){
+        registers += plan->spans[s].member_count;
+      }
+    }
+    if (registers > 0){
+      LOG_WARN("serial bus %d has %d register(s) and no port on this controller, they are not polled", bus, registers);
+    }
   }
+}
+
+/// @brief Slave reached over the serial bus driven by this controller
+bool onControllerBus(int deviceId){
+  return !ModbusTcp.IsTcp(deviceId) && ConfigMgr.GetBus(config, deviceId) == CONTROLLER_SERIAL_BUS;
+}
+
+/// @brief Serial frame format of the bus, ex: 8 data bits, even parity and 1 stop bit = SERIAL_8E1
+uint16_t serialConfig(SerialPortConfiguration* port){
+  bool sevenBits = port->data_bits == 7;
+  bool twoStops = port->stop_bits == 2;
+  switch (port->parity_bits)
+  {
+    case 1:
+      return sevenBits ? (twoStops ? SERIAL_7O2 : SERIAL_7O1) : (twoStops ? SERIAL_8O2 : SERIAL_8O1);
+    case 2:
+      return sevenBits ? (twoStops ? SERIAL_7E2 : SERIAL_7E1) : (twoStops ? SERIAL_8E2 : SERIAL_8E1);
+    default:
+      return sevenBits ? (twoStops ? SERIAL_7N2 : SERIAL_7N1) : (twoStops ? SERIAL_8N2 : SERIAL_8N1);
+  }
+}
 
-  telemetryFrequency = config->modbus.telemetry_interval_sec * 1000;
+/// @brief Obtain a DHCP lease, then set up the broker client and the modbus tcp slaves
+/// @return 0 = success, -4 = ethernet failure
+int initNetwork(){
+  LOG_INFO("Initializing remote connections ...");
+  if (RemoteConnMgr.Init(config->broker, config->device) < 0){
+    Health.Fail(eSubsystem::subsystem_ethernet);
+    networkBackoffMs = constrain(networkBackoffMs * 2, NETWORK_MIN_BACKOFF_MS, NETWORK_MAX_BACKOFF_MS);
+    networkRetryAt = millis() + networkBackoffMs;
+    return -4;
+  }
+  networkReady = true;
+  networkBackoffMs = 0;
+  Health.Recover(eSubsystem::subsystem_ethernet);
 
-  Serial.print("Setup message received events ...");
+  LOG_INFO("Initializing modbus tcp ... %d tcp device(s)", ModbusTcp.Begin(config->modbus));
   RemoteConnMgr.RegisterOnMessageReceivedCallback(messageReceived);
-  Serial.println("Success.");
+  return 0;
+}
+
+/// @brief Start again only the subsystems that failed, everything else keeps running
+/// @return 0 = every subsystem is up, < 0 = error of a subsystem still down
+int recoverSubsystems(){
+  int res = 0;
+  if (Health.IsFailed(eSubsystem::subsystem_storage)){
+    res = initStorage();
+    //nothing else can be configured until the card is readable
+    if (!configLoaded){
+      return res;
+    }
+  }
+  if (Health.IsFailed(eSubsystem::subsystem_modbus)){
+    int modbusRes = initModbus();
+    if (res == 0){
+      res = modbusRes;
+    }
+  }
+  //a dropped link comes back by itself, only a missing lease needs the network started again
+  if (!networkReady){
+    int networkRes = (long)(millis() - networkRetryAt) >= 0 ? initNetwork() : -4;
+    if (res == 0){
+      res = networkRes;
+    }
+  }
+  return res;
 }
 
-void messageReceived(String &topic, String &payload) {
-  Serial.println("new message!");
-  Serial.println("incoming: " + topic + " - " + payload);
+void messageReceived(MQTTClient* /*client*/, char topic[], char bytes[], int length) {
+  LOG_DEBUG("incoming: %s", topic);
   // Note: Do not use the client in the callback to publish, subscribe or
   // unsubscribe as it may cause deadlocks when other things arrive while
   // sending and receiving acknowledgments. Instead, change a global variable,
   // or push to a queue and handle it in the loop after calling `client.loop()`.
 
-  //TODO: Add into a dictionary<topic, body> and then serialize later to prevent dropping msgs
+  //the log is published from the loop, never from inside the callback
+  snprintf(topicBuffer, sizeof(topicBuffer), "cmd/vfdctl/%s/log", config->device.device_name);
+  if (strcmp(topic, topicBuffer) == 0){
+    logDumpRequested = true;
+    return;
+  }
+  snprintf(topicBuffer, sizeof(topicBuffer), "cmd/vfdctl/%s/config/reload", config->device.device_name);
+  if (strcmp(topic, topicBuffer) == 0){
+    reloadRequested = true;
+    return;
+  }
+  //the patch is only copied here, reloadTask parses it and stages its registers
+  snprintf(topicBuffer, sizeof(topicBuffer), "cmd/vfdctl/%s/config/patch", config->device.device_name);
+  if (strcmp(topic, topicBuffer) == 0){
+    if (pendingReload != nullptr || patchLength > 0){
+      reloadRejected = static_cast<int>(ConfigurationManagerErrors::CONFIG_RELOAD_BUSY);
+    }else if (length <= 0 || length > static_cast<int>(sizeof(patchPayload))){
+      reloadRejected = static_cast<int>(ConfigurationManagerErrors::CONFIG_PATCH_INVALID);
+    }else{
+      memcpy(patchPayload, bytes, length);
+      patchLength = length;
+    }
+    return;
+  }
 
-  Message msg = Message();
-  //remove 'cmd/' from beginning
-  msg.topic = topic;
-  msg.body = payload;
+  //commands are parsed once, straight out of the mqtt buffer
+  Command cmd;
+  int res = CmdParser.Parse(config, topic, bytes, length, &cmd);
+  if (res < 0){
+    errorCode = res;
+    return;
+  }
+  if (res == 0){
+    return;
+  }
 
-  cmdQ.push(&msg);
-  Serial.println("message sent to queue");
+  res = CommandQ.Push(&cmd);
+  if (res == static_cast<int>(CommandQueueErrors::QUEUE_FULL)){
+    LOG_WARN("command queue is full, message dropped");
+    return;
+  }
+  if (res == static_cast<int>(CommandQueueErrors::COALESCED)){
+    LOG_DEBUG("replaced pending command for the same register");
+    //cmd now holds the replaced command, its requester is told it will never be written once the loop runs
+    if (cmd.res_topic[0] != '\0'){
+      if (supersededCount < SUPERSEDED_REPLY_CAPACITY){
+        SupersededReply* reply = &supersededReplies[supersededCount++];
+        reply->content_type = cmd.content_type;
+        reply->value = cmd.writes[0].value;
+        strlcpy(reply->res_topic, cmd.res_topic, sizeof(reply->res_topic));
+        strlcpy(reply->session_id, cmd.session_id, sizeof(reply->session_id));
+      }else{
+        LOG_WARN("too many superseded writes waiting, response dropped");
+      }
+    }
+  }else{
+    LOG_DEBUG("message sent to queue");
+  }
   pulseStatus(false, 3);
 }
 
-int publishResponse(String topic, int requestedValue, int actualValue, String contentType, String sessionId){
+int publishResponse(Command* cmd, int actualValue){
   StaticJsonDocument<192> doc;
-  String payload;
-  doc["requestedValue"] = requestedValue;
-  doc["actualValue"] = actualValue;
-  doc["contentType"] = contentType;
-  doc["sessionId"] = sessionId;
-  serializeJson(doc, payload);
-
-  int pubVal = RemoteConnMgr.Publish(payload, topic);
+  CmdParser.BuildResponse(doc, cmd, actualValue);
+  size_t len = serializePayload(doc);
+
+  int pubVal = RemoteConnMgr.Publish(cmd->res_topic, reinterpret_cast<const uint8_t*>(payloadBuffer), len);
   if(pubVal < 0)
   {
-    Serial.print("failed to publish response message to remote");
-    Serial.println(pubVal);
+    LOG_ERROR("failed to publish response message to remote. Error: %d", pubVal);
     return -1;
   }
 
-  //takes about 5 counts for RTU transaction to complete
-  delay(5);
   return 2;
 }
 
-/// @brief 
-/// @return 0 = success, -1 = unrecognized command
+/// @brief Write the oldest queued command to the bus, a batch is written one transaction per call
+/// @return 0 = nothing to do or batch in progress, 3 = command written, < 0 = error
 int processCommandQueue(){
-  if (!cmdQ.isEmpty())
+  if (commandState == CommandState::WRITING){
+    return writeNextGroup();
+  }
+
+  if (!CommandQ.Pop(&activeCommand)){
+    return 0;
+  }
+
+  switch (activeCommand.content_type)
   {
-    Serial.println("processing queue");
-    Message cmd = Message();
-    if (cmdQ.pop(&cmd))
-    {
-      Serial.println("found message ");
-      Serial.println(cmd.topic);
-      Serial.println(cmd.body);
+    case eContentType::coil_write:
+    case eContentType::register_write:
+      return writeRegister(&activeCommand);
 
-      //mqtt subscription overlapped with another
-      if (!cmd.topic.endsWith("/config")){
-        Serial.println("unrecognized command was requested, message ignored");
-        return 0;
-      }
+    case eContentType::register_batch_write:
+      return beginBatch(&activeCommand);
 
-      //content checking on cmd
-      int numSlashes = 0; 
-      for(auto x : cmd.topic)
-      {
-        Serial.println(x);
-        if (x == '/' || x == '\\'){
-          numSlashes++;
+    default:
+      return -6;
+  }
+}
+
+/// @brief Write a single holding register (function 6) or coil (function 5)
+/// @return 3 = register written, < 0 = error
+int writeRegister(Command* cmd){
+  ModbusConfigParameter* p = &config->modbus.configuration_registers[cmd->writes[0].register_index];
+  int val = cmd->writes[0].value;
+  //ensure requested values are within limits
+  int inRange = CommandParser::CheckValue(p, val);
+  switch (inRange)
+  {
+    case 0:
+      LOG_WARN("Requested value not within allowed range");
+      return -9;
+
+    case 1:
+      LOG_INFO("Writing value to register %s (%d): %d", p->name, p->address, val);
+
+      commandStats.transactions++;
+      if (ModbusTcp.IsTcp(p->device_id)){
+        //modbusTcpTask finishes the command once the slave responds
+        uint16_t value = val;
+        if (ModbusTcp.RequestWrite(p->device_id, p->type, p->address, &value, 1, MODBUS_TCP_COMMAND_TAG) < 0){
+          return -3;
         }
+        commandState = CommandState::AWAITING_TCP;
+        return 0;
       }
-      if (numSlashes != 4){
-        Serial.println("requested command topic is not formatted properly");
-        return -6;
+      if (!onControllerBus(p->device_id)){
+        LOG_WARN("device %d is on a serial bus this controller doesn't drive", p->device_id);
+        return -3;
       }
 
-      Serial.println("Looking for parameter...");
-      //lookup object from config
-      ModbusConfigParameter p = ConfigMgr.GetParameter(cmd.topic, config);
-
-      if(!p.formed){
-        Serial.print("Unable to find a matching command in config. Ignoring message");
-        return -6;
+      //modbus client writes off by 1
+      int writeRes;
+      unsigned long writeStart;
+      writeStart = beginTransaction(p->device_id);
+      if (p->type == eRegisterType::coil){
+        writeRes = ModbusRTUClient.coilWrite(p->device_id, p->address, val);
+      }else{
+        writeRes = ModbusRTUClient.holdingRegisterWrite(p->device_id, p->address, val);
       }
+      endTransaction(p->device_id, writeStart, writeRes);
+      return finishRegisterWrite(cmd, writeRes > 0);
+
+    default:
+      LOG_ERROR("Error determining if requested value is within range");
+      return -8;
+  }
+}
+
+/// @brief Respond to a single register write once the slave has answered
+/// @return 3 = register written, < 0 = error
+int finishRegisterWrite(Command* cmd, bool written){
+  if (!written)
+    return -3;
+  recordLatency(cmd);
+  // respond if a response topic was provided in message
+  if (cmd->res_topic[0] != '\0'){
+    LOG_DEBUG("Session ID: %s", cmd->session_id);
 
-      //check other assumptions are true?
+    if(publishResponse(cmd, cmd->writes[0].value) < 0){
+      return -3;
+    }
+  }
+  return 3;
+}
 
-      Serial.println("Deserializing content...");
-      StaticJsonDocument<512> doc;
-      DeserializationError error = deserializeJson(doc, cmd.body);
-      Serial.println("Deserializing content... Done.");
+/// @brief Limit check every value of a batch and order the writes into block writes
+/// @return 0 = writing, 3 = nothing to write, < 0 = error
+int beginBatch(Command* cmd){
+  ModbusConfigParameter* regs = config->modbus.configuration_registers;
+  bool rejected = false;
+  for (int i = 0; i < cmd->write_count; i++)
+  {
+    ModbusConfigParameter* p = &regs[cmd->writes[i].register_index];
+    if (CommandParser::CheckValue(p, cmd->writes[i].value) == 1){
+      writeResults[i] = eWriteResult::write_pending;
+    }else{
+      writeResults[i] = eWriteResult::write_out_of_range;
+      rejected = true;
+    }
+  }
+  if (rejected && cmd->all_or_nothing){
+    LOG_WARN("Batch rejected, a requested value is not within its allowed range");
+    return finishBatch(cmd);
+  }
 
-      if (error)
+  //order the accepted writes by device, type, then address (insertion sort, batches are small)
+  writeCount = 0;
+  for (int i = 0; i < cmd->write_count; i++)
+  {
+    if (writeResults[i] != eWriteResult::write_pending){
+      continue;
+    }
+    ModbusConfigParameter* p = &regs[cmd->writes[i].register_index];
+    int j = writeCount;
+    while (j > 0)
+    {
+      ModbusConfigParameter* prev = &regs[cmd->writes[writeOrder[j - 1]].register_index];
+      if (prev->device_id < p->device_id ||
+          (prev->device_id == p->device_id && (prev->type < p->type || (prev->type == p->type && prev->address <= p->address))))
       {
-        Serial.println("unable to deserialize, message ignored");
-        return -5;
+        break;
       }
+      writeOrder[j] = writeOrder[j - 1];
+      j--;
+    }
+    writeOrder[j] = i;
+    writeCount++;
+  }
 
-      // v1 message
-      if (doc.containsKey("value")){
-        Serial.println("Received V1 message, which is no longer supported...");
-        Serial.println("Please visit https://github.com/tulsasoftware/vfdctl/wiki/Message-Definitions#v2-messages");
-        return -6;
-      }
+  writeNext = 0;
+  commandState = CommandState::WRITING;
+  return writeNextGroup();
+}
 
-      // v2 message
-      if (doc.containsKey("requestedValue") && doc.containsKey("contentType")){
-        // Determine the message type
-        // TODO: use std::map in order to properly switch on strings rather than using this large if-else.
-        String msgType = doc["contentType"];
-        if (msgType == "coilWriteMsg"){
-          // TODO: implement coil writes
-        }
-        else if (msgType == "registerWriteMsg"){
-          int val = doc["requestedValue"];
-          //ensure requested values are within limits
-          Serial.println("Checking value within range for parameter");
-          //Serial.println(ConfigMgr.toString(p.limit_comparison));
-
-          int inRange = isWithinRange(p.lower_limit, p.upper_limit, val, p.limit_comparison);
-          switch (inRange)
-          {
-            case 0:
-              Serial.println("Requested value not within allowed range");
-              return -9;
-
-            case 1:
-              Serial.println("Requested value is within allowed range");
-              Serial.println("Writing value to register...");
-              Serial.println(p.name);
-              Serial.println(p.address);
-              Serial.println(val);
-
-              //modbus client writes off by 1
-              int writeRes;
-              writeRes = ModbusRTUClient.holdingRegisterWrite(p.device_id, p.address, val);
-
-              if (writeRes <= 0)
-                return -3;
-              // Check if a response topic was provided in message, respond if so
-              if (doc.containsKey("resTopic")){
-                String resTopic = doc["resTopic"];
-
-                String sessionId;
-                if (doc.containsKey("sessiondId")){
-                  Serial.print("Session ID was provided, reusing.");
-                  sessionId = doc["sessionId"].as<String>();
-                }
-                else{
-                  Serial.println("No Session ID was provided, generating one to use.");
-                  sessionId = String("session-") += random(INT32_MAX);
-                }
-                Serial.print("Session ID: ");
-                Serial.println(sessionId);
-
-                if(!publishResponse(resTopic, val, val, msgType, sessionId)){
-                  return -3;
-                }
-              }
-              return 3;
-
-            default:
-              Serial.println("Error determining if requested value is within range");
-              return -8;
-          }
-        }
-        else{
-          Serial.print("Received message with an unsupported 'contentType': ");
-          Serial.println(msgType);
-          return -6;
-        }
-      }
-      else{
-        Serial.println("Command must contain both 'requestedValue' and 'contentType' properties");
-        Serial.println("Please visit https://github.com/tulsasoftware/vfdctl/wiki/Message-Definitions#v2-messages");
-        return -6;
-      }
+/// @brief Write the next run of consecutive registers or coils on one device with a single request
+/// @return 0 = more to write, otherwise the batch result
+int writeNextGroup(){
+  Command* cmd = &activeCommand;
+  if (writeNext >= writeCount){
+    return finishBatch(cmd);
+  }
+
+  ModbusConfigParameter* regs = config->modbus.configuration_registers;
+  ModbusConfigParameter* first = &regs[cmd->writes[writeOrder[writeNext]].register_index];
+  int length = 1;
+  while (writeNext + length < writeCount)
+  {
+    ModbusConfigParameter* next = &regs[cmd->writes[writeOrder[writeNext + length]].register_index];
+    if (next->device_id != first->device_id || next->type != first->type || next->address != first->address + length){
+      break;
     }
+    length++;
   }
-  else{
+
+  LOG_INFO("Writing %d register(s) to device %d starting at %d", length, first->device_id, first->address);
+  commandStats.transactions++;
+
+  if (ModbusTcp.IsTcp(first->device_id)){
+    uint16_t values[COMMAND_MAX_WRITES];
+    for (int i = 0; i < length; i++)
+    {
+      values[i] = cmd->writes[writeOrder[writeNext + i]].value;
+    }
+    if (ModbusTcp.RequestWrite(first->device_id, first->type, first->address, values, length, MODBUS_TCP_COMMAND_TAG) < 0){
+      return endGroup(length, false);
+    }
+    //modbusTcpTask continues the batch once the slave responds
+    writeGroupLength = length;
+    commandState = CommandState::AWAITING_TCP;
     return 0;
   }
+  if (!onControllerBus(first->device_id)){
+    LOG_WARN("device %d is on a serial bus this controller doesn't drive", first->device_id);
+    return endGroup(length, false);
+  }
+
+  int writeRes;
+  unsigned long writeStart = beginTransaction(first->device_id);
+  bool isCoil = first->type == eRegisterType::coil;
+  if (length == 1 && isCoil){
+    writeRes = ModbusRTUClient.coilWrite(first->device_id, first->address, cmd->writes[writeOrder[writeNext]].value);
+  }
+  else if (length == 1){
+    writeRes = ModbusRTUClient.holdingRegisterWrite(first->device_id, first->address, cmd->writes[writeOrder[writeNext]].value);
+  }
+  else{
+    //function 15 or 16, write multiple coils or registers
+    ModbusRTUClient.beginTransmission(first->device_id, isCoil ? COILS : HOLDING_REGISTERS, first->address, length);
+    for (int i = 0; i < length; i++)
+    {
+      ModbusRTUClient.write(cmd->writes[writeOrder[writeNext + i]].value);
+    }
+    writeRes = ModbusRTUClient.endTransmission();
+  }
+  endTransaction(first->device_id, writeStart, writeRes);
+  return endGroup(length, writeRes > 0);
 }
 
-/// @brief Judge if a value is within the user's limits
-/// @param lower Lower comparison limit
-/// @param upper Upper comparison limit
-/// @param value Value to compare
-/// @param eComparison How to execute comparison
-/// @return 0 = false, 1 = true, < 0 = error
-int isWithinRange(int lower, int upper, int value, eLimitComparison eComparison){
-  int retVal = 0;
-  Serial.println("Comparison mode:");
-  Serial.println(eComparison);
-  switch (eComparison)
+/// @brief Record the outcome of a group write and move on to the next group
+/// @return 0 = more to write, otherwise the batch result
+int endGroup(int length, bool written){
+  Command* cmd = &activeCommand;
+  for (int i = 0; i < length; i++)
   {
-    case eLimitComparison::none:
-      retVal = 1;
-      break;
-    case eLimitComparison::between:
-      if ((value > lower) && (value < upper)){
-        retVal = 1;
-      }
-      break;
-    case eLimitComparison::between_or_equal:
-      if ((value >= lower) && (value <= upper)){
-        retVal = 1;
-      }
-    case eLimitComparison::less_than:
-      if ((value < upper)){
-        retVal = 1;
-      }
-    case eLimitComparison::less_than_or_equal:
-      if ((value <= upper)){
-        retVal = 1;
-      }
-    case eLimitComparison::greater_than:
-      if ((value > lower)){
-        retVal = 1;
-      }
-    case eLimitComparison::greater_than_or_equal:
-      if ((value < lower)){
-        retVal = 1;
-      }
-    default:
-      retVal = -1;
-      break;
+    writeResults[writeOrder[writeNext + i]] = written ? eWriteResult::write_ok : eWriteResult::write_failed;
+  }
+  writeNext += length;
+
+  //registers already written cannot be rolled back, only the remaining writes are abandoned
+  if (!written && cmd->all_or_nothing){
+    writeNext = writeCount;
+  }
+  if (writeNext >= writeCount){
+    return finishBatch(cmd);
   }
-  return retVal;
+  return 0;
 }
 
-void loop() {
-  //status LED freq should always be smaller than telem freq
-  int statusLedFrequency = min(10000, telemetryFrequency);
+void recordLatency(Command* cmd){
+  commandStats.lastLatencyMs = millis() - cmd->received_ms;
+  Diag.RecordCommandLatency(commandStats.lastLatencyMs);
+  if (commandStats.lastLatencyMs > commandStats.maxLatencyMs){
+    commandStats.maxLatencyMs = commandStats.lastLatencyMs;
+  }
+}
 
-  //give a status update every few seconds or when an error is present
-  if (millis() - lastStatusMillis > statusLedFrequency || errorCode != 0) {
-    lastStatusMillis = millis();
+/// @brief Respond with the result of every parameter in the batch
+/// @return 3 = every value written, < 0 = error
+int finishBatch(Command* cmd){
+  commandState = CommandState::IDLE;
+  commandStats.batches++;
+  recordLatency(cmd);
+
+  int res = 3;
+  for (int i = 0; i < cmd->write_count; i++)
+  {
+    switch (writeResults[i])
+    {
+      case eWriteResult::write_pending:
+        writeResults[i] = eWriteResult::write_skipped;
+        break;
+      case eWriteResult::write_out_of_range:
+        if (res > 0){
+          res = -9;
+        }
+        break;
+      case eWriteResult::write_failed:
+        res = -3;
+        break;
+      default:
+        break;
+    }
+  }
 
-    //display existing results before updating
-    //good running condition gives no error and 0 flashes
-    blinkStatus(errorCode < 0, errorCode);
+  // respond if a response topic was provided in message
+  if (cmd->res_topic[0] != '\0'){
+    LOG_DEBUG("Session ID: %s", cmd->session_id);
 
-    //if we encountered an error, setup is expected to resolve it
-    if (errorCode < 0){
-      delay(1000);
-      setup();
+    if (publishBatchResponse(cmd) < 0){
+      return -3;
     }
   }
+  return res;
+}
 
-  //maintain connection / callbacks
-  if (RemoteConnMgr.Connect() < 0){
-    errorCode = -4;
-  }else{
-    //process any incoming commands before reporting telemetry
-    //if an error condition exists on the controller, allow it to reset before popping queue
-    errorCode = processCommandQueue();
+/// @brief Answer a single write that was replaced in the queue by a newer write to the same register
+/// ex: {"requestedValue":40,"contentType":"registerWriteMsg","sessionId":"s1","result":"superseded"}
+int publishSuperseded(SupersededReply* reply){
+  StaticJsonDocument<192> doc;
+  doc["requestedValue"] = reply->value;
+  doc["contentType"] = CommandQueue::toString(reply->content_type);
+  doc["sessionId"] = reply->session_id;
+  doc["result"] = CommandQueue::toString(eWriteResult::write_superseded);
+  size_t len = serializePayload(doc);
+
+  int pubVal = RemoteConnMgr.Publish(reply->res_topic, reinterpret_cast<const uint8_t*>(payloadBuffer), len);
+  if(pubVal < 0)
+  {
+    LOG_ERROR("failed to publish response message to remote. Error: %d", pubVal);
+    return -1;
+  }
+
+  return 2;
+}
+
+/// @brief Publish the per-parameter results of a batch command
+/// ex: {"contentType":"registerBatchWriteMsg","sessionId":"s1","results":[{"parameter":"acceltime","requestedValue":40,"result":"written"}]}
+int publishBatchResponse(Command* cmd){
+  StaticJsonDocument<1024> doc;
+  CmdParser.BuildBatchResponse(doc, config, cmd, writeResults);
+  size_t len = serializePayload(doc);
+
+  int pubVal = RemoteConnMgr.Publish(cmd->res_topic, reinterpret_cast<const uint8_t*>(payloadBuffer), len);
+  if(pubVal < 0)
+  {
+    LOG_ERROR("failed to publish response message to remote. Error: %d", pubVal);
+    return -1;
   }
 
-  // if enough time has elapsed, publish telemetry again.
-  if (millis() - lastMillis > telemetryFrequency) {
-    lastMillis = millis();
+  return 2;
+}
+
+void loop() {
+  TaskScheduler.Run();
+  Diag.RecordLoop(TaskScheduler.GetLastLoopMicros());
+}
+
+/// @brief Give the modbus client the slave's response timeout before a transaction
+/// @return Start of the transaction, passed to endTransaction()
+unsigned long beginTransaction(int deviceId){
+  ModbusRTUClient.setTimeout(BusTiming.GetTimeout(deviceId));
+  return micros();
+}
+
+/// @brief Mark the bus busy after a transaction and record its outcome for diagnostics
+/// @param result Return value of the ArduinoModbus call, 0 = failed
+/// @return Duration of the transaction
+unsigned long endTransaction(int deviceId, unsigned long startMicros, int result){
+  unsigned long elapsed = micros() - startMicros;
+  busIdleAt = micros() + BusTiming.GetFrameGapMicros();
 
-    if(errorCode >= 0){
-      errorCode = publishTelemetry();
+  eTransactionResult outcome = eTransactionResult::transaction_ok;
+  if (result <= 0){
+    //only the error text is exposed by the modbus client
+    const char* error = ModbusRTUClient.lastError();
+    if (strcmp(error, "Connection timed out") == 0){
+      outcome = eTransactionResult::transaction_timeout;
+    }else if (strcmp(error, "Invalid CRC") == 0){
+      outcome = eTransactionResult::transaction_crc_error;
+    }else{
+      outcome = eTransactionResult::transaction_error;
     }
   }
+  Diag.RecordTransaction(deviceId, elapsed, outcome);
+  //only a complete answer is a response time sample
+  if (outcome == eTransactionResult::transaction_timeout){
+    BusTiming.RecordTimeout(deviceId);
+  }else if (outcome != eTransactionResult::transaction_crc_error){
+    BusTiming.RecordResponse(deviceId, elapsed);
+  }
+  //an exception is still an answer, only silence or garbage counts against the slave
+  Health.SlaveResult(deviceId, outcome != eTransactionResult::transaction_timeout && outcome != eTransactionResult::transaction_crc_error);
+  return elapsed;
 }
 
-int publishTelemetry(){
-  Serial.print(" publishing..");
-  for (size_t i = 0; i < 50; i++)
-    {
-      // Serial.println("Scanning next modbus param from configuration ...");
-      ModbusParameter param = config->modbus.registers[i];
+bool busReady(){
+  return (long)(micros() - busIdleAt) >= 0;
+}
 
-      //abort early if at the end of the defined registers
-      if (param.formed == false){
-        break;
-      }
-      // Serial.println(param.name);
-      // Serial.println(param.address);
+/// @brief Status led task, plays the active pattern and gives a status update every few seconds
+void ledTask(){
+  if (led.active){
+    if (millis() - led.lastToggle < led.duration){
+      return;
+    }
+    if (led.togglesLeft > 0){
+      //pull the led opposite of current state, wait and toggle it
+      //takes two cycles for a single "blink"
+      digitalWrite(LED_BUILTIN, !led.level);
+      led.level = !led.level;
+      led.togglesLeft--;
+      led.lastToggle = millis();
+      return;
+    }
+    //return led to original state
+    digitalWrite(LED_BUILTIN, led.startState);
+    led.active = false;
+    return;
+  }
 
-      // Serial.print("Beginning read ... ");
-      int regValue = ModbusRTUClient.holdingRegisterRead(param.device_id, param.address);
-      if (regValue < 0) 
-      {
-        //move to next register
-        Serial.print("failed to read register ");
-        Serial.print(40000 + param.address);
-        Serial.print(" ; ");
-        Serial.println(ModbusRTUClient.lastError());
-        return -7;
+  //errors are displayed by the recovery task
+  if (errorCode < 0){
+    return;
+  }
+
+  //status LED freq should always be smaller than telem freq
+  unsigned long statusLedFrequency = min(10000UL, telemetryFrequency);
+
+  //good running condition gives no error and 0 flashes
+  if (millis() - lastStatusMillis > statusLedFrequency || errorCode != 0) {
+    lastStatusMillis = millis();
+    blinkStatus(false, errorCode);
+    //results only need to be displayed once
+    errorCode = 0;
+  }
+}
+
+/// @brief Error recovery task, displays the error then starts again whichever subsystems have failed
+void recoveryTask(){
+  switch (recoveryState)
+  {
+    case RecoveryState::IDLE:
+      if (errorCode < 0){
+        blinkStatus(true, errorCode);
+        recoveryState = RecoveryState::SIGNALLING;
       }
-      else
-      {
-        //write the contents to the remote
-
-        //store value in source to preserve last value read
-        // config->modbus.registers[i].value = regValue;
-        // Serial.print("value = ");
-        // Serial.println(regValue);
-
-        // Serial.println("Serializing results...");
-        //serialize the contents
-        StaticJsonDocument<96> doc;
-        String val;
-        String topic = "";
-        doc["name"] = param.name;
-        doc["value"] = regValue;
-        doc["units"] = param.units;
-        serializeJson(doc, val);
-        // Serial.print("value: ");
-        // Serial.println(val);
-
-        // Serial.println("Assembling topic...");
-        //ex: devices/vfd2/torque
-        topic += param.topic;
-        // Serial.print("topic: ");
-        // Serial.println(topic);
-
-        // Serial.print("Publishing results...");
-        int pubVal = RemoteConnMgr.Publish(val, topic);
-        if(pubVal < 0)
-        {
-          Serial.print("failed to publish to remote. Error: ");
-          Serial.println(pubVal);
-          return -7;
-        }
-        // Serial.println("done.");
+      break;
+
+    case RecoveryState::SIGNALLING:
+      if (!led.active){
+        recoveryAt = millis() + 1000;
+        recoveryState = RecoveryState::WAITING;
       }
+      break;
 
-      //takes about 5 counts for RTU transaction to complete
-      delay(5);
-    }
-    return 2;
+    case RecoveryState::WAITING:
+      if ((long)(millis() - recoveryAt) >= 0){
+        recoveryState = RecoveryState::IDLE;
+        //a subsystem still down sets the error again and is retried after it is displayed
+        errorCode = recoverSubsystems();
+      }
+      break;
+  }
 }
 
-void blinkStatus(bool isError, int errorCode){
-  //accept positive or negative codes
-  int num = abs(errorCode);
-  //track the start state to return it when complete
-  bool startState = isError;
-  //errors blink slower for troubleshooting
-  int duration;
-  if (isError){
-    duration = 1000;
+/// @brief Maintain connection / callbacks
+void keepaliveTask(){
+  //no lease yet, recovery starts the network
+  if (!networkReady){
+    return;
+  }
+  //an outage is ridden out without restarting, polling continues while reconnects back off
+  int res = RemoteConnMgr.Connect();
+  if (res == static_cast<int>(RemoteConnectionErrors::ETHERNET_INITIALIZATION_FAILURE)){
+    Health.Fail(eSubsystem::subsystem_ethernet);
+  }else if (res != static_cast<int>(RemoteConnectionErrors::BROKER_RECONNECT_PENDING)){
+    Health.Recover(eSubsystem::subsystem_ethernet);
+  }
+
+  if (res < 0){
+    Health.Fail(eSubsystem::subsystem_mqtt);
+    remoteConnected = false;
   }else{
-    duration = 300;
+    Health.Recover(eSubsystem::subsystem_mqtt);
+    //make records buffered during the outage visible to replay
+    if (!remoteConnected && Journal.IsOpen()){
+      Journal.Flush();
+    }
+    if (!remoteConnected){
+      schemaNext = 0;
+    }
+    remoteConnected = true;
   }
+}
 
-  for (size_t i = 0; i < num*2; i++)
+/// @brief Process a single incoming command, commands are handled between telemetry block reads
+void commandTask(){
+  //superseded writes are answered here, keepaliveTask has already serviced the client this pass
+  if (remoteConnected && supersededCount > 0){
+    for (int i = 0; i < supersededCount; i++)
+    {
+      if (publishSuperseded(&supersededReplies[i]) < 0){
+        errorCode = -3;
+      }
+    }
+    supersededCount = 0;
+  }
+  //commands wait in the queue until the bus is started again
+  if (!modbusReady()){
+    commandState = CommandState::IDLE;
+    return;
+  }
+  if (!remoteConnected || commandState == CommandState::AWAITING_TCP ||
+      (commandState == CommandState::IDLE && CommandQ.IsEmpty()) || !busReady())
   {
-    //pull the led opposite of current state, wait and toggle it
-    //takes two cycles for a single "blink"
-    digitalWrite(LED_BUILTIN, !isError);
-    delay(duration);
-    isError = !isError;
+    return;
   }
-  
-  //return led to original state
-  digitalWrite(LED_BUILTIN, startState);
-}
 
-void pulseStatus(bool isError, int errorCode){
-  //accept positive or negative codes
-  int num = abs(errorCode);
-  //track the start state to return it when complete
-  bool startState = isError;
-  //errors blink slower for troubleshooting
-  int duration;
-  duration = 100;
+  int res = processCommandQueue();
+  if (res != 0){
+    errorCode = res;
+  }
+}
 
-  for (size_t i = 0; i < num*2; i++)
+/// @brief Telemetry poll task, issues at most one block read per pass
+void telemetryTask(){
+  switch (telemetryState)
   {
-    //pull the led opposite of current state, wait and toggle it
-    //takes two cycles for a single "blink"
-    digitalWrite(LED_BUILTIN, !isError);
-    delay(duration);
-    isError = !isError;
-  }
-  
-  //return led to original state
-  digitalWrite(LED_BUILTIN, startState);
+    case TelemetryState::IDLE:
+      // if enough time has elapsed, publish telemetry again.
+      //tcp responses from an abandoned cycle are let through before the next one starts
+      if (millis() - lastMillis > telemetryFrequency && modbusReady() && ModbusTcp.GetInFlight() == 0) {
+        lastMillis = millis();
+        telemetrySpan = nextRtuSpan(0);
+        beginTcpReads();
+        telemetryStats.cyclePublishes = RemoteConnMgr.GetPublishCount();
+        telemetryStats.cycleBytes = RemoteConnMgr.GetPublishedBytes();
+        telemetryStats.cycleStartedAt = millis();
+        telemetryStats.cycleBusMicros = 0;
+        telemetryStats.cycleFreeRam = Diagnostics::FreeMemory();
+        telemetryState = TelemetryState::READING;
+        LOG_DEBUG("publishing telemetry");
+      }
+      break;
+
+    case TelemetryState::READING:
+      //abandon the cycle, recovery will restart polling
+      if (!modbusReady()){
+        discardBatch();
+        telemetryState = TelemetryState::IDLE;
+        break;
+      }
+      //tcp slaves are sent as many reads as they accept, modbusTcpTask publishes the responses
+      if (telemetrySpan >= config->modbus.read_plan.span_count){
+        if (!requestTcpReads() || ModbusTcp.GetInFlight() > 0){
+          break;
+        }
+        //one device message per pass, a cycle over many devices doesn't hold the loop
+        int flushRes = flushBatch();
+        if (flushRes > 0){
+          break;
+        }
+        LOG_INFO("telemetry done. sent: %lu suppressed: %lu journaled: %lu lost: %lu replay backlog: %lu publishes: %lu bytes: %lu",
+          telemetryStats.sent, telemetryStats.suppressed, telemetryStats.journaled, telemetryStats.lost, Journal.GetBacklog(),
+          RemoteConnMgr.GetPublishCount() - telemetryStats.cyclePublishes, RemoteConnMgr.GetPublishedBytes() - telemetryStats.cycleBytes);
+        LOG_INFO("cmd queue max depth: %d coalesced: %lu dropped: %lu cmd bus writes: %lu cmd latency last/max (ms): %lu/%lu",
+          CommandQ.GetMaxDepth(), CommandQ.GetCoalesceCount(), CommandQ.GetDropCount(), commandStats.transactions,
+          commandStats.lastLatencyMs, commandStats.maxLatencyMs);
+        Diag.RecordTelemetryCycle(millis() - telemetryStats.cycleStartedAt);
+        LOG_INFO("cycle (ms): %lu bus (us): %lu worst loop (us): %lu free ram: %d change: %d",
+          millis() - telemetryStats.cycleStartedAt, telemetryStats.cycleBusMicros, TaskScheduler.GetMaxLoopMicros(),
+          Diagnostics::FreeMemory(), Diagnostics::FreeMemory() - telemetryStats.cycleFreeRam);
+        TaskScheduler.ResetStats();
+        errorCode = flushRes < 0 ? flushRes : 2;
+        telemetryState = TelemetryState::IDLE;
+        break;
+      }
+
+      requestTcpReads();
+      if (!busReady()){
+        break;
+      }
+      //a slave that doesn't answer only loses its own values, the rest of the cycle carries on
+      int spanRes = publishSpan(&config->modbus.read_plan.spans[telemetrySpan]);
+      if (spanRes < 0){
+        errorCode = spanRes;
+      }
+      telemetrySpan = nextRtuSpan(telemetrySpan + 1);
+      break;
+  }
+}
+
+/// @brief Configuration is loaded and the serial bus is open, telemetry and commands can run
+bool modbusReady(){
+  return configLoaded && !Health.IsFailed(eSubsystem::subsystem_modbus);
+}
+
+/// @brief First span at or after index that is read over the controller's serial bus
+int nextRtuSpan(int index){
+  ModbusReadPlan* plan = &config->modbus.read_plan;
+  while (index < plan->span_count &&
+    (ModbusTcp.IsTcp(plan->spans[index].device_id) || plan->spans[index].bus != CONTROLLER_SERIAL_BUS))
+  {
+    index++;
+  }
+  return index;
+}
+
+/// @brief Find the spans of each tcp slave, the read plan orders spans by device
+void beginTcpReads(){
+  ModbusReadPlan* plan = &config->modbus.read_plan;
+  tcpReadCount = 0;
+  for (int s = 0; s < plan->span_count; s++)
+  {
+    if (!ModbusTcp.IsTcp(plan->spans[s].device_id)){
+      continue;
+    }
+    if (tcpReadCount > 0 && tcpReads[tcpReadCount - 1].end == s &&
+        plan->spans[s - 1].device_id == plan->spans[s].device_id)
+    {
+      tcpReads[tcpReadCount - 1].end++;
+      continue;
+    }
+    if (tcpReadCount >= MODBUS_MAX_TCP_DEVICES){
+      break;
+    }
+    tcpReads[tcpReadCount].next = s;
+    tcpReads[tcpReadCount].end = s + 1;
+    tcpReadCount++;
+  }
+}
+
+/// @brief Send each tcp slave the block reads its pipeline has room for
+/// @return true once every tcp span of the cycle has been requested
+bool requestTcpReads(){
+  ModbusReadPlan* plan = &config->modbus.read_plan;
+  bool requested = true;
+  for (int d = 0; d < tcpReadCount; d++)
+  {
+    TcpReadCursor* cursor = &tcpReads[d];
+    while (cursor->next < cursor->end)
+    {
+      ModbusReadSpan* span = &plan->spans[cursor->next];
+      //a degraded slave sits out the cycle until its backoff expires
+      if (!Health.SlaveReady(span->device_id)){
+        cursor->next = cursor->end;
+        break;
+      }
+      int res = ModbusTcp.RequestRead(span->device_id, span->type, span->start_address, span->length, cursor->next);
+      if (res == static_cast<int>(ModbusTcpErrors::TCP_BUSY)){
+        break;
+      }
+      //an unreachable tcp slave only loses its own values, the rest of the cycle carries on
+      if (res < 0){
+        LOG_DEBUG("failed to request registers %d-%d from device %d: %d", 40000 + span->start_address,
+          40000 + span->start_address + span->length - 1, span->device_id, res);
+        Diag.RecordTransaction(span->device_id, 0, eTransactionResult::transaction_error);
+        Health.SlaveResult(span->device_id, false);
+      }
+      cursor->next++;
+    }
+    if (cursor->next < cursor->end){
+      requested = false;
+    }
+  }
+  return requested;
+}
+
+/// @brief Hand finished modbus tcp transactions back to the telemetry cycle or command that sent them
+void modbusTcpTask(){
+  ModbusTcpResponse response;
+  for (int i = 0; i < MODBUS_TCP_RESPONSE_BURST && ModbusTcp.Poll(&response); i++)
+  {
+    eTransactionResult outcome = eTransactionResult::transaction_ok;
+    if (response.result == static_cast<int>(ModbusTcpErrors::TCP_TIMEOUT)){
+      outcome = eTransactionResult::transaction_timeout;
+    }else if (response.result < 0){
+      outcome = eTransactionResult::transaction_error;
+    }
+    Diag.RecordTransaction(response.device_id, response.micros, outcome);
+    Health.SlaveResult(response.device_id, response.result == 0 || response.result == static_cast<int>(ModbusTcpErrors::TCP_EXCEPTION));
+
+    if (response.tag == MODBUS_TCP_COMMAND_TAG){
+      completeTcpWrite(&response);
+    }else{
+      completeTcpRead(&response);
+    }
+  }
+}
+
+/// @brief Publish a block read returned by a tcp slave, or add it to the sample windows
+void completeTcpRead(ModbusTcpResponse* response){
+  ModbusReadPlan* plan = &config->modbus.read_plan;
+  if (response->tag >= MODBUS_TCP_SAMPLE_TAG){
+    int s = response->tag - MODBUS_TCP_SAMPLE_TAG;
+    if (response->result < 0 || s >= plan->span_count){
+      return;
+    }
+    for (int r = 0; r < plan->spans[s].length; r++)
+    {
+      spanValues[r] = response->values[r];
+    }
+    sampleSpanValues(&plan->spans[s]);
+    return;
+  }
+  //the cycle was abandoned while the read was in flight
+  if (telemetryState != TelemetryState::READING || response->tag >= plan->span_count){
+    return;
+  }
+  ModbusReadSpan* span = &plan->spans[response->tag];
+  if (response->result < 0){
+    LOG_ERROR("failed to read registers %d-%d from device %d: %d exception %d", 40000 + span->start_address,
+      40000 + span->start_address + span->length - 1, span->device_id, response->result, response->exception);
+    return;
+  }
+
+  for (int r = 0; r < span->length; r++)
+  {
+    spanValues[r] = response->values[r];
+  }
+  int res = publishSpanValues(span);
+  if (res < 0){
+    errorCode = res;
+  }
+}
+
+/// @brief Continue the active command once a tcp slave has answered its write
+void completeTcpWrite(ModbusTcpResponse* response){
+  //the command was abandoned while the write was in flight
+  if (commandState != CommandState::AWAITING_TCP){
+    return;
+  }
+  bool written = response->result == 0;
+  if (!written){
+    LOG_ERROR("failed to write to device %d: %d exception %d", response->device_id, response->result, response->exception);
+  }
+
+  int res;
+  if (activeCommand.content_type == eContentType::register_batch_write){
+    commandState = CommandState::WRITING;
+    res = endGroup(writeGroupLength, written);
+  }else{
+    commandState = CommandState::IDLE;
+    res = finishRegisterWrite(&activeCommand, written);
+  }
+  if (res != 0){
+    errorCode = res;
+  }
+}
+
+/// @brief Publish the diagnostics of the last interval on dt/vfdctl/<device_name>/$diag
+void diagnosticsTask(){
+  if (!remoteConnected){
+    return;
+  }
+
+  //written as text straight into payloadBuffer, no document is built on the stack
+  size_t size = sizeof(payloadBuffer);
+  size_t len = Diagnostics::Append(payloadBuffer, size, 0, "{\"uptime_s\":%lu,", millis() / 1000);
+  len = Diag.Serialize(payloadBuffer, size, len);
+  len = Diagnostics::Append(payloadBuffer, size, len, ",\"cmd_q\":{\"depth\":%d,\"max\":%d,\"coalesced\":%lu,\"dropped\":%lu}",
+    CommandQ.GetDepth(), CommandQ.GetMaxDepth(), CommandQ.GetCoalesceCount(), CommandQ.GetDropCount());
+  len = Diagnostics::Append(payloadBuffer, size, len, ",\"pub\":{\"ok\":%lu,\"fail\":%lu,\"bytes\":%lu,\"backlog\":%lu}",
+    RemoteConnMgr.GetPublishCount(), RemoteConnMgr.GetPublishFailures(), RemoteConnMgr.GetPublishedBytes(), Journal.GetBacklog());
+  len = Diagnostics::Append(payloadBuffer, size, len, ",\"ram\":{\"free\":%d,\"stack_min\":%d}}",
+    Diagnostics::FreeMemory(), Diagnostics::StackHighWater());
+  if (len >= size){
+    LOG_WARN("diagnostics message is too large to publish");
+    return;
+  }
+
+  snprintf(topicBuffer, sizeof(topicBuffer), "dt/vfdctl/%s/$diag", config->device.device_name);
+  if (RemoteConnMgr.Publish(topicBuffer, reinterpret_cast<const uint8_t*>(payloadBuffer), len) == 0){
+    Diag.Reset();
+  }
+}
+
+/// @brief Publish subsystem health on dt/vfdctl/<device_name>/$health whenever it changes, and with the diagnostics
+/// ex: {"uptime_s":812,"storage":{"ok":true,"failures":0,"mttr_ms":0,"max_ms":0},...,"slaves":[{"id":2,"failures":5,"retry_ms":16000}]}
+void healthTask(){
+  if (!remoteConnected || (!Health.IsChanged() && millis() - healthPublishedAt < DIAG_PUBLISH_INTERVAL_MS)){
+    return;
+  }
+  healthPublishedAt = millis();
+
+  StaticJsonDocument<1024> doc;
+  JsonObject root = doc.to<JsonObject>();
+  root["uptime_s"] = millis() / 1000;
+  Health.Serialize(root);
+  size_t len = serializeJson(doc, payloadBuffer, sizeof(payloadBuffer));
+
+  snprintf(topicBuffer, sizeof(topicBuffer), "dt/vfdctl/%s/$health", config->device.device_name);
+  if (RemoteConnMgr.Publish(topicBuffer, reinterpret_cast<const uint8_t*>(payloadBuffer), len) == 0){
+    Health.ClearChanged();
+  }
+}
+
+/// @brief Stage conf.txt, or the live configuration with a patch applied when patch isn't nullptr
+/// Only one reload is staged at a time, a second one is refused with CONFIG_RELOAD_BUSY.
+int startReload(const char* patch, int length){
+  if (pendingReload != nullptr){
+    return static_cast<int>(ConfigurationManagerErrors::CONFIG_RELOAD_BUSY);
+  }
+  reloadStart = millis();
+  Config* staged = new Config{};
+  pendingReload = new ConfigReload{};
+  if (staged == nullptr || pendingReload == nullptr){
+    delete staged;
+    delete pendingReload;
+    pendingReload = nullptr;
+    return static_cast<int>(ConfigurationManagerErrors::CONFIG_OUT_OF_MEMORY);
+  }
+  int res = patch == nullptr ? ConfigMgr.BeginReload(pendingReload, filename, config, staged) :
+    ConfigMgr.BeginPatch(pendingReload, patch, length, config, staged);
+  if (res < 0){
+    endReload();
+  }
+  return res;
+}
+
+/// @brief Free the staged reload, along with its configuration unless it was swapped in
+void endReload(){
+  Config* staged = pendingReload->staged;
+  ConfigMgr.EndReload(pendingReload);
+  delete pendingReload;
+  pendingReload = nullptr;
+  if (staged != nullptr){
+    staged->arena.Release();
+    delete staged;
+  }
+}
+
+/// @brief Reload conf.txt or apply a patch without restarting
+/// Requested on cmd/vfdctl/<device_name>/config/reload and cmd/vfdctl/<device_name>/config/patch. The new
+/// configuration is loaded next to the live one a few registers per pass, so polling and commands carry on,
+/// and swapped in between telemetry cycles once no command or journal record refers to a register index.
+/// A file or patch that fails to load is rejected and the live configuration keeps running.
+/// Registers that didn't change keep their report by exception state.
+void reloadTask(){
+  if (reloadRejected < 0){
+    LOG_ERROR("configuration patch rejected: %d", reloadRejected);
+    publishReloadResult(reloadRejected, nullptr, 0);
+    reloadRejected = 0;
+  }
+  if (!configLoaded){
+    return;
+  }
+  if (pendingReload == nullptr){
+    if (!reloadRequested && patchLength == 0){
+      return;
+    }
+    //a patch waiting is staged first, a reload requested with it follows once the patch is done
+    int res;
+    if (patchLength > 0){
+      res = startReload(patchPayload, patchLength);
+      patchLength = 0;
+    }else{
+      reloadRequested = false;
+      res = startReload(nullptr, 0);
+    }
+    if (res < 0){
+      LOG_ERROR("configuration reload rejected: %d", res);
+      publishReloadResult(res, nullptr, millis() - reloadStart);
+    }
+    return;
+  }
+
+  if (pendingReload->phase != ConfigReloadPhase::DONE){
+    int res = ConfigMgr.StepReload(pendingReload);
+    if (res == static_cast<int>(ConfigurationManagerErrors::CONFIG_RELOAD_PENDING)){
+      return;
+    }
+    if (res < 0){
+      LOG_ERROR("configuration reload rejected: %d", res);
+      publishReloadResult(res, nullptr, millis() - reloadStart);
+      endReload();
+      return;
+    }
+  }
+  ConfigDiff diff = pendingReload->diff;
+  if (diff.unchanged){
+    LOG_INFO("configuration unchanged");
+    publishReloadResult(0, &diff, millis() - reloadStart);
+    endReload();
+    return;
+  }
+  if (telemetryState != TelemetryState::IDLE || commandState != CommandState::IDLE || !CommandQ.IsEmpty() ||
+      ModbusTcp.GetInFlight() > 0 || Journal.GetBacklog() > 0)
+  {
+    return;
+  }
+
+  ConfigMgr.CommitReload(pendingReload);
+  Config* previous = config;
+  config = pendingReload->staged;
+  pendingReload->staged = nullptr;
+  endReload();
+  previous->arena.Release();
+  delete previous;
+
+  telemetryFrequency = config->modbus.telemetry_interval_sec * 1000UL;
+  resetSampling();
+  schemaNext = 0;
+  //rtu timeout overrides are listed with the tcp slaves
+  if (diff.serial_port_changed || diff.devices_changed){
+    errorCode = initModbus();
+  }
+  if (diff.devices_changed){
+    ModbusTcp.Begin(config->modbus);
+  }
+  //journal records are keyed by register index, the empty journal is started again for the new tables
+  journalOpened = Journal.Open(journalFilename, config->journal, config->source_hash) >= 0;
+
+  LOG_INFO("configuration reloaded in %lu ms. registers unchanged: %d changed: %d added: %d removed: %d commands changed: %d",
+    millis() - reloadStart, diff.registers_unchanged, diff.registers_changed, diff.registers_added,
+    diff.registers_removed, diff.commands_changed);
+  if (diff.restart_required){
+    LOG_WARN("device and broker settings take effect after a restart");
+  }
+  publishReloadResult(0, &diff, millis() - reloadStart);
+}
+
+/// @brief Publish the outcome of a reload on dt/vfdctl/<device_name>/$config
+/// ex: {"result":"applied","ms":84,"registers":{"unchanged":40,"changed":1,"added":2,"removed":0},"commands_changed":0,"restart_required":false}
+void publishReloadResult(int res, ConfigDiff* diff, unsigned long elapsedMs){
+  if (!remoteConnected){
+    return;
+  }
+  StaticJsonDocument<256> doc;
+  if (res < 0){
+    doc["result"] = "rejected";
+    doc["error"] = res;
+  }else if (diff->unchanged){
+    doc["result"] = "unchanged";
+  }else{
+    doc["result"] = "applied";
+  }
+  doc["ms"] = elapsedMs;
+  if (res >= 0 && !diff->unchanged){
+    JsonObject registers = doc.createNestedObject("registers");
+    registers["unchanged"] = diff->registers_unchanged;
+    registers["changed"] = diff->registers_changed;
+    registers["added"] = diff->registers_added;
+    registers["removed"] = diff->registers_removed;
+    doc["commands_changed"] = diff->commands_changed;
+    doc["restart_required"] = diff->restart_required;
+  }
+  size_t len = serializeJson(doc, payloadBuffer, sizeof(payloadBuffer));
+
+  snprintf(topicBuffer, sizeof(topicBuffer), "dt/vfdctl/%s/$config", config->device.device_name);
+  RemoteConnMgr.Publish(topicBuffer, reinterpret_cast<const uint8_t*>(payloadBuffer), len);
+}
+
+/// @brief Drain the log ring to Serial and answer log dump requests, only while the bus and broker are idle
+void logTask(){
+  if (telemetryState != TelemetryState::IDLE || commandState != CommandState::IDLE || !CommandQ.IsEmpty()){
+    return;
+  }
+  Log.Drain();
+
+  if (!logDumpRequested || !remoteConnected){
+    return;
+  }
+  logDumpRequested = false;
+  publishLog();
+}
+
+/// @brief Publish every line held in the log ring on dt/vfdctl/<device_name>/$log
+/// Lines are sent oldest first, split across as many messages as the payload buffer requires.
+void publishLog(){
+  snprintf(topicBuffer, sizeof(topicBuffer), "dt/vfdctl/%s/$log", config->device.device_name);
+  //lines written while publishing are left for the next dump
+  size_t retained = Log.GetRetained();
+  size_t offset = 0;
+  while (offset < retained)
+  {
+    size_t len = Log.Copy(offset, payloadBuffer, min(sizeof(payloadBuffer), retained - offset));
+    if (len == 0 || RemoteConnMgr.Publish(topicBuffer, reinterpret_cast<const uint8_t*>(payloadBuffer), len) < 0){
+      return;
+    }
+    offset += len;
+  }
+}
+
+void journalTask(){
+  //the journal stops itself on a card error, recovery remounts the card and reopens it
+  if (journalOpened && !Journal.IsOpen()){
+    journalOpened = false;
+    Health.Fail(eSubsystem::subsystem_storage);
+    errorCode = -13;
+    return;
+  }
+  if (Journal.Maintain() < 0){
+    return;
+  }
+
+  //replay only uses what live telemetry and commands leave idle
+  if (!remoteConnected || Journal.GetBacklog() == 0 ||
+      telemetryState != TelemetryState::IDLE || commandState != CommandState::IDLE || !CommandQ.IsEmpty())
+  {
+    replayAt = millis();
+    return;
+  }
+
+  unsigned long due = (millis() - replayAt) * config->journal.replay_rate_per_sec / 1000;
+  if (due == 0){
+    return;
+  }
+  replayAt = millis();
+
+  JournalRecord record;
+  for (unsigned long i = 0; i < due && i < JOURNAL_REPLAY_BURST && Journal.Peek(&record); i++)
+  {
+    //a failed publish is retried once the connection is checked again
+    if (publishJournalRecord(&record) < 0){
+      break;
+    }
+    Journal.Pop();
+  }
+}
+
+/// @brief Serialize a telemetry or command response message into payloadBuffer in the configured payload_format
+/// @return Payload length
+size_t serializePayload(JsonDocument& doc){
+  if (config->modbus.payload_format == ePayloadFormat::payload_msgpack){
+    return serializeMsgPack(doc, payloadBuffer, sizeof(payloadBuffer));
+  }
+  return serializeJson(doc, payloadBuffer, sizeof(payloadBuffer));
+}
+
+/// @brief Telemetry carries values alone, each register's name and units are in its retained schema message
+bool usesSchema(){
+  return config->modbus.payload_format == ePayloadFormat::payload_msgpack;
+}
+
+/// @brief Publish the schema of every register once as a retained message on <topic>/$schema
+/// Schemas are sent again after a reconnect or reload, the broker may have been restarted without its retained messages.
+void schemaTask(){
+  if (!configLoaded || !usesSchema() || !remoteConnected || schemaNext >= config->modbus.registers.count ||
+      telemetryState != TelemetryState::IDLE)
+  {
+    return;
+  }
+  for (int i = 0; i < SCHEMA_PUBLISH_BURST && schemaNext < config->modbus.registers.count; i++)
+  {
+    //a failed publish is retried once the connection is checked again
+    if (publishSchema(schemaNext) < 0){
+      return;
+    }
+    schemaNext++;
+  }
+}
+
+/// @brief Publish the static metadata of a telemetry register
+/// ex: dt/vfdctl/vfd1/amps/$schema {"name":"amps","units":"A","device_id":1,"address":200}
+int publishSchema(int reg){
+  ModbusRegisterTable* regs = &config->modbus.registers;
+  StaticJsonDocument<128> doc;
+  doc["name"] = regs->meta[reg].name;
+  doc["units"] = regs->meta[reg].units;
+  doc["device_id"] = regs->device_id[reg];
+  doc["address"] = regs->address[reg];
+  size_t len = serializePayload(doc);
+
+  size_t topicLen = ConfigMgr.FormatTopic(regs->meta[reg].topic, topicBuffer, sizeof(topicBuffer));
+  if (topicLen >= sizeof(topicBuffer) ||
+      strlcpy(topicBuffer + topicLen, "/$schema", sizeof(topicBuffer) - topicLen) >= sizeof(topicBuffer) - topicLen)
+  {
+    LOG_WARN("schema topic of %s is too long", regs->meta[reg].name);
+    return 0;
+  }
+  return RemoteConnMgr.Publish(topicBuffer, reinterpret_cast<const uint8_t*>(payloadBuffer), len, true);
+}
+
+/// @brief Publish a journaled value on its register's telemetry topic
+/// ex: {"name":"amps","value":52,"units":"A","ts":81234,"age_ms":64000}
+/// ts is millis() when the value was read, age_ms is omitted for records written before this boot
+int publishJournalRecord(JournalRecord* record){
+  ModbusRegisterTable* regs = &config->modbus.registers;
+  if (record->register_index >= regs->count){
+    LOG_WARN("Skipping journal record for an unknown register");
+    return 0;
+  }
+  ModbusParameter* param = &regs->meta[record->register_index];
+
+  StaticJsonDocument<128> doc;
+  if (!usesSchema()){
+    doc["name"] = param->name;
+  }
+  doc["value"] = record->value;
+  if (!usesSchema()){
+    doc["units"] = param->units;
+  }
+  doc["ts"] = record->timestamp_ms;
+  if (!Journal.IsFromPriorBoot()){
+    doc["age_ms"] = millis() - record->timestamp_ms;
+  }
+  size_t len = serializePayload(doc);
+  ConfigMgr.FormatTopic(param->topic, topicBuffer, sizeof(topicBuffer));
+
+  return RemoteConnMgr.Publish(topicBuffer, reinterpret_cast<const uint8_t*>(payloadBuffer), len);
+}
+
+/// @brief Read spans with a sample_interval_ms between telemetry cycles, each read goes into the sample windows
+/// At most one serial bus transaction is made per pass, tcp slaves are sent every sample that is due.
+void samplingTask(){
+  if (!modbusReady() || telemetryState != TelemetryState::IDLE || (long)(millis() - samplingDueAt) < 0){
+    return;
+  }
+  //let the tcp pipelines drain once the telemetry cycle is due, it only starts with nothing in flight
+  if (millis() - lastMillis > telemetryFrequency){
+    return;
+  }
+
+  ModbusReadPlan* plan = &config->modbus.read_plan;
+  unsigned long now = millis();
+  bool rtuBusy = !busReady();
+  //spans are scanned again once the earliest sample is due, at least every telemetry interval
+  samplingDueAt = now + telemetryFrequency;
+  for (int s = 0; s < plan->span_count; s++)
+  {
+    ModbusReadSpan* span = &plan->spans[s];
+    if (span->sample_interval_ms == 0 || (span->bus != CONTROLLER_SERIAL_BUS && !ModbusTcp.IsTcp(span->device_id))){
+      continue;
+    }
+    if ((long)(now - span->sample_due_ms) >= 0){
+      //a degraded slave's samples are skipped, not queued up
+      bool sampled = true;
+      if (Health.SlaveReady(span->device_id)){
+        if (ModbusTcp.IsTcp(span->device_id)){
+          int res = ModbusTcp.RequestRead(span->device_id, span->type, span->start_address, span->length, MODBUS_TCP_SAMPLE_TAG + s);
+          sampled = res != static_cast<int>(ModbusTcpErrors::TCP_BUSY);
+        }
+        else if (!rtuBusy){
+          sampleSpan(span);
+          rtuBusy = true;
+        }
+        else{
+          sampled = false;
+        }
+      }
+      if (sampled){
+        span->sample_due_ms = now + span->sample_interval_ms;
+      }
+    }
+    if ((long)(span->sample_due_ms - samplingDueAt) < 0){
+      samplingDueAt = span->sample_due_ms;
+    }
+  }
+}
+
+/// @brief Make every sampled span due and log the share of the serial bus sampling will take
+void resetSampling(){
+  ModbusReadPlan* plan = &config->modbus.read_plan;
+  unsigned long now = millis();
+  samplingDueAt = now;
+  //wire time only, request and response frames plus the silent interval, slave turnaround comes on top
+  unsigned long busMicrosPerSec = 0;
+  int sampled = 0;
+  for (int s = 0; s < plan->span_count; s++)
+  {
+    ModbusReadSpan* span = &plan->spans[s];
+    span->sample_due_ms = now;
+    if (span->sample_interval_ms == 0){
+      continue;
+    }
+    if (ModbusTcp.IsTcp(span->device_id)){
+      sampled += span->member_count;
+      continue;
+    }
+    if (span->bus != CONTROLLER_SERIAL_BUS){
+      continue;
+    }
+    sampled += span->member_count;
+    int dataBytes = isBitSpan(span) ? (span->length + 7) / 8 : span->length * 2;
+    unsigned long frameMicros = (8 + 5 + dataBytes) * BusTiming.GetCharMicros() + 2 * BusTiming.GetFrameGapMicros();
+    busMicrosPerSec += frameMicros * 1000 / span->sample_interval_ms;
+  }
+  if (sampled > 0){
+    LOG_INFO("sampling %d register(s), serial bus wire time %lu%% (turnaround not included)", sampled, busMicrosPerSec / 10000);
+  }
+}
+
+/// @brief Read a sampled span over the serial bus and add it to the sample windows
+void sampleSpan(ModbusReadSpan* span){
+  unsigned long readStart = beginTransaction(span->device_id);
+  int readRes = ModbusRTUClient.requestFrom(span->device_id, modbusTable(span->type), span->start_address, span->length);
+  endTransaction(span->device_id, readStart, readRes);
+  if (!readRes){
+    LOG_DEBUG("failed to sample device %d at %d: %s", span->device_id, span->start_address, ModbusRTUClient.lastError());
+    return;
+  }
+  for (int r = 0; r < span->length; r++)
+  {
+    spanValues[r] = ModbusRTUClient.read();
+  }
+  sampleSpanValues(span);
+}
+
+/// @brief Add the values of a sampled span, held in spanValues, to the windows of its registers
+void sampleSpanValues(ModbusReadSpan* span){
+  ModbusReadPlan* plan = &config->modbus.read_plan;
+  ModbusRegisterTable* regs = &config->modbus.registers;
+  for (int m = 0; m < span->member_count; m++)
+  {
+    int reg = plan->register_order[span->first_member + m];
+    int32_t value = spanValues[regs->address[reg] - span->start_address];
+    regs->value[reg] = value;
+    addSample(&regs->window[reg], value);
+  }
+}
+
+void addSample(SampleWindow* window, int32_t value){
+  if (window->count == 0){
+    window->min = value;
+    window->max = value;
+    window->sum = 0;
+  }else{
+    window->min = min(window->min, value);
+    window->max = max(window->max, value);
+  }
+  //a full window keeps its min and max but stops moving the mean
+  if (window->count < UINT16_MAX){
+    window->sum += value;
+    window->count++;
+  }
+}
+
+bool isBitSpan(ModbusReadSpan* span){
+  return span->type == eRegisterType::coil || span->type == eRegisterType::discrete_input;
+}
+
+/// @brief ArduinoModbus table holding a register type
+int modbusTable(eRegisterType type){
+  switch (type)
+  {
+    case eRegisterType::coil:
+      return COILS;
+    case eRegisterType::discrete_input:
+      return DISCRETE_INPUTS;
+    case eRegisterType::input_register:
+      return INPUT_REGISTERS;
+    default:
+      return HOLDING_REGISTERS;
+  }
+}
+
+/// @brief Read a single block of telemetry registers over the serial bus and publish each of them
+/// @param span Block read from the telemetry read plan
+/// @return 0 = success or the slave is degraded, -7 = read or publish failure
+int publishSpan(ModbusReadSpan* span){
+  //a degraded slave is only polled again once its backoff expires
+  if (!Health.SlaveReady(span->device_id)){
+    return 0;
+  }
+  //one request (function 0x01-0x04 by type) covers every telemetry point in the span, bits arrive packed
+  unsigned long readStart = beginTransaction(span->device_id);
+  int readRes = ModbusRTUClient.requestFrom(span->device_id, modbusTable(span->type), span->start_address, span->length);
+  telemetryStats.cycleBusMicros += endTransaction(span->device_id, readStart, readRes);
+  if (!readRes)
+  {
+    LOG_ERROR("failed to read registers %d-%d ; %s", 40000 + span->start_address,
+      40000 + span->start_address + span->length - 1, ModbusRTUClient.lastError());
+    return -7;
+  }
+  for (int r = 0; r < span->length; r++)
+  {
+    spanValues[r] = ModbusRTUClient.read();
+  }
+  return publishSpanValues(span);
+}
+
+/// @brief Publish the registers of a block read, its values are in spanValues
+/// @return 0 = success, -7 = publish failure
+int publishSpanValues(ModbusReadSpan* span){
+  ModbusReadPlan* plan = &config->modbus.read_plan;
+  //split the block back out to each register's topic
+  for (int m = 0; m < span->member_count; m++)
+  {
+    int reg = plan->register_order[span->first_member + m];
+    ModbusRegisterTable* regs = &config->modbus.registers;
+    ModbusParameter* param = &regs->meta[reg];
+    int regValue = spanValues[regs->address[reg] - span->start_address];
+
+    //store value in source to preserve last value read
+    regs->value[reg] = regValue;
+
+    //the publish read closes the window, a spike between publishes is reported even if the value settled
+    SampleWindow* window = &regs->window[reg];
+    bool sampled = regs->sample_interval_ms[reg] > 0;
+    if (sampled){
+      addSample(window, regValue);
+    }
+    bool publish = Reporting.ShouldPublish(regs, reg, regValue) ||
+      (sampled && (Reporting.ShouldPublish(regs, reg, window->min) || Reporting.ShouldPublish(regs, reg, window->max)));
+    if (!publish){
+      window->count = 0;
+      telemetryStats.suppressed++;
+      continue;
+    }
+
+    //broker is down, keep the value for replay, the journal only holds the last sample
+    if (!remoteConnected){
+      window->count = 0;
+      if (journalValue(regs, reg, regValue) < 0){
+        telemetryStats.lost++;
+      }
+      continue;
+    }
+
+    if (config->modbus.telemetry_mode == eTelemetryMode::per_device){
+      addToBatch(reg);
+      continue;
+    }
+
+    //write the contents to the remote
+    //with msgpack the name and units are left to the retained schema message
+    StaticJsonDocument<192> doc;
+    if (!usesSchema()){
+      doc["name"] = param->name;
+    }
+    doc["value"] = regValue;
+    if (!usesSchema()){
+      doc["units"] = param->units;
+    }
+    addWindow(doc.as<JsonObject>(), regs, reg);
+    size_t len = serializePayload(doc);
+
+    //ex: devices/vfd2/torque
+    ConfigMgr.FormatTopic(param->topic, topicBuffer, sizeof(topicBuffer));
+    int pubVal = RemoteConnMgr.Publish(topicBuffer, reinterpret_cast<const uint8_t*>(payloadBuffer), len);
+    if(pubVal < 0)
+    {
+      LOG_ERROR("failed to publish to remote. Error: %d", pubVal);
+      int journalRes = journalValue(regs, reg, regValue);
+      if (journalRes < 0){
+        return journalRes;
+      }
+      continue;
+    }
+    Reporting.MarkPublished(regs, reg, regValue);
+    telemetryStats.sent++;
+  }
+  return 0;
+}
+
+/// @brief Keep a value that could not be published, it is replayed once the broker is back
+/// @return 0 = journaled, -7 = no journal, the value is lost
+int journalValue(ModbusRegisterTable* regs, int reg, int32_t value){
+  if (Journal.Append(reg, value) < 0){
+    return -7;
+  }
+  //deadband comparisons continue from the journaled value
+  Reporting.MarkPublished(regs, reg, value);
+  telemetryStats.journaled++;
+  return 0;
+}
+
+/// @brief Journal the registers of a device message that failed to publish
+/// @param first position in the read order of the message's first register
+/// @param end position after its last register
+/// @return 0 = journaled, -7 = no journal, the values are lost
+int journalBatch(int first, int end){
+  ModbusReadPlan* plan = &config->modbus.read_plan;
+  ModbusRegisterTable* regs = &config->modbus.registers;
+  int res = 0;
+  for (int k = first; k < end; k++)
+  {
+    int reg = plan->register_order[k];
+    if (!(regs->flags[reg] & REGISTER_BATCH_PENDING)){
+      continue;
+    }
+    regs->flags[reg] &= ~REGISTER_BATCH_PENDING;
+    if (journalValue(regs, reg, regs->value[reg]) < 0){
+      telemetryStats.lost++;
+      res = -7;
+    }
+  }
+  return res;
+}
+
+/// @brief Add the sample window of a sampled register to its message and start a new window
+/// ex: "min":48,"max":71,"mean":52,"count":50
+void addWindow(JsonObject obj, ModbusRegisterTable* regs, int reg){
+  SampleWindow* window = &regs->window[reg];
+  if (regs->sample_interval_ms[reg] == 0 || window->count == 0){
+    return;
+  }
+  obj["min"] = window->min;
+  obj["max"] = window->max;
+  obj["mean"] = static_cast<int32_t>(window->sum / window->count);
+  obj["count"] = window->count;
+  window->count = 0;
+}
+
+/// @brief Mark a register for its device's message, the value and sample window are read when it is sent
+void addToBatch(int reg){
+  config->modbus.registers.flags[reg] |= REGISTER_BATCH_PENDING;
+  if (batchCount == 0){
+    batchNext = 0;
+    batchError = 0;
+  }
+  batchCount++;
+}
+
+/// @brief Publish the message of the next device with marked registers on its device topic, ex: dt/vfdctl/vfd1
+/// A device's registers are contiguous in the read order, each device goes out as one message
+/// unless it holds more than a document fits, then it continues in another.
+/// @return 1 = a message was handled and more devices follow, 0 = done, -7 = a message was lost
+int flushBatch(){
+  if (batchCount == 0){
+    return 0;
+  }
+  ModbusReadPlan* plan = &config->modbus.read_plan;
+  ModbusRegisterTable* regs = &config->modbus.registers;
+
+  //skip to the next marked register, its device is the one sent
+  while (batchNext < regs->count && !(regs->flags[plan->register_order[batchNext]] & REGISTER_BATCH_PENDING))
+  {
+    batchNext++;
+  }
+  if (batchNext >= regs->count){
+    batchCount = 0;
+    return batchError;
+  }
+
+  int first = batchNext;
+  int firstReg = plan->register_order[first];
+  int device = regs->device_id[firstReg];
+  batchDoc.clear();
+  batchDoc["ts"] = millis();
+  JsonArray values = batchDoc.createNestedArray("values");
+  int end = first;
+  for (; end < regs->count && regs->device_id[plan->register_order[end]] == device; end++)
+  {
+    //a full document is sent early and the device continues in a new message, an entry holds at most 7 members
+    if (batchDoc.memoryUsage() + JSON_OBJECT_SIZE(10) > batchDoc.capacity()){
+      break;
+    }
+    int reg = plan->register_order[end];
+    if (!(regs->flags[reg] & REGISTER_BATCH_PENDING)){
+      continue;
+    }
+    JsonObject entry = values.createNestedObject();
+    entry["name"] = regs->meta[reg].name;
+    entry["value"] = regs->value[reg];
+    if (!usesSchema()){
+      entry["units"] = regs->meta[reg].units;
+    }
+    addWindow(entry, regs, reg);
+  }
+  batchNext = end;
+
+  const char* topic = regs->meta[firstReg].topic.prefix;
+  if (topic[0] == '\0'){
+    topic = regs->meta[firstReg].topic.leaf;
+  }
+  strlcpy(topicBuffer, topic, sizeof(topicBuffer));
+  //device prefixes are stored with their trailing slash
+  size_t topicLen = strlen(topicBuffer);
+  if (topicLen > 0 && topicBuffer[topicLen - 1] == '/'){
+    topicBuffer[topicLen - 1] = '\0';
+  }
+  size_t len = serializePayload(batchDoc);
+
+  int pubVal = RemoteConnMgr.Publish(topicBuffer, reinterpret_cast<const uint8_t*>(payloadBuffer), len);
+  if(pubVal < 0)
+  {
+    LOG_ERROR("failed to publish device telemetry to remote. Error: %d", pubVal);
+    if (journalBatch(first, end) < 0 && batchError == 0){
+      batchError = -7;
+    }
+    return 1;
+  }
+
+  for (int k = first; k < end; k++)
+  {
+    int reg = plan->register_order[k];
+    if (regs->flags[reg] & REGISTER_BATCH_PENDING){
+      Reporting.MarkPublished(regs, reg, regs->value[reg]);
+      telemetryStats.sent++;
+    }
+  }
+  return 1;
+}
+
+/// @brief Drop a partially assembled message, its registers are sent again next cycle
+void discardBatch(){
+  ModbusRegisterTable* regs = &config->modbus.registers;
+  for (int reg = 0; reg < regs->count; reg++)
+  {
+    regs->flags[reg] &= ~REGISTER_BATCH_PENDING;
+  }
+  batchCount = 0;
+}
+
+/// @brief Start playing an error code on the status led without blocking
+void blinkStatus(bool isError, int errorCode){
+  //errors blink slower for troubleshooting
+  if (isError){
+    showPattern(isError, errorCode, 1000);
+  }else{
+    showPattern(isError, errorCode, 300);
+  }
+}
+
+/// @brief Start a short pulse sequence on the status led without blocking
+void pulseStatus(bool isError, int errorCode){
+  showPattern(isError, errorCode, 100);
+}
+
+/// @brief Replace the active led pattern, played back by ledTask()
+void showPattern(bool isError, int errorCode, unsigned long duration){
+  //accept positive or negative codes
+  int num = abs(errorCode);
+  //track the start state to return it when complete
+  led.startState = isError;
+  led.level = isError;
+  led.togglesLeft = num*2;
+  led.duration = duration;
+  //first toggle happens on the next pass
+  led.lastToggle = millis() - duration;
+  led.active = true;
 }
 
 void setStatus(bool isError){
@@ -0,0 +1,270 @@
+#include "CommandParser.h"
+#include "Log.h"
+
+CommandParser::CommandParser(){
+}
+
+CommandParser CmdParser;
+
+int CommandParser::Parse(struct Config* config, char topic[], char bytes[], int length, Command* cmd)
+{
+    //mqtt subscription overlapped with another
+    size_t topicLen = strlen(topic);
+    if (topicLen < 7 || strcmp(topic + topicLen - 7, "/config") != 0){
+        LOG_DEBUG("unrecognized command was requested, message ignored");
+        return 0;
+    }
+
+    //content checking on cmd
+    int numSlashes = 0;
+    for (size_t i = 0; i < topicLen; i++)
+    {
+        if (topic[i] == '/' || topic[i] == '\\'){
+            numSlashes++;
+        }
+    }
+    //cmd/[app]/[device]/config carries a batch, cmd/[app]/[device]/[parameter]/config a single write
+    if (numSlashes != 3 && numSlashes != 4){
+        LOG_WARN("requested command topic is not formatted properly");
+        return -6;
+    }
+
+    //a message pack body starts with a map marker, a json body with '{' or whitespace
+    StaticJsonDocument<1024> doc;
+    DeserializationError error = IsMsgPackMap(bytes, length) ?
+        deserializeMsgPack(doc, bytes, length) : deserializeJson(doc, bytes, length);
+    if (error)
+    {
+        LOG_WARN("unable to deserialize, message ignored");
+        return -5;
+    }
+
+    // v1 message
+    if (doc.containsKey("value")){
+        LOG_WARN("Received V1 message, which is no longer supported. Please visit https://github.com/tulsasoftware/vfdctl/wiki/Message-Definitions#v2-messages");
+        return -6;
+    }
+
+    // Determine the message type
+    const char* msgType = doc["contentType"] | "";
+    if (strcmp(msgType, CommandQueue::toString(eContentType::coil_write)) == 0){
+        cmd->content_type = eContentType::coil_write;
+    }
+    else if (strcmp(msgType, CommandQueue::toString(eContentType::register_write)) == 0){
+        cmd->content_type = eContentType::register_write;
+    }
+    else if (strcmp(msgType, CommandQueue::toString(eContentType::register_batch_write)) == 0){
+        cmd->content_type = eContentType::register_batch_write;
+    }
+    else{
+        LOG_WARN("Received message with an unsupported 'contentType': %s. Please visit https://github.com/tulsasoftware/vfdctl/wiki/Message-Definitions#v2-messages", msgType);
+        return -6;
+    }
+
+    if (cmd->content_type == eContentType::register_batch_write){
+        if (numSlashes != 3){
+            LOG_WARN("batch commands must be sent to cmd/[app]/[device]/config");
+            return -6;
+        }
+        int res = ParseBatch(config, topic, doc, cmd);
+        if (res < 0){
+            return res;
+        }
+    }
+    else{
+        // v2 message
+        if (numSlashes != 4 || !doc.containsKey("requestedValue")){
+            LOG_WARN("Command must contain both 'requestedValue' and 'contentType' properties. Please visit https://github.com/tulsasoftware/vfdctl/wiki/Message-Definitions#v2-messages");
+            return -6;
+        }
+
+        //lookup object from config
+        ModbusConfigParameter* p = ConfigMgr.GetParameter(topic, config);
+        if(p == nullptr){
+            LOG_WARN("Unable to find a matching command in config. Ignoring message");
+            return -6;
+        }
+        //coils are written with coilWriteMsg, holding registers with registerWriteMsg
+        bool isCoil = p->type == eRegisterType::coil;
+        if (isCoil != (cmd->content_type == eContentType::coil_write) || !IsWritable(p)){
+            LOG_WARN("'%s' cannot be written to %s", msgType, p->name);
+            return -6;
+        }
+        cmd->all_or_nothing = false;
+        cmd->write_count = 1;
+        cmd->writes[0].register_index = p - config->modbus.configuration_registers;
+        cmd->writes[0].value = doc["requestedValue"];
+    }
+    cmd->received_ms = millis();
+
+    // Check if a response topic was provided in message
+    if (strlcpy(cmd->res_topic, doc["resTopic"] | "", sizeof(cmd->res_topic)) >= sizeof(cmd->res_topic)){
+        LOG_WARN("'resTopic' is too long");
+        return -6;
+    }
+    if (doc.containsKey("sessionId")){
+        strlcpy(cmd->session_id, doc["sessionId"] | "", sizeof(cmd->session_id));
+    }
+    else{
+        snprintf(cmd->session_id, sizeof(cmd->session_id), "session-%ld", random(INT32_MAX));
+    }
+    return 1;
+}
+
+/// @brief Resolve the parameters of a batch command
+/// ex: {"contentType":"registerBatchWriteMsg","allOrNothing":true,"requests":[{"parameter":"acceltime","requestedValue":40}]}
+/// @param topic Batch topic, cmd/[app]/[device]/config
+/// @return 1 = success, < 0 = invalid command
+int CommandParser::ParseBatch(struct Config* config, const char* topic, JsonDocument& doc, Command* cmd)
+{
+    JsonArrayConst requests = doc["requests"];
+    if (requests.isNull() || requests.size() == 0){
+        LOG_WARN("Batch command must contain a 'requests' array");
+        return -6;
+    }
+    if (requests.size() > COMMAND_MAX_WRITES){
+        LOG_WARN("Batch command exceeds the maximum number of requests: %d", COMMAND_MAX_WRITES);
+        return -6;
+    }
+
+    //parameter topics share the batch topic's cmd/[app]/[device]/ prefix
+    int prefixLen = strlen(topic) - strlen("config");
+    char paramTopic[96];
+    cmd->write_count = 0;
+    cmd->all_or_nothing = doc["allOrNothing"] | false;
+    for (JsonObjectConst request : requests)
+    {
+        const char* name = request["parameter"] | "";
+        if (name[0] == '\0' || !request.containsKey("requestedValue")){
+            LOG_WARN("Batch requests must contain both 'parameter' and 'requestedValue' properties");
+            return -6;
+        }
+        snprintf(paramTopic, sizeof(paramTopic), "%.*s%s/config", prefixLen, topic, name);
+        ModbusConfigParameter* p = ConfigMgr.GetParameter(paramTopic, config);
+        if (p == nullptr){
+            LOG_WARN("Unable to find a matching command in config: %s", paramTopic);
+            return -6;
+        }
+        if (!IsWritable(p)){
+            LOG_WARN("%s is read only", p->name);
+            return -6;
+        }
+
+        //a parameter repeated within the batch keeps its last value
+        uint16_t registerIndex = p - config->modbus.configuration_registers;
+        int i = 0;
+        while (i < cmd->write_count && cmd->writes[i].register_index != registerIndex)
+        {
+            i++;
+        }
+        cmd->writes[i].register_index = registerIndex;
+        cmd->writes[i].value = request["requestedValue"];
+        if (i == cmd->write_count){
+            cmd->write_count++;
+        }
+    }
+    return 1;
+}
+
+void CommandParser::BuildResponse(JsonDocument& doc, const Command* cmd, int actualValue)
+{
+    doc.clear();
+    doc["requestedValue"] = cmd->writes[0].value;
+    doc["actualValue"] = actualValue;
+    doc["contentType"] = CommandQueue::toString(cmd->content_type);
+    doc["sessionId"] = cmd->session_id;
+}
+
+/// @brief ex: {"contentType":"registerBatchWriteMsg","sessionId":"s1","results":[{"parameter":"acceltime","requestedValue":40,"result":"written"}]}
+void CommandParser::BuildBatchResponse(JsonDocument& doc, struct Config* config, const Command* cmd, const uint8_t* results)
+{
+    doc.clear();
+    doc["contentType"] = CommandQueue::toString(cmd->content_type);
+    doc["sessionId"] = cmd->session_id;
+    JsonArray entries = doc.createNestedArray("results");
+    char name[32];
+    for (int i = 0; i < cmd->write_count; i++)
+    {
+        ModbusConfigParameter* p = &config->modbus.configuration_registers[cmd->writes[i].register_index];
+        //parameter segment of the command topic, ex: acceltime/config -> acceltime
+        size_t len = strcspn(p->topic.leaf, "/");
+        strlcpy(name, p->topic.leaf, min(len + 1, sizeof(name)));
+
+        JsonObject result = entries.createNestedObject();
+        result["parameter"] = name;
+        result["requestedValue"] = cmd->writes[i].value;
+        result["result"] = CommandQueue::toString(static_cast<eWriteResult>(results[i]));
+    }
+}
+
+int CommandParser::CheckValue(ModbusConfigParameter* p, int value)
+{
+    if (p->type == eRegisterType::coil){
+        return (value == 0 || value == 1) ? 1 : 0;
+    }
+    return IsWithinRange(p->lower_limit, p->upper_limit, value, p->limit_comparison);
+}
+
+/// @param lower Lower comparison limit
+/// @param upper Upper comparison limit
+/// @param value Value to compare
+/// @param eComparison How to execute comparison
+int CommandParser::IsWithinRange(int lower, int upper, int value, eLimitComparison eComparison)
+{
+    int retVal = 0;
+    LOG_DEBUG("Comparison mode: %d", eComparison);
+    switch (eComparison)
+    {
+        case eLimitComparison::none:
+            retVal = 1;
+            break;
+        case eLimitComparison::between:
+            if ((value > lower) && (value < upper)){
+                retVal = 1;
+            }
+            break;
+        case eLimitComparison::between_or_equal:
+            if ((value >= lower) && (value <= upper)){
+                retVal = 1;
+            }
+            break;
+        case eLimitComparison::less_than:
+            if ((value < upper)){
+                retVal = 1;
+            }
+            break;
+        case eLimitComparison::less_than_or_equal:
+            if ((value <= upper)){
+                retVal = 1;
+            }
+            break;
+        case eLimitComparison::greater_than:
+            if ((value > lower)){
+                retVal = 1;
+            }
+            break;
+        case eLimitComparison::greater_than_or_equal:
+            if ((value >= lower)){
+                retVal = 1;
+            }
+            break;
+        default:
+            retVal = -1;
+            break;
+    }
+    return retVal;
+}
+
+bool CommandParser::IsWritable(ModbusConfigParameter* p)
+{
+    return p->type == eRegisterType::holding_register || p->type == eRegisterType::coil;
+}
+
+bool CommandParser::IsMsgPackMap(const char bytes[], int length)
+{
+    if (length <= 0){
+        return false;
+    }
+    uint8_t marker = static_cast<uint8_t>(bytes[0]);
+    return (marker & 0xf0) == 0x80 || marker == 0xde || marker == 0xdf;
+}
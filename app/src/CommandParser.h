@@ -0,0 +1,36 @@
+#ifndef CommandParser_h
+#define CommandParser_h
+
+#include "Arduino.h"
+#include "ConfigurationManager.h"
+#include "CommandQueue.h"
+
+/// @brief Command messages turned into register writes, and the responses sent back for them
+/// Shared by the controller and the Linux gateway, it only reads the configuration it is given.
+class CommandParser
+{
+    public:
+        CommandParser();
+        //validate a command message and resolve its registers, bytes are parsed in place
+        //returns 1 = command parsed, 0 = not a command (ignored), < 0 = invalid command
+        int Parse(struct Config* config, char topic[], char bytes[], int length, Command* cmd);
+        //response to a single write, ex: {"requestedValue":40,"actualValue":40,"contentType":"registerWriteMsg","sessionId":"s1"}
+        void BuildResponse(JsonDocument& doc, const Command* cmd, int actualValue);
+        //per parameter results of a batch, results holds an eWriteResult per write
+        void BuildBatchResponse(JsonDocument& doc, struct Config* config, const Command* cmd, const uint8_t* results);
+        //judge if a requested value may be written to a parameter, coils only accept 0 or 1
+        //returns 0 = false, 1 = true, < 0 = error
+        static int CheckValue(ModbusConfigParameter* p, int value);
+        //judge if a value is within the user's limits, returns 0 = false, 1 = true, < 0 = error
+        static int IsWithinRange(int lower, int upper, int value, eLimitComparison eComparison);
+        //input registers and discrete inputs can only be read
+        static bool IsWritable(ModbusConfigParameter* p);
+        //true if a message body is a message pack map, fixmap (0x80-0x8f), map 16 (0xde) or map 32 (0xdf)
+        static bool IsMsgPackMap(const char bytes[], int length);
+    private:
+        int ParseBatch(struct Config* config, const char* topic, JsonDocument& doc, Command* cmd);
+};
+
+extern CommandParser CmdParser;	//Default class instance
+
+#endif
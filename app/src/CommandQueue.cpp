@@ -0,0 +1,135 @@
+#include "CommandQueue.h"
+
+CommandQueue::CommandQueue(){
+    _head = 0;
+    _count = 0;
+    _maxDepth = 0;
+    _coalesced = 0;
+    _dropped = 0;
+}
+
+CommandQueue CommandQ;
+
+bool touchesRegister(const Command& cmd, uint16_t registerIndex)
+{
+    for (int i = 0; i < cmd.write_count; i++)
+    {
+        if (cmd.writes[i].register_index == registerIndex){
+            return true;
+        }
+    }
+    return false;
+}
+
+void swapCommands(Command* a, Command* b)
+{
+    uint8_t* x = reinterpret_cast<uint8_t*>(a);
+    uint8_t* y = reinterpret_cast<uint8_t*>(b);
+    for (size_t i = 0; i < sizeof(Command); i++)
+    {
+        uint8_t t = x[i];
+        x[i] = y[i];
+        y[i] = t;
+    }
+}
+
+int CommandQueue::Push(Command* cmd)
+{
+    //last write wins, the pending command keeps its place in line
+    //newest first, a pending batch touching the register must still run before this write
+    for (int i = _count - 1; i >= 0 && cmd->content_type != eContentType::register_batch_write; i--)
+    {
+        Command* pending = &_items[(_head + i) % COMMAND_QUEUE_CAPACITY];
+        if (pending->content_type == cmd->content_type && pending->writes[0].register_index == cmd->writes[0].register_index){
+            //swapped in place, the caller answers the superseded requester without a second Command on the stack
+            swapCommands(pending, cmd);
+            _coalesced++;
+            return static_cast<int>(CommandQueueErrors::COALESCED);
+        }
+        if (touchesRegister(*pending, cmd->writes[0].register_index)){
+            break;
+        }
+    }
+
+    if (_count >= COMMAND_QUEUE_CAPACITY){
+        _dropped++;
+        return static_cast<int>(CommandQueueErrors::QUEUE_FULL);
+    }
+
+    _items[(_head + _count) % COMMAND_QUEUE_CAPACITY] = *cmd;
+    _count++;
+    if (_count > _maxDepth){
+        _maxDepth = _count;
+    }
+    return static_cast<int>(CommandQueueErrors::SUCCESS);
+}
+
+bool CommandQueue::Pop(Command* cmd)
+{
+    if (_count == 0){
+        return false;
+    }
+    *cmd = _items[_head];
+    _head = (_head + 1) % COMMAND_QUEUE_CAPACITY;
+    _count--;
+    return true;
+}
+
+bool CommandQueue::IsEmpty()
+{
+    return _count == 0;
+}
+
+int CommandQueue::GetDepth()
+{
+    return _count;
+}
+
+int CommandQueue::GetMaxDepth()
+{
+    return _maxDepth;
+}
+
+unsigned long CommandQueue::GetCoalesceCount()
+{
+    return _coalesced;
+}
+
+unsigned long CommandQueue::GetDropCount()
+{
+    return _dropped;
+}
+
+const char* CommandQueue::toString(eContentType type)
+{
+    switch (type)
+    {
+        case eContentType::register_write:
+            return "registerWriteMsg";
+        case eContentType::coil_write:
+            return "coilWriteMsg";
+        case eContentType::register_batch_write:
+            return "registerBatchWriteMsg";
+        default:
+            return "unknown";
+    }
+}
+
+const char* CommandQueue::toString(eWriteResult result)
+{
+    switch (result)
+    {
+        case eWriteResult::write_ok:
+            return "written";
+        case eWriteResult::write_out_of_range:
+            return "out_of_range";
+        case eWriteResult::write_failed:
+            return "write_failed";
+        case eWriteResult::write_skipped:
+            return "skipped";
+        case eWriteResult::write_superseded:
+            return "superseded";
+        default:
+            return "pending";
+    }
+}
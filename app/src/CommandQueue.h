@@ -0,0 +1,95 @@
+#ifndef CommandQueue_h
+#define CommandQueue_h
+
+#include "Arduino.h"
+
+//pending commands for distinct registers, writes to the same register coalesce
+//a slot is about 204 bytes, 8 slots keep the queue near 1.6 KB of static RAM
+#define COMMAND_QUEUE_CAPACITY 8
+
+/// @brief Supported command message types
+enum eContentType
+{
+    register_write = 0,
+    coil_write,
+    register_batch_write
+};
+
+/// @brief Outcome of a single parameter write, reported back on the response topic
+enum eWriteResult
+{
+    write_pending = 0,
+    write_ok,
+    write_out_of_range,
+    write_failed,
+    write_skipped,
+    //replaced by a newer write to the same register before it reached the bus
+    write_superseded
+};
+
+//most parameters a single batch command may carry
+#define COMMAND_MAX_WRITES 12
+
+/// @brief Value requested for one configuration register
+struct CommandWrite
+{
+    //index into ModbusConfiguration::configuration_registers
+    uint16_t register_index;
+    int32_t value;
+};
+
+/// @brief Command parsed once in the MQTT callback, ready to be written to the bus
+struct Command
+{
+    eContentType content_type;
+    //batch only, reject every write when any value fails its limit check
+    bool all_or_nothing;
+    //single writes use writes[0]
+    uint8_t write_count;
+    CommandWrite writes[COMMAND_MAX_WRITES];
+    //empty when no response was requested
+    char res_topic[64];
+    char session_id[32];
+    unsigned long received_ms;
+};
+
+enum class CommandQueueErrors 
+{
+  SUCCESS,
+  COALESCED,
+  QUEUE_FULL = -100,
+};
+
+/// @brief Fixed capacity FIFO of pending commands
+/// A single write for a register that already has a pending single write replaces it in place (last write wins),
+/// the replaced command is handed back so its requester can still be answered
+class CommandQueue
+{
+  public:
+    CommandQueue();
+    //queue a command, returns SUCCESS, COALESCED or QUEUE_FULL
+    //on COALESCED cmd holds the pending command it replaced
+    int Push(Command* cmd);
+    //remove the oldest command, false if empty
+    bool Pop(Command* cmd);
+    bool IsEmpty();
+    int GetDepth();
+    int GetMaxDepth();
+    unsigned long GetCoalesceCount();
+    unsigned long GetDropCount();
+    //convert enum to the contentType used in messages
+    static const char* toString(eContentType type);
+    //convert enum to the result reported in batch responses
+    static const char* toString(eWriteResult result);
+  private:
+    Command _items[COMMAND_QUEUE_CAPACITY];
+    int _head;
+    int _count;
+    int _maxDepth;
+    unsigned long _coalesced;
+    unsigned long _dropped;
+};
+
+extern CommandQueue CommandQ;	//Default class instance
+
+#endif
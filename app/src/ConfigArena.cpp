@@ -0,0 +1,183 @@
+#include "ConfigArena.h"
+
+//first index size, doubled whenever it is half full
+#define STRING_POOL_MIN_INDEX_SLOTS 64
+
+/// @brief FNV-1a hash of the first len chars of str
+uint32_t hashString(const char* str, size_t len)
+{
+    uint32_t hash = 2166136261UL;
+    for (size_t i = 0; i < len; i++)
+    {
+        hash = (hash ^ static_cast<uint8_t>(str[i])) * 16777619UL;
+    }
+    return hash;
+}
+
+/// @brief Slot holding str or the empty slot it would be placed in, slots is a power of two
+size_t findSlot(const uint32_t* index, size_t slots, const char* data, const char* str, size_t len)
+{
+    size_t slot = hashString(str, len) & (slots - 1);
+    while (index[slot] != 0)
+    {
+        const char* existing = data + index[slot] - 1;
+        if (strncmp(existing, str, len) == 0 && existing[len] == '\0'){
+            break;
+        }
+        slot = (slot + 1) & (slots - 1);
+    }
+    return slot;
+}
+
+/// @brief Move the index into a table of slots entries
+bool resizeIndex(StringPool* pool, size_t slots)
+{
+    uint32_t* index = static_cast<uint32_t*>(calloc(slots, sizeof(uint32_t)));
+    if (index == nullptr){
+        return false;
+    }
+    for (size_t i = 0; i < pool->index_slots; i++)
+    {
+        if (pool->index[i] == 0){
+            continue;
+        }
+        const char* str = pool->data + pool->index[i] - 1;
+        index[findSlot(index, slots, pool->data, str, strlen(str))] = pool->index[i];
+    }
+    free(pool->index);
+    pool->index = index;
+    pool->index_slots = slots;
+    return true;
+}
+
+const char* StringPool::Intern(const char* str, size_t len)
+{
+    if (index == nullptr){
+        //without an index, lookups scan the pool, only used for pools built outside a load
+        size_t pos = 0;
+        while (pos < used)
+        {
+            const char* existing = data + pos;
+            size_t existingLen = strlen(existing);
+            if (existingLen == len && strncmp(existing, str, len) == 0){
+                return existing;
+            }
+            pos += existingLen + 1;
+        }
+    }
+    else{
+        size_t slot = findSlot(index, index_slots, data, str, len);
+        if (index[slot] != 0){
+            return data + index[slot] - 1;
+        }
+    }
+
+    if (used + len + 1 > capacity){
+        return nullptr;
+    }
+    if (index != nullptr && (index_count + 1) * 2 > index_slots && !resizeIndex(this, index_slots * 2)){
+        return nullptr;
+    }
+    char* dest = data + used;
+    memcpy(dest, str, len);
+    dest[len] = '\0';
+    if (index != nullptr){
+        index[findSlot(index, index_slots, data, dest, len)] = used + 1;
+        index_count++;
+    }
+    used += len + 1;
+    return dest;
+}
+
+const char* StringPool::Intern(const char* str)
+{
+    if (str == nullptr){
+        str = "";
+    }
+    return Intern(str, strlen(str));
+}
+
+bool StringPool::BuildIndex()
+{
+    ReleaseIndex();
+    index = static_cast<uint32_t*>(calloc(STRING_POOL_MIN_INDEX_SLOTS, sizeof(uint32_t)));
+    if (index == nullptr){
+        return false;
+    }
+    index_slots = STRING_POOL_MIN_INDEX_SLOTS;
+    size_t pos = 0;
+    while (pos < used)
+    {
+        size_t len = strlen(data + pos);
+        if ((index_count + 1) * 2 > index_slots && !resizeIndex(this, index_slots * 2)){
+            ReleaseIndex();
+            return false;
+        }
+        index[findSlot(index, index_slots, data, data + pos, len)] = pos + 1;
+        index_count++;
+        pos += len + 1;
+    }
+    return true;
+}
+
+void StringPool::ReleaseIndex()
+{
+    free(index);
+    index = nullptr;
+    index_slots = 0;
+    index_count = 0;
+}
+
+bool ConfigArena::Begin(size_t size)
+{
+    Release();
+    base = static_cast<uint8_t*>(malloc(size));
+    if (base == nullptr){
+        return false;
+    }
+    capacity = size;
+    used = 0;
+    return true;
+}
+
+void* ConfigArena::Alloc(size_t size, size_t align)
+{
+    size_t start = (used + align - 1) & ~(align - 1);
+    if (base == nullptr || start + size > capacity){
+        return nullptr;
+    }
+    used = start + size;
+    memset(base + start, 0, size);
+    return base + start;
+}
+
+bool ConfigArena::AdoptStrings(const StringPool& seed)
+{
+    if (!ReserveStrings(seed.used)){
+        return false;
+    }
+    memcpy(strings.data, seed.data, seed.used);
+    return true;
+}
+
+bool ConfigArena::ReserveStrings(size_t size)
+{
+    char* data = static_cast<char*>(Alloc(size, 1));
+    if (data == nullptr){
+        return false;
+    }
+    strings.data = data;
+    strings.capacity = size;
+    strings.used = size;
+    return true;
+}
+
+void ConfigArena::Release()
+{
+    strings.ReleaseIndex();
+    free(base);
+    base = nullptr;
+    capacity = 0;
+    used = 0;
+    strings = StringPool{};
+}
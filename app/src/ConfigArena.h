@@ -0,0 +1,52 @@
+#ifndef ConfigArena_h
+#define ConfigArena_h
+
+#include <Arduino.h>
+
+/// @brief Deduplicating store of NUL terminated strings
+/// Each distinct string is stored once, callers keep pointers into the pool.
+/// While a configuration loads the pool keeps a hash index of its strings, so interning
+/// stays constant time however many registers the file holds.
+struct StringPool
+{
+    char* data = nullptr;
+    size_t capacity = 0;
+    size_t used = 0;
+    //open addressing table of string offsets + 1, 0 = empty slot, heap owned and only kept during a load
+    uint32_t* index = nullptr;
+    size_t index_slots = 0;
+    size_t index_count = 0;
+
+    //return the pooled copy of the first len chars of str, nullptr if the pool or its index is full
+    const char* Intern(const char* str, size_t len);
+    const char* Intern(const char* str);
+    //index the strings already in the pool, later lookups hash instead of scanning the pool
+    bool BuildIndex();
+    void ReleaseIndex();
+};
+
+/// @brief Single block holding every variable-size configuration table
+/// Tables are bump allocated after Load() has sized them from the document and the
+/// whole block is released at once when the configuration is reloaded.
+struct ConfigArena
+{
+    uint8_t* base = nullptr;
+    size_t capacity = 0;
+    size_t used = 0;
+    StringPool strings;
+
+    //allocate the backing block, releasing any previous one
+    bool Begin(size_t size);
+    //carve out zeroed, aligned space for a table
+    void* Alloc(size_t size, size_t align = 4);
+    //place the shared string pool in the arena, seeded with a prebuilt pool
+    bool AdoptStrings(const StringPool& seed);
+    //place a full string pool of size bytes in the arena, contents are filled in by the caller
+    bool ReserveStrings(size_t size);
+    void Release();
+};
+
+//bytes an allocation of size will take in an arena, including worst case alignment padding
+#define CONFIG_ARENA_SIZE(size) (((size) + 3) & ~static_cast<size_t>(3))
+
+#endif
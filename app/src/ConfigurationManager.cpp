@@ -1,4 +1,5 @@
 #include "ConfigurationManager.h"
+#include "Log.h"
 
 int _sdCardSsPin;
 
@@ -26,19 +27,374 @@ eLimitComparison from(JsonVariantConst mode) {
   if (mode == toString(eLimitComparison::less_than_or_equal)) return eLimitComparison::less_than_or_equal;
   return eLimitComparison::none;
 }
+/// @brief Register type of a register entry, ex: "type" : "coil", holding registers when omitted
+eRegisterType registerTypeFrom(JsonVariantConst type) {
+  if (type == "input_register") return eRegisterType::input_register;
+  if (type == "coil") return eRegisterType::coil;
+  if (type == "discrete_input") return eRegisterType::discrete_input;
+  return eRegisterType::holding_register;
+}
+
+/// @brief Name of a register type as conf.txt writes it
+const char* registerTypeName(eRegisterType type) {
+  if (type == eRegisterType::input_register) return "input_register";
+  if (type == eRegisterType::coil) return "coil";
+  if (type == eRegisterType::discrete_input) return "discrete_input";
+  return "holding_register";
+}
+
+bool isBitType(eRegisterType type) {
+  return type == eRegisterType::coil || type == eRegisterType::discrete_input;
+}
+/// @brief Split a topic after its app/device segments so the shared prefix is pooled once
+/// ex: dt/vfdctl/vfd1/amps -> dt/vfdctl/vfd1/ + amps
+PooledTopic internTopic(StringPool& pool, const char* topic)
+{
+    if (topic == nullptr){
+        topic = "";
+    }
+    size_t prefixLen = 0;
+    int slashes = 0;
+    for (size_t i = 0; topic[i] != '\0' && slashes < 3; i++)
+    {
+        if (topic[i] == '/'){
+            slashes++;
+            prefixLen = i + 1;
+        }
+    }
+    if (slashes < 3){
+        prefixLen = 0;
+    }
+
+    PooledTopic pooled;
+    pooled.prefix = pool.Intern(topic, prefixLen);
+    pooled.leaf = pool.Intern(topic + prefixLen);
+    return pooled;
+}
+
+/// @brief Upper bound of the pool space used by a register's strings
+size_t pooledBytes(JsonVariant reg)
+{
+    const char* name = reg["name"] | "";
+    const char* units = reg["units"] | "";
+    const char* topic = reg["topic"] | "";
+    //topic is stored as two strings
+    return strlen(name) + 1 + strlen(units) + 1 + strlen(topic) + 2;
+}
+
+void internStrings(StringPool& pool, JsonVariant reg)
+{
+    pool.Intern(reg["name"].as<const char*>());
+    pool.Intern(reg["units"].as<const char*>());
+    internTopic(pool, reg["topic"].as<const char*>());
+}
+
+/// @brief Grow a heap owned pool so at least extra more bytes fit
+bool reserveScratch(StringPool& pool, size_t extra)
+{
+    if (pool.used + extra <= pool.capacity){
+        return true;
+    }
+    size_t capacity = max(pool.capacity * 2, pool.used + extra);
+    char* data = static_cast<char*>(realloc(pool.data, capacity));
+    if (data == nullptr){
+        return false;
+    }
+    pool.data = data;
+    pool.capacity = capacity;
+    return true;
+}
+
+/// @brief Keys copied out of each telemetry_registers / configuration_registers element
+void buildRegisterFilter(JsonDocument& filter)
+{
+    filter["name"] = true;
+    filter["units"] = true;
+    filter["topic"] = true;
+    filter["address"] = true;
+    filter["value"] = true;
+    filter["device_id"] = true;
+    filter["type"] = true;
+    filter["upper_limit"] = true;
+    filter["lower_limit"] = true;
+    filter["limit_comparison"] = true;
+    filter["deadband"] = true;
+    filter["max_silence_sec"] = true;
+    filter["sample_interval_ms"] = true;
+}
+
+/// @brief Read a deadband given as an absolute change (5) or a percentage of the last published value ("2.5%")
+void parseDeadband(JsonVariant deadband, uint16_t* value, uint8_t* flags)
+{
+    const char* text = deadband.as<const char*>();
+    if (text != nullptr && strchr(text, '%') != nullptr){
+        //stored as hundredths of a percent
+        *value = static_cast<uint16_t>(constrain(atof(text) * 100.0, 0.0, 65535.0));
+        *flags |= REGISTER_DEADBAND_PERCENT;
+    }
+    else{
+        *value = static_cast<uint16_t>(constrain(deadband.as<float>() + 0.5, 0.0, 65535.0));
+        *flags &= ~REGISTER_DEADBAND_PERCENT;
+    }
+}
+
+/// @brief Read a serial port's settings, missing settings fall back to 9600 8N1
+void parseSerialPort(JsonVariant src, SerialPortConfiguration* port)
+{
+    port->baud_rate = src["baud_rate"] | 9600;
+    port->stop_bits = src["stop_bits"] | 1;
+    port->parity_bits = src["parity_bits"] | 0;
+    port->data_bits = src["data_bits"] | 8;
+    port->flow_control = src["flow_control"];
+    port->flow_control = true;
+    port->formed = true;
+}
+
+/// @brief Skip whitespace and return the next character without consuming it
+int peekNonWhitespace(File& file)
+{
+    while (isspace(file.peek()))
+    {
+        file.read();
+    }
+    return file.peek();
+}
+
+/// @brief Deserialize the next element of a register array into reload->element
+/// The array is found again whenever a pass over it starts, at reload->cursor 0.
+/// @return 1 with a register, 0 once the array is done, < 0 if an element could not be parsed
+int streamRegister(ConfigReload* reload, const char* key)
+{
+    File& file = reload->file;
+    if (reload->cursor == 0){
+        char pattern[48];
+        snprintf(pattern, sizeof(pattern), "\"%s\"", key);
+        char arrayStart[] = "[";
+        //a missing or empty array has no registers
+        file.seek(0);
+        reload->more = file.find(pattern) && file.find(arrayStart) && peekNonWhitespace(file) != ']';
+    }
+    if (!reload->more){
+        return 0;
+    }
+
+    DeserializationError error = deserializeJson(reload->element, file, DeserializationOption::Filter(reload->filter));
+    if (error)
+    {
+        LOG_ERROR("Failed to read %s entry %d: %s", key, reload->cursor, error.c_str());
+        return static_cast<int>(ConfigurationManagerErrors::CONFIG_FILE_NOT_FOUND);
+    }
+    char separator[] = ",";
+    char arrayEnd[] = "]";
+    reload->more = file.findUntil(separator, arrayEnd);
+    return 1;
+}
+
+/// @brief Arena space needed by the register tables and everything derived from them
+size_t registerTableBytes(int telemetryCount, int configCount)
+{
+    return CONFIG_ARENA_SIZE(telemetryCount * sizeof(ModbusParameter)) +
+        CONFIG_ARENA_SIZE(telemetryCount * sizeof(uint16_t)) +
+        CONFIG_ARENA_SIZE(telemetryCount * sizeof(uint8_t)) +
+        CONFIG_ARENA_SIZE(telemetryCount * sizeof(uint8_t)) +
+        CONFIG_ARENA_SIZE(telemetryCount * sizeof(int32_t)) +
+        CONFIG_ARENA_SIZE(telemetryCount * sizeof(uint16_t)) +
+        CONFIG_ARENA_SIZE(telemetryCount * sizeof(uint16_t)) +
+        CONFIG_ARENA_SIZE(telemetryCount * sizeof(int32_t)) +
+        CONFIG_ARENA_SIZE(telemetryCount * sizeof(uint32_t)) +
+        CONFIG_ARENA_SIZE(telemetryCount * sizeof(uint8_t)) +
+        CONFIG_ARENA_SIZE(telemetryCount * sizeof(uint16_t)) +
+        //windows hold 64 bit sums, up to 4 bytes are lost aligning them to 8
+        CONFIG_ARENA_SIZE(telemetryCount * sizeof(SampleWindow)) + 4 +
+        CONFIG_ARENA_SIZE(telemetryCount * sizeof(uint16_t)) +
+        CONFIG_ARENA_SIZE(telemetryCount * sizeof(ModbusReadSpan)) +
+        CONFIG_ARENA_SIZE(configCount * sizeof(ModbusConfigParameter)) +
+        CONFIG_ARENA_SIZE(configCount * sizeof(TopicIndexEntry));
+}
+
+/// @brief Carve the register tables out of the arena, sized by registerTableBytes()
+bool allocateTables(struct Config* config, int telemetryCount, int configCount)
+{
+    ConfigArena* arena = &config->arena;
+    ModbusRegisterTable* regs = &config->modbus.registers;
+
+    regs->count = telemetryCount;
+    regs->meta = static_cast<ModbusParameter*>(arena->Alloc(telemetryCount * sizeof(ModbusParameter)));
+    regs->address = static_cast<uint16_t*>(arena->Alloc(telemetryCount * sizeof(uint16_t)));
+    regs->device_id = static_cast<uint8_t*>(arena->Alloc(telemetryCount * sizeof(uint8_t)));
+    regs->type = static_cast<uint8_t*>(arena->Alloc(telemetryCount * sizeof(uint8_t)));
+    regs->value = static_cast<int32_t*>(arena->Alloc(telemetryCount * sizeof(int32_t)));
+    regs->deadband = static_cast<uint16_t*>(arena->Alloc(telemetryCount * sizeof(uint16_t)));
+    regs->max_silence_sec = static_cast<uint16_t*>(arena->Alloc(telemetryCount * sizeof(uint16_t)));
+    regs->last_published = static_cast<int32_t*>(arena->Alloc(telemetryCount * sizeof(int32_t)));
+    regs->last_publish_ms = static_cast<uint32_t*>(arena->Alloc(telemetryCount * sizeof(uint32_t)));
+    regs->flags = static_cast<uint8_t*>(arena->Alloc(telemetryCount * sizeof(uint8_t)));
+    regs->sample_interval_ms = static_cast<uint16_t*>(arena->Alloc(telemetryCount * sizeof(uint16_t)));
+    regs->window = static_cast<SampleWindow*>(arena->Alloc(telemetryCount * sizeof(SampleWindow), 8));
+    //a span serves at least one register, the plan can never need more spans than registers
+    config->modbus.read_plan.register_order = static_cast<uint16_t*>(arena->Alloc(telemetryCount * sizeof(uint16_t)));
+    config->modbus.read_plan.spans = static_cast<ModbusReadSpan*>(arena->Alloc(telemetryCount * sizeof(ModbusReadSpan)));
+
+    config->modbus.configuration_register_count = configCount;
+    config->modbus.configuration_registers = static_cast<ModbusConfigParameter*>(arena->Alloc(configCount * sizeof(ModbusConfigParameter)));
+    config->modbus.command_index.entries = static_cast<TopicIndexEntry*>(arena->Alloc(configCount * sizeof(TopicIndexEntry)));
+
+    return regs->meta != nullptr && regs->address != nullptr && regs->device_id != nullptr && regs->type != nullptr &&
+        regs->value != nullptr && regs->deadband != nullptr && regs->max_silence_sec != nullptr &&
+        regs->last_published != nullptr && regs->last_publish_ms != nullptr && regs->flags != nullptr &&
+        regs->sample_interval_ms != nullptr && regs->window != nullptr &&
+        config->modbus.read_plan.register_order != nullptr &&
+        config->modbus.read_plan.spans != nullptr && config->modbus.configuration_registers != nullptr &&
+        config->modbus.command_index.entries != nullptr;
+}
+
+//identifies a configuration snapshot file
+#define CONFIG_SNAPSHOT_MAGIC 0x43444656UL
+//largest read issued while loading a snapshot, SD reads take a 16-bit size
+#define SNAPSHOT_READ_CHUNK 0x4000
+
+/// @brief Start of a configuration snapshot file
+struct SnapshotHeader
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t header_size;
+    //sizes of the register table entries, snapshots from another build layout are rejected
+    uint32_t layout;
+    //crc32 of the json source the snapshot was built from
+    uint32_t source_hash;
+    uint32_t arena_size;
+    //crc32 of the body and arena
+    uint32_t crc;
+};
+
+/// @brief Settings and table sizes, tables are laid out in the arena exactly as allocateTables() places them
+struct SnapshotBody
+{
+    DeviceConfiguration device;
+    BrokerConfiguration broker;
+    int offset;
+    int telemetry_interval_sec;
+    int max_read_gap;
+    eTelemetryMode telemetry_mode;
+    ePayloadFormat payload_format;
+    int serial_port_count;
+    SerialPortConfiguration serial_ports[MODBUS_MAX_SERIAL_BUSES];
+    int device_count;
+    ModbusDeviceTransport devices[MODBUS_MAX_DEVICES];
+    JournalConfiguration journal;
+    int32_t telemetry_count;
+    int32_t config_count;
+    int32_t span_count;
+    int32_t index_count;
+    uint32_t strings_used;
+};
+
+uint32_t crc32Update(uint32_t crc, const uint8_t* data, size_t len)
+{
+    static const uint32_t table[16] = {
+        0x00000000UL, 0x1DB71064UL, 0x3B6E20C8UL, 0x26D930ACUL, 0x76DC4190UL, 0x6B6B51F4UL, 0x4DB26158UL, 0x5005713CUL,
+        0xEDB88320UL, 0xF00F9344UL, 0xD6D6A3E8UL, 0xCB61B38CUL, 0x9B64C2B0UL, 0x86D3D2D4UL, 0xA00AE278UL, 0xBDBDF21CUL
+    };
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++)
+    {
+        crc = table[(crc ^ data[i]) & 0x0F] ^ (crc >> 4);
+        crc = table[(crc ^ (data[i] >> 4)) & 0x0F] ^ (crc >> 4);
+    }
+    return ~crc;
+}
+
+/// @brief Read size bytes in chunks, a single SD read is limited to 16-bit sizes
+/// @return bytes read, less than size at the end of the file or on a read error
+size_t readFully(File& file, uint8_t* buffer, size_t size)
+{
+    size_t done = 0;
+    while (done < size)
+    {
+        uint16_t chunk = static_cast<uint16_t>(min(size - done, static_cast<size_t>(SNAPSHOT_READ_CHUNK)));
+        int len = file.read(buffer + done, chunk);
+        if (len <= 0){
+            break;
+        }
+        done += len;
+    }
+    return done;
+}
+
+/// @brief crc32 of a file's contents in a single sequential read
+bool hashFile(const char* fileName, uint32_t* hash)
+{
+    File file = SD.open(fileName);
+    if (!file){
+        return false;
+    }
+    uint8_t buffer[64];
+    uint32_t crc = 0;
+    int len;
+    while ((len = file.read(buffer, sizeof(buffer))) > 0)
+    {
+        crc = crc32Update(crc, buffer, len);
+    }
+    file.close();
+    *hash = crc;
+    return true;
+}
+
+/// @brief Snapshot lives next to the json source, ex: conf.txt -> conf.bin
+void snapshotFileName(const char* configFileName, char* buffer, size_t size)
+{
+    strlcpy(buffer, configFileName, size);
+    char* ext = strrchr(buffer, '.');
+    if (ext == nullptr){
+        ext = buffer + strlen(buffer);
+    }
+    strlcpy(ext, ".bin", size - (ext - buffer));
+}
+
+uint32_t tableLayout()
+{
+    return sizeof(ModbusParameter) | (sizeof(ModbusConfigParameter) << 8) |
+        (sizeof(ModbusReadSpan) << 16) | (sizeof(TopicIndexEntry) << 24);
+}
+
+/// @brief Move every string pointer in the register tables from one arena base to another
+void rebaseStrings(struct Config* config, uintptr_t from, uintptr_t to)
+{
+    auto rebase = [from, to](const char*& str) {
+        str = reinterpret_cast<const char*>(reinterpret_cast<uintptr_t>(str) - from + to);
+    };
+    for (int i = 0; i < config->modbus.registers.count; i++)
+    {
+        ModbusParameter* meta = &config->modbus.registers.meta[i];
+        rebase(meta->name);
+        rebase(meta->units);
+        rebase(meta->topic.prefix);
+        rebase(meta->topic.leaf);
+    }
+    for (int i = 0; i < config->modbus.configuration_register_count; i++)
+    {
+        ModbusConfigParameter* param = &config->modbus.configuration_registers[i];
+        rebase(param->name);
+        rebase(param->units);
+        rebase(param->topic.prefix);
+        rebase(param->topic.leaf);
+    }
+}
+
 int ConfigurationManager::Init(bool resetSsPinMode, int sdCardSsPin)
 {
     _sdCardSsPin = sdCardSsPin;
 
     // Initialize SD library
     if (resetSsPinMode){
-        Serial.println(F("Resetting SS pinmode"));
+        LOG_DEBUG("Resetting SS pinmode");
         pinMode(_sdCardSsPin, OUTPUT);
     }
     
-    Serial.println(F("Beginning to initialize SD library"));
+    LOG_INFO("Beginning to initialize SD library");
     if (!SD.begin(_sdCardSsPin)) {
-        Serial.println(F("Failed to initialize SD library"));
+        LOG_ERROR("Failed to initialize SD library");
         return static_cast<int>(ConfigurationManagerErrors::SD_INIT_FAILED);
     }
 
@@ -49,164 +405,848 @@ int ConfigurationManager::Load(char* configFileName, struct Config* config)
 {
     if (SD.exists(configFileName))
     {
-        Serial.print("Found ");
-        Serial.println(configFileName);
+        LOG_INFO("Found %s", configFileName);
     }
     else
     {
-        Serial.print("Could not find ");
-        Serial.println(configFileName);
+        LOG_ERROR("Could not find %s", configFileName);
         return static_cast<int>(ConfigurationManagerErrors::CONFIG_FILE_NOT_FOUND);
     }
 
-    Serial.print("Opening config file ");
-    Serial.println(configFileName);
+    unsigned long loadStart = millis();
+    uint32_t sourceHash;
+    if (!hashFile(configFileName, &sourceHash)){
+        LOG_ERROR("Could not read %s", configFileName);
+        return static_cast<int>(ConfigurationManagerErrors::CONFIG_FILE_FAILED_OPEN);
+    }
+
+    //nothing to do if the file hasn't changed since it was loaded
+    if (config->formed && config->source_hash == sourceHash){
+        LOG_INFO("Configuration unchanged, keeping resident copy");
+        return static_cast<int>(ConfigurationManagerErrors::SUCCESS);
+    }
+    config->formed = false;
+
+    char snapshotName[32];
+    snapshotFileName(configFileName, snapshotName, sizeof(snapshotName));
 
-    // Open file for reading
-    File file = SD.open(configFileName);
+    int res = LoadSnapshot(snapshotName, config, sourceHash);
+    if (res == static_cast<int>(ConfigurationManagerErrors::SUCCESS)){
+        LOG_INFO("Configuration loaded from snapshot %s in %lu ms", snapshotName, millis() - loadStart);
+    }
+    else{
+        LOG_INFO("Snapshot unavailable (%d), parsing json", res);
+        res = ParseJson(configFileName, config);
+        if (res < 0){
+            return res;
+        }
+        if (SaveSnapshot(snapshotName, config, sourceHash) < 0){
+            LOG_WARN("Failed to write configuration snapshot");
+        }
+        LOG_INFO("Configuration parsed from json in %lu ms", millis() - loadStart);
+    }
+    config->source_hash = sourceHash;
+    config->formed = true;
+    return static_cast<int>(ConfigurationManagerErrors::SUCCESS);
+}
+
+/// @brief Read the broker, device, journal and modbus settings, register arrays are filtered out
+int parseSettings(File& file, struct Config* config, int sdCardSsPin)
+{
     // Allocate a temporary JsonDocument
-    // Don't forget to change the capacity to match your requirements.
+    // Only the settings are kept in this document, register arrays are filtered out
+    // and streamed one element at a time so memory use doesn't grow with the register count.
     // Use arduinojson.org/v6/assistant to compute the capacity.
-    StaticJsonDocument<8192> doc;
+    StaticJsonDocument<CONFIG_SETTINGS_DOC_SIZE> doc;
+    StaticJsonDocument<256> filter;
+    filter[config->broker.key] = true;
+    filter[config->device.key] = true;
+    filter[config->journal.key] = true;
+    filter[config->modbus.key]["offset"] = true;
+    filter[config->modbus.key]["telemetry_interval_sec"] = true;
+    filter[config->modbus.key]["max_read_gap"] = true;
+    filter[config->modbus.key]["telemetry_mode"] = true;
+    filter[config->modbus.key]["payload_format"] = true;
+    filter[config->modbus.key][config->modbus.serial_ports[0].key] = true;
+    filter[config->modbus.key]["devices"] = true;
 
-    if (file)
+    // Deserialize the JSON document
+    DeserializationError error = deserializeJson(doc, file, DeserializationOption::Filter(filter));
+    if (error)
     {
-        // Deserialize the JSON document
-        DeserializationError error = deserializeJson(doc, file);
-        JsonObject jObj = doc.as<JsonObject>();
-        if (error)
+        LOG_ERROR("Failed to read file: %s", error.c_str());
+        LOG_ERROR("Create conf.txt and place at root of SD card to configure settings");
+        return static_cast<int>(ConfigurationManagerErrors::CONFIG_FILE_NOT_FOUND);
+    }
+
+    // Copy values from the JsonDocument to the Config
+
+    //mqtt broker connection
+    strlcpy(config->broker.broker_user,                  // <- destination
+        doc[config->broker.key]["broker_user"] | "",              // <- source
+        sizeof(config->broker.broker_user));         // <- destination's capacity
+    strlcpy(config->broker.broker_pass,
+        doc[config->broker.key]["broker_pass"] | "",
+        sizeof(config->broker.broker_pass));
+    strlcpy(config->broker.broker_url,
+        doc[config->broker.key]["broker_url"] | "none",
+        sizeof(config->broker.broker_url));
+    config->broker.broker_port = doc[config->broker.key]["broker_port"] | 1883;
+    config->broker.broker_retry_interval_sec = doc[config->broker.key]["broker_retry_interval_sec"] | 5;
+    config->broker.formed = true;
+
+    //arduino device settings
+    config->device.ethernet_pin = sdCardSsPin;
+    strlcpy(config->device.device_name,
+            doc[config->device.key]["device_name"] | "arduino",
+            sizeof(config->device.device_name));
+
+    config->device.device_mac.b1 = doc[config->device.key][config->device.device_mac.key]["b1"];
+    config->device.device_mac.b2 = doc[config->device.key][config->device.device_mac.key]["b2"];
+    config->device.device_mac.b3 = doc[config->device.key][config->device.device_mac.key]["b3"];
+    config->device.device_mac.b4 = doc[config->device.key][config->device.device_mac.key]["b4"];
+    config->device.device_mac.b5 = doc[config->device.key][config->device.device_mac.key]["b5"];
+    config->device.device_mac.b6 = doc[config->device.key][config->device.device_mac.key]["b6"];
+    config->device.device_mac.formed = true;
+
+    config->device.formed = true;
+    //app settings
+    config->journal.enabled = doc[config->journal.key]["enabled"] | false;
+    config->journal.max_records = doc[config->journal.key]["max_records"] | 20000L;
+    config->journal.flush_interval_sec = doc[config->journal.key]["flush_interval_sec"] | 10;
+    config->journal.replay_rate_per_sec = doc[config->journal.key]["replay_rate_per_sec"] | 20;
+    config->journal.formed = true;
+
+    //modbus settings
+    config->modbus.offset = doc[config->modbus.key]["offset"];
+    config->modbus.telemetry_interval_sec = doc[config->modbus.key]["telemetry_interval_sec"] | 10;
+    config->modbus.max_read_gap = doc[config->modbus.key]["max_read_gap"] | 0;
+    if (doc[config->modbus.key]["telemetry_mode"] == "per_device"){
+        config->modbus.telemetry_mode = eTelemetryMode::per_device;
+    }else{
+        config->modbus.telemetry_mode = eTelemetryMode::per_register;
+    }
+    if (doc[config->modbus.key]["payload_format"] == "msgpack"){
+        config->modbus.payload_format = ePayloadFormat::payload_msgpack;
+    }else{
+        config->modbus.payload_format = ePayloadFormat::payload_json;
+    }
+    //frame timing is derived from these, serial_port is either a single port or an array with one entry per bus
+    JsonVariant serialPorts = doc[config->modbus.key][config->modbus.serial_ports[0].key];
+    config->modbus.serial_port_count = 1;
+    if (serialPorts.is<JsonArray>() && serialPorts.size() > 0){
+        if (serialPorts.size() > MODBUS_MAX_SERIAL_BUSES){
+            LOG_WARN("Too many serial ports, ignoring the rest");
+        }
+        config->modbus.serial_port_count = min(static_cast<int>(serialPorts.size()), MODBUS_MAX_SERIAL_BUSES);
+        for (int i = 0; i < config->modbus.serial_port_count; i++)
         {
-            // Close the file (Curiously, File's destructor doesn't close the file)
-            Serial.println(F("Failed to read file"));
-            Serial.println(error.c_str());
-            Serial.println("Create conf.txt and place at root of SD card to configure settings");
-
-            file.close();
-            Serial.println("Gracefully closed config file");
-            return static_cast<int>(ConfigurationManagerErrors::CONFIG_FILE_NOT_FOUND);
-        }
-
-        // Copy values from the JsonDocument to the Config
-
-        //mqtt broker connection
-        strlcpy(config->broker.broker_user,                  // <- destination
-            doc[config->broker.key]["broker_user"] | "",              // <- source
-            sizeof(config->broker.broker_user));         // <- destination's capacity
-        strlcpy(config->broker.broker_pass,
-            doc[config->broker.key]["broker_pass"] | "",
-            sizeof(config->broker.broker_pass));
-        strlcpy(config->broker.broker_url,
-            doc[config->broker.key]["broker_url"] | "none",
-            sizeof(config->broker.broker_url));
-        config->broker.broker_port = doc[config->broker.key]["broker_port"] | 1883;
-        config->broker.broker_retry_interval_sec = doc[config->broker.key]["broker_retry_interval_sec"] | 5;
-        config->broker.formed = true;
-
-        //arduino device settings
-        config->device.ethernet_pin = _sdCardSsPin;
-        strlcpy(config->device.device_name,
-                doc[config->device.key]["device_name"] | "arduino",
-                sizeof(config->device.device_name));
-
-        Serial.print("reading mac address...");
-        config->device.device_mac.b1 = doc[config->device.key][config->device.device_mac.key]["b1"];
-        config->device.device_mac.b2 = doc[config->device.key][config->device.device_mac.key]["b2"];
-        config->device.device_mac.b3 = doc[config->device.key][config->device.device_mac.key]["b3"];
-        config->device.device_mac.b4 = doc[config->device.key][config->device.device_mac.key]["b4"];
-        config->device.device_mac.b5 = doc[config->device.key][config->device.device_mac.key]["b5"];
-        config->device.device_mac.b6 = doc[config->device.key][config->device.device_mac.key]["b6"];
-        config->device.device_mac.formed = true;
-        Serial.println("done.");
-
-        config->device.formed = true;
-        //app settings
-
-        //modbus settings
-        Serial.println("reading modbus settings");
-        config->modbus.offset = doc[config->modbus.key]["offset"];
-        config->modbus.telemetry_interval_sec = doc[config->modbus.key]["telemetry_interval_sec"] | 10;
-        config->modbus.serial_port.baud_rate = doc[config->modbus.key][config->modbus.serial_port.key]["baud_rate"];
-        config->modbus.serial_port.stop_bits = doc[config->modbus.key][config->modbus.serial_port.key]["stop_bits"];
-        config->modbus.serial_port.parity_bits = doc[config->modbus.key][config->modbus.serial_port.key]["parity_bits"];
-        config->modbus.serial_port.data_bits = doc[config->modbus.key][config->modbus.serial_port.key]["data_bits"];
-        config->modbus.serial_port.flow_control = doc[config->modbus.key][config->modbus.serial_port.key]["flow_control"];
-        config->modbus.serial_port.flow_control = true;
-        
-        JsonArray arr = jObj[config->modbus.key]["telemetry_registers"].as<JsonArray>();
-        int i = 0;
-
-        for (JsonVariant value : arr) {
-            strlcpy(config->modbus.registers[i].name,
-                value["name"].as<char*>(),
-                sizeof(config->modbus.registers[i].name));
-            strlcpy(config->modbus.registers[i].units,
-                value["units"].as<char*>(),
-                sizeof(config->modbus.registers[i].units));
-            strlcpy(config->modbus.registers[i].topic,
-                value["topic"].as<char*>(),
-                sizeof(config->modbus.registers[i].topic));
-            config->modbus.registers[i].address = value["address"].as<int>() + config->modbus.offset;
-            config->modbus.registers[i].value = value["value"].as<int>();
-            config->modbus.registers[i].device_id = value["device_id"].as<int>();
-            config->modbus.registers[i].formed = true;
-
-            Serial.println("Loaded modbus param:");
-            Serial.println(config->modbus.registers[i].name);
-            Serial.println(config->modbus.registers[i].units);
-            Serial.println(config->modbus.registers[i].device_id);
-            Serial.println(config->modbus.registers[i].topic);
-            Serial.println("");
-            i++;
-        }
-        config->modbus.formed = true;
-
-        //configuration registers
-        JsonArray arr2 = jObj[config->modbus.key]["configuration_registers"].as<JsonArray>();
-        int configIndex = 0;
-
-        for (JsonVariant value2 : arr2) {
-            strlcpy(config->modbus.configuration_registers[configIndex].name,
-                value2["name"].as<char*>(),
-                sizeof(config->modbus.configuration_registers[configIndex].name));
-            strlcpy(config->modbus.configuration_registers[configIndex].units,
-                value2["units"].as<char*>(),
-                sizeof(config->modbus.configuration_registers[configIndex].units));
-            strlcpy(config->modbus.configuration_registers[configIndex].topic,
-                value2["topic"].as<char*>(),
-                sizeof(config->modbus.configuration_registers[configIndex].topic));
-            config->modbus.configuration_registers[configIndex].address = value2["address"].as<int>() + config->modbus.offset;
-            config->modbus.configuration_registers[configIndex].value = value2["value"].as<int>();
-            config->modbus.configuration_registers[configIndex].device_id = value2["device_id"].as<int>();
-            config->modbus.configuration_registers[i].upper_limit = value2["upper_limit"].as<int>();
-            config->modbus.configuration_registers[i].lower_limit = value2["lower_limit"].as<int>();
-            //NOT WORKING AFTER RETURN??
-            config->modbus.configuration_registers[i].limit_comparison = from(value2["limit_comparison"]);
-            config->modbus.configuration_registers[i].formed = true;
-
-            Serial.println("Loaded modbus config param:");
-            Serial.println(config->modbus.configuration_registers[configIndex].name);
-            Serial.println(config->modbus.configuration_registers[configIndex].units);
-            Serial.println(config->modbus.configuration_registers[configIndex].device_id);
-            Serial.println(config->modbus.configuration_registers[configIndex].topic);
-            Serial.println(config->modbus.configuration_registers[configIndex].limit_comparison);
-            Serial.println(config->modbus.configuration_registers[configIndex].formed);
-            Serial.println("");
-            configIndex++;
-        }
-        config->modbus.configuration_registers->formed = true;
+            parseSerialPort(serialPorts[i], &config->modbus.serial_ports[i]);
+        }
+    }else{
+        parseSerialPort(serialPorts, &config->modbus.serial_ports[0]);
     }
-    else
+
+    //slaves listed here are reached over modbus tcp or a serial bus other than the first
+    config->modbus.device_count = 0;
+    for (JsonObject device : doc[config->modbus.key]["devices"].as<JsonArray>())
     {
-        file.close();
-        Serial.println("Gracefully closed config file");
+        if (config->modbus.device_count >= MODBUS_MAX_DEVICES){
+            LOG_WARN("Too many modbus devices, ignoring the rest");
+            break;
+        }
+        ModbusDeviceTransport* transport = &config->modbus.devices[config->modbus.device_count++];
+        transport->device_id = device["device_id"] | 0;
+        if (device["transport"] == "tcp"){
+            transport->transport = eModbusTransport::transport_tcp;
+        }else{
+            transport->transport = eModbusTransport::transport_rtu;
+        }
+        transport->bus = max(0, device["bus"] | 0);
+        strlcpy(transport->host, device["host"] | "", sizeof(transport->host));
+        transport->port = device["port"] | 502;
+        transport->max_inflight = device["max_inflight"] | 4;
+        //rtu slaves without a timeout adapt it to their measured response time
+        transport->timeout_ms = device["timeout_ms"] | (transport->transport == eModbusTransport::transport_tcp ? 1000 : 0);
+    }
+    return static_cast<int>(ConfigurationManagerErrors::SUCCESS);
+}
+
+/// @brief A patch keeps every setting of the live configuration, only its register arrays change
+void copySettings(struct Config* live, struct Config* config)
+{
+    config->device = live->device;
+    config->broker = live->broker;
+    config->journal = live->journal;
+    config->modbus.offset = live->modbus.offset;
+    config->modbus.telemetry_interval_sec = live->modbus.telemetry_interval_sec;
+    config->modbus.max_read_gap = live->modbus.max_read_gap;
+    config->modbus.telemetry_mode = live->modbus.telemetry_mode;
+    config->modbus.payload_format = live->modbus.payload_format;
+    config->modbus.serial_port_count = live->modbus.serial_port_count;
+    for (int i = 0; i < live->modbus.serial_port_count; i++)
+    {
+        config->modbus.serial_ports[i] = live->modbus.serial_ports[i];
+    }
+    config->modbus.device_count = live->modbus.device_count;
+    for (int i = 0; i < live->modbus.device_count; i++)
+    {
+        config->modbus.devices[i] = live->modbus.devices[i];
+    }
+}
+
+/// @brief Live telemetry register i written out the way conf.txt lists it
+void telemetryElement(struct Config* config, int i, JsonDocument& element)
+{
+    ModbusRegisterTable* regs = &config->modbus.registers;
+    char topic[96];
+    snprintf(topic, sizeof(topic), "%s%s", regs->meta[i].topic.prefix, regs->meta[i].topic.leaf);
+    element.clear();
+    element["name"] = regs->meta[i].name;
+    element["units"] = regs->meta[i].units;
+    element["topic"] = topic;
+    element["address"] = regs->address[i] - config->modbus.offset;
+    element["value"] = regs->value[i];
+    element["device_id"] = regs->device_id[i];
+    element["type"] = registerTypeName(static_cast<eRegisterType>(regs->type[i]));
+    //either key turns report by exception on
+    if (regs->flags[i] & REGISTER_REPORT_BY_EXCEPTION){
+        if (regs->flags[i] & REGISTER_DEADBAND_PERCENT){
+            char deadband[16];
+            snprintf(deadband, sizeof(deadband), "%u.%02u%%", regs->deadband[i] / 100, regs->deadband[i] % 100);
+            element["deadband"] = deadband;
+        }else{
+            element["deadband"] = regs->deadband[i];
+        }
+        element["max_silence_sec"] = regs->max_silence_sec[i];
+    }
+    element["sample_interval_ms"] = regs->sample_interval_ms[i];
+}
+
+/// @brief Live configuration register i written out the way conf.txt lists it
+void configElement(struct Config* config, int i, JsonDocument& element)
+{
+    ModbusConfigParameter* param = &config->modbus.configuration_registers[i];
+    char topic[96];
+    snprintf(topic, sizeof(topic), "%s%s", param->topic.prefix, param->topic.leaf);
+    element.clear();
+    element["name"] = param->name;
+    element["units"] = param->units;
+    element["topic"] = topic;
+    element["address"] = param->address - config->modbus.offset;
+    element["value"] = param->value;
+    element["device_id"] = param->device_id;
+    element["type"] = registerTypeName(param->type);
+    element["upper_limit"] = param->upper_limit;
+    element["lower_limit"] = param->lower_limit;
+    element["limit_comparison"] = toString(param->limit_comparison);
+}
+
+/// @brief Patch entry naming the same register as live entry i, -1 if the patch doesn't touch it
+int patchEntryFor(JsonArray entries, struct Config* live, bool telemetry, int i)
+{
+    int deviceId;
+    int type;
+    int address;
+    if (telemetry){
+        deviceId = live->modbus.registers.device_id[i];
+        type = live->modbus.registers.type[i];
+        address = live->modbus.registers.address[i];
+    }else{
+        deviceId = live->modbus.configuration_registers[i].device_id;
+        type = live->modbus.configuration_registers[i].type;
+        address = live->modbus.configuration_registers[i].address;
+    }
+    int k = 0;
+    for (JsonObject entry : entries)
+    {
+        if (entry["device_id"].as<int>() == deviceId && static_cast<int>(registerTypeFrom(entry["type"])) == type &&
+            entry["address"].as<int>() + live->modbus.offset == address)
+        {
+            return k;
+        }
+        k++;
+    }
+    return -1;
+}
+
+/// @brief Copy the keys a patch entry sets over an element
+void applyPatchEntry(JsonObject entry, JsonDocument& element)
+{
+    for (JsonPair kv : entry)
+    {
+        if (strcmp(kv.key().c_str(), "remove") != 0){
+            element[kv.key().c_str()] = kv.value();
+        }
+    }
+}
+
+/// @brief Next element of a patched register array into reload->element
+/// Live registers come first and in order, merged with their patch entry or left out when it removes them,
+/// then the patch entries that matched no live register are added.
+/// @return 1 with a register, 0 once the array is done, < 0 if the patch can't be applied
+int patchRegister(ConfigReload* reload, bool telemetry)
+{
+    Config* live = reload->live;
+    JsonArray entries = (*reload->patch)[telemetry ? live->modbus.registers.key : "configuration_registers"];
+    int liveCount = telemetry ? live->modbus.registers.count : live->modbus.configuration_register_count;
+    uint32_t* matched = &reload->patch_matched[telemetry ? 0 : 1];
+    int total = liveCount + static_cast<int>(entries.size());
+    while (reload->source < total)
+    {
+        int source = reload->source++;
+        if (source < liveCount){
+            int k = patchEntryFor(entries, live, telemetry, source);
+            if (k >= 0){
+                *matched |= 1UL << k;
+                if (entries[k]["remove"] | false){
+                    continue;
+                }
+            }
+            if (telemetry){
+                telemetryElement(live, source, reload->element);
+            }else{
+                configElement(live, source, reload->element);
+            }
+            if (k >= 0){
+                applyPatchEntry(entries[k], reload->element);
+            }
+            return 1;
+        }
+
+        int k = source - liveCount;
+        if (*matched & (1UL << k)){
+            continue;
+        }
+        if (entries[k]["remove"] | false){
+            LOG_ERROR("Patch removes a register that isn't configured: device %d address %d",
+                entries[k]["device_id"].as<int>(), entries[k]["address"].as<int>());
+            return static_cast<int>(ConfigurationManagerErrors::CONFIG_PATCH_INVALID);
+        }
+        reload->element.clear();
+        applyPatchEntry(entries[k], reload->element);
+        return 1;
+    }
+    return 0;
+}
+
+/// @brief Next telemetry or configuration register of the file or patch being staged
+int nextRegister(ConfigReload* reload, bool telemetry)
+{
+    if (reload->patch != nullptr){
+        return patchRegister(reload, telemetry);
+    }
+    return streamRegister(reload, telemetry ? reload->staged->modbus.registers.key : "configuration_registers");
+}
+
+/// @brief Start the pass over the next register array
+void nextPhase(ConfigReload* reload, ConfigReloadPhase phase)
+{
+    reload->phase = phase;
+    reload->cursor = 0;
+    reload->source = 0;
+}
+
+/// @brief Fields common to a reload from the file and from a patch
+void beginStaging(ConfigReload* reload, struct Config* live, struct Config* staged)
+{
+    memset(&reload->diff, 0, sizeof(ConfigDiff));
+    reload->live = live;
+    reload->staged = staged;
+    reload->hash = 0;
+    reload->patch_matched[0] = 0;
+    reload->patch_matched[1] = 0;
+    reload->telemetry_count = 0;
+    reload->config_count = 0;
+    reload->scratch_ok = true;
+    buildRegisterFilter(reload->filter);
+    nextPhase(reload, ConfigReloadPhase::HASH);
+}
+
+int ConfigurationManager::ParseJson(char* configFileName, struct Config* config)
+{
+    LOG_INFO("Opening config file %s", configFileName);
+
+    //the steps a reload spreads over scheduler passes, run back to back
+    ConfigReload load{};
+    beginStaging(&load, nullptr, config);
+    load.fileName = configFileName;
+    load.file = SD.open(configFileName);
+    if (!load.file){
         return static_cast<int>(ConfigurationManagerErrors::CONFIG_FILE_FAILED_OPEN);
     }
+    nextPhase(&load, ConfigReloadPhase::SETTINGS);
 
-    file.close();
-    Serial.println("Gracefully closed config file");
+    int res;
+    do
+    {
+        res = StepReload(&load);
+    } while (res == static_cast<int>(ConfigurationManagerErrors::CONFIG_RELOAD_PENDING));
+    EndReload(&load);
+    LOG_DEBUG("Gracefully closed config file");
+    return res;
+}
+
+//flags that come from the configuration, the rest is runtime state
+#define REGISTER_CONFIG_FLAGS (REGISTER_DEADBAND_PERCENT | REGISTER_REPORT_BY_EXCEPTION)
+
+bool sameTopic(const PooledTopic& a, const PooledTopic& b)
+{
+    return strcmp(a.prefix, b.prefix) == 0 && strcmp(a.leaf, b.leaf) == 0;
+}
+
+/// @brief Telemetry register i of a has the same publish settings as register j of b
+bool sameTelemetrySettings(ModbusRegisterTable* a, int i, ModbusRegisterTable* b, int j)
+{
+    return strcmp(a->meta[i].name, b->meta[j].name) == 0 &&
+        strcmp(a->meta[i].units, b->meta[j].units) == 0 &&
+        sameTopic(a->meta[i].topic, b->meta[j].topic) &&
+        a->deadband[i] == b->deadband[j] &&
+        a->max_silence_sec[i] == b->max_silence_sec[j] &&
+        a->sample_interval_ms[i] == b->sample_interval_ms[j] &&
+        (a->flags[i] & REGISTER_CONFIG_FLAGS) == (b->flags[j] & REGISTER_CONFIG_FLAGS);
+}
+
+bool sameConfigParameter(const ModbusConfigParameter& a, const ModbusConfigParameter& b)
+{
+    return a.device_id == b.device_id && a.type == b.type && a.address == b.address &&
+        a.upper_limit == b.upper_limit && a.lower_limit == b.lower_limit &&
+        a.limit_comparison == b.limit_comparison &&
+        strcmp(a.name, b.name) == 0 && strcmp(a.units, b.units) == 0 && sameTopic(a.topic, b.topic);
+}
+
+/// @brief Settings of staged that differ from live, device and broker settings are kept until a restart
+void diffSettings(struct Config* live, struct Config* staged, ConfigDiff* diff)
+{
+    diff->serial_port_changed = staged->modbus.serial_port_count != live->modbus.serial_port_count;
+    for (int i = 0; i < staged->modbus.serial_port_count && !diff->serial_port_changed; i++)
+    {
+        SerialPortConfiguration* port = &staged->modbus.serial_ports[i];
+        SerialPortConfiguration* livePort = &live->modbus.serial_ports[i];
+        diff->serial_port_changed = port->baud_rate != livePort->baud_rate || port->data_bits != livePort->data_bits ||
+            port->parity_bits != livePort->parity_bits || port->stop_bits != livePort->stop_bits;
+    }
+    diff->devices_changed = staged->modbus.device_count != live->modbus.device_count;
+    for (int i = 0; i < staged->modbus.device_count && !diff->devices_changed; i++)
+    {
+        ModbusDeviceTransport* device = &staged->modbus.devices[i];
+        ModbusDeviceTransport* liveDevice = &live->modbus.devices[i];
+        diff->devices_changed = device->device_id != liveDevice->device_id || device->transport != liveDevice->transport ||
+            device->bus != liveDevice->bus ||
+            strcmp(device->host, liveDevice->host) != 0 || device->port != liveDevice->port ||
+            device->max_inflight != liveDevice->max_inflight || device->timeout_ms != liveDevice->timeout_ms;
+    }
+
+    //the broker connection and ethernet identity are kept until the next restart
+    MacAddress* mac = &staged->device.device_mac;
+    MacAddress* liveMac = &live->device.device_mac;
+    BrokerConfiguration* broker = &staged->broker;
+    BrokerConfiguration* liveBroker = &live->broker;
+    diff->restart_required = strcmp(staged->device.device_name, live->device.device_name) != 0 ||
+        mac->b1 != liveMac->b1 || mac->b2 != liveMac->b2 || mac->b3 != liveMac->b3 ||
+        mac->b4 != liveMac->b4 || mac->b5 != liveMac->b5 || mac->b6 != liveMac->b6 ||
+        strcmp(broker->broker_url, liveBroker->broker_url) != 0 || broker->broker_port != liveBroker->broker_port ||
+        strcmp(broker->broker_user, liveBroker->broker_user) != 0 || strcmp(broker->broker_pass, liveBroker->broker_pass) != 0 ||
+        broker->broker_retry_interval_sec != liveBroker->broker_retry_interval_sec;
+    staged->device = live->device;
+    staged->broker = live->broker;
+}
+
+int ConfigurationManager::BeginReload(ConfigReload* reload, char* configFileName, struct Config* live, struct Config* staged)
+{
+    beginStaging(reload, live, staged);
+    reload->fileName = configFileName;
+    if (!SD.exists(configFileName)){
+        LOG_ERROR("Could not find %s", configFileName);
+        return static_cast<int>(ConfigurationManagerErrors::CONFIG_FILE_NOT_FOUND);
+    }
+    reload->file = SD.open(configFileName);
+    if (!reload->file){
+        LOG_ERROR("Could not read %s", configFileName);
+        return static_cast<int>(ConfigurationManagerErrors::CONFIG_FILE_FAILED_OPEN);
+    }
     return static_cast<int>(ConfigurationManagerErrors::SUCCESS);
 }
 
+int ConfigurationManager::BeginPatch(ConfigReload* reload, const char* patch, size_t length, struct Config* live, struct Config* staged)
+{
+    beginStaging(reload, live, staged);
+    reload->patch = new StaticJsonDocument<CONFIG_PATCH_DOC_SIZE>();
+    if (reload->patch == nullptr){
+        return static_cast<int>(ConfigurationManagerErrors::CONFIG_OUT_OF_MEMORY);
+    }
+    DeserializationError error = deserializeJson(*reload->patch, patch, length);
+    if (error || !reload->patch->is<JsonObject>()){
+        LOG_ERROR("Failed to read configuration patch: %s", error.c_str());
+        return static_cast<int>(ConfigurationManagerErrors::CONFIG_PATCH_INVALID);
+    }
+
+    //only register arrays are patched, each entry names its register and sets keys conf.txt allows
+    const char* keys[] = {live->modbus.registers.key, "configuration_registers"};
+    for (JsonPair array : reload->patch->as<JsonObject>())
+    {
+        if (strcmp(array.key().c_str(), keys[0]) != 0 && strcmp(array.key().c_str(), keys[1]) != 0){
+            LOG_ERROR("Configuration patch can't change %s", array.key().c_str());
+            return static_cast<int>(ConfigurationManagerErrors::CONFIG_PATCH_INVALID);
+        }
+        JsonArray entries = array.value().as<JsonArray>();
+        if (entries.isNull() || entries.size() > CONFIG_PATCH_MAX_ENTRIES){
+            LOG_ERROR("Configuration patch %s must be an array of at most %d entries", array.key().c_str(), CONFIG_PATCH_MAX_ENTRIES);
+            return static_cast<int>(ConfigurationManagerErrors::CONFIG_PATCH_INVALID);
+        }
+        for (JsonObject entry : entries)
+        {
+            bool valid = entry["device_id"].is<int>() && entry["address"].is<int>();
+            for (JsonPair kv : entry)
+            {
+                valid = valid && (reload->filter.containsKey(kv.key().c_str()) || strcmp(kv.key().c_str(), "remove") == 0);
+            }
+            if (!valid){
+                LOG_ERROR("Configuration patch entry needs device_id and address and only register keys");
+                return static_cast<int>(ConfigurationManagerErrors::CONFIG_PATCH_INVALID);
+            }
+        }
+    }
+
+    //a patched configuration matches no file, the patch is folded into the live hash
+    reload->hash = crc32Update(live->source_hash, reinterpret_cast<const uint8_t*>(patch), length);
+    nextPhase(reload, ConfigReloadPhase::SETTINGS);
+    return static_cast<int>(ConfigurationManagerErrors::SUCCESS);
+}
+
+int ConfigurationManager::StepReload(ConfigReload* reload)
+{
+    int pending = static_cast<int>(ConfigurationManagerErrors::CONFIG_RELOAD_PENDING);
+    Config* config = reload->staged;
+    Config* live = reload->live;
+    ModbusRegisterTable* regs = &config->modbus.registers;
+    switch (reload->phase)
+    {
+        case ConfigReloadPhase::HASH:
+        {
+            uint8_t buffer[64];
+            for (int done = 0; done < CONFIG_RELOAD_HASH_CHUNK; done += sizeof(buffer))
+            {
+                int len = reload->file.read(buffer, sizeof(buffer));
+                if (len <= 0){
+                    reload->more = false;
+                    break;
+                }
+                reload->hash = crc32Update(reload->hash, buffer, len);
+                reload->more = true;
+            }
+            if (reload->more){
+                return pending;
+            }
+            if (reload->hash == live->source_hash){
+                reload->diff.unchanged = true;
+                nextPhase(reload, ConfigReloadPhase::DONE);
+                return static_cast<int>(ConfigurationManagerErrors::SUCCESS);
+            }
+
+            //a snapshot of the new file loads in one pass, the json is parsed over many
+            char snapshotName[32];
+            snapshotFileName(reload->fileName, snapshotName, sizeof(snapshotName));
+            if (LoadSnapshot(snapshotName, config, reload->hash) == static_cast<int>(ConfigurationManagerErrors::SUCCESS)){
+                LOG_INFO("Configuration staged from snapshot %s", snapshotName);
+                reload->file.close();
+                config->source_hash = reload->hash;
+                config->formed = true;
+                nextPhase(reload, ConfigReloadPhase::MATCH);
+                return pending;
+            }
+            reload->file.seek(0);
+            nextPhase(reload, ConfigReloadPhase::SETTINGS);
+            return pending;
+        }
+        case ConfigReloadPhase::SETTINGS:
+        {
+            if (reload->patch == nullptr){
+                int res = parseSettings(reload->file, config, _sdCardSsPin);
+                if (res < 0){
+                    return res;
+                }
+            }else{
+                copySettings(live, config);
+            }
+            //intern every string once up front so the arena can be sized exactly
+            reload->scratch_ok = reload->scratch.BuildIndex();
+            nextPhase(reload, ConfigReloadPhase::SIZE_TELEMETRY);
+            return pending;
+        }
+        case ConfigReloadPhase::SIZE_TELEMETRY:
+        case ConfigReloadPhase::SIZE_CONFIG:
+        {
+            //registers are streamed twice, once to size the arena and once to fill it
+            bool telemetry = reload->phase == ConfigReloadPhase::SIZE_TELEMETRY;
+            for (int n = 0; n < CONFIG_RELOAD_STEP; n++)
+            {
+                int res = nextRegister(reload, telemetry);
+                if (res < 0){
+                    return res;
+                }
+                if (res == 0){
+                    if (telemetry){
+                        reload->telemetry_count = reload->cursor;
+                        nextPhase(reload, ConfigReloadPhase::SIZE_CONFIG);
+                    }else{
+                        reload->config_count = reload->cursor;
+                        nextPhase(reload, ConfigReloadPhase::ALLOCATE);
+                    }
+                    return pending;
+                }
+                JsonVariant value = reload->element.as<JsonVariant>();
+                reload->scratch_ok = reload->scratch_ok && reserveScratch(reload->scratch, pooledBytes(value));
+                if (reload->scratch_ok){
+                    internStrings(reload->scratch, value);
+                }
+                reload->cursor++;
+            }
+            return pending;
+        }
+        case ConfigReloadPhase::ALLOCATE:
+        {
+            reload->scratch.ReleaseIndex();
+            if (!reload->scratch_ok){
+                LOG_ERROR("Not enough memory to load configuration");
+                return static_cast<int>(ConfigurationManagerErrors::CONFIG_OUT_OF_MEMORY);
+            }
+            //the pool is placed first and unaligned, the tables after it start on the next 4 byte boundary
+            size_t tableBytes = registerTableBytes(reload->telemetry_count, reload->config_count);
+            bool allocated = config->arena.Begin(CONFIG_ARENA_SIZE(reload->scratch.used) + tableBytes) &&
+                config->arena.AdoptStrings(reload->scratch) &&
+                config->arena.strings.BuildIndex() &&
+                allocateTables(config, reload->telemetry_count, reload->config_count);
+            free(reload->scratch.data);
+            reload->scratch = StringPool();
+            if (!allocated){
+                config->arena.Release();
+                LOG_ERROR("Not enough memory to load configuration");
+                return static_cast<int>(ConfigurationManagerErrors::CONFIG_OUT_OF_MEMORY);
+            }
+            nextPhase(reload, ConfigReloadPhase::FILL_TELEMETRY);
+            return pending;
+        }
+        case ConfigReloadPhase::FILL_TELEMETRY:
+        case ConfigReloadPhase::FILL_CONFIG:
+        {
+            bool telemetry = reload->phase == ConfigReloadPhase::FILL_TELEMETRY;
+            int count = telemetry ? reload->telemetry_count : reload->config_count;
+            for (int n = 0; n < CONFIG_RELOAD_STEP; n++)
+            {
+                int res = nextRegister(reload, telemetry);
+                if (res < 0){
+                    return res;
+                }
+                //the file changed between the two passes
+                if ((res == 0) != (reload->cursor == count)){
+                    LOG_ERROR("Configuration changed while it was loading");
+                    return static_cast<int>(ConfigurationManagerErrors::CONFIG_FILE_NOT_FOUND);
+                }
+                if (res == 0){
+                    if (telemetry){
+                        config->modbus.formed = true;
+                        nextPhase(reload, ConfigReloadPhase::FILL_CONFIG);
+                    }else{
+                        nextPhase(reload, ConfigReloadPhase::INDEX);
+                    }
+                    return pending;
+                }
+
+                int i = reload->cursor++;
+                JsonVariant value = reload->element.as<JsonVariant>();
+                if (telemetry){
+                    regs->meta[i].name = config->arena.strings.Intern(value["name"].as<const char*>());
+                    regs->meta[i].units = config->arena.strings.Intern(value["units"].as<const char*>());
+                    regs->meta[i].topic = internTopic(config->arena.strings, value["topic"].as<const char*>());
+                    regs->address[i] = value["address"].as<int>() + config->modbus.offset;
+                    regs->value[i] = value["value"].as<int>();
+                    regs->device_id[i] = value["device_id"].as<int>();
+                    regs->type[i] = registerTypeFrom(value["type"]);
+                    parseDeadband(value["deadband"], &regs->deadband[i], &regs->flags[i]);
+                    regs->max_silence_sec[i] = value["max_silence_sec"] | 0;
+                    regs->sample_interval_ms[i] = constrain(value["sample_interval_ms"] | 0, 0, UINT16_MAX);
+                    //registers without either key keep publishing every cycle, bits are only published when they change
+                    if (value.containsKey("deadband") || value.containsKey("max_silence_sec") ||
+                        isBitType(static_cast<eRegisterType>(regs->type[i])))
+                    {
+                        regs->flags[i] |= REGISTER_REPORT_BY_EXCEPTION;
+                    }
+
+                    LOG_DEBUG("Loaded modbus param: %s %s device %d type %d %s%s", regs->meta[i].name, regs->meta[i].units,
+                        regs->device_id[i], regs->type[i], regs->meta[i].topic.prefix, regs->meta[i].topic.leaf);
+                }else{
+                    ModbusConfigParameter* param = &config->modbus.configuration_registers[i];
+                    param->name = config->arena.strings.Intern(value["name"].as<const char*>());
+                    param->units = config->arena.strings.Intern(value["units"].as<const char*>());
+                    param->topic = internTopic(config->arena.strings, value["topic"].as<const char*>());
+                    param->address = value["address"].as<int>() + config->modbus.offset;
+                    param->value = value["value"].as<int>();
+                    param->device_id = value["device_id"].as<int>();
+                    param->type = registerTypeFrom(value["type"]);
+                    param->upper_limit = value["upper_limit"].as<int>();
+                    param->lower_limit = value["lower_limit"].as<int>();
+                    param->limit_comparison = from(value["limit_comparison"]);
+
+                    LOG_DEBUG("Loaded modbus config param: %s %s device %d %s%s limit %d", param->name, param->units,
+                        param->device_id, param->topic.prefix, param->topic.leaf, param->limit_comparison);
+                }
+            }
+            return pending;
+        }
+        case ConfigReloadPhase::INDEX:
+        {
+            config->arena.strings.ReleaseIndex();
+            if (reload->file){
+                reload->file.close();
+            }
+
+            LOG_INFO("Configuration arena: %u bytes (%u bytes of strings)",
+                static_cast<unsigned>(config->arena.used), static_cast<unsigned>(config->arena.strings.used));
+
+            BuildReadPlan(config);
+            BuildCommandIndex(config);
+            LOG_INFO("Telemetry read plan: %d block read(s) per cycle", config->modbus.read_plan.span_count);
+            //Load() keeps the hash and snapshot of a configuration loaded at startup
+            if (live == nullptr){
+                nextPhase(reload, ConfigReloadPhase::DONE);
+                return static_cast<int>(ConfigurationManagerErrors::SUCCESS);
+            }
+            if (reload->patch == nullptr){
+                char snapshotName[32];
+                snapshotFileName(reload->fileName, snapshotName, sizeof(snapshotName));
+                if (SaveSnapshot(snapshotName, config, reload->hash) < 0){
+                    LOG_WARN("Failed to write configuration snapshot");
+                }
+            }
+            config->source_hash = reload->hash;
+            config->formed = true;
+            nextPhase(reload, ConfigReloadPhase::MATCH);
+            return pending;
+        }
+        case ConfigReloadPhase::MATCH:
+        {
+            ModbusRegisterTable* liveRegs = &live->modbus.registers;
+            if (reload->match == nullptr){
+                reload->match = static_cast<int16_t*>(malloc(max(regs->count, 1) * sizeof(int16_t)));
+                reload->claimed = static_cast<uint8_t*>(calloc(max(liveRegs->count, 1), sizeof(uint8_t)));
+                if (reload->match == nullptr || reload->claimed == nullptr){
+                    return static_cast<int>(ConfigurationManagerErrors::CONFIG_OUT_OF_MEMORY);
+                }
+            }
+
+            //registers are matched by device, type and address and each live register is claimed once, identical
+            //registers are paired first so duplicates find their own, live registers left unclaimed were removed
+            int total = 2 * regs->count + config->modbus.configuration_register_count;
+            for (int n = 0; n < CONFIG_RELOAD_STEP && reload->cursor < total; n++)
+            {
+                int i = reload->cursor++;
+                if (i >= 2 * regs->count){
+                    ModbusConfigParameter* param = &config->modbus.configuration_registers[i - 2 * regs->count];
+                    int j = 0;
+                    while (j < live->modbus.configuration_register_count &&
+                        !sameConfigParameter(*param, live->modbus.configuration_registers[j]))
+                    {
+                        j++;
+                    }
+                    if (j == live->modbus.configuration_register_count){
+                        reload->diff.commands_changed++;
+                    }
+                    continue;
+                }
+
+                bool identical = i < regs->count;
+                if (!identical){
+                    i -= regs->count;
+                    if (reload->match[i] >= 0){
+                        continue;
+                    }
+                }
+                int j = 0;
+                while (j < liveRegs->count && (reload->claimed[j] || liveRegs->device_id[j] != regs->device_id[i] ||
+                    liveRegs->type[j] != regs->type[i] || liveRegs->address[j] != regs->address[i] ||
+                    (identical && !sameTelemetrySettings(regs, i, liveRegs, j))))
+                {
+                    j++;
+                }
+                if (j == liveRegs->count){
+                    reload->match[i] = -1;
+                    if (!identical){
+                        reload->diff.registers_added++;
+                    }
+                    continue;
+                }
+                reload->claimed[j] = 1;
+                reload->match[i] = j;
+                if (identical){
+                    reload->diff.registers_unchanged++;
+                }else{
+                    //published fresh under its new settings
+                    reload->diff.registers_changed++;
+                }
+            }
+            if (reload->cursor < total){
+                return pending;
+            }
+
+            for (int j = 0; j < liveRegs->count; j++)
+            {
+                reload->diff.registers_removed += reload->claimed[j] ? 0 : 1;
+            }
+            diffSettings(live, config, &reload->diff);
+            nextPhase(reload, ConfigReloadPhase::DONE);
+            return static_cast<int>(ConfigurationManagerErrors::SUCCESS);
+        }
+        default:
+            return static_cast<int>(ConfigurationManagerErrors::SUCCESS);
+    }
+}
+
+void ConfigurationManager::CommitReload(ConfigReload* reload)
+{
+    if (reload->diff.unchanged || reload->match == nullptr){
+        return;
+    }
+    //state is copied at the swap so values read while the reload was staged aren't lost
+    ModbusRegisterTable* liveRegs = &reload->live->modbus.registers;
+    ModbusRegisterTable* regs = &reload->staged->modbus.registers;
+    for (int i = 0; i < regs->count; i++)
+    {
+        int j = reload->match[i];
+        if (j < 0){
+            continue;
+        }
+        regs->value[i] = liveRegs->value[j];
+        //changed registers are published fresh under their new settings
+        if (!sameTelemetrySettings(regs, i, liveRegs, j)){
+            continue;
+        }
+        //report by exception carries on from the last value sent
+        regs->last_published[i] = liveRegs->last_published[j];
+        regs->last_publish_ms[i] = liveRegs->last_publish_ms[j];
+        regs->flags[i] |= liveRegs->flags[j] & REGISTER_PUBLISHED;
+    }
+}
+
+void ConfigurationManager::EndReload(ConfigReload* reload)
+{
+    if (reload->file){
+        reload->file.close();
+    }
+    if (reload->staged != nullptr){
+        reload->staged->arena.strings.ReleaseIndex();
+    }
+    reload->scratch.ReleaseIndex();
+    free(reload->scratch.data);
+    reload->scratch = StringPool();
+    free(reload->match);
+    reload->match = nullptr;
+    free(reload->claimed);
+    reload->claimed = nullptr;
+    delete reload->patch;
+    reload->patch = nullptr;
+}
+
 char* ConfigurationManager::GetError(int code)
 {
     char* val;
@@ -223,6 +1263,31 @@ char* ConfigurationManager::GetError(int code)
             break;
         case ConfigurationManagerErrors::CONFIG_FILE_FAILED_OPEN:
             val = "unable to open configuration file";
+            break;
+        case ConfigurationManagerErrors::CONFIG_OUT_OF_MEMORY:
+            val = "not enough memory for the configuration, reduce the number of registers or the length of their names";
+            break;
+        case ConfigurationManagerErrors::CONFIG_PATCH_INVALID:
+            val = "configuration patch must be a json object of register arrays whose entries name a device_id and address";
+            break;
+        case ConfigurationManagerErrors::CONFIG_RELOAD_BUSY:
+            val = "a configuration reload is already in progress";
+            break;
+        case ConfigurationManagerErrors::CONFIG_RELOAD_PENDING:
+            val = "configuration reload in progress";
+            break;
+        case ConfigurationManagerErrors::SNAPSHOT_NOT_FOUND:
+            val = "no configuration snapshot on the card";
+            break;
+        case ConfigurationManagerErrors::SNAPSHOT_INVALID:
+            val = "configuration snapshot is damaged or was written by another firmware version";
+            break;
+        case ConfigurationManagerErrors::SNAPSHOT_STALE:
+            val = "configuration snapshot was made from a different configuration file";
+            break;
+        case ConfigurationManagerErrors::SNAPSHOT_WRITE_FAILED:
+            val = "unable to write the configuration snapshot";
+            break;
         default:
             val = "unrecognized error";
             break;
@@ -231,31 +1296,354 @@ char* ConfigurationManager::GetError(int code)
     return val;
 }
 
-ModbusConfigParameter ConfigurationManager::GetParameter(String topic, struct Config* config)
+/// @brief Feed the device/parameter segments of part of a topic into an FNV-1a hash
+/// @return true once the segment following the parameter name is reached
+bool hashTopicSegments(const char* part, int& slashes, uint32_t& hash)
 {
-    //temp value
-    String s = "";
-    Serial.print("Searching for ");
-    Serial.println(topic);
+    for (const char* c = part; *c != '\0'; c++)
+    {
+        if (*c == '/'){
+            slashes++;
+            //request type follows the parameter segment
+            if (slashes == 4){
+                return true;
+            }
+            //skip the slash ending the app segment
+            if (slashes <= 2){
+                continue;
+            }
+        }
+        if (slashes < 2){
+            continue;
+        }
+        hash ^= static_cast<uint8_t>(*c);
+        hash *= 16777619UL;
+    }
+    return false;
+}
+
+/// @brief Hash the device/parameter segments of a command topic
+/// ex: cmd/vfdctl/vfd1/acceltime/config -> vfd1/acceltime
+/// @param prefix Start of the topic
+/// @param leaf Remainder of the topic, continues where prefix ends
+/// @return FNV-1a hash of the segments, 0 if the topic is not formatted as a command
+uint32_t hashCommandTopic(const char* prefix, const char* leaf)
+{
+    int slashes = 0;
+    uint32_t hash = 2166136261UL;
+    if (hashTopicSegments(prefix, slashes, hash) || hashTopicSegments(leaf, slashes, hash)){
+        return hash;
+    }
+    return 0;
+}
 
-    for (ModbusConfigParameter param : config->modbus.configuration_registers)
+int ConfigurationManager::BuildCommandIndex(struct Config* config)
+{
+    TopicIndex* index = &config->modbus.command_index;
+    ModbusConfigParameter* regs = config->modbus.configuration_registers;
+
+    index->count = 0;
+    for (int i = 0; i < config->modbus.configuration_register_count; i++)
     {
-        s = param.topic;
-        Serial.print("Found ");
-        Serial.println(s);
+        uint32_t hash = hashCommandTopic(regs[i].topic.prefix, regs[i].topic.leaf);
+        if (hash == 0){
+            LOG_WARN("Configuration register topic is not a command topic, skipping: %s%s", regs[i].topic.prefix, regs[i].topic.leaf);
+            continue;
+        }
 
-        if (s.startsWith(topic))
+        //insertion sort by hash
+        int j = index->count;
+        while (j > 0 && index->entries[j - 1].hash > hash)
         {
-            Serial.println("Found match!");
-            Serial.println(param.name);
-            Serial.println(param.device_id);
-            Serial.println(param.address);
-            Serial.println(param.limit_comparison);
+            index->entries[j] = index->entries[j - 1];
+            j--;
+        }
+        index->entries[j].hash = hash;
+        index->entries[j].register_index = i;
+        index->count++;
+    }
+
+    index->formed = true;
+    return index->count;
+}
+
+/// @brief Exact comparison of a pooled topic against a full topic
+bool topicEquals(const PooledTopic& pooled, const char* topic)
+{
+    size_t prefixLen = strlen(pooled.prefix);
+    return strncmp(pooled.prefix, topic, prefixLen) == 0 && strcmp(pooled.leaf, topic + prefixLen) == 0;
+}
+
+ModbusConfigParameter* ConfigurationManager::GetParameter(const char* topic, struct Config* config)
+{
+    TopicIndex* index = &config->modbus.command_index;
+    uint32_t hash = hashCommandTopic(topic, "");
+    if (hash == 0 || !index->formed){
+        return nullptr;
+    }
+
+    //lower bound of the hash
+    int lo = 0;
+    int hi = index->count;
+    while (lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+        if (index->entries[mid].hash < hash){
+            lo = mid + 1;
+        }else{
+            hi = mid;
+        }
+    }
+
+    //collisions are resolved by an exact topic match
+    for (; lo < index->count && index->entries[lo].hash == hash; lo++)
+    {
+        ModbusConfigParameter* param = &config->modbus.configuration_registers[index->entries[lo].register_index];
+        if (topicEquals(param->topic, topic)){
             return param;
         }
     }
-    Serial.print("Unable to find a matching modbus param with topic ");
-    Serial.println(s);
-    //TODO: populate the end of the array with an "errror" config or pass it via ref
-    return ModbusConfigParameter{};
-}
\ No newline at end of file
+    return nullptr;
+}
+
+size_t ConfigurationManager::FormatTopic(const PooledTopic& topic, char* buffer, size_t size)
+{
+    int len = snprintf(buffer, size, "%s%s", topic.prefix, topic.leaf);
+    return len < 0 ? 0 : static_cast<size_t>(len);
+}
+
+int ConfigurationManager::GetBus(struct Config* config, int deviceId)
+{
+    for (int i = 0; i < config->modbus.device_count; i++)
+    {
+        ModbusDeviceTransport* device = &config->modbus.devices[i];
+        if (device->device_id == deviceId && device->transport == eModbusTransport::transport_rtu){
+            return device->bus;
+        }
+    }
+    return 0;
+}
+
+int ConfigurationManager::BuildReadPlan(struct Config* config)
+{
+    ModbusReadPlan* plan = &config->modbus.read_plan;
+    ModbusRegisterTable* regs = &config->modbus.registers;
+    int gap = max(0, config->modbus.max_read_gap);
+
+    //order the registers by bus, device, type, sample interval, then address (insertion sort, tables are small)
+    for (int i = 0; i < regs->count; i++)
+    {
+        int bus = GetBus(config, regs->device_id[i]);
+        int j = i;
+        while (j > 0)
+        {
+            int prev = plan->register_order[j - 1];
+            int prevBus = GetBus(config, regs->device_id[prev]);
+            if (prevBus != bus){
+                if (prevBus < bus){
+                    break;
+                }
+            }
+            else if (regs->device_id[prev] != regs->device_id[i]){
+                if (regs->device_id[prev] < regs->device_id[i]){
+                    break;
+                }
+            }
+            else if (regs->type[prev] != regs->type[i]){
+                if (regs->type[prev] < regs->type[i]){
+                    break;
+                }
+            }
+            else if (regs->sample_interval_ms[prev] != regs->sample_interval_ms[i]){
+                if (regs->sample_interval_ms[prev] < regs->sample_interval_ms[i]){
+                    break;
+                }
+            }
+            else if (regs->address[prev] <= regs->address[i]){
+                break;
+            }
+            plan->register_order[j] = plan->register_order[j - 1];
+            j--;
+        }
+        plan->register_order[j] = i;
+    }
+
+    //walk the ordered registers and open a new span whenever the slave, type or sample interval changes,
+    //the gap to the previous register is too wide or the span would exceed a single request
+    plan->span_count = 0;
+    ModbusReadSpan* span = nullptr;
+    for (int k = 0; k < regs->count; k++)
+    {
+        int reg = plan->register_order[k];
+        int address = regs->address[reg];
+        if (span != nullptr && span->device_id == regs->device_id[reg] && span->type == regs->type[reg] &&
+            span->sample_interval_ms == regs->sample_interval_ms[reg])
+        {
+            int end = span->start_address + span->length;
+            int newLength = address - span->start_address + 1;
+            //a register's worth of unused bits costs the same on the wire as one unused register
+            int allowedGap = isBitType(span->type) ? gap * 16 : gap;
+            if (address - end <= allowedGap && newLength <= MODBUS_MAX_READ_REGISTERS)
+            {
+                //duplicate addresses share the already-read value
+                span->length = max(span->length, newLength);
+                span->member_count++;
+                continue;
+            }
+        }
+
+        span = &plan->spans[plan->span_count++];
+        span->device_id = regs->device_id[reg];
+        span->bus = GetBus(config, span->device_id);
+        span->type = static_cast<eRegisterType>(regs->type[reg]);
+        span->start_address = address;
+        span->length = 1;
+        span->first_member = k;
+        span->member_count = 1;
+        span->sample_interval_ms = regs->sample_interval_ms[reg];
+        span->sample_due_ms = 0;
+    }
+
+    plan->formed = true;
+    return plan->span_count;
+}
+
+int ConfigurationManager::SaveSnapshot(const char* fileName, struct Config* config, uint32_t sourceHash)
+{
+    ConfigArena* arena = &config->arena;
+    SnapshotBody body;
+    body.device = config->device;
+    body.broker = config->broker;
+    body.offset = config->modbus.offset;
+    body.telemetry_interval_sec = config->modbus.telemetry_interval_sec;
+    body.max_read_gap = config->modbus.max_read_gap;
+    body.telemetry_mode = config->modbus.telemetry_mode;
+    body.payload_format = config->modbus.payload_format;
+    body.serial_port_count = config->modbus.serial_port_count;
+    memcpy(body.serial_ports, config->modbus.serial_ports, sizeof(body.serial_ports));
+    body.device_count = config->modbus.device_count;
+    memcpy(body.devices, config->modbus.devices, sizeof(body.devices));
+    body.journal = config->journal;
+    body.telemetry_count = config->modbus.registers.count;
+    body.config_count = config->modbus.configuration_register_count;
+    body.span_count = config->modbus.read_plan.span_count;
+    body.index_count = config->modbus.command_index.count;
+    body.strings_used = arena->strings.used;
+
+    SnapshotHeader header;
+    header.magic = CONFIG_SNAPSHOT_MAGIC;
+    header.version = CONFIG_SNAPSHOT_VERSION;
+    header.header_size = sizeof(SnapshotHeader);
+    header.layout = tableLayout();
+    header.source_hash = sourceHash;
+    header.arena_size = arena->used;
+
+    //strings are written as offsets so the snapshot can be loaded at any address
+    rebaseStrings(config, reinterpret_cast<uintptr_t>(arena->base), 0);
+    header.crc = crc32Update(0, reinterpret_cast<const uint8_t*>(&body), sizeof(body));
+    header.crc = crc32Update(header.crc, arena->base, arena->used);
+
+    SD.remove(fileName);
+    File file = SD.open(fileName, FILE_WRITE);
+    bool written = file &&
+        file.write(reinterpret_cast<const uint8_t*>(&header), sizeof(header)) == sizeof(header) &&
+        file.write(reinterpret_cast<const uint8_t*>(&body), sizeof(body)) == sizeof(body) &&
+        file.write(arena->base, arena->used) == arena->used;
+    rebaseStrings(config, 0, reinterpret_cast<uintptr_t>(arena->base));
+    if (file){
+        file.close();
+    }
+
+    if (!written){
+        SD.remove(fileName);
+        return static_cast<int>(ConfigurationManagerErrors::SNAPSHOT_WRITE_FAILED);
+    }
+    return static_cast<int>(ConfigurationManagerErrors::SUCCESS);
+}
+
+int ConfigurationManager::LoadSnapshot(const char* fileName, struct Config* config, uint32_t sourceHash)
+{
+    if (!SD.exists(fileName)){
+        return static_cast<int>(ConfigurationManagerErrors::SNAPSHOT_NOT_FOUND);
+    }
+    File file = SD.open(fileName);
+    if (!file){
+        return static_cast<int>(ConfigurationManagerErrors::SNAPSHOT_NOT_FOUND);
+    }
+
+    SnapshotHeader header;
+    SnapshotBody body;
+    if (file.read(reinterpret_cast<uint8_t*>(&header), sizeof(header)) != sizeof(header) ||
+        header.magic != CONFIG_SNAPSHOT_MAGIC || header.version != CONFIG_SNAPSHOT_VERSION ||
+        header.header_size != sizeof(SnapshotHeader) || header.layout != tableLayout() ||
+        file.read(reinterpret_cast<uint8_t*>(&body), sizeof(body)) != sizeof(body))
+    {
+        file.close();
+        return static_cast<int>(ConfigurationManagerErrors::SNAPSHOT_INVALID);
+    }
+    if (header.source_hash != sourceHash){
+        file.close();
+        return static_cast<int>(ConfigurationManagerErrors::SNAPSHOT_STALE);
+    }
+
+    //rebuild the table pointers first, the arena contents are then read over them
+    ConfigArena* arena = &config->arena;
+    bool allocated = arena->Begin(header.arena_size) &&
+        arena->ReserveStrings(body.strings_used) &&
+        allocateTables(config, body.telemetry_count, body.config_count) &&
+        arena->used == header.arena_size;
+    if (!allocated){
+        arena->Release();
+        file.close();
+        return static_cast<int>(ConfigurationManagerErrors::SNAPSHOT_INVALID);
+    }
+    size_t len = readFully(file, arena->base, header.arena_size);
+    file.close();
+
+    uint32_t crc = crc32Update(0, reinterpret_cast<const uint8_t*>(&body), sizeof(body));
+    crc = crc32Update(crc, arena->base, header.arena_size);
+    if (len != header.arena_size || crc != header.crc){
+        arena->Release();
+        return static_cast<int>(ConfigurationManagerErrors::SNAPSHOT_INVALID);
+    }
+
+    //settings are copied field by field, key names point at this build's literals
+    const char* mac = config->device.device_mac.key;
+    const char* device = config->device.key;
+    config->device = body.device;
+    config->device.key = device;
+    config->device.device_mac.key = mac;
+
+    const char* broker = config->broker.key;
+    config->broker = body.broker;
+    config->broker.key = broker;
+
+    const char* serialPort = config->modbus.serial_ports[0].key;
+    config->modbus.serial_port_count = body.serial_port_count;
+    for (int i = 0; i < MODBUS_MAX_SERIAL_BUSES; i++)
+    {
+        config->modbus.serial_ports[i] = body.serial_ports[i];
+        config->modbus.serial_ports[i].key = serialPort;
+    }
+
+    const char* journal = config->journal.key;
+    config->journal = body.journal;
+    config->journal.key = journal;
+
+    config->modbus.device_count = body.device_count;
+    memcpy(config->modbus.devices, body.devices, sizeof(body.devices));
+    config->modbus.offset = body.offset;
+    config->modbus.telemetry_interval_sec = body.telemetry_interval_sec;
+    config->modbus.max_read_gap = body.max_read_gap;
+    config->modbus.telemetry_mode = body.telemetry_mode;
+    config->modbus.payload_format = body.payload_format;
+
+    config->modbus.read_plan.span_count = body.span_count;
+    config->modbus.read_plan.formed = true;
+    config->modbus.command_index.count = body.index_count;
+    config->modbus.command_index.formed = true;
+    rebaseStrings(config, 0, reinterpret_cast<uintptr_t>(arena->base));
+    config->modbus.formed = true;
+
+    return static_cast<int>(ConfigurationManagerErrors::SUCCESS);
+}
@@ -6,6 +6,7 @@
 #include <Arduino.h>
 #include <ArduinoJson.h>
 #include <SD.h>
+#include "ConfigArena.h"
 
 /// @brief Comparison modes for two integers
 enum eLimitComparison
@@ -19,6 +20,21 @@ enum eLimitComparison
     less_than_or_equal
 };
 
+/// @brief How telemetry values are grouped into MQTT messages
+enum eTelemetryMode
+{
+    per_register = 0,
+    per_device
+};
+
+/// @brief Encoding of telemetry and command response payloads
+enum ePayloadFormat
+{
+    payload_json = 0,
+    //name and units are left to a retained schema message per topic
+    payload_msgpack
+};
+
 /// @brief MQTT broker and connection information
 struct BrokerConfiguration
 {
@@ -31,6 +47,45 @@ struct BrokerConfiguration
     int broker_retry_interval_sec;
 };
 
+/// @brief Modbus data tables, coils and discrete inputs are single bits read as packed groups
+enum eRegisterType
+{
+    holding_register = 0,
+    input_register,
+    coil,
+    discrete_input
+};
+
+/// @brief How a slave is reached
+enum eModbusTransport
+{
+    transport_rtu = 0,
+    transport_tcp
+};
+
+//tcp slaves, each holds an ethernet socket
+#define MODBUS_MAX_TCP_DEVICES 4
+//slaves given their own transport entry, tcp or rtu
+#define MODBUS_MAX_DEVICES 16
+//RS-485 segments a configuration may describe, this controller drives the first one
+#define MODBUS_MAX_SERIAL_BUSES 6
+
+/// @brief Per slave transport, slaves without an entry are polled over the first serial bus
+struct ModbusDeviceTransport
+{
+    int device_id;
+    eModbusTransport transport;
+    //serial bus of an rtu slave, index into ModbusConfiguration::serial_ports
+    int bus;
+    //dotted IPv4 address of the slave or its gateway, ex: 192.168.1.40
+    char host[16];
+    int port;
+    //requests kept in flight on the connection
+    int max_inflight;
+    //response timeout, 0 = rtu slaves adapt it to their measured response time
+    int timeout_ms;
+};
+
 /// @brief Serial port connection information
 struct SerialPortConfiguration
 {
@@ -38,6 +93,7 @@ struct SerialPortConfiguration
     const char* key = "serial_port";
     int baud_rate = 9600;
     int data_bits = 8;
+    //0 = none, 1 = odd, 2 = even
     int parity_bits = 0;
     int stop_bits = 1;
     bool flow_control = false;
@@ -65,27 +121,81 @@ struct DeviceConfiguration
     uint8_t ethernet_pin = 5;
 };
 
-/// @brief Telemetry (publish-only) register configuration
-struct ModbusParameter
+/// @brief Store-and-forward of telemetry sampled while the broker is unreachable
+struct JournalConfiguration
 {
     bool formed = false;
+    const char* key = "journal";
+    bool enabled;
+    //ring size on the SD card, the oldest records are overwritten once full
+    long max_records;
+    //longest a buffered record waits before it is written to the card
+    int flush_interval_sec;
+    //records published per second while catching up after a reconnect
+    int replay_rate_per_sec;
+};
+
+/// @brief Topic split into an interned app/device prefix (ex: dt/vfdctl/vfd1/) and leaf (ex: amps)
+struct PooledTopic
+{
+    const char* prefix;
+    const char* leaf;
+};
+
+/// @brief Telemetry (publish-only) register metadata, only needed when publishing
+struct ModbusParameter
+{
+    const char* name;
+    const char* units;
+    PooledTopic topic;
+};
+
+//ModbusRegisterTable::flags bits
+#define REGISTER_DEADBAND_PERCENT 0x01
+#define REGISTER_PUBLISHED 0x02
+#define REGISTER_REPORT_BY_EXCEPTION 0x04
+#define REGISTER_BATCH_PENDING 0x08
+
+/// @brief Samples of a register taken since it was last published
+struct SampleWindow
+{
+    int32_t min;
+    int32_t max;
+    int64_t sum;
+    uint16_t count;
+};
+
+/// @brief Telemetry registers, fields used by the poll loop are kept in parallel arrays
+struct ModbusRegisterTable
+{
     const char* key = "telemetry_registers";
-    char name[32];
-    char units[16];
-    char topic[64];
-    int address;
-    int value;
-    int device_id;
+    int count = 0;
+    ModbusParameter* meta;
+    uint16_t* address;
+    uint8_t* device_id;
+    //eRegisterType
+    uint8_t* type;
+    //last value read from the device
+    int32_t* value;
+    //report by exception: change needed before publishing again, absolute or hundredths of a percent
+    uint16_t* deadband;
+    //heartbeat, publish at least this often even when unchanged (0 = no heartbeat)
+    uint16_t* max_silence_sec;
+    int32_t* last_published;
+    uint32_t* last_publish_ms;
+    uint8_t* flags;
+    //read this often between publishes and published as min/max/mean (0 = read once per publish)
+    uint16_t* sample_interval_ms;
+    SampleWindow* window;
 };
 
 /// @brief Configuration (command-response) register setup
 struct ModbusConfigParameter
 {
-    bool formed = false;
-    const char* key = "configuration_registers";
-    char name[32];
-    char units[16];
-    char topic[64];
+    const char* name;
+    const char* units;
+    PooledTopic topic;
+    eRegisterType type;
     int address;
     int value;
     int device_id;
@@ -94,6 +204,53 @@ struct ModbusConfigParameter
     eLimitComparison limit_comparison;
 };
 
+//largest number of registers a single function 0x03/0x04 request may return
+//bit reads (0x01/0x02) are held to the same count so every span fits one buffer
+#define MODBUS_MAX_READ_REGISTERS 125
+
+/// @brief Contiguous block of a single type fetched with a single read request
+struct ModbusReadSpan
+{
+    int device_id;
+    //serial bus of the slave, spans of a bus are contiguous
+    int bus;
+    eRegisterType type;
+    int start_address;
+    int length;
+    //position in ModbusReadPlan::register_order of the first register served by this span
+    int first_member;
+    int member_count;
+    //shared by every member, spans are split where the interval changes (0 = not sampled)
+    uint16_t sample_interval_ms;
+    //millis() of the next sample
+    uint32_t sample_due_ms;
+};
+
+/// @brief Telemetry registers grouped into the fewest block reads per slave
+struct ModbusReadPlan
+{
+    bool formed = false;
+    int span_count;
+    ModbusReadSpan* spans;
+    //telemetry register indices ordered by bus, device_id, type, sample interval, then address
+    uint16_t* register_order;
+};
+
+/// @brief Command topic lookup entry, keyed on the topic's device/parameter segments
+struct TopicIndexEntry
+{
+    uint32_t hash;
+    int register_index;
+};
+
+/// @brief Configuration registers sorted by topic hash for binary search
+struct TopicIndex
+{
+    bool formed = false;
+    int count;
+    TopicIndexEntry* entries;
+};
+
 /// @brief Parent of all types of Modbus registers
 struct ModbusConfiguration
 {
@@ -101,9 +258,21 @@ struct ModbusConfiguration
     const char* key = "modbus";
     int offset;
     int telemetry_interval_sec;
-    SerialPortConfiguration serial_port;
-    ModbusParameter registers[50];
-    ModbusConfigParameter configuration_registers[50];
+    //unused registers allowed between two telemetry registers before a block read is split
+    int max_read_gap;
+    //one message per register or one message per device_id per cycle
+    eTelemetryMode telemetry_mode;
+    ePayloadFormat payload_format;
+    //one entry per RS-485 segment, a single serial_port object is bus 0
+    int serial_port_count = 1;
+    SerialPortConfiguration serial_ports[MODBUS_MAX_SERIAL_BUSES];
+    int device_count = 0;
+    ModbusDeviceTransport devices[MODBUS_MAX_DEVICES];
+    ModbusRegisterTable registers;
+    int configuration_register_count = 0;
+    ModbusConfigParameter* configuration_registers;
+    ModbusReadPlan read_plan;
+    TopicIndex command_index;
 };
 
 // Never use a JsonDocument to store the configuration!
@@ -116,6 +285,92 @@ struct Config
     struct DeviceConfiguration device;
     struct BrokerConfiguration broker;
     struct ModbusConfiguration modbus;
+    struct JournalConfiguration journal;
+    //backing storage for every register table and string in the configuration
+    struct ConfigArena arena;
+    //crc32 of the json source this configuration was loaded from
+    uint32_t source_hash;
+};
+
+//bump whenever Config or the register table layout changes, older snapshots are rebuilt from json
+#define CONFIG_SNAPSHOT_VERSION 10
+
+/// @brief What a reload changed compared to the live configuration
+struct ConfigDiff
+{
+    //the file hasn't changed since the live configuration was loaded
+    bool unchanged;
+    //telemetry registers matched on device, type and address
+    int registers_unchanged;
+    int registers_changed;
+    int registers_added;
+    int registers_removed;
+    //configuration registers without an identical entry in the live configuration
+    int commands_changed;
+    //a serial port or the tcp slaves differ, their transports must be started again
+    bool serial_port_changed;
+    bool devices_changed;
+    //device or broker settings differ, they only take effect after a restart
+    bool restart_required;
+};
+
+//register entries loaded, sized or matched per scheduler pass while a reload is staged
+#define CONFIG_RELOAD_STEP 16
+//bytes of the configuration file hashed per scheduler pass
+#define CONFIG_RELOAD_HASH_CHUNK 1024
+//entries a patch may list per register array
+#define CONFIG_PATCH_MAX_ENTRIES 32
+#define CONFIG_PATCH_DOC_SIZE 1024
+//settings without the register arrays, counted in json slots so a 64-bit build (the Linux gateway) fits
+//as many serial ports and devices as the controller, 1536 bytes on the controller
+#define CONFIG_SETTINGS_DOC_SIZE JSON_OBJECT_SIZE(96)
+
+/// @brief Steps of a load, a reload takes one step per scheduler pass
+enum class ConfigReloadPhase
+{
+    HASH,
+    SETTINGS,
+    SIZE_TELEMETRY,
+    SIZE_CONFIG,
+    ALLOCATE,
+    FILL_TELEMETRY,
+    FILL_CONFIG,
+    INDEX,
+    MATCH,
+    DONE
+};
+
+/// @brief A configuration loaded next to the live one a few registers at a time
+/// Staged from conf.txt or from a patch of the live configuration, live is only read until CommitReload().
+struct ConfigReload
+{
+    ConfigReloadPhase phase;
+    Config* live;
+    Config* staged;
+    char* fileName;
+    File file;
+    uint32_t hash;
+    //register array entries to merge into the live ones, nullptr when conf.txt is loaded
+    StaticJsonDocument<CONFIG_PATCH_DOC_SIZE>* patch;
+    //patch entries that matched a live register, bit per entry
+    uint32_t patch_matched[2];
+    //registers taken from the array being streamed, and whether the stream has more
+    int cursor;
+    bool more;
+    //live register or patch entry a patched array continues from
+    int source;
+    int telemetry_count;
+    int config_count;
+    //every string interned once while sizing, becomes the start of the staged arena
+    StringPool scratch;
+    bool scratch_ok;
+    StaticJsonDocument<512> element;
+    StaticJsonDocument<256> filter;
+    //live register each staged register carries its state from, -1 = added
+    int16_t* match;
+    //live registers claimed by a staged register, a live register is claimed at most once
+    uint8_t* claimed;
+    ConfigDiff diff;
 };
 
 enum class ConfigurationManagerErrors 
@@ -123,6 +378,15 @@ enum class ConfigurationManagerErrors
     SUCCESS,
     CONFIG_FILE_NOT_FOUND = -100,
     CONFIG_FILE_FAILED_OPEN,
+    CONFIG_OUT_OF_MEMORY,
+    CONFIG_PATCH_INVALID,
+    CONFIG_RELOAD_BUSY,
+    //a reload step finished, more steps follow
+    CONFIG_RELOAD_PENDING,
+    SNAPSHOT_NOT_FOUND = -150,
+    SNAPSHOT_INVALID,
+    SNAPSHOT_STALE,
+    SNAPSHOT_WRITE_FAILED,
     SD_INIT_FAILED = -200,
 };
 
@@ -134,14 +398,38 @@ class ConfigurationManager
         int Init(bool resetSsPinMode, int sdCardSsPin);
         //load the configuration from disk
         int Load(char *configFileName, struct Config* config);
+        //stage conf.txt next to the live configuration, loaded by StepReload()
+        int BeginReload(ConfigReload* reload, char *configFileName, struct Config* live, struct Config* staged);
+        //stage the live configuration with a patch applied, loaded by StepReload()
+        int BeginPatch(ConfigReload* reload, const char* patch, size_t length, struct Config* live, struct Config* staged);
+        //take the next load step, CONFIG_RELOAD_PENDING until staged is complete and diffed against live
+        int StepReload(ConfigReload* reload);
+        //carry the live register state over to staged, call right before staged replaces live
+        void CommitReload(ConfigReload* reload);
+        //close the file and free what the reload held, staged is left to the caller
+        void EndReload(ConfigReload* reload);
         //get a readable error msg
         char* GetError(int code);
         //convert enum to string equivalent
         String toString(eLimitComparison mode);
         //eLimitComparison from(JsonVariantConst mode);
-        ModbusConfigParameter GetParameter(String topic, struct Config* config);
+        //find the configuration register matching a command topic, nullptr if not found
+        ModbusConfigParameter* GetParameter(const char* topic, struct Config* config);
+        //write the full topic into buffer, returns the topic length
+        size_t FormatTopic(const PooledTopic& topic, char* buffer, size_t size);
+        //serial bus a slave is polled on, slaves without an rtu entry are on bus 0
+        int GetBus(struct Config* config, int deviceId);
+        //group telemetry registers into block reads
+        int BuildReadPlan(struct Config* config);
+        //index configuration registers by command topic
+        int BuildCommandIndex(struct Config* config);
     private:
         int _sdCardSsPin;
+        //parse the json source, slow path used when no valid snapshot exists
+        int ParseJson(char *configFileName, struct Config* config);
+        //binary image of a parsed configuration, keyed by the hash of its json source
+        int SaveSnapshot(const char* fileName, struct Config* config, uint32_t sourceHash);
+        int LoadSnapshot(const char* fileName, struct Config* config, uint32_t sourceHash);
 };
 
 extern ConfigurationManager ConfigMgr;	//Default class instance
@@ -0,0 +1,200 @@
+#include "Diagnostics.h"
+#include <stdarg.h>
+
+#ifdef __arm__
+extern "C" char* sbrk(int incr);
+#endif
+
+//unused stack is filled with this byte, the first changed byte marks the deepest the stack has reached
+#define DIAG_STACK_PATTERN 0xA5
+//left untouched below the current stack pointer while painting
+#define DIAG_STACK_MARGIN 64
+
+Diagnostics::Diagnostics(){
+    Reset();
+}
+
+Diagnostics Diag;
+
+void Diagnostics::Reset()
+{
+    //first bucket: 32us loop, 16ms telemetry cycle, 8ms command, 512us transaction
+    Clear(&_loopUs, 5);
+    Clear(&_cycleMs, 4);
+    Clear(&_commandMs, 3);
+    _slaveCount = 0;
+    _untracked = 0;
+    _intervalStart = millis();
+}
+
+void Diagnostics::RecordLoop(unsigned long micros)
+{
+    Record(&_loopUs, micros);
+}
+
+void Diagnostics::RecordTelemetryCycle(unsigned long ms)
+{
+    Record(&_cycleMs, ms);
+}
+
+void Diagnostics::RecordCommandLatency(unsigned long ms)
+{
+    Record(&_commandMs, ms);
+}
+
+void Diagnostics::RecordTransaction(int deviceId, unsigned long micros, eTransactionResult result)
+{
+    //a bus rarely has more than a handful of slaves, a linear scan beats anything clever
+    SlaveStats* slave = nullptr;
+    for (int i = 0; i < _slaveCount; i++)
+    {
+        if (_slaves[i].device_id == deviceId){
+            slave = &_slaves[i];
+            break;
+        }
+    }
+    if (slave == nullptr){
+        if (_slaveCount >= DIAG_MAX_SLAVES){
+            _untracked++;
+            return;
+        }
+        slave = &_slaves[_slaveCount++];
+        slave->device_id = deviceId;
+        slave->transactions = 0;
+        slave->timeouts = 0;
+        slave->crc_errors = 0;
+        slave->errors = 0;
+        Clear(&slave->latency_us, 9);
+    }
+
+    slave->transactions++;
+    switch (result)
+    {
+        case eTransactionResult::transaction_ok:
+            Record(&slave->latency_us, micros);
+            break;
+        case eTransactionResult::transaction_timeout:
+            slave->timeouts++;
+            break;
+        case eTransactionResult::transaction_crc_error:
+            slave->crc_errors++;
+            break;
+        default:
+            slave->errors++;
+            break;
+    }
+}
+
+/// @brief Written straight into the payload buffer, a document tree of every histogram would need about 3 KB of stack
+/// ex: "interval_s":60,"loop_us":{...},"cycle_ms":{...},"cmd_ms":{...},"slaves":[{"id":2,"n":600,"timeout":0,"crc":0,"err":0,"us":{...}}]
+size_t Diagnostics::Serialize(char* buffer, size_t size, size_t len)
+{
+    len = Append(buffer, size, len, "\"interval_s\":%lu,", (millis() - _intervalStart) / 1000);
+    len = Serialize(buffer, size, len, "loop_us", _loopUs);
+    len = Append(buffer, size, len, ",");
+    len = Serialize(buffer, size, len, "cycle_ms", _cycleMs);
+    len = Append(buffer, size, len, ",");
+    len = Serialize(buffer, size, len, "cmd_ms", _commandMs);
+
+    len = Append(buffer, size, len, ",\"slaves\":[");
+    for (int i = 0; i < _slaveCount; i++)
+    {
+        len = Append(buffer, size, len, "%s{\"id\":%d,\"n\":%lu,\"timeout\":%lu,\"crc\":%lu,\"err\":%lu,",
+            i == 0 ? "" : ",", _slaves[i].device_id, (unsigned long)_slaves[i].transactions, (unsigned long)_slaves[i].timeouts,
+            (unsigned long)_slaves[i].crc_errors, (unsigned long)_slaves[i].errors);
+        len = Serialize(buffer, size, len, "us", _slaves[i].latency_us);
+        len = Append(buffer, size, len, "}");
+    }
+    len = Append(buffer, size, len, "]");
+    if (_untracked > 0){
+        len = Append(buffer, size, len, ",\"untracked\":%lu", (unsigned long)_untracked);
+    }
+    return len;
+}
+
+/// @brief ex: "loop_us":{"base":32,"max":870,"h":[1200,40,3,0,0,0,0,0,0,0]}
+size_t Diagnostics::Serialize(char* buffer, size_t size, size_t len, const char* key, const Histogram& histogram)
+{
+    len = Append(buffer, size, len, "\"%s\":{\"base\":%lu,\"max\":%lu,\"h\":[", key, 1UL << histogram.shift, (unsigned long)histogram.max);
+    for (int i = 0; i < DIAG_HISTOGRAM_BUCKETS; i++)
+    {
+        len = Append(buffer, size, len, i == 0 ? "%lu" : ",%lu", (unsigned long)histogram.counts[i]);
+    }
+    return Append(buffer, size, len, "]}");
+}
+
+size_t Diagnostics::Append(char* buffer, size_t size, size_t len, const char* format, ...)
+{
+    //once full every further append is skipped, the caller checks the length once at the end
+    if (len >= size){
+        return len;
+    }
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(buffer + len, size - len, format, args);
+    va_end(args);
+    if (written < 0){
+        return size;
+    }
+    return len + written;
+}
+
+void Diagnostics::Record(Histogram* histogram, unsigned long value)
+{
+    if (value > histogram->max){
+        histogram->max = value;
+    }
+    unsigned long scaled = value >> histogram->shift;
+    int bucket = 0;
+    while (scaled != 0 && bucket < DIAG_HISTOGRAM_BUCKETS - 1)
+    {
+        scaled >>= 1;
+        bucket++;
+    }
+    histogram->counts[bucket]++;
+}
+
+void Diagnostics::Clear(Histogram* histogram, uint8_t shift)
+{
+    histogram->shift = shift;
+    histogram->max = 0;
+    memset(histogram->counts, 0, sizeof(histogram->counts));
+}
+
+int Diagnostics::FreeMemory()
+{
+#ifdef __arm__
+    char top;
+    return &top - sbrk(0);
+#else
+    return -1;
+#endif
+}
+
+void Diagnostics::PaintStack()
+{
+#ifdef __arm__
+    char top;
+    char* heapEnd = sbrk(0);
+    for (char* p = heapEnd; p < &top - DIAG_STACK_MARGIN; p++)
+    {
+        *p = DIAG_STACK_PATTERN;
+    }
+#endif
+}
+
+int Diagnostics::StackHighWater()
+{
+#ifdef __arm__
+    char top;
+    char* heapEnd = sbrk(0);
+    char* p = heapEnd;
+    while (p < &top && *p == static_cast<char>(DIAG_STACK_PATTERN))
+    {
+        p++;
+    }
+    return p - heapEnd;
+#else
+    return -1;
+#endif
+}
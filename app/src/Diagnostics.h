@@ -0,0 +1,79 @@
+#ifndef Diagnostics_h
+#define Diagnostics_h
+
+#include "Arduino.h"
+
+#define DIAG_HISTOGRAM_BUCKETS 10
+//slaves tracked individually, transactions with further slaves are only counted as untracked
+#define DIAG_MAX_SLAVES 4
+//how often the diagnostics message is published
+#define DIAG_PUBLISH_INTERVAL_MS 60000
+
+/// @brief Power of two histogram, bucket 0 holds values below 2^shift and every bucket after doubles
+/// The last bucket also holds everything larger.
+struct Histogram
+{
+    uint8_t shift;
+    uint32_t max;
+    uint32_t counts[DIAG_HISTOGRAM_BUCKETS];
+};
+
+/// @brief How a Modbus transaction ended
+enum eTransactionResult
+{
+    transaction_ok = 0,
+    transaction_timeout,
+    transaction_crc_error,
+    transaction_error
+};
+
+/// @brief Modbus statistics for a single slave
+struct SlaveStats
+{
+    int device_id;
+    uint32_t transactions;
+    uint32_t timeouts;
+    uint32_t crc_errors;
+    uint32_t errors;
+    Histogram latency_us;
+};
+
+/// @brief Counters and histograms describing the controller's behaviour in the field
+/// Recording is a bucket increment, everything is reset once the interval has been published.
+class Diagnostics
+{
+    public:
+        Diagnostics();
+        //clear every counter, the interval starts now
+        void Reset();
+        void RecordLoop(unsigned long micros);
+        void RecordTelemetryCycle(unsigned long ms);
+        void RecordCommandLatency(unsigned long ms);
+        void RecordTransaction(int deviceId, unsigned long micros, eTransactionResult result);
+        //append the histograms and slave statistics of the current interval as json members, returns the new length
+        size_t Serialize(char* buffer, size_t size, size_t len);
+        //printf onto the end of buffer, returns the new length, >= size once the text no longer fits
+        static size_t Append(char* buffer, size_t size, size_t len, const char* format, ...) __attribute__((format(printf, 4, 5)));
+        //bytes between the top of the heap and the stack
+        static int FreeMemory();
+        //fill unused stack with a pattern, call once as early as possible
+        static void PaintStack();
+        //smallest gap the stack has left above the heap since PaintStack
+        static int StackHighWater();
+    private:
+        Histogram _loopUs;
+        Histogram _cycleMs;
+        Histogram _commandMs;
+        int _slaveCount;
+        SlaveStats _slaves[DIAG_MAX_SLAVES];
+        //transactions with slaves beyond DIAG_MAX_SLAVES
+        uint32_t _untracked;
+        unsigned long _intervalStart;
+        static void Record(Histogram* histogram, unsigned long value);
+        static void Clear(Histogram* histogram, uint8_t shift);
+        static size_t Serialize(char* buffer, size_t size, size_t len, const char* key, const Histogram& histogram);
+};
+
+extern Diagnostics Diag;	//Default class instance
+
+#endif
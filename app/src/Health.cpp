@@ -0,0 +1,198 @@
+#include "Health.h"
+#include "Log.h"
+
+HealthMonitor::HealthMonitor(){
+    memset(_failed, 0, sizeof(_failed));
+    memset(_failedAt, 0, sizeof(_failedAt));
+    memset(_stats, 0, sizeof(_stats));
+    _slaveCount = 0;
+    _changed = false;
+}
+
+HealthMonitor Health;
+
+void HealthMonitor::Fail(eSubsystem subsystem)
+{
+    if (_failed[subsystem]){
+        return;
+    }
+    LOG_WARN("%s failed", toString(subsystem));
+    _failed[subsystem] = true;
+    _failedAt[subsystem] = millis();
+    _stats[subsystem].failures++;
+    _changed = true;
+}
+
+void HealthMonitor::Recover(eSubsystem subsystem)
+{
+    if (!_failed[subsystem]){
+        return;
+    }
+    unsigned long downMs = millis() - _failedAt[subsystem];
+    LOG_INFO("%s recovered after %lu ms", toString(subsystem), downMs);
+    _failed[subsystem] = false;
+    RecordRecovery(subsystem, downMs);
+    _changed = true;
+}
+
+bool HealthMonitor::IsFailed(eSubsystem subsystem)
+{
+    return _failed[subsystem];
+}
+
+RecoveryStats HealthMonitor::GetStats(eSubsystem subsystem)
+{
+    return _stats[subsystem];
+}
+
+bool HealthMonitor::SlaveReady(int deviceId)
+{
+    SlaveHealth* slave = FindSlave(deviceId, false);
+    return slave == nullptr || !slave->degraded || (long)(millis() - slave->retry_at) >= 0;
+}
+
+bool HealthMonitor::SlaveResult(int deviceId, bool ok)
+{
+    SlaveHealth* slave = FindSlave(deviceId, !ok);
+    if (slave == nullptr){
+        return false;
+    }
+
+    if (ok){
+        if (slave->degraded){
+            unsigned long downMs = millis() - slave->degraded_at;
+            LOG_INFO("slave %d recovered after %lu ms", deviceId, downMs);
+            RecordRecovery(eSubsystem::subsystem_slave, downMs);
+            slave->degraded = false;
+            _changed = true;
+        }
+        slave->failures = 0;
+        return false;
+    }
+
+    if (slave->failures < UINT16_MAX){
+        slave->failures++;
+    }
+    if (slave->failures < HEALTH_SLAVE_DEGRADED_AFTER){
+        return false;
+    }
+
+    //each failed retry doubles the wait, a dead slave costs one timeout per backoff period
+    int doublings = min(slave->failures - HEALTH_SLAVE_DEGRADED_AFTER, 16);
+    unsigned long backoffMs = min(static_cast<unsigned long>(HEALTH_SLAVE_MIN_BACKOFF_MS) << doublings,
+        static_cast<unsigned long>(HEALTH_SLAVE_MAX_BACKOFF_MS));
+    slave->retry_at = millis() + backoffMs;
+    if (slave->degraded){
+        return false;
+    }
+
+    LOG_WARN("slave %d degraded after %d failures, retrying in %lu ms", deviceId, slave->failures, backoffMs);
+    slave->degraded = true;
+    slave->degraded_at = millis();
+    _stats[eSubsystem::subsystem_slave].failures++;
+    _changed = true;
+    return true;
+}
+
+int HealthMonitor::GetDegradedCount()
+{
+    int count = 0;
+    for (int i = 0; i < _slaveCount; i++)
+    {
+        if (_slaves[i].degraded){
+            count++;
+        }
+    }
+    return count;
+}
+
+bool HealthMonitor::IsChanged()
+{
+    return _changed;
+}
+
+void HealthMonitor::ClearChanged()
+{
+    _changed = false;
+}
+
+/// @brief ex: "storage":{"ok":true,"failures":1,"mttr_ms":5300,"max_ms":5300},"slaves":[{"id":2,"failures":7,"retry_ms":40000}]
+void HealthMonitor::Serialize(JsonObject root)
+{
+    for (int i = 0; i < HEALTH_SUBSYSTEM_COUNT; i++)
+    {
+        eSubsystem subsystem = static_cast<eSubsystem>(i);
+        JsonObject obj = root.createNestedObject(toString(subsystem));
+        if (subsystem == eSubsystem::subsystem_slave){
+            obj["degraded"] = GetDegradedCount();
+        }else{
+            obj["ok"] = !_failed[i];
+        }
+        obj["failures"] = _stats[i].failures;
+        obj["mttr_ms"] = _stats[i].recoveries > 0 ? _stats[i].total_ms / _stats[i].recoveries : 0;
+        obj["max_ms"] = _stats[i].max_ms;
+    }
+
+    JsonArray slaves = root.createNestedArray("slaves");
+    for (int i = 0; i < _slaveCount; i++)
+    {
+        if (!_slaves[i].degraded){
+            continue;
+        }
+        JsonObject slave = slaves.createNestedObject();
+        slave["id"] = _slaves[i].device_id;
+        slave["failures"] = _slaves[i].failures;
+        long retryMs = _slaves[i].retry_at - millis();
+        slave["retry_ms"] = retryMs > 0 ? retryMs : 0;
+    }
+}
+
+const char* HealthMonitor::toString(eSubsystem subsystem)
+{
+    switch (subsystem)
+    {
+        case eSubsystem::subsystem_storage:
+            return "storage";
+        case eSubsystem::subsystem_modbus:
+            return "modbus";
+        case eSubsystem::subsystem_ethernet:
+            return "ethernet";
+        case eSubsystem::subsystem_mqtt:
+            return "mqtt";
+        case eSubsystem::subsystem_slave:
+            return "slave";
+        default:
+            return "unknown";
+    }
+}
+
+/// @brief Find a slave's entry, optionally adding it, nullptr once the table is full
+SlaveHealth* HealthMonitor::FindSlave(int deviceId, bool add)
+{
+    for (int i = 0; i < _slaveCount; i++)
+    {
+        if (_slaves[i].device_id == deviceId){
+            return &_slaves[i];
+        }
+    }
+    if (!add || _slaveCount >= HEALTH_MAX_SLAVES){
+        return nullptr;
+    }
+    SlaveHealth* slave = &_slaves[_slaveCount++];
+    slave->device_id = deviceId;
+    slave->failures = 0;
+    slave->degraded = false;
+    slave->degraded_at = 0;
+    slave->retry_at = 0;
+    return slave;
+}
+
+void HealthMonitor::RecordRecovery(eSubsystem subsystem, unsigned long ms)
+{
+    RecoveryStats* stats = &_stats[subsystem];
+    stats->recoveries++;
+    stats->total_ms += ms;
+    if (ms > stats->max_ms){
+        stats->max_ms = ms;
+    }
+}
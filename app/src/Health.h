@@ -0,0 +1,87 @@
+#ifndef Health_h
+#define Health_h
+
+#include "Arduino.h"
+#include <ArduinoJson.h>
+
+//slaves whose failures are tracked, further slaves are always polled
+#define HEALTH_MAX_SLAVES 8
+//consecutive failed transactions before a slave is degraded
+#define HEALTH_SLAVE_DEGRADED_AFTER 3
+//first wait before a degraded slave is polled again, doubled per failed retry
+#define HEALTH_SLAVE_MIN_BACKOFF_MS 5000
+#define HEALTH_SLAVE_MAX_BACKOFF_MS 300000
+
+/// @brief Failure classes, each recovers without touching the others
+enum eSubsystem
+{
+    //SD card, configuration and journal
+    subsystem_storage = 0,
+    //serial port driving the RTU bus
+    subsystem_modbus,
+    //DHCP lease and link
+    subsystem_ethernet,
+    //broker connection
+    subsystem_mqtt,
+    //individual slaves, tracked per device
+    subsystem_slave
+};
+#define HEALTH_SUBSYSTEM_COUNT 5
+
+/// @brief How often a failure class has failed and how long it took to come back
+struct RecoveryStats
+{
+    uint32_t failures;
+    uint32_t recoveries;
+    uint32_t total_ms;
+    uint32_t max_ms;
+};
+
+/// @brief Consecutive failures of a single slave
+struct SlaveHealth
+{
+    int device_id;
+    uint16_t failures;
+    bool degraded;
+    unsigned long degraded_at;
+    unsigned long retry_at;
+};
+
+/// @brief Health of every subsystem, recovery only re-initializes what has failed
+class HealthMonitor
+{
+    public:
+        HealthMonitor();
+        //a subsystem stopped working, the first failure starts its recovery clock
+        void Fail(eSubsystem subsystem);
+        //a subsystem is working again, its time to recovery is recorded
+        void Recover(eSubsystem subsystem);
+        bool IsFailed(eSubsystem subsystem);
+        //failures and recovery times of a failure class so far
+        RecoveryStats GetStats(eSubsystem subsystem);
+        //false while a degraded slave is waiting out its backoff
+        bool SlaveReady(int deviceId);
+        //outcome of a transaction with a slave, returns true if the slave was just degraded
+        bool SlaveResult(int deviceId, bool ok);
+        //slaves currently degraded
+        int GetDegradedCount();
+        //set whenever a subsystem or slave changes state
+        bool IsChanged();
+        void ClearChanged();
+        //add the state and recovery times of every failure class to a message
+        void Serialize(JsonObject root);
+        static const char* toString(eSubsystem subsystem);
+    private:
+        bool _failed[HEALTH_SUBSYSTEM_COUNT];
+        unsigned long _failedAt[HEALTH_SUBSYSTEM_COUNT];
+        RecoveryStats _stats[HEALTH_SUBSYSTEM_COUNT];
+        SlaveHealth _slaves[HEALTH_MAX_SLAVES];
+        int _slaveCount;
+        bool _changed;
+        SlaveHealth* FindSlave(int deviceId, bool add);
+        void RecordRecovery(eSubsystem subsystem, unsigned long ms);
+};
+
+extern HealthMonitor Health;	//Default class instance
+
+#endif
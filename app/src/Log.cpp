@@ -0,0 +1,93 @@
+#include "Log.h"
+#include <stdarg.h>
+
+Logger::Logger(){
+    _start = 0;
+    _drained = 0;
+    _end = 0;
+    _dropped = 0;
+}
+
+Logger Log;
+
+void Logger::Write(char level, const char* format, ...)
+{
+    char line[LOG_LINE_MAX];
+    int len = snprintf(line, sizeof(line), "%lu %c ", millis(), level);
+
+    //one byte is kept back for the newline
+    size_t room = sizeof(line) - len - 1;
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(line + len, room, format, args);
+    va_end(args);
+    if (written > 0){
+        len += min(static_cast<size_t>(written), room - 1);
+    }
+    line[len++] = '\n';
+
+    while (_end + len - _start > LOG_BUFFER_SIZE)
+    {
+        DropOldestLine();
+    }
+    for (int i = 0; i < len; i++)
+    {
+        _ring[(_end + i) % LOG_BUFFER_SIZE] = line[i];
+    }
+    _end += len;
+}
+
+void Logger::Drain()
+{
+    int room = Serial.availableForWrite();
+    while (room > 0 && _drained < _end)
+    {
+        size_t index = _drained % LOG_BUFFER_SIZE;
+        size_t chunk = min(static_cast<size_t>(_end - _drained), static_cast<size_t>(LOG_BUFFER_SIZE - index));
+        chunk = min(chunk, static_cast<size_t>(room));
+        Serial.write(reinterpret_cast<const uint8_t*>(&_ring[index]), chunk);
+        _drained += chunk;
+        room -= chunk;
+    }
+}
+
+size_t Logger::Copy(size_t offset, char* buffer, size_t size)
+{
+    size_t copied = 0;
+    for (unsigned long i = _start + offset; i < _end && copied < size; i++)
+    {
+        buffer[copied++] = _ring[i % LOG_BUFFER_SIZE];
+    }
+    return copied;
+}
+
+size_t Logger::GetBuffered()
+{
+    return _end - _drained;
+}
+
+size_t Logger::GetRetained()
+{
+    return _end - _start;
+}
+
+unsigned long Logger::GetDropped()
+{
+    return _dropped;
+}
+
+void Logger::DropOldestLine()
+{
+    while (_start < _end)
+    {
+        char c = _ring[_start % LOG_BUFFER_SIZE];
+        _start++;
+        if (c == '\n'){
+            break;
+        }
+    }
+    if (_drained < _start){
+        _drained = _start;
+    }
+    _dropped++;
+}
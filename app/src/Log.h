@@ -0,0 +1,77 @@
+#ifndef Log_h
+#define Log_h
+
+#include "Arduino.h"
+
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+//messages above this level are compiled out along with their arguments, which are still type checked
+//so variables only used by a disabled message don't warn
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+//enabled messages are kept here until serial has room for them
+#define LOG_BUFFER_SIZE 2048
+//longest formatted message, longer messages are truncated
+#define LOG_LINE_MAX 120
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) Log.Write('E', __VA_ARGS__)
+#else
+#define LOG_ERROR(...) do { if (0) Log.Write('E', __VA_ARGS__); } while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(...) Log.Write('W', __VA_ARGS__)
+#else
+#define LOG_WARN(...) do { if (0) Log.Write('W', __VA_ARGS__); } while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(...) Log.Write('I', __VA_ARGS__)
+#else
+#define LOG_INFO(...) do { if (0) Log.Write('I', __VA_ARGS__); } while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) Log.Write('D', __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) do { if (0) Log.Write('D', __VA_ARGS__); } while (0)
+#endif
+
+/// @brief Ring of formatted log lines, drained to Serial when the loop is idle
+/// When full the oldest lines are dropped, a slow or absent serial monitor never blocks the caller.
+class Logger
+{
+    public:
+        Logger();
+        //format a line into the ring, ex: "81234 W failed to read registers 40205-40212"
+        void Write(char level, const char* format, ...) __attribute__((format(printf, 3, 4)));
+        //send buffered lines to Serial, only as much as it accepts without blocking
+        void Drain();
+        //copy buffered text starting offset bytes after the oldest line, returns bytes copied
+        size_t Copy(size_t offset, char* buffer, size_t size);
+        //bytes waiting to be drained
+        size_t GetBuffered();
+        //bytes held in the ring, drained or not
+        size_t GetRetained();
+        //lines dropped because the ring was full
+        unsigned long GetDropped();
+    private:
+        char _ring[LOG_BUFFER_SIZE];
+        //oldest retained byte, next byte to drain and next byte to write, as running totals
+        unsigned long _start;
+        unsigned long _drained;
+        unsigned long _end;
+        unsigned long _dropped;
+        void DropOldestLine();
+};
+
+extern Logger Log;	//Default class instance
+
+#endif
@@ -1,4 +0,0 @@
-#include "Message.h"
-
-Message::Message(){
-}
\ No newline at end of file
@@ -1,9 +0,0 @@
-#include "Arduino.h"
-
-class Message
-{
-  public:
-    Message();
-    String topic;
-    String body;
-};
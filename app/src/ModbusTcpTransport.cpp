@@ -0,0 +1,398 @@
+#include "ModbusTcpTransport.h"
+#include "Log.h"
+
+//transaction id, protocol id, length and unit id
+#define MBAP_HEADER_SIZE 7
+
+ModbusTcpTransport::ModbusTcpTransport(){
+    _count = 0;
+    _pollNext = 0;
+}
+
+ModbusTcpTransport ModbusTcp;
+
+int ModbusTcpTransport::Begin(const ModbusConfiguration& modbus)
+{
+    //calling Begin() again abandons the requests in flight
+    for (int i = 0; i < _count; i++)
+    {
+        _connections[i].client.stop();
+    }
+    _count = 0;
+    _pollNext = 0;
+
+    for (int i = 0; i < modbus.device_count; i++)
+    {
+        const ModbusDeviceTransport* device = &modbus.devices[i];
+        if (device->transport != eModbusTransport::transport_tcp){
+            continue;
+        }
+        if (_count >= MODBUS_MAX_TCP_DEVICES){
+            LOG_WARN("too many modbus tcp devices, %d stays on the serial bus", device->device_id);
+            continue;
+        }
+        Connection* conn = &_connections[_count];
+        if (!conn->ip.fromString(device->host)){
+            LOG_WARN("modbus device %d has an invalid host %s, it stays on the serial bus", device->device_id, device->host);
+            continue;
+        }
+        conn->device = *device;
+        conn->device.max_inflight = constrain(device->max_inflight, 1, MODBUS_TCP_MAX_INFLIGHT);
+        conn->nextId = 0;
+        conn->retryAt = millis();
+        conn->inflight = 0;
+        conn->rxLen = 0;
+        for (int t = 0; t < MODBUS_TCP_MAX_PENDING; t++)
+        {
+            conn->pending[t].active = false;
+        }
+        _count++;
+    }
+    return _count;
+}
+
+bool ModbusTcpTransport::IsTcp(int deviceId)
+{
+    return Find(deviceId) != nullptr;
+}
+
+/// @brief Read function code of a register type
+uint8_t readFunction(eRegisterType type)
+{
+    switch (type)
+    {
+        case eRegisterType::coil:
+            return 0x01;
+        case eRegisterType::discrete_input:
+            return 0x02;
+        case eRegisterType::input_register:
+            return 0x04;
+        default:
+            return 0x03;
+    }
+}
+
+bool isReadFunction(uint8_t function)
+{
+    return function <= 0x04;
+}
+
+int ModbusTcpTransport::RequestRead(int deviceId, eRegisterType type, int startAddress, int length, int tag)
+{
+    Connection* conn = Find(deviceId);
+    if (conn == nullptr){
+        return static_cast<int>(ModbusTcpErrors::TCP_DEVICE_UNKNOWN);
+    }
+    uint8_t pdu[4] = {
+        static_cast<uint8_t>(startAddress >> 8), static_cast<uint8_t>(startAddress),
+        static_cast<uint8_t>(length >> 8), static_cast<uint8_t>(length)
+    };
+    return Send(conn, readFunction(type), pdu, sizeof(pdu), length, tag);
+}
+
+int ModbusTcpTransport::RequestWrite(int deviceId, eRegisterType type, int startAddress, const uint16_t* values, int count, int tag)
+{
+    Connection* conn = Find(deviceId);
+    if (conn == nullptr){
+        return static_cast<int>(ModbusTcpErrors::TCP_DEVICE_UNKNOWN);
+    }
+    bool bits = type == eRegisterType::coil;
+
+    uint8_t pdu[5 + 2 * MODBUS_TCP_MAX_WRITE_REGISTERS];
+    pdu[0] = startAddress >> 8;
+    pdu[1] = startAddress;
+    if (count == 1){
+        //a coil is switched on with 0xFF00
+        uint16_t value = bits ? (values[0] ? 0xFF00 : 0x0000) : values[0];
+        pdu[2] = value >> 8;
+        pdu[3] = value;
+        return Send(conn, bits ? 0x05 : 0x06, pdu, 4, count, tag);
+    }
+
+    count = min(count, MODBUS_TCP_MAX_WRITE_REGISTERS);
+    pdu[2] = count >> 8;
+    pdu[3] = count;
+    if (bits){
+        //coils are packed eight to a byte, lowest address in the least significant bit
+        int bytes = (count + 7) / 8;
+        pdu[4] = bytes;
+        memset(&pdu[5], 0, bytes);
+        for (int i = 0; i < count; i++)
+        {
+            if (values[i]){
+                pdu[5 + i / 8] |= 1 << (i % 8);
+            }
+        }
+        return Send(conn, 0x0F, pdu, 5 + bytes, count, tag);
+    }
+    pdu[4] = count * 2;
+    for (int i = 0; i < count; i++)
+    {
+        pdu[5 + i * 2] = values[i] >> 8;
+        pdu[6 + i * 2] = values[i];
+    }
+    return Send(conn, 0x10, pdu, 5 + count * 2, count, tag);
+}
+
+bool ModbusTcpTransport::Poll(ModbusTcpResponse* response)
+{
+    for (int n = 0; n < _count; n++)
+    {
+        int i = (_pollNext + n) % _count;
+        Connection* conn = &_connections[i];
+        if (conn->inflight == 0){
+            continue;
+        }
+        if (Receive(conn, response) || Expire(conn, response)){
+            _pollNext = (i + 1) % _count;
+            return true;
+        }
+    }
+    return false;
+}
+
+int ModbusTcpTransport::GetInFlight()
+{
+    int inflight = 0;
+    for (int i = 0; i < _count; i++)
+    {
+        inflight += _connections[i].inflight;
+    }
+    return inflight;
+}
+
+ModbusTcpTransport::Connection* ModbusTcpTransport::Find(int deviceId)
+{
+    //only a handful of tcp slaves, a linear scan is enough
+    for (int i = 0; i < _count; i++)
+    {
+        if (_connections[i].device.device_id == deviceId){
+            return &_connections[i];
+        }
+    }
+    return nullptr;
+}
+
+int ModbusTcpTransport::Connect(Connection* conn)
+{
+    if (conn->client.connected()){
+        return static_cast<int>(ModbusTcpErrors::SUCCESS);
+    }
+    if ((long)(millis() - conn->retryAt) < 0){
+        return static_cast<int>(ModbusTcpErrors::TCP_NOT_CONNECTED);
+    }
+
+    //release the socket of a dropped connection before opening another
+    conn->client.stop();
+    conn->rxLen = 0;
+    conn->client.setConnectionTimeout(MODBUS_TCP_CONNECT_TIMEOUT_MS);
+    if (!conn->client.connect(conn->ip, conn->device.port)){
+        LOG_WARN("modbus device %d unreachable at %s:%d", conn->device.device_id, conn->device.host, conn->device.port);
+        conn->retryAt = millis() + MODBUS_TCP_RETRY_MS;
+        return static_cast<int>(ModbusTcpErrors::TCP_NOT_CONNECTED);
+    }
+    LOG_INFO("modbus device %d connected at %s:%d", conn->device.device_id, conn->device.host, conn->device.port);
+    return static_cast<int>(ModbusTcpErrors::SUCCESS);
+}
+
+/// @brief Frame a request with an MBAP header and send it without waiting for the response
+/// @param pdu Request data following the function code
+/// @param count Registers expected back by a read, or written by a write
+int ModbusTcpTransport::Send(Connection* conn, uint8_t function, const uint8_t* pdu, int pduLen, uint16_t count, int tag)
+{
+    int limit = conn->device.max_inflight;
+    if (!isReadFunction(function)){
+        limit++;
+    }
+    if (conn->inflight >= limit){
+        return static_cast<int>(ModbusTcpErrors::TCP_BUSY);
+    }
+    int res = Connect(conn);
+    if (res < 0){
+        return res;
+    }
+
+    Transaction* txn = nullptr;
+    for (int t = 0; t < MODBUS_TCP_MAX_PENDING; t++)
+    {
+        if (!conn->pending[t].active){
+            txn = &conn->pending[t];
+            break;
+        }
+    }
+
+    uint8_t frame[MODBUS_TCP_ADU_MAX];
+    uint16_t id = conn->nextId++;
+    //length counts the unit id, function code and data
+    uint16_t len = pduLen + 2;
+    frame[0] = id >> 8;
+    frame[1] = id;
+    frame[2] = 0;
+    frame[3] = 0;
+    frame[4] = len >> 8;
+    frame[5] = len;
+    frame[6] = conn->device.device_id;
+    frame[7] = function;
+    memcpy(&frame[8], pdu, pduLen);
+
+    size_t total = MBAP_HEADER_SIZE + 1 + pduLen;
+    if (conn->client.write(frame, total) != total){
+        LOG_WARN("failed to send modbus request to device %d", conn->device.device_id);
+        Disconnect(conn);
+        return static_cast<int>(ModbusTcpErrors::TCP_SEND_FAILED);
+    }
+
+    txn->active = true;
+    txn->id = id;
+    txn->function = function;
+    txn->count = count;
+    txn->tag = tag;
+    txn->sentAt = micros();
+    conn->inflight++;
+    return static_cast<int>(ModbusTcpErrors::SUCCESS);
+}
+
+/// @brief Read whatever has arrived on the connection and complete the transaction it answers
+/// @return true if a transaction was completed
+bool ModbusTcpTransport::Receive(Connection* conn, ModbusTcpResponse* response)
+{
+    //a dropped connection fails its outstanding requests one at a time
+    if (!conn->client.connected()){
+        for (int t = 0; t < MODBUS_TCP_MAX_PENDING; t++)
+        {
+            if (conn->pending[t].active){
+                Complete(conn, &conn->pending[t], static_cast<int>(ModbusTcpErrors::TCP_NOT_CONNECTED), response);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    while (true)
+    {
+        //header first, it gives the length of the rest of the frame
+        int frameLen = MBAP_HEADER_SIZE;
+        if (conn->rxLen >= MBAP_HEADER_SIZE){
+            frameLen = 6 + ((conn->rx[4] << 8) | conn->rx[5]);
+        }
+        while (conn->rxLen < frameLen)
+        {
+            int available = conn->client.available();
+            if (available <= 0){
+                return false;
+            }
+            int got = conn->client.read(&conn->rx[conn->rxLen], min(available, frameLen - conn->rxLen));
+            if (got <= 0){
+                return false;
+            }
+            conn->rxLen += got;
+
+            if (conn->rxLen == MBAP_HEADER_SIZE){
+                uint16_t protocol = (conn->rx[2] << 8) | conn->rx[3];
+                frameLen = 6 + ((conn->rx[4] << 8) | conn->rx[5]);
+                //nothing after a malformed header can be trusted, start the stream over
+                if (protocol != 0 || frameLen < MBAP_HEADER_SIZE + 2 || frameLen > MODBUS_TCP_ADU_MAX){
+                    LOG_WARN("malformed modbus response from device %d, reconnecting", conn->device.device_id);
+                    Disconnect(conn);
+                    return false;
+                }
+            }
+        }
+        conn->rxLen = 0;
+
+        //responses to requests that already timed out are dropped
+        uint16_t id = (conn->rx[0] << 8) | conn->rx[1];
+        Transaction* txn = nullptr;
+        for (int t = 0; t < MODBUS_TCP_MAX_PENDING; t++)
+        {
+            if (conn->pending[t].active && conn->pending[t].id == id){
+                txn = &conn->pending[t];
+                break;
+            }
+        }
+        if (txn == nullptr){
+            continue;
+        }
+
+        const uint8_t* pdu = &conn->rx[MBAP_HEADER_SIZE];
+        int pduLen = frameLen - MBAP_HEADER_SIZE;
+        int result = static_cast<int>(ModbusTcpErrors::SUCCESS);
+        uint8_t exception = 0;
+        if (pdu[0] == (txn->function | 0x80)){
+            exception = pdu[1];
+            result = static_cast<int>(ModbusTcpErrors::TCP_EXCEPTION);
+        }
+        else if (pdu[0] != txn->function){
+            result = static_cast<int>(ModbusTcpErrors::TCP_BAD_RESPONSE);
+        }
+        else if (txn->function == 0x01 || txn->function == 0x02){
+            int bytes = (txn->count + 7) / 8;
+            if (pduLen != 2 + bytes || pdu[1] != bytes){
+                result = static_cast<int>(ModbusTcpErrors::TCP_BAD_RESPONSE);
+            }
+            else{
+                for (int r = 0; r < txn->count; r++)
+                {
+                    _values[r] = (pdu[2 + r / 8] >> (r % 8)) & 0x01;
+                }
+            }
+        }
+        else if (isReadFunction(txn->function)){
+            if (pduLen != 2 + txn->count * 2 || pdu[1] != txn->count * 2){
+                result = static_cast<int>(ModbusTcpErrors::TCP_BAD_RESPONSE);
+            }
+            else{
+                for (int r = 0; r < txn->count; r++)
+                {
+                    _values[r] = (pdu[2 + r * 2] << 8) | pdu[3 + r * 2];
+                }
+            }
+        }
+        //functions 5 and 6 echo the request, 15 and 16 return the address and quantity
+        else if (pduLen != 5){
+            result = static_cast<int>(ModbusTcpErrors::TCP_BAD_RESPONSE);
+        }
+
+        Complete(conn, txn, result, response);
+        response->exception = exception;
+        if (result == static_cast<int>(ModbusTcpErrors::SUCCESS) && isReadFunction(txn->function)){
+            response->count = txn->count;
+        }
+        return true;
+    }
+}
+
+/// @brief Fail the oldest request that has waited longer than the slave's timeout
+bool ModbusTcpTransport::Expire(Connection* conn, ModbusTcpResponse* response)
+{
+    unsigned long timeout = conn->device.timeout_ms * 1000UL;
+    for (int t = 0; t < MODBUS_TCP_MAX_PENDING; t++)
+    {
+        Transaction* txn = &conn->pending[t];
+        if (txn->active && micros() - txn->sentAt >= timeout){
+            Complete(conn, txn, static_cast<int>(ModbusTcpErrors::TCP_TIMEOUT), response);
+            return true;
+        }
+    }
+    return false;
+}
+
+void ModbusTcpTransport::Complete(Connection* conn, Transaction* txn, int result, ModbusTcpResponse* response)
+{
+    response->tag = txn->tag;
+    response->device_id = conn->device.device_id;
+    response->result = result;
+    response->exception = 0;
+    response->micros = micros() - txn->sentAt;
+    response->count = 0;
+    response->values = _values;
+    txn->active = false;
+    conn->inflight--;
+}
+
+void ModbusTcpTransport::Disconnect(Connection* conn)
+{
+    conn->client.stop();
+    conn->rxLen = 0;
+    conn->retryAt = millis() + MODBUS_TCP_RETRY_MS;
+}
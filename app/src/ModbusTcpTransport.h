@@ -0,0 +1,108 @@
+#ifndef ModbusTcpTransport_h
+#define ModbusTcpTransport_h
+
+#include "Arduino.h"
+#include <Ethernet.h>
+#include "ConfigurationManager.h"
+
+//reads a single connection may have in flight, max_inflight is capped to this
+#define MODBUS_TCP_MAX_INFLIGHT 4
+//one more transaction is held back for command writes, a full read pipeline never delays a command
+#define MODBUS_TCP_MAX_PENDING (MODBUS_TCP_MAX_INFLIGHT + 1)
+//most registers or coils a single function 16/15 request may write
+#define MODBUS_TCP_MAX_WRITE_REGISTERS 16
+//largest Modbus TCP frame, 7 byte MBAP header and a 253 byte PDU
+#define MODBUS_TCP_ADU_MAX 260
+//longest a connection attempt may block the loop, slaves share the controller's segment
+#define MODBUS_TCP_CONNECT_TIMEOUT_MS 250
+//wait before reconnecting to a slave that refused or dropped the connection
+#define MODBUS_TCP_RETRY_MS 5000
+
+enum class ModbusTcpErrors
+{
+    SUCCESS,
+    TCP_DEVICE_UNKNOWN = -100,
+    TCP_NOT_CONNECTED,
+    TCP_BUSY,
+    TCP_SEND_FAILED,
+    TCP_TIMEOUT = -150,
+    TCP_EXCEPTION,
+    TCP_BAD_RESPONSE,
+};
+
+/// @brief Finished transaction handed back by Poll()
+struct ModbusTcpResponse
+{
+    //caller's identifier given with the request
+    int tag;
+    int device_id;
+    //0 = success, < 0 = ModbusTcpErrors
+    int result;
+    //modbus exception code when result is TCP_EXCEPTION
+    uint8_t exception;
+    //request sent to response received, or to the failure
+    unsigned long micros;
+    //registers or bits (0/1) returned by a read, only valid until the next Poll()
+    int count;
+    const uint16_t* values;
+};
+
+/// @brief Modbus TCP client keeping several requests in flight per slave
+/// Requests are matched to their responses by MBAP transaction id, so TCP slaves are polled
+/// concurrently while the RTU bus keeps working. Nothing here waits on the network.
+class ModbusTcpTransport
+{
+    public:
+        ModbusTcpTransport();
+        //take the tcp slaves from the configuration, existing connections are closed
+        int Begin(const ModbusConfiguration& modbus);
+        //true if the slave is reached over modbus tcp
+        bool IsTcp(int deviceId);
+        //send a function 1, 2, 3 or 4 request, the response is returned by Poll() with the same tag
+        int RequestRead(int deviceId, eRegisterType type, int startAddress, int length, int tag);
+        //send a function 5/15 (coils) or 6/16 (holding registers) request, single writes use 5 or 6
+        int RequestWrite(int deviceId, eRegisterType type, int startAddress, const uint16_t* values, int count, int tag);
+        //collect the next finished transaction, returns false when none is ready
+        bool Poll(ModbusTcpResponse* response);
+        //requests waiting on a response across every slave
+        int GetInFlight();
+    private:
+        struct Transaction
+        {
+            bool active;
+            uint16_t id;
+            uint8_t function;
+            uint16_t count;
+            int tag;
+            unsigned long sentAt;
+        };
+        struct Connection
+        {
+            ModbusDeviceTransport device;
+            IPAddress ip;
+            EthernetClient client;
+            uint16_t nextId;
+            unsigned long retryAt;
+            int inflight;
+            Transaction pending[MODBUS_TCP_MAX_PENDING];
+            //partially received response
+            uint8_t rx[MODBUS_TCP_ADU_MAX];
+            int rxLen;
+        };
+        Connection _connections[MODBUS_MAX_TCP_DEVICES];
+        int _count;
+        //connection Poll() starts from, rotated so one busy slave can't starve the others
+        int _pollNext;
+        uint16_t _values[MODBUS_MAX_READ_REGISTERS];
+        Connection* Find(int deviceId);
+        int Connect(Connection* conn);
+        int Send(Connection* conn, uint8_t function, const uint8_t* pdu, int pduLen, uint16_t count, int tag);
+        bool Receive(Connection* conn, ModbusTcpResponse* response);
+        bool Expire(Connection* conn, ModbusTcpResponse* response);
+        void Complete(Connection* conn, Transaction* txn, int result, ModbusTcpResponse* response);
+        void Disconnect(Connection* conn);
+};
+
+extern ModbusTcpTransport ModbusTcp;	//Default class instance
+
+#endif
@@ -1,10 +1,18 @@
 #include "RemoteConnectionManager.h"
+#include "Log.h"
 
 EthernetClient client;
-MQTTClient mqttClient;
+//the library default of 128 bytes drops every batch, $diag and $log message and any larger command
+MQTTClient mqttClient(REMOTE_MQTT_BUFFER_SIZE);
 bool _initialized = false;
 
 RemoteConnectionManager::RemoteConnectionManager(){
+    _publishCount = 0;
+    _publishedBytes = 0;
+    _publishFailures = 0;
+    _connected = false;
+    _backoffMs = 0;
+    _nextAttemptAt = 0;
 }
 
 RemoteConnectionManager RemoteConnMgr;
@@ -30,20 +38,22 @@ int RemoteConnectionManager::Init(BrokerConfiguration config, DeviceConfiguratio
         _devConfig.device_mac.b5,
         _devConfig.device_mac.b6,
         };
-    //val = Ethernet.begin(_devConfig.device_mac, 10);  // Get IP from DHCP
-    val = Ethernet.begin(mac);  // Get IP from DHCP
+    //recovery retries from inside the loop, a missing DHCP server may only hold it for a bounded time
+    val = Ethernet.begin(mac, REMOTE_DHCP_TIMEOUT_MS, REMOTE_DHCP_RESPONSE_TIMEOUT_MS);  // Get IP from DHCP
     if (val == 0)
     {
-        Serial.print("Ethernet failed to obtain DHCP address. Error code = ");
-        Serial.println(val);
+        LOG_WARN("Ethernet failed to obtain DHCP address. Error code = %d", val);
         _initialized = false;
         return static_cast<int>(RemoteConnectionErrors::ETHERNET_INITIALIZATION_FAILURE);
     }else{
-        Serial.print("Ethernet DHCP connection established - ");
-        Serial.println(Ethernet.localIP());
+        IPAddress ip = Ethernet.localIP();
+        LOG_INFO("Ethernet DHCP connection established - %u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
     }
 
-    mqttClient.begin(_remConfig.broker_url, client);
+    //a dead broker must not hold the loop for the library default timeouts
+    client.setConnectionTimeout(REMOTE_CONNECT_TIMEOUT_MS);
+    mqttClient.setTimeout(REMOTE_CONNECT_TIMEOUT_MS);
+    mqttClient.begin(_remConfig.broker_url, _remConfig.broker_port, client);
 
     _initialized = true;
     return 0;
@@ -54,43 +64,71 @@ int RemoteConnectionManager::Connect()
     // if (!_initialized){
     //     return static_cast<int>(RemoteConnectionErrors::ETHERNET_INITIALIZATION_FAILURE);
     // }
+    //renew the DHCP lease when due, returns immediately otherwise
+    Ethernet.maintain();
+
     //signal that a new cycle has occurred to trigger any queued callback processing
     //this should stay as close to the top of the loop as possible
     mqttClient.loop();
 
     if (mqttClient.connected())
     {
+        _connected = true;
         return static_cast<int>(RemoteConnectionErrors::SUCCESS);
     }
+    if (_connected){
+        LOG_WARN("Lost connection to the MQTT broker");
+        _connected = false;
+        _backoffMs = 0;
+        _nextAttemptAt = millis();
+    }
+
+    //offline, only one bounded attempt is made per backoff period
+    if ((long)(millis() - _nextAttemptAt) < 0){
+        return static_cast<int>(RemoteConnectionErrors::BROKER_RECONNECT_PENDING);
+    }
 
     //check ethernet link active
     if (Ethernet.linkStatus() != 1){
-        Serial.println("Aborting - Ethernet link is down.");
+        LOG_WARN("Aborting - Ethernet link is down.");
+        ScheduleReconnect();
         return static_cast<int>(RemoteConnectionErrors::ETHERNET_INITIALIZATION_FAILURE);
     }
-    Serial.print("Connecting to the MQTT broker: ");
-    Serial.print(_remConfig.broker_url);
-    Serial.print(" , ");
-    Serial.println(_remConfig.broker_user);
+    LOG_INFO("Connecting to the MQTT broker: %s:%d , %s", _remConfig.broker_url, _remConfig.broker_port, _remConfig.broker_user);
 
     // Username and Password tokens for protected broker topics
     if (!mqttClient.connect(_devConfig.device_name, _remConfig.broker_user, _remConfig.broker_pass)) 
     {
-        Serial.print("MQTT connection failed! Error code = ");
-        Serial.println(mqttClient.returnCode());
-        _initialized = false;
+        LOG_WARN("MQTT connection failed! Error code = %d", mqttClient.returnCode());
+        ScheduleReconnect();
         return static_cast<int>(RemoteConnectionErrors::BROKER_FAILED_CONNECT);
     }
     else
     {
-        Serial.println("Connected to the MQTT broker");
+        LOG_INFO("Connected to the MQTT broker");
         //app name on network is vfdctl (vfd control)
         mqttClient.subscribe("cmd/vfdctl/#");
     }
 
+    _connected = true;
+    _backoffMs = 0;
     return static_cast<int>(RemoteConnectionErrors::SUCCESS);
 }
 
+void RemoteConnectionManager::ScheduleReconnect()
+{
+    unsigned long maxBackoffMs = max(_remConfig.broker_retry_interval_sec, 1) * 1000UL;
+    _backoffMs = _backoffMs == 0 ? REMOTE_MIN_BACKOFF_MS : _backoffMs * 2;
+    if (_backoffMs > maxBackoffMs){
+        _backoffMs = maxBackoffMs;
+    }
+
+    //jitter keeps controllers that lost the same broker from reconnecting in lockstep
+    unsigned long delayMs = _backoffMs / 2 + random(_backoffMs / 2 + 1);
+    _nextAttemptAt = millis() + delayMs;
+    LOG_INFO("Next broker connection attempt in (ms): %lu", delayMs);
+}
+
 void RemoteConnectionManager::RegisterOnMessageReceivedCallback(InputEvent event)
 {
     //prevent invalid callback events
@@ -101,27 +139,50 @@ void RemoteConnectionManager::RegisterOnMessageReceivedCallback(InputEvent event
     //prevent double subscribing
     if (_event != event){
         _event = event;
-        mqttClient.onMessage(event);
+        mqttClient.onMessageAdvanced(event);
     }
 }
 
 int RemoteConnectionManager::Publish(String message, String topic)
+{
+    return Publish(topic.c_str(), reinterpret_cast<const uint8_t*>(message.c_str()), message.length());
+}
+
+int RemoteConnectionManager::Publish(const char* topic, const uint8_t* payload, size_t len, bool retained)
 {
     if (!mqttClient.connected()){
         return -1;
     }
-    int pubValue = mqttClient.publish(topic, message);
 
-    if ( pubValue < 0)
+    if (!mqttClient.publish(topic, reinterpret_cast<const char*>(payload), static_cast<int>(len), retained, 0))
     {
-        Serial.println("Error publishing to MQTT topic. Code: ");
-        Serial.println(pubValue);
+        LOG_ERROR("Error publishing to MQTT topic. Code: %d", mqttClient.lastError());
+        _publishFailures++;
         return -2;
     }
 
+    //fixed header, remaining length, topic length, topic and payload (qos 0 has no packet id)
+    unsigned long remaining = 2 + strlen(topic) + len;
+    _publishedBytes += 1 + (remaining < 128 ? 1 : remaining < 16384 ? 2 : 3) + remaining;
+    _publishCount++;
     return 0;
 }
 
+unsigned long RemoteConnectionManager::GetPublishCount()
+{
+    return _publishCount;
+}
+
+unsigned long RemoteConnectionManager::GetPublishedBytes()
+{
+    return _publishedBytes;
+}
+
+unsigned long RemoteConnectionManager::GetPublishFailures()
+{
+    return _publishFailures;
+}
+
 char* RemoteConnectionManager::GetError(int code)
 {
     char* val;
@@ -133,6 +194,9 @@ char* RemoteConnectionManager::GetError(int code)
         case RemoteConnectionErrors::BROKER_FAILED_CONNECT:
             val = "failed to connect to mqtt broker";
             break;
+        case RemoteConnectionErrors::BROKER_RECONNECT_PENDING:
+            val = "waiting to reconnect to mqtt broker";
+            break;
         case RemoteConnectionErrors::UNREADABLE_MESSAGE:
             val = "unable to parse received message from topic";
             break;
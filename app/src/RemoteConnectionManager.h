@@ -6,10 +6,21 @@
 #include <Ethernet.h>
 #include <MQTT.h>
 
+//longest a single broker connection attempt may block the loop
+#define REMOTE_CONNECT_TIMEOUT_MS 1000
+//longest a DHCP attempt may block the loop and the wait for each DHCP reply, the library defaults are 60 s and 4 s
+#define REMOTE_DHCP_TIMEOUT_MS 2000
+#define REMOTE_DHCP_RESPONSE_TIMEOUT_MS 1000
+//first reconnect delay, doubled per failed attempt up to broker_retry_interval_sec
+#define REMOTE_MIN_BACKOFF_MS 1000
+//read and write buffers of the mqtt client, a packet holds a 1024 byte payload plus its topic and header
+#define REMOTE_MQTT_BUFFER_SIZE 1280
+
 enum class RemoteConnectionErrors 
 {
   SUCCESS,
   BROKER_FAILED_CONNECT = -100,
+  BROKER_RECONNECT_PENDING,
   UNREADABLE_MESSAGE = -200,
   NO_MESSAGES_AVAILABLE = -201,
   HARDWARE_FAILURE = -300,
@@ -19,12 +30,12 @@ enum class RemoteConnectionErrors
 
 class RemoteConnectionManager
 {
-  using InputEvent = void (*)(String &topic, String &payload);
+  using InputEvent = void (*)(MQTTClient *client, char topic[], char bytes[], int length);
 
   public:
     RemoteConnectionManager();
     int Init(BrokerConfiguration remConfig, DeviceConfiguration devConfig);
-    //contact the remote
+    //service the connection, reconnects are attempted with jittered exponential backoff
     int Connect();
     //return any messages found
     int CheckForMessages(String message);
@@ -32,13 +43,29 @@ class RemoteConnectionManager
     char* GetError(int code);
     //publish a remote message
     int Publish(String message, String topic);
+    //publish a remote message without copying the topic or payload, a retained message is kept by the broker for new subscribers
+    int Publish(const char* topic, const uint8_t* payload, size_t len, bool retained = false);
     //wire up callback
     void RegisterOnMessageReceivedCallback(InputEvent event);
+    //successful publishes since boot
+    unsigned long GetPublishCount();
+    //estimated MQTT bytes on the wire for those publishes
+    unsigned long GetPublishedBytes();
+    //publishes rejected by the client since boot, not counting those attempted while offline
+    unsigned long GetPublishFailures();
   private:
     BrokerConfiguration _remConfig;
     DeviceConfiguration _devConfig;
     InputEvent _event;
     uint8_t _ethernetMac[6];
+    unsigned long _publishCount;
+    unsigned long _publishedBytes;
+    unsigned long _publishFailures;
+    bool _connected;
+    unsigned long _backoffMs;
+    unsigned long _nextAttemptAt;
+    //wait before the next connection attempt
+    void ScheduleReconnect();
 };
 
 extern RemoteConnectionManager RemoteConnMgr;	//Default class instance
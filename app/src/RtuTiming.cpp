@@ -0,0 +1,132 @@
+#include "RtuTiming.h"
+#include "Log.h"
+
+RtuTiming::RtuTiming(){
+    _charMicros = 0;
+    _charGapMicros = 0;
+    _frameGapMicros = 0;
+    _slaveCount = 0;
+}
+
+RtuTiming BusTiming;
+
+void RtuTiming::Begin(const ModbusConfiguration& modbus)
+{
+    Begin(modbus, 0);
+}
+
+void RtuTiming::Begin(const ModbusConfiguration& modbus, int bus)
+{
+    const SerialPortConfiguration* port = &modbus.serial_ports[bus];
+    unsigned long baud = port->baud_rate > 0 ? port->baud_rate : 9600;
+    //start bit, data bits, optional parity bit and stop bits
+    unsigned long bits = 1 + port->data_bits + (port->parity_bits != 0 ? 1 : 0) + port->stop_bits;
+    _charMicros = (bits * 1000000UL + baud - 1) / baud;
+    if (baud > RTU_FIXED_TIMING_BAUD){
+        _charGapMicros = RTU_FIXED_CHAR_GAP_US;
+        _frameGapMicros = RTU_FIXED_FRAME_GAP_US;
+    }else{
+        _charGapMicros = _charMicros * 3 / 2;
+        _frameGapMicros = _charMicros * 7 / 2;
+    }
+
+    //estimates survive a restart of the bus, only the overrides are taken again
+    for (int i = 0; i < _slaveCount; i++)
+    {
+        _slaves[i].override_ms = 0;
+    }
+    for (int i = 0; i < modbus.device_count; i++)
+    {
+        const ModbusDeviceTransport* device = &modbus.devices[i];
+        if (device->transport != eModbusTransport::transport_rtu || device->bus != bus || device->timeout_ms <= 0){
+            continue;
+        }
+        SlaveTiming* slave = Find(device->device_id, true);
+        if (slave != nullptr){
+            slave->override_ms = device->timeout_ms;
+        }
+    }
+    LOG_INFO("rtu timing of bus %d at %lu baud. char (us): %lu t1.5 (us): %lu t3.5 (us): %lu", bus, baud, _charMicros, _charGapMicros, _frameGapMicros);
+}
+
+unsigned long RtuTiming::GetCharMicros()
+{
+    return _charMicros;
+}
+
+unsigned long RtuTiming::GetCharGapMicros()
+{
+    return _charGapMicros;
+}
+
+unsigned long RtuTiming::GetFrameGapMicros()
+{
+    return _frameGapMicros;
+}
+
+unsigned long RtuTiming::GetTimeout(int deviceId)
+{
+    SlaveTiming* slave = Find(deviceId, false);
+    if (slave == nullptr){
+        return RTU_TIMEOUT_DEFAULT_MS;
+    }
+    if (slave->override_ms > 0){
+        return slave->override_ms;
+    }
+    if (slave->samples == 0){
+        return RTU_TIMEOUT_DEFAULT_MS;
+    }
+    unsigned long timeoutMs = (slave->srtt_us + 4 * slave->rttvar_us + 999) / 1000;
+    return constrain(timeoutMs, RTU_TIMEOUT_MIN_MS, RTU_TIMEOUT_MAX_MS);
+}
+
+void RtuTiming::RecordResponse(int deviceId, unsigned long micros)
+{
+    SlaveTiming* slave = Find(deviceId, true);
+    if (slave == nullptr){
+        return;
+    }
+    if (slave->samples == 0){
+        slave->srtt_us = micros;
+        slave->rttvar_us = micros / 2;
+    }else{
+        //gains of 1/8 and 1/4, a single slow answer moves the timeout without resetting it
+        long err = static_cast<long>(micros) - static_cast<long>(slave->srtt_us);
+        slave->rttvar_us += (static_cast<long>(abs(err)) - static_cast<long>(slave->rttvar_us)) / 4;
+        slave->srtt_us += err / 8;
+    }
+    if (slave->samples < UINT32_MAX){
+        slave->samples++;
+    }
+}
+
+void RtuTiming::RecordTimeout(int deviceId)
+{
+    SlaveTiming* slave = Find(deviceId, false);
+    if (slave == nullptr || slave->samples == 0){
+        return;
+    }
+    //the slave may just be slower than estimated, widen the timeout until it answers again
+    slave->rttvar_us = min(slave->rttvar_us * 2, static_cast<uint32_t>(RTU_TIMEOUT_MAX_MS * 1000UL));
+}
+
+/// @brief Find a slave's entry, optionally adding it, nullptr once the table is full
+SlaveTiming* RtuTiming::Find(int deviceId, bool add)
+{
+    for (int i = 0; i < _slaveCount; i++)
+    {
+        if (_slaves[i].device_id == deviceId){
+            return &_slaves[i];
+        }
+    }
+    if (!add || _slaveCount >= RTU_TIMING_MAX_SLAVES){
+        return nullptr;
+    }
+    SlaveTiming* slave = &_slaves[_slaveCount++];
+    slave->device_id = deviceId;
+    slave->override_ms = 0;
+    slave->samples = 0;
+    slave->srtt_us = 0;
+    slave->rttvar_us = 0;
+    return slave;
+}
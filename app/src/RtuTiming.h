@@ -0,0 +1,65 @@
+#ifndef RtuTiming_h
+#define RtuTiming_h
+
+#include "Arduino.h"
+#include "ConfigurationManager.h"
+
+//slaves given their own response timeout, further slaves use RTU_TIMEOUT_DEFAULT_MS
+#define RTU_TIMING_MAX_SLAVES 8
+//response timeout until a slave has answered, the modbus client's own default
+#define RTU_TIMEOUT_DEFAULT_MS 1000
+//bounds of an adapted response timeout
+#define RTU_TIMEOUT_MIN_MS 20
+#define RTU_TIMEOUT_MAX_MS 1000
+//above 19200 baud the spec fixes the silent intervals instead of scaling them with the character time
+#define RTU_FIXED_TIMING_BAUD 19200
+#define RTU_FIXED_CHAR_GAP_US 750
+#define RTU_FIXED_FRAME_GAP_US 1750
+
+/// @brief Response time estimate of a single slave, kept in microseconds
+struct SlaveTiming
+{
+    int device_id;
+    //configured timeout, 0 = adapt to the measured response time
+    int override_ms;
+    uint32_t samples;
+    //smoothed response time and its mean deviation
+    uint32_t srtt_us;
+    uint32_t rttvar_us;
+};
+
+/// @brief RTU frame timing derived from the serial settings and response timeouts adapted per slave
+/// Timeouts follow the smoothed response time plus four mean deviations (RFC 6298), so a fast slave
+/// that stops answering costs a few tens of milliseconds instead of the client's full default timeout.
+class RtuTiming
+{
+    public:
+        RtuTiming();
+        //derive the character time and silent intervals from the serial port and take the per slave overrides
+        void Begin(const ModbusConfiguration& modbus);
+        //same for one of the serial buses, a gateway keeps an instance per bus
+        void Begin(const ModbusConfiguration& modbus, int bus);
+        //time on the wire of a single character, start, data, parity and stop bits
+        unsigned long GetCharMicros();
+        //t1.5, longest silence allowed between two characters of a frame
+        unsigned long GetCharGapMicros();
+        //t3.5, silence required between two frames
+        unsigned long GetFrameGapMicros();
+        //response timeout to use for the next request to a slave
+        unsigned long GetTimeout(int deviceId);
+        //a slave answered, valid or exception, after micros
+        void RecordResponse(int deviceId, unsigned long micros);
+        //a slave didn't answer within its timeout
+        void RecordTimeout(int deviceId);
+    private:
+        unsigned long _charMicros;
+        unsigned long _charGapMicros;
+        unsigned long _frameGapMicros;
+        SlaveTiming _slaves[RTU_TIMING_MAX_SLAVES];
+        int _slaveCount;
+        SlaveTiming* Find(int deviceId, bool add);
+};
+
+extern RtuTiming BusTiming;	//Default class instance
+
+#endif
@@ -0,0 +1,69 @@
+#include "Scheduler.h"
+
+Scheduler::Scheduler(){
+    _count = 0;
+    _lastLoopMicros = 0;
+    _maxLoopMicros = 0;
+}
+
+Scheduler TaskScheduler;
+
+int Scheduler::Add(TaskFn task, unsigned long intervalMs)
+{
+    if (task == nullptr){
+        return static_cast<int>(SchedulerErrors::INVALID_TASK);
+    }
+
+    //prevent double registering, a task added again only has its interval updated
+    for (int i = 0; i < _count; i++)
+    {
+        if (_tasks[i].fn == task){
+            _tasks[i].interval = intervalMs;
+            return i;
+        }
+    }
+
+    if (_count >= SCHEDULER_MAX_TASKS){
+        return static_cast<int>(SchedulerErrors::TASK_LIMIT_REACHED);
+    }
+
+    _tasks[_count].fn = task;
+    _tasks[_count].interval = intervalMs;
+    _tasks[_count].lastRun = millis();
+    return _count++;
+}
+
+void Scheduler::Run()
+{
+    unsigned long start = micros();
+
+    for (int i = 0; i < _count; i++)
+    {
+        Task* t = &_tasks[i];
+        unsigned long now = millis();
+        if (t->interval == 0 || now - t->lastRun >= t->interval){
+            t->lastRun = now;
+            t->fn();
+        }
+    }
+
+    _lastLoopMicros = micros() - start;
+    if (_lastLoopMicros > _maxLoopMicros){
+        _maxLoopMicros = _lastLoopMicros;
+    }
+}
+
+unsigned long Scheduler::GetLastLoopMicros()
+{
+    return _lastLoopMicros;
+}
+
+unsigned long Scheduler::GetMaxLoopMicros()
+{
+    return _maxLoopMicros;
+}
+
+void Scheduler::ResetStats()
+{
+    _maxLoopMicros = 0;
+}
@@ -0,0 +1,48 @@
+#ifndef Scheduler_h
+#define Scheduler_h
+
+#include "Arduino.h"
+
+#define SCHEDULER_MAX_TASKS 16
+
+enum class SchedulerErrors 
+{
+  SUCCESS,
+  TASK_LIMIT_REACHED = -100,
+  INVALID_TASK,
+};
+
+/// @brief Cooperative millis() based task runner
+/// Tasks must never block; a task that has more work than fits in one call keeps its own
+/// state and resumes on the next pass.
+class Scheduler
+{
+  using TaskFn = void (*)();
+
+  public:
+    Scheduler();
+    //register a task to run every intervalMs (0 = every pass), returns the task id
+    int Add(TaskFn task, unsigned long intervalMs);
+    //run one pass over every task that is due
+    void Run();
+    //duration of the most recent pass
+    unsigned long GetLastLoopMicros();
+    //longest pass since the stats were last reset
+    unsigned long GetMaxLoopMicros();
+    void ResetStats();
+  private:
+    struct Task
+    {
+      TaskFn fn;
+      unsigned long interval;
+      unsigned long lastRun;
+    };
+    Task _tasks[SCHEDULER_MAX_TASKS];
+    int _count;
+    unsigned long _lastLoopMicros;
+    unsigned long _maxLoopMicros;
+};
+
+extern Scheduler TaskScheduler;	//Default class instance
+
+#endif
@@ -0,0 +1,35 @@
+#include "TelemetryFilter.h"
+
+TelemetryFilter::TelemetryFilter(){
+}
+
+TelemetryFilter Reporting;
+
+bool TelemetryFilter::ShouldPublish(ModbusRegisterTable* regs, int reg, int32_t value)
+{
+    uint8_t flags = regs->flags[reg];
+    if (!(flags & REGISTER_REPORT_BY_EXCEPTION) || !(flags & REGISTER_PUBLISHED)){
+        return true;
+    }
+
+    unsigned long heartbeat = regs->max_silence_sec[reg] * 1000UL;
+    if (heartbeat > 0 && millis() - regs->last_publish_ms[reg] >= heartbeat){
+        return true;
+    }
+
+    int32_t last = regs->last_published[reg];
+    int32_t band = regs->deadband[reg];
+    if (flags & REGISTER_DEADBAND_PERCENT){
+        //deadband is stored in hundredths of a percent of the last published value
+        band = static_cast<int32_t>(static_cast<int64_t>(abs(last)) * band / 10000);
+    }
+    return abs(value - last) > band;
+}
+
+void TelemetryFilter::MarkPublished(ModbusRegisterTable* regs, int reg, int32_t value)
+{
+    regs->last_published[reg] = value;
+    regs->last_publish_ms[reg] = millis();
+    regs->flags[reg] |= REGISTER_PUBLISHED;
+    regs->flags[reg] &= ~REGISTER_BATCH_PENDING;
+}
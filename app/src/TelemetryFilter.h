@@ -0,0 +1,22 @@
+#ifndef TelemetryFilter_h
+#define TelemetryFilter_h
+
+#include "Arduino.h"
+#include "ConfigurationManager.h"
+
+/// @brief Report by exception, decides which telemetry readings are worth publishing
+/// A register is published when its value leaves the deadband around the last published value,
+/// when its heartbeat expires, or always when it has no deadband. Shared by the controller and the Linux gateway.
+class TelemetryFilter
+{
+    public:
+        TelemetryFilter();
+        //true if the register should be published with this value
+        bool ShouldPublish(ModbusRegisterTable* regs, int reg, int32_t value);
+        //the value was published or journaled, deadband and heartbeat continue from it
+        void MarkPublished(ModbusRegisterTable* regs, int reg, int32_t value);
+};
+
+extern TelemetryFilter Reporting;	//Default class instance
+
+#endif
@@ -0,0 +1,260 @@
+#include "TelemetryJournal.h"
+#include "Log.h"
+
+//identifies a journal file
+#define JOURNAL_MAGIC 0x4A524E4CUL
+
+TelemetryJournal::TelemetryJournal(){
+    _open = false;
+    _dirty = false;
+    _buffered = 0;
+    _flushedAt = 0;
+    _flushIntervalMs = 0;
+    _priorBoot = 0;
+    _replayed = 0;
+    _header.count = 0;
+    _header.overwritten = 0;
+}
+
+TelemetryJournal Journal;
+
+int TelemetryJournal::Open(const char* fileName, const JournalConfiguration& config, uint32_t sourceHash)
+{
+    //reopened when recovery remounts the card, keep whatever is buffered
+    Close();
+    if (!config.enabled || config.max_records <= 0){
+        return static_cast<int>(JournalErrors::JOURNAL_DISABLED);
+    }
+
+    _file = SD.open(fileName, O_READ | O_WRITE | O_CREAT);
+    if (!_file){
+        LOG_ERROR("Failed to open journal %s", fileName);
+        return static_cast<int>(JournalErrors::JOURNAL_OPEN_FAILED);
+    }
+
+    JournalHeader existing;
+    bool valid = _file.size() >= sizeof(existing) &&
+        _file.read(reinterpret_cast<uint8_t*>(&existing), sizeof(existing)) == sizeof(existing) &&
+        existing.magic == JOURNAL_MAGIC &&
+        existing.version == JOURNAL_VERSION &&
+        existing.record_size == sizeof(JournalRecord) &&
+        existing.capacity == static_cast<uint32_t>(config.max_records) &&
+        existing.source_hash == sourceHash &&
+        existing.head < existing.capacity &&
+        existing.count <= existing.capacity;
+
+    if (valid){
+        _header = existing;
+        LOG_INFO("Journal opened, records waiting to be sent: %lu", static_cast<unsigned long>(_header.count));
+    }
+    else{
+        //records from another configuration or layout can't be mapped back to registers
+        if (_file.size() > 0){
+            LOG_WARN("Discarding journal written by another configuration");
+            _file.close();
+            SD.remove(fileName);
+            _file = SD.open(fileName, O_READ | O_WRITE | O_CREAT);
+            if (!_file){
+                return static_cast<int>(JournalErrors::JOURNAL_OPEN_FAILED);
+            }
+        }
+        _header.magic = JOURNAL_MAGIC;
+        _header.version = JOURNAL_VERSION;
+        _header.record_size = sizeof(JournalRecord);
+        _header.capacity = config.max_records;
+        _header.source_hash = sourceHash;
+        _header.head = 0;
+        _header.count = 0;
+        _header.overwritten = 0;
+        if (WriteHeader() < 0){
+            _file.close();
+            return static_cast<int>(JournalErrors::JOURNAL_WRITE_FAILED);
+        }
+    }
+
+    _priorBoot = _header.count;
+    _buffered = 0;
+    _dirty = false;
+    _flushIntervalMs = config.flush_interval_sec * 1000UL;
+    _flushedAt = millis();
+    _open = true;
+    return static_cast<int>(JournalErrors::SUCCESS);
+}
+
+void TelemetryJournal::Close()
+{
+    if (!_open){
+        return;
+    }
+    Flush();
+    _file.close();
+    _open = false;
+}
+
+bool TelemetryJournal::IsOpen()
+{
+    return _open;
+}
+
+int TelemetryJournal::Append(uint16_t registerIndex, int32_t value)
+{
+    if (!_open){
+        return static_cast<int>(JournalErrors::JOURNAL_DISABLED);
+    }
+
+    JournalRecord* record = &_buffer[_buffered++];
+    record->timestamp_ms = millis();
+    record->register_index = registerIndex;
+    record->value = value;
+
+    if (_buffered >= JOURNAL_BUFFER_RECORDS){
+        return Flush();
+    }
+    return static_cast<int>(JournalErrors::SUCCESS);
+}
+
+int TelemetryJournal::Flush()
+{
+    if (!_open){
+        return static_cast<int>(JournalErrors::JOURNAL_DISABLED);
+    }
+    _flushedAt = millis();
+
+    if (_buffered > 0){
+        uint32_t capacity = _header.capacity;
+        uint32_t count = _buffered;
+        const JournalRecord* records = _buffer;
+        //a buffer larger than the ring keeps only its newest records
+        if (count > capacity){
+            _header.overwritten += count - capacity;
+            records += count - capacity;
+            count = capacity;
+        }
+
+        //the ring wraps at most once per flush
+        uint32_t tail = (_header.head + _header.count) % capacity;
+        uint32_t first = min(count, capacity - tail);
+        if (WriteRecords(tail, records, first) < 0 ||
+            (count > first && WriteRecords(0, records + first, count - first) < 0))
+        {
+            LOG_ERROR("Failed to write telemetry journal, journaling stopped");
+            _file.close();
+            _open = false;
+            return static_cast<int>(JournalErrors::JOURNAL_WRITE_FAILED);
+        }
+
+        //once full the newest records replace the oldest
+        uint32_t total = _header.count + count;
+        if (total > capacity){
+            uint32_t lost = total - capacity;
+            _header.head = (_header.head + lost) % capacity;
+            _header.overwritten += lost;
+            _priorBoot = _priorBoot > lost ? _priorBoot - lost : 0;
+            total = capacity;
+        }
+        _header.count = total;
+        _buffered = 0;
+        _dirty = true;
+    }
+
+    //the header follows the records so a reset mid-flush never exposes unwritten records
+    if (_dirty){
+        if (WriteHeader() < 0){
+            LOG_ERROR("Failed to write telemetry journal, journaling stopped");
+            _file.close();
+            _open = false;
+            return static_cast<int>(JournalErrors::JOURNAL_WRITE_FAILED);
+        }
+        _dirty = false;
+    }
+    return static_cast<int>(JournalErrors::SUCCESS);
+}
+
+int TelemetryJournal::Maintain()
+{
+    if (!_open){
+        return static_cast<int>(JournalErrors::JOURNAL_DISABLED);
+    }
+    if ((_buffered > 0 || _dirty) && millis() - _flushedAt >= _flushIntervalMs){
+        return Flush();
+    }
+    return static_cast<int>(JournalErrors::SUCCESS);
+}
+
+bool TelemetryJournal::Peek(JournalRecord* record)
+{
+    if (!_open || _header.count == 0){
+        return false;
+    }
+
+    uint32_t offset = sizeof(JournalHeader) + _header.head * sizeof(JournalRecord);
+    if (!_file.seek(offset) ||
+        _file.read(reinterpret_cast<uint8_t*>(record), sizeof(JournalRecord)) != sizeof(JournalRecord))
+    {
+        LOG_ERROR("Failed to read telemetry journal, journaling stopped");
+        _file.close();
+        _open = false;
+        return false;
+    }
+    return true;
+}
+
+void TelemetryJournal::Pop()
+{
+    if (!_open || _header.count == 0){
+        return;
+    }
+    _header.head = (_header.head + 1) % _header.capacity;
+    _header.count--;
+    if (_priorBoot > 0){
+        _priorBoot--;
+    }
+    _replayed++;
+    _dirty = true;
+}
+
+bool TelemetryJournal::IsFromPriorBoot()
+{
+    return _priorBoot > 0;
+}
+
+unsigned long TelemetryJournal::GetBacklog()
+{
+    if (!_open){
+        return 0;
+    }
+    return _header.count + _buffered;
+}
+
+unsigned long TelemetryJournal::GetOverwritten()
+{
+    return _header.overwritten;
+}
+
+unsigned long TelemetryJournal::GetReplayed()
+{
+    return _replayed;
+}
+
+int TelemetryJournal::WriteHeader()
+{
+    if (!_file.seek(0) ||
+        _file.write(reinterpret_cast<const uint8_t*>(&_header), sizeof(_header)) != sizeof(_header))
+    {
+        return static_cast<int>(JournalErrors::JOURNAL_WRITE_FAILED);
+    }
+    _file.flush();
+    return static_cast<int>(JournalErrors::SUCCESS);
+}
+
+int TelemetryJournal::WriteRecords(uint32_t slot, const JournalRecord* records, uint32_t count)
+{
+    //the ring only grows at its end until it first wraps, so a slot is never past the end of the file
+    size_t len = count * sizeof(JournalRecord);
+    if (!_file.seek(sizeof(JournalHeader) + slot * sizeof(JournalRecord)) ||
+        _file.write(reinterpret_cast<const uint8_t*>(records), len) != len)
+    {
+        return static_cast<int>(JournalErrors::JOURNAL_WRITE_FAILED);
+    }
+    return static_cast<int>(JournalErrors::SUCCESS);
+}
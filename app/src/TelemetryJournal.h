@@ -0,0 +1,92 @@
+#ifndef TelemetryJournal_h
+#define TelemetryJournal_h
+
+#include "Arduino.h"
+#include <SD.h>
+#include "ConfigurationManager.h"
+
+//records held in RAM before they are written to the card together
+#define JOURNAL_BUFFER_RECORDS 32
+//bump whenever JournalRecord or JournalHeader changes, older journals are discarded
+#define JOURNAL_VERSION 1
+
+/// @brief Telemetry sample that could not be published
+struct __attribute__((packed)) JournalRecord
+{
+    //millis() when the register was read
+    uint32_t timestamp_ms;
+    //index into ModbusConfiguration::registers
+    uint16_t register_index;
+    int32_t value;
+};
+
+/// @brief Start of the journal file, records follow as a ring
+struct JournalHeader
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_size;
+    uint32_t capacity;
+    //register indices are only meaningful for the configuration that wrote them
+    uint32_t source_hash;
+    //ring position of the oldest record
+    uint32_t head;
+    uint32_t count;
+    //records lost to the ring wrapping since the journal was created
+    uint32_t overwritten;
+};
+
+enum class JournalErrors
+{
+    SUCCESS,
+    JOURNAL_DISABLED = -100,
+    JOURNAL_OPEN_FAILED,
+    JOURNAL_WRITE_FAILED,
+    JOURNAL_READ_FAILED,
+};
+
+/// @brief Append-only ring of telemetry records on the SD card
+/// Appends are combined in RAM and written when the buffer fills or flush_interval_sec passes.
+/// Replay is at-least-once, the head is persisted with each flush so a reset may resend a few records.
+class TelemetryJournal
+{
+    public:
+        TelemetryJournal();
+        //open or create the journal, an existing journal from another configuration is discarded
+        int Open(const char* fileName, const JournalConfiguration& config, uint32_t sourceHash);
+        void Close();
+        bool IsOpen();
+        //buffer a record, the buffer is written to the card when full
+        int Append(uint16_t registerIndex, int32_t value);
+        //write buffered records and the ring position to the card
+        int Flush();
+        //flush buffered records and replay progress every flush_interval_sec
+        int Maintain();
+        //oldest unsent record, false if the journal is empty
+        bool Peek(JournalRecord* record);
+        //drop the record returned by Peek
+        void Pop();
+        //true if the oldest record was written before this boot, its timestamp is from another clock
+        bool IsFromPriorBoot();
+        //records waiting to be replayed, including buffered records
+        unsigned long GetBacklog();
+        unsigned long GetOverwritten();
+        unsigned long GetReplayed();
+    private:
+        File _file;
+        bool _open;
+        bool _dirty;
+        JournalHeader _header;
+        JournalRecord _buffer[JOURNAL_BUFFER_RECORDS];
+        int _buffered;
+        unsigned long _flushedAt;
+        unsigned long _flushIntervalMs;
+        unsigned long _priorBoot;
+        unsigned long _replayed;
+        int WriteHeader();
+        int WriteRecords(uint32_t slot, const JournalRecord* records, uint32_t count);
+};
+
+extern TelemetryJournal Journal;	//Default class instance
+
+#endif
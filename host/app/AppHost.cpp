@@ -0,0 +1,105 @@
+//the sketch, converted by cmake/InoToCpp.cmake, its "src/..." includes resolve against app/
+#include "app.ino.cpp"
+#include "AppHost.h"
+
+AppHost App;
+
+void AppHost::Setup()
+{
+    setup();
+}
+
+void AppHost::Loop()
+{
+    loop();
+}
+
+Config* AppHost::GetConfig()
+{
+    return config;
+}
+
+int AppHost::GetErrorCode()
+{
+    return errorCode;
+}
+
+bool AppHost::IsConfigLoaded()
+{
+    return configLoaded;
+}
+
+bool AppHost::IsRemoteConnected()
+{
+    return remoteConnected;
+}
+
+bool AppHost::IsTelemetryIdle()
+{
+    return telemetryState == TelemetryState::IDLE;
+}
+
+bool AppHost::IsCommandIdle()
+{
+    return commandState == CommandState::IDLE && CommandQ.IsEmpty();
+}
+
+bool AppHost::IsReloadPending()
+{
+    return reloadRequested || pendingReload != nullptr;
+}
+
+const char* AppHost::GetConfigFileName()
+{
+    return filename;
+}
+
+const char* AppHost::GetJournalFileName()
+{
+    return journalFilename;
+}
+
+unsigned long AppHost::GetTelemetrySent()
+{
+    return telemetryStats.sent;
+}
+
+unsigned long AppHost::GetTelemetrySuppressed()
+{
+    return telemetryStats.suppressed;
+}
+
+unsigned long AppHost::GetTelemetryJournaled()
+{
+    return telemetryStats.journaled;
+}
+
+unsigned long AppHost::GetTelemetryLost()
+{
+    return telemetryStats.lost;
+}
+
+unsigned long AppHost::GetCommandBatches()
+{
+    return commandStats.batches;
+}
+
+unsigned long AppHost::GetCommandTransactions()
+{
+    return commandStats.transactions;
+}
+
+unsigned long AppHost::GetCommandLastLatencyMs()
+{
+    return commandStats.lastLatencyMs;
+}
+
+unsigned long AppHost::GetCommandMaxLatencyMs()
+{
+    return commandStats.maxLatencyMs;
+}
+
+int AppHost::GetTelemetryFrequencyMs()
+{
+    return telemetryFrequency;
+}
@@ -0,0 +1,40 @@
+#ifndef AppHost_h
+#define AppHost_h
+
+#include "../../app/src/ConfigurationManager.h"
+
+/// @brief Runs the sketch on the host and exposes the state tests and benchmarks look at
+/// app.ino is compiled into AppHost.cpp the way the Arduino builder does it, so its globals are reached
+/// from here rather than through declarations copied out of the sketch.
+class AppHost
+{
+    public:
+        void Setup();
+        void Loop();
+        Config* GetConfig();
+        int GetErrorCode();
+        bool IsConfigLoaded();
+        bool IsRemoteConnected();
+        bool IsTelemetryIdle();
+        bool IsCommandIdle();
+        bool IsReloadPending();
+        //the configuration file and journal on the card
+        const char* GetConfigFileName();
+        const char* GetJournalFileName();
+        //report by exception results since boot
+        unsigned long GetTelemetrySent();
+        unsigned long GetTelemetrySuppressed();
+        unsigned long GetTelemetryJournaled();
+        unsigned long GetTelemetryLost();
+        //command batches finished, bus transactions they took and the message to last write latency
+        unsigned long GetCommandBatches();
+        unsigned long GetCommandTransactions();
+        unsigned long GetCommandLastLatencyMs();
+        unsigned long GetCommandMaxLatencyMs();
+        //time between telemetry cycles
+        int GetTelemetryFrequencyMs();
+};
+
+extern AppHost App;	//Default class instance
+
+#endif
@@ -0,0 +1,265 @@
+#include "Harness.h"
+#include "../sim/SimClock.h"
+#include "../sim/SimulatedBus.h"
+#include "../sim/FakeBroker.h"
+#include "../sim/AllocCounter.h"
+#include <SD.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+
+Harness::Harness(){
+    idleMicros = 100;
+    createSlaves = true;
+    cycles = 0;
+    lastCycleMicros = 0;
+    _cardPath[0] = '\0';
+    _cycleRunning = false;
+    _cycleStartedAt = 0;
+    ResetLoopStats();
+}
+
+Harness Sim;
+
+bool Harness::CreateCard()
+{
+    AllocCounter::Pause pause;
+    const char* tmp = getenv("TMPDIR");
+    snprintf(_cardPath, sizeof(_cardPath), "%s/vfdctl-card-XXXXXX", tmp != nullptr ? tmp : "/tmp");
+    if (mkdtemp(_cardPath) == nullptr){
+        return false;
+    }
+    SD.SetRoot(_cardPath);
+    return true;
+}
+
+const char* Harness::GetCardPath()
+{
+    return _cardPath;
+}
+
+bool Harness::WriteFile(const char* name, const std::string& contents)
+{
+    AllocCounter::Pause pause;
+    std::string path = std::string(_cardPath) + "/" + name;
+    FILE* fp = fopen(path.c_str(), "wb");
+    if (fp == nullptr){
+        return false;
+    }
+    bool ok = fwrite(contents.data(), 1, contents.size(), fp) == contents.size();
+    return fclose(fp) == 0 && ok;
+}
+
+bool Harness::CopyFile(const char* source, const char* name)
+{
+    AllocCounter::Pause pause;
+    FILE* fp = fopen(source, "rb");
+    if (fp == nullptr){
+        return false;
+    }
+    std::string contents;
+    char buffer[4096];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+    {
+        contents.append(buffer, n);
+    }
+    fclose(fp);
+    return WriteFile(name, contents);
+}
+
+std::string Harness::ReadFile(const char* name)
+{
+    AllocCounter::Pause pause;
+    std::string path = std::string(_cardPath) + "/" + name;
+    std::string contents;
+    FILE* fp = fopen(path.c_str(), "rb");
+    if (fp == nullptr){
+        return contents;
+    }
+    char buffer[4096];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+    {
+        contents.append(buffer, n);
+    }
+    fclose(fp);
+    return contents;
+}
+
+void Harness::Boot()
+{
+    App.Setup();
+    Config* config = App.GetConfig();
+    if (!App.IsConfigLoaded()){
+        return;
+    }
+    Broker.Start(config->broker.broker_url, config->broker.broker_port);
+    if (createSlaves){
+        CreateSlaves();
+    }
+}
+
+void Harness::CreateSlaves()
+{
+    AllocCounter::Pause pause;
+    Config* config = App.GetConfig();
+    std::vector<int> ids;
+    ModbusRegisterTable* regs = &config->modbus.registers;
+    for (int i = 0; i < regs->count; i++)
+    {
+        ids.push_back(regs->device_id[i]);
+    }
+    for (int i = 0; i < config->modbus.configuration_register_count; i++)
+    {
+        ids.push_back(config->modbus.configuration_registers[i].device_id);
+    }
+    for (int i = 0; i < config->modbus.device_count; i++)
+    {
+        ids.push_back(config->modbus.devices[i].device_id);
+    }
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+    for (int id : ids)
+    {
+        ModbusDeviceTransport* tcp = nullptr;
+        for (int i = 0; i < config->modbus.device_count; i++)
+        {
+            if (config->modbus.devices[i].device_id == id && config->modbus.devices[i].transport == eModbusTransport::transport_tcp){
+                tcp = &config->modbus.devices[i];
+            }
+        }
+        SimSlave* slave;
+        if (tcp != nullptr){
+            SimTcpSlave* server = new SimTcpSlave(id);
+            server->Start(tcp->host, tcp->port);
+            _tcpSlaves.push_back(server);
+            slave = &server->slave;
+        }else{
+            slave = new SimSlave(id);
+            RtuBus.Attach(slave);
+            _rtuSlaves.push_back(slave);
+        }
+        //every telemetry register starts with a distinct value so the first cycle publishes all of them
+        for (int i = 0; i < regs->count; i++)
+        {
+            if (regs->device_id[i] == id){
+                int table = regs->type[i] == eRegisterType::coil ? SIM_COILS :
+                    regs->type[i] == eRegisterType::discrete_input ? SIM_DISCRETE_INPUTS :
+                    regs->type[i] == eRegisterType::input_register ? SIM_INPUT_REGISTERS : SIM_HOLDING_REGISTERS;
+                slave->Set(table, regs->address[i], static_cast<uint16_t>(100 + i));
+            }
+        }
+    }
+}
+
+SimSlave* Harness::Slave(int deviceId)
+{
+    for (SimSlave* slave : _rtuSlaves)
+    {
+        if (slave->id == deviceId){
+            return slave;
+        }
+    }
+    for (SimTcpSlave* server : _tcpSlaves)
+    {
+        if (server->slave.id == deviceId){
+            return &server->slave;
+        }
+    }
+    return nullptr;
+}
+
+void Harness::Command(const char* topic, const char* payload)
+{
+    Broker.Publish(topic, payload);
+}
+
+void Harness::ResetLoopStats()
+{
+    loopStats.passes = 0;
+    loopStats.totalMicros = 0;
+    loopStats.worstMicros = 0;
+    loopStats.squareMicros = 0;
+    loopStats.cpuTotalMicros = 0;
+    loopStats.cpuWorstMicros = 0;
+    loopStats.cpuSquareMicros = 0;
+    totalCycleMicros = 0;
+    worstCycleMicros = 0;
+}
+
+void Harness::Step()
+{
+    uint64_t simulated = Clock.GetSimulatedMicros();
+    uint64_t start = Clock.Micros();
+    bool wasIdle = App.IsTelemetryIdle();
+    App.Loop();
+    uint64_t end = Clock.Micros();
+    uint64_t elapsed = end - start;
+
+    loopStats.passes++;
+    loopStats.totalMicros += elapsed;
+    loopStats.squareMicros += static_cast<double>(elapsed) * elapsed;
+    if (elapsed > loopStats.worstMicros){
+        loopStats.worstMicros = elapsed;
+    }
+    uint64_t cpu = elapsed - (Clock.GetSimulatedMicros() - simulated);
+    loopStats.cpuTotalMicros += cpu;
+    loopStats.cpuSquareMicros += static_cast<double>(cpu) * cpu;
+    if (cpu > loopStats.cpuWorstMicros){
+        loopStats.cpuWorstMicros = cpu;
+    }
+
+    if (wasIdle && !App.IsTelemetryIdle()){
+        _cycleRunning = true;
+        _cycleStartedAt = start;
+    }else if (_cycleRunning && App.IsTelemetryIdle()){
+        _cycleRunning = false;
+        lastCycleMicros = end - _cycleStartedAt;
+        totalCycleMicros += lastCycleMicros;
+        if (lastCycleMicros > worstCycleMicros){
+            worstCycleMicros = lastCycleMicros;
+        }
+        cycles++;
+    }
+
+    if (Clock.GetSimulatedMicros() == simulated){
+        Clock.Advance(idleMicros);
+    }
+}
+
+void Harness::RunFor(uint64_t micros)
+{
+    uint64_t until = Clock.Micros() + micros;
+    while (Clock.Micros() < until)
+    {
+        Step();
+    }
+}
+
+bool Harness::RunUntil(bool (*done)(), uint64_t timeoutMicros)
+{
+    uint64_t until = Clock.Micros() + timeoutMicros;
+    while (!done())
+    {
+        if (Clock.Micros() >= until){
+            return false;
+        }
+        Step();
+    }
+    return true;
+}
+
+bool Harness::RunCycles(unsigned long count, uint64_t timeoutMicros)
+{
+    uint64_t until = Clock.Micros() + timeoutMicros;
+    while (cycles < count)
+    {
+        if (Clock.Micros() >= until){
+            return false;
+        }
+        Step();
+    }
+    return true;
+}
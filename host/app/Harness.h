@@ -0,0 +1,75 @@
+#ifndef Harness_h
+#define Harness_h
+
+#include "AppHost.h"
+#include "../sim/SimSlave.h"
+#include "../sim/SimTcpSlave.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/// @brief Timing of the loop() passes run by the harness
+struct LoopStats
+{
+    unsigned long passes;
+    //Clock time of the passes, simulated bus and broker time plus real time when enabled
+    uint64_t totalMicros;
+    uint64_t worstMicros;
+    //sum of squares, for the standard deviation
+    double squareMicros;
+    //the same passes without the simulated bus, network and broker time, only the firmware's own cost
+    uint64_t cpuTotalMicros;
+    uint64_t cpuWorstMicros;
+    double cpuSquareMicros;
+};
+
+/// @brief Boots the firmware against the simulated card, bus, slaves and broker and drives its loop
+/// Every scenario is expected to run in a fresh process, the firmware's globals are only set up once.
+class Harness
+{
+    public:
+        Harness();
+        //point the SD card at a new empty directory
+        bool CreateCard();
+        const char* GetCardPath();
+        //write a file on the card, ex: conf.txt
+        bool WriteFile(const char* name, const std::string& contents);
+        bool CopyFile(const char* source, const char* name);
+        std::string ReadFile(const char* name);
+        //setup(), then the broker is started at the configured address and a slave is created for every device
+        void Boot();
+        //one loop() pass, a pass that took no simulated time moves the clock on by idleMicros
+        void Step();
+        void RunFor(uint64_t micros);
+        //run until done() returns true, false if timeoutMicros passed first
+        bool RunUntil(bool (*done)(), uint64_t timeoutMicros);
+        //run until the telemetry cycles completed since boot reach count
+        bool RunCycles(unsigned long count, uint64_t timeoutMicros);
+        //the slave of a device, nullptr if the configuration doesn't use it
+        SimSlave* Slave(int deviceId);
+        //deliver a command message the way the broker would
+        void Command(const char* topic, const char* payload);
+        //time added after a pass that waited on nothing
+        uint32_t idleMicros;
+        //slaves are created by Boot() unless this is cleared first
+        bool createSlaves;
+        //completed telemetry cycles and the Clock time they took
+        unsigned long cycles;
+        uint64_t lastCycleMicros;
+        uint64_t totalCycleMicros;
+        uint64_t worstCycleMicros;
+        LoopStats loopStats;
+        //clears the loop and cycle timings, not the cycle count
+        void ResetLoopStats();
+    private:
+        char _cardPath[64];
+        std::vector<SimSlave*> _rtuSlaves;
+        std::vector<SimTcpSlave*> _tcpSlaves;
+        bool _cycleRunning;
+        uint64_t _cycleStartedAt;
+        void CreateSlaves();
+};
+
+extern Harness Sim;	//Default class instance
+
+#endif
@@ -0,0 +1,99 @@
+#include "SyntheticConfig.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+//registers of each slave start here, holding registers 40201 and up like the fr800 drives
+#define SYNTHETIC_FIRST_ADDRESS 200
+#define SYNTHETIC_FIRST_COMMAND 1000
+
+void appendf(std::string& out, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+void appendf(std::string& out, const char* format, ...)
+{
+    char line[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    out += line;
+}
+
+std::string buildSyntheticConfig(const SyntheticOptions& options)
+{
+    std::string out;
+    out += "{\n";
+    appendf(out, "    \"broker\":{\"broker_user\":\"\",\"broker_pass\":\"\",\"broker_url\":\"%s\",\"broker_port\":%d,\"broker_retry_interval_sec\":%d},\n",
+        options.brokerUrl, options.brokerPort, options.brokerRetryIntervalSec);
+    out += "    \"device\":{\"device_mac\":[],\"device_name\":\"prime\",\"ethernet_pin\":5},\n";
+    appendf(out, "    \"journal\":{\"enabled\":%s,\"max_records\":20000,\"flush_interval_sec\":10,\"replay_rate_per_sec\":20},\n",
+        options.journal ? "true" : "false");
+    out += "    \"modbus\":{\n";
+    appendf(out, "        \"offset\":-1,\"max_read_gap\":%d,\"telemetry_interval_sec\":%d,\"telemetry_mode\":\"%s\",\"payload_format\":\"%s\",\n",
+        options.maxReadGap, options.telemetryIntervalSec, options.telemetryMode, options.payloadFormat);
+    int buses = options.buses > 0 ? options.buses : 1;
+    out += "        \"serial_port\":";
+    for (int bus = 0; bus < buses; bus++)
+    {
+        appendf(out, "%s{\"baud_rate\":%d,\"data_bits\":8,\"parity_bits\":%d,\"stop_bits\":%d}",
+            buses == 1 ? "" : (bus == 0 ? "[" : ","), options.baudRate, options.parityBits, options.stopBits);
+    }
+    out += buses == 1 ? ",\n" : "],\n";
+
+    out += "        \"devices\":[";
+    int devices = options.devices > 0 ? options.devices : 1;
+    int entries = 0;
+    for (int id = 1; (options.rtuTimeoutMs > 0 || buses > 1) && id <= devices - options.tcpDevices; id++)
+    {
+        appendf(out, "%s{\"device_id\":%d,\"transport\":\"rtu\"", entries++ > 0 ? "," : "", id);
+        if (buses > 1){
+            appendf(out, ",\"bus\":%d", (id - 1) % buses);
+        }
+        if (options.rtuTimeoutMs > 0){
+            appendf(out, ",\"timeout_ms\":%d", options.rtuTimeoutMs);
+        }
+        out += "}";
+    }
+    for (int t = 0; t < options.tcpDevices && t < devices; t++)
+    {
+        int id = devices - options.tcpDevices + t + 1;
+        appendf(out, "%s{\"device_id\":%d,\"transport\":\"tcp\",\"host\":\"192.168.1.%d\",\"port\":502}",
+            entries++ > 0 ? "," : "", id, 100 + id);
+    }
+    out += "],\n";
+
+    out += "        \"telemetry_registers\":[\n";
+    for (int i = 0; i < options.registers; i++)
+    {
+        int device = 1 + i % devices;
+        int address = SYNTHETIC_FIRST_ADDRESS + (i / devices) * options.spacing;
+        appendf(out, "            {\"name\":\"r%d\",\"units\":\"u%d\",\"address\":%d,\"value\":0,\"device_id\":%d,\"topic\":\"dt/vfdctl/vfd%d/r%d\"",
+            i, i % 8, address, device, device, i);
+        if (options.sampleIntervalMs > 0){
+            appendf(out, ",\"sample_interval_ms\":%d", options.sampleIntervalMs);
+        }
+        if (strcmp(options.registerType, "holding_register") != 0){
+            appendf(out, ",\"type\":\"%s\"", options.registerType);
+        }
+        out += i + 1 < options.registers ? "},\n" : "}\n";
+    }
+    out += "        ],\n";
+
+    out += "        \"configuration_registers\":[\n";
+    for (int i = 0; i < options.commands; i++)
+    {
+        int device = 1 + i % devices;
+        int address = SYNTHETIC_FIRST_COMMAND + i / devices;
+        appendf(out, "            {\"name\":\"c%d\",\"units\":\"\",\"address\":%d,\"value\":0,\"device_id\":%d,\"topic\":\"cmd/vfdctl/vfd%d/c%d/config\",",
+            i, address, device, device, i);
+        if (strcmp(options.commandType, "holding_register") != 0){
+            appendf(out, "\"type\":\"%s\",", options.commandType);
+        }
+        appendf(out, "\"upper_limit\":1000,\"lower_limit\":0,\"limit_comparison\":\"between_or_equal\"%s\n",
+            i + 1 < options.commands ? "}," : "}");
+    }
+    out += "        ]\n";
+    out += "    }\n";
+    out += "}\n";
+    return out;
+}
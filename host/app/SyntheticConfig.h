@@ -0,0 +1,42 @@
+#ifndef SyntheticConfig_h
+#define SyntheticConfig_h
+
+#include <string>
+
+/// @brief Shape of a generated conf.txt, sized to exercise configurations larger than config-fr800.txt
+struct SyntheticOptions
+{
+    int registers = 50;
+    int commands = 10;
+    //slaves the registers are spread over, device ids start at 1
+    int devices = 1;
+    //the last tcpDevices slaves are reached over modbus tcp at 192.168.1.101, .102, ...
+    int tcpDevices = 0;
+    //address step between two registers of a slave, 1 = contiguous blocks
+    int spacing = 1;
+    int maxReadGap = 4;
+    int telemetryIntervalSec = 1;
+    //0 = no sampling
+    int sampleIntervalMs = 0;
+    //modbus table of the telemetry and configuration registers, ex: "coil"
+    const char* registerType = "holding_register";
+    const char* commandType = "holding_register";
+    const char* telemetryMode = "per_register";
+    const char* payloadFormat = "json";
+    int baudRate = 9600;
+    int parityBits = 0;
+    int stopBits = 1;
+    bool journal = true;
+    //response timeout override given to every rtu slave, 0 = adapted to each slave's response time
+    int rtuTimeoutMs = 0;
+    //serial buses the rtu slaves are spread over, slave id goes on bus (id - 1) % buses
+    int buses = 1;
+    const char* brokerUrl = "192.168.1.18";
+    int brokerPort = 1883;
+    int brokerRetryIntervalSec = 60;
+};
+
+//conf.txt contents for the options
+std::string buildSyntheticConfig(const SyntheticOptions& options);
+
+#endif
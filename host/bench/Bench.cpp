@@ -0,0 +1,71 @@
+#include "Bench.h"
+#include "Check.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+//stack given to benchPeakStack() threads, painted with STACK_PAINT before fn runs
+#define STACK_SIZE (4 * 1024 * 1024)
+#define STACK_PAINT 0xA5
+
+bool benchCard(const BenchConfig& config)
+{
+    if (!Sim.CreateCard()){
+        return false;
+    }
+    if (config.options == nullptr){
+        return Sim.CopyFile(repoPath("config-fr800.txt"), "conf.txt");
+    }
+    return Sim.WriteFile("conf.txt", buildSyntheticConfig(*config.options));
+}
+
+double benchStddev(unsigned long count, double sum, double squares)
+{
+    if (count < 2){
+        return 0;
+    }
+    double mean = sum / count;
+    double variance = squares / count - mean * mean;
+    return variance > 0 ? sqrt(variance) : 0;
+}
+
+void* benchStackThread(void* fn)
+{
+    reinterpret_cast<void (*)()>(fn)();
+    return nullptr;
+}
+
+void benchNothing()
+{
+}
+
+size_t benchStackUsed(void (*fn)())
+{
+    std::vector<uint8_t> stack(STACK_SIZE, STACK_PAINT);
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstack(&attr, stack.data(), stack.size());
+    pthread_t thread;
+    if (pthread_create(&thread, &attr, benchStackThread, reinterpret_cast<void*>(fn)) != 0){
+        pthread_attr_destroy(&attr);
+        return 0;
+    }
+    pthread_join(thread, nullptr);
+    pthread_attr_destroy(&attr);
+    //the stack grows down, the first byte not holding the paint is the deepest one reached
+    size_t untouched = 0;
+    while (untouched < stack.size() && stack[untouched] == STACK_PAINT)
+    {
+        untouched++;
+    }
+    return stack.size() - untouched;
+}
+
+size_t benchPeakStack(void (*fn)())
+{
+    //the thread's own descriptor and tls sit at the top of the stack it is given
+    size_t used = benchStackUsed(fn);
+    size_t overhead = benchStackUsed(benchNothing);
+    return used > overhead ? used - overhead : 0;
+}
@@ -0,0 +1,25 @@
+#ifndef Bench_h
+#define Bench_h
+
+#include "../app/Harness.h"
+#include "../app/SyntheticConfig.h"
+#include <math.h>
+#include <stddef.h>
+
+//configuration a benchmark runs against, config-fr800.txt when options is nullptr
+struct BenchConfig
+{
+    const char* name;
+    const SyntheticOptions* options;
+};
+
+//put the configuration on a new card
+bool benchCard(const BenchConfig& config);
+
+//run fn on a thread with a painted stack, returns the deepest stack bytes it used
+size_t benchPeakStack(void (*fn)());
+
+//standard deviation from a count, a sum and a sum of squares
+double benchStddev(unsigned long count, double sum, double squares);
+
+#endif
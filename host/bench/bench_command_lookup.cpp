@@ -0,0 +1,149 @@
+#include "Bench.h"
+#include "Check.h"
+#include "../sim/AllocCounter.h"
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+
+//command topic lookup through the sorted hash index against the linear scan it replaced
+#define LOOKUPS 200000
+//Serial rate the old scan's debug lines were printed at
+#define SERIAL_BAUD 115200
+
+/// @brief Configuration register as it was stored before the index, copied by value during the scan
+struct LegacyConfigParameter
+{
+    bool formed = false;
+    const char* key = "configuration_registers";
+    char name[32];
+    char units[16];
+    char topic[64];
+    int address;
+    int value;
+    int device_id;
+    int upper_limit;
+    int lower_limit;
+    eLimitComparison limit_comparison;
+};
+
+int legacyCount;
+LegacyConfigParameter* legacyRegisters;
+
+/// @brief The scan GetParameter() did before the index, with its Serial lines and String copies
+LegacyConfigParameter legacyGetParameter(String topic)
+{
+    String s = "";
+    Serial.print("Searching for ");
+    Serial.println(topic.c_str());
+    for (int i = 0; i < legacyCount; i++)
+    {
+        LegacyConfigParameter param = legacyRegisters[i];
+        s = param.topic;
+        Serial.print("Found ");
+        Serial.println(s.c_str());
+        //s.startsWith(topic)
+        if (strncmp(s.c_str(), topic.c_str(), topic.length()) == 0){
+            Serial.println("Found match!");
+            Serial.println(param.name);
+            Serial.println(param.device_id);
+            Serial.println(param.address);
+            Serial.println(static_cast<long>(param.limit_comparison));
+            return param;
+        }
+    }
+    Serial.print("Unable to find a matching modbus param with topic ");
+    Serial.println(s.c_str());
+    return LegacyConfigParameter{};
+}
+
+const SyntheticOptions* lookupOptions;
+
+void runLookupBench()
+{
+    BenchConfig config = {"lookup", lookupOptions};
+    if (!benchCard(config)){
+        checkFailures++;
+        return;
+    }
+    App.Setup();
+    if (!App.IsConfigLoaded()){
+        checkFailures++;
+        return;
+    }
+    Config* live = App.GetConfig();
+    int count = live->modbus.configuration_register_count;
+
+    //the same registers in the old layout, and every topic plus one that matches nothing
+    std::vector<LegacyConfigParameter> legacy(count);
+    std::vector<std::string> topics;
+    for (int i = 0; i < count; i++)
+    {
+        ModbusConfigParameter* param = &live->modbus.configuration_registers[i];
+        strlcpy(legacy[i].name, param->name, sizeof(legacy[i].name));
+        strlcpy(legacy[i].units, param->units, sizeof(legacy[i].units));
+        ConfigMgr.FormatTopic(param->topic, legacy[i].topic, sizeof(legacy[i].topic));
+        legacy[i].address = param->address;
+        legacy[i].device_id = param->device_id;
+        topics.push_back(legacy[i].topic);
+    }
+    topics.push_back("cmd/vfdctl/vfd1/unknown/config");
+    for (int i = 0; i < count; i++)
+    {
+        CHECK(ConfigMgr.GetParameter(topics[i].c_str(), live) == &live->modbus.configuration_registers[i]);
+    }
+    CHECK(ConfigMgr.GetParameter(topics[count].c_str(), live) == nullptr);
+    legacyCount = count;
+    legacyRegisters = legacy.data();
+
+    int found = 0;
+    AllocCounter::Reset();
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < LOOKUPS; i++)
+    {
+        found += ConfigMgr.GetParameter(topics[i % topics.size()].c_str(), live) != nullptr;
+    }
+    double indexNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / LOOKUPS;
+    uint64_t indexAllocs = AllocCounter::GetAllocations();
+
+    //the scan is slow enough that fewer lookups give a stable figure
+    int legacyLookups = LOOKUPS / (count / 10 + 1);
+    unsigned long serialBytes = Serial.written;
+    AllocCounter::Reset();
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < legacyLookups; i++)
+    {
+        String topic(topics[i % topics.size()].c_str());
+        found += legacyGetParameter(topic).address != 0;
+    }
+    double legacyNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / legacyLookups;
+    uint64_t legacyAllocs = AllocCounter::GetAllocations();
+    double legacySerial = static_cast<double>(Serial.written - serialBytes) / legacyLookups;
+    CHECK(found > 0);
+
+    //ten bits per character on the wire
+    printf("%6d %12.1f %10.2f %12.1f %10.2f %12.0f %12.1f %8.0fx\n", count,
+        indexNs, static_cast<double>(indexAllocs) / LOOKUPS,
+        legacyNs, static_cast<double>(legacyAllocs) / legacyLookups,
+        legacySerial, legacySerial * 10 * 1000 / SERIAL_BAUD, legacyNs / indexNs);
+    fflush(stdout);
+}
+
+int main()
+{
+    SyntheticOptions small;
+    small.registers = 1;
+    small.commands = 50;
+    SyntheticOptions large = small;
+    large.commands = 500;
+    large.devices = 10;
+
+    printf("mean of every configured topic and one unknown topic, host cpu time\n");
+    printf("%6s %12s %10s %12s %10s %12s %12s %9s\n", "regs", "index_ns", "allocs", "scan_ns", "allocs",
+        "serial_B", "serial_ms", "speedup");
+    int failures = 0;
+    lookupOptions = &small;
+    failures += runScenario("lookup-50", runLookupBench);
+    lookupOptions = &large;
+    failures += runScenario("lookup-500", runLookupBench);
+    return failures;
+}
@@ -0,0 +1,98 @@
+#include "Bench.h"
+#include "Check.h"
+#include "../sim/AllocCounter.h"
+#include <SD.h>
+#include <chrono>
+#include <stdio.h>
+
+//configuration load time and peak stack against the number of registers, json against the snapshot
+#define LOADS 5
+
+char loadFileName[] = "conf.txt";
+Config* loadConfig;
+int loadResult;
+
+void loadOnce()
+{
+    loadResult = ConfigMgr.Load(loadFileName, loadConfig);
+}
+
+const SyntheticOptions* loadOptions;
+
+void runLoadBench()
+{
+    BenchConfig config = {"load", loadOptions};
+    if (!benchCard(config) || ConfigMgr.Init(true, SDCARD_SS_PIN) < 0){
+        checkFailures++;
+        return;
+    }
+
+    //the json path each time, the snapshot written by the previous load is removed first
+    double best = 0;
+    size_t stack = 0;
+    uint64_t heapBytes = 0;
+    unsigned long sdBytes = 0;
+    double snapshotBest = 0;
+    size_t snapshotStack = 0;
+    unsigned long snapshotSdBytes = 0;
+    for (int i = 0; i < LOADS; i++)
+    {
+        SD.remove("conf.bin");
+        loadConfig = new Config{};
+        AllocCounter::Reset();
+        unsigned long readBefore = SD.bytesRead;
+        auto start = std::chrono::steady_clock::now();
+        loadOnce();
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        CHECK_EQ(loadResult, 0);
+        best = i == 0 || ms < best ? ms : best;
+        heapBytes = AllocCounter::GetBytes();
+        sdBytes = SD.bytesRead - readBefore;
+
+        //the snapshot the json load just wrote
+        loadConfig = new Config{};
+        readBefore = SD.bytesRead;
+        start = std::chrono::steady_clock::now();
+        loadOnce();
+        ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        CHECK_EQ(loadResult, 0);
+        snapshotBest = i == 0 || ms < snapshotBest ? ms : snapshotBest;
+        snapshotSdBytes = SD.bytesRead - readBefore;
+        loadConfig = new Config{};
+        snapshotStack = benchPeakStack(loadOnce);
+
+        //both loads again on a painted stack
+        SD.remove("conf.bin");
+        loadConfig = new Config{};
+        stack = benchPeakStack(loadOnce);
+        CHECK_EQ(loadResult, 0);
+    }
+    CHECK_EQ(loadConfig->modbus.registers.count, loadOptions->registers);
+    printf("%6d %10zu %10.2f %10zu %10llu %10lu %10.2f %10zu %10lu %8.0fx\n", loadOptions->registers,
+        buildSyntheticConfig(*loadOptions).size(), best, stack, static_cast<unsigned long long>(heapBytes), sdBytes,
+        snapshotBest, snapshotStack, snapshotSdBytes, best / snapshotBest);
+    fflush(stdout);
+}
+
+int main()
+{
+    SyntheticOptions configs[3];
+    configs[0].registers = 50;
+    configs[1].registers = 500;
+    configs[1].devices = 4;
+    configs[1].commands = 50;
+    configs[2].registers = 2000;
+    configs[2].devices = 16;
+    configs[2].commands = 200;
+
+    printf("json path including the snapshot write, then the snapshot path, best of %d loads, host cpu time\n", LOADS);
+    printf("%6s %10s %10s %10s %10s %10s %10s %10s %10s %9s\n", "regs", "file_B", "load_ms", "stack_B", "heap_B", "sd_read_B",
+        "snap_ms", "stack_B", "sd_read_B", "speedup");
+    int failures = 0;
+    for (const SyntheticOptions& options : configs)
+    {
+        loadOptions = &options;
+        failures += runScenario("load", runLoadBench);
+    }
+    return failures;
+}
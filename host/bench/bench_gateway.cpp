@@ -0,0 +1,152 @@
+#include "Bench.h"
+#include "Check.h"
+#include "../gateway/Gateway.h"
+#include "../../app/src/Log.h"
+#include "../sim/PtyBus.h"
+#include "../sim/SimSlave.h"
+#include "../sim/TcpBroker.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <sys/mman.h>
+#include <unistd.h>
+
+//aggregate samples per second of the Linux gateway as buses are added, each bus a pty pair with one slave
+//polled back to back at 115200 baud, the slave answering after its default 2 ms latency
+#define MEASURE_SECONDS 3
+#define MAX_BUSES 6
+//character time at 115200 baud, 8N1
+#define CHAR_MICROS 87
+
+const int registersPerBus[] = {8, 64};
+
+/// @brief Rates measured in a scenario's child process
+struct GatewayRates
+{
+    double samples;
+    double published;
+    unsigned long readErrors;
+    unsigned long dropped;
+};
+
+int benchBuses;
+int benchRegisters;
+//written by the scenario's child process
+GatewayRates* rates;
+
+void runGatewayBench()
+{
+    TcpBroker broker;
+    PtyBus buses[MAX_BUSES];
+    SimSlave* slaves[MAX_BUSES];
+    if (!broker.Start()){
+        checkFailures++;
+        return;
+    }
+    broker.SetLogging(false);
+
+    SyntheticOptions options;
+    options.buses = benchBuses;
+    options.devices = benchBuses;
+    options.registers = benchRegisters * benchBuses;
+    options.commands = 0;
+    options.telemetryIntervalSec = 0;
+    options.baudRate = 115200;
+    options.journal = false;
+    options.brokerUrl = "127.0.0.1";
+    options.brokerPort = broker.GetPort();
+
+    const char* ports[MAX_BUSES];
+    for (int bus = 0; bus < benchBuses; bus++)
+    {
+        if (!buses[bus].Open()){
+            checkFailures++;
+            return;
+        }
+        buses[bus].SetCharMicros(CHAR_MICROS);
+        slaves[bus] = new SimSlave(bus + 1);
+        buses[bus].Attach(slaves[bus]);
+        buses[bus].Start();
+        ports[bus] = buses[bus].GetPath();
+    }
+
+    char dir[] = "/tmp/vfdctl_benchXXXXXX";
+    if (mkdtemp(dir) == nullptr){
+        checkFailures++;
+        return;
+    }
+    std::string path = std::string(dir) + "/conf.txt";
+    FILE* file = fopen(path.c_str(), "w");
+    std::string config = buildSyntheticConfig(options);
+    fwrite(config.data(), 1, config.size(), file);
+    fclose(file);
+
+    if (LinuxGateway.Begin(path.c_str(), ports, benchBuses) < 0){
+        Log.Drain();
+        checkFailures++;
+        return;
+    }
+    LinuxGateway.Start();
+    //settle, the first cycles include connecting to the broker
+    usleep(500000);
+    unsigned long samples = 0;
+    unsigned long errors = 0;
+    for (int bus = 0; bus < benchBuses; bus++)
+    {
+        samples += LinuxGateway.GetBus(bus)->stats.samples;
+        errors += LinuxGateway.GetBus(bus)->stats.read_errors;
+    }
+    unsigned long published = broker.publishes;
+    usleep(MEASURE_SECONDS * 1000000);
+    unsigned long samplesAfter = 0;
+    unsigned long errorsAfter = 0;
+    unsigned long dropped = 0;
+    for (int bus = 0; bus < benchBuses; bus++)
+    {
+        samplesAfter += LinuxGateway.GetBus(bus)->stats.samples;
+        errorsAfter += LinuxGateway.GetBus(bus)->stats.read_errors;
+        dropped += LinuxGateway.GetBus(bus)->stats.samples_dropped;
+    }
+    rates->samples = static_cast<double>(samplesAfter - samples) / MEASURE_SECONDS;
+    rates->published = static_cast<double>(broker.publishes - published) / MEASURE_SECONDS;
+    rates->readErrors = errorsAfter - errors;
+    rates->dropped = dropped;
+
+    LinuxGateway.Stop();
+    for (int bus = 0; bus < benchBuses; bus++)
+    {
+        buses[bus].Stop();
+    }
+    broker.Stop();
+    std::string command = std::string("rm -rf ") + dir;
+    if (system(command.c_str()) != 0){
+        checkFailures++;
+    }
+}
+
+int main()
+{
+    rates = static_cast<GatewayRates*>(mmap(nullptr, sizeof(GatewayRates), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+    scenarioQuiet = true;
+    int failures = 0;
+    for (int registers : registersPerBus)
+    {
+        printf("\ngateway throughput, %d contiguous registers per bus polled back to back at 115200 baud\n", registers);
+        printf("%5s %11s %13s %8s %11s %8s\n", "buses", "samples/s", "published/s", "scaling", "read errors", "dropped");
+        double single = 0;
+        for (int buses = 1; buses <= MAX_BUSES; buses++)
+        {
+            benchBuses = buses;
+            benchRegisters = registers;
+            *rates = GatewayRates{};
+            failures += runScenario("gateway", runGatewayBench);
+            if (buses == 1){
+                single = rates->samples;
+            }
+            printf("%5d %11.0f %13.0f %7.2fx %11lu %8lu\n", buses, rates->samples, rates->published,
+                single > 0 ? rates->samples / single : 0.0, rates->readErrors, rates->dropped);
+            fflush(stdout);
+        }
+    }
+    return failures;
+}
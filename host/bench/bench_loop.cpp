@@ -0,0 +1,133 @@
+#include "Bench.h"
+#include "Check.h"
+#include "../../app/src/Log.h"
+#include "../sim/AllocCounter.h"
+#include "../sim/FakeBroker.h"
+#include "../sim/SimClock.h"
+#include "../sim/SimulatedBus.h"
+#include <stdio.h>
+
+//telemetry cycle time, command-to-write latency, loop jitter and heap use per cycle, with real time on so
+//the firmware's own cost is counted next to the simulated bus and broker time
+#define SECONDS 1000000ULL
+#define WARMUP_CYCLES 2
+#define MEASURED_CYCLES 10
+
+const BenchConfig* benchConfig;
+
+void runLoopBench()
+{
+    const BenchConfig& config = *benchConfig;
+    Clock.SetRealTime(true);
+    if (!benchCard(config)){
+        checkFailures++;
+        return;
+    }
+    Sim.Boot();
+    if (!App.IsConfigLoaded()){
+        fprintf(stderr, "%s: configuration not loaded, error %d\n", config.name, App.GetErrorCode());
+        checkFailures++;
+        return;
+    }
+    const char* commandTopic = config.options == nullptr ? "cmd/vfdctl/vfd1/ratedhp/config" : "cmd/vfdctl/vfd1/c0/config";
+    SimSlave* slave = Sim.Slave(1);
+    uint64_t interval = static_cast<uint64_t>(App.GetTelemetryFrequencyMs()) * 1000;
+    if (!Sim.RunCycles(WARMUP_CYCLES, (WARMUP_CYCLES + 1) * interval + 30 * SECONDS)){
+        fprintf(stderr, "%s: warm-up cycles did not complete\n", config.name);
+        checkFailures++;
+        return;
+    }
+
+    Sim.ResetLoopStats();
+    unsigned long firstCycle = Sim.cycles;
+    uint64_t busMicros = RtuBus.busyMicros;
+    AllocCounter::Reset();
+    uint64_t latencyTotal = 0;
+    uint64_t latencyWorst = 0;
+    int commands = 0;
+    char payload[96];
+    for (int i = 0; i < MEASURED_CYCLES; i++)
+    {
+        //one command per cycle, landing at a different point of the interval each time
+        Sim.RunCycles(firstCycle + i + 1, interval + 30 * SECONDS);
+        Sim.RunFor(interval * ((i * 37) % 100) / 100);
+        snprintf(payload, sizeof(payload), "{\"contentType\":\"registerWriteMsg\",\"requestedValue\":%d}", 10 + i);
+        size_t before = slave->writeLog.size();
+        uint64_t sent = Clock.Micros();
+        Sim.Command(commandTopic, payload);
+        uint64_t until = sent + 10 * SECONDS;
+        while (slave->writeLog.size() == before && Clock.Micros() < until)
+        {
+            Sim.Step();
+        }
+        if (slave->writeLog.size() == before){
+            fprintf(stderr, "%s: command %d was not written\n", config.name, i);
+            checkFailures++;
+            continue;
+        }
+        uint64_t latency = slave->writeLog.back().at - sent;
+        latencyTotal += latency;
+        latencyWorst = latency > latencyWorst ? latency : latencyWorst;
+        commands++;
+    }
+    Sim.RunCycles(firstCycle + MEASURED_CYCLES, interval + 30 * SECONDS);
+    unsigned long cycles = Sim.cycles - firstCycle;
+    uint64_t allocations = AllocCounter::GetAllocations();
+    busMicros = RtuBus.busyMicros - busMicros;
+
+    const LoopStats& loop = Sim.loopStats;
+    printf("%-22s %5d %8.2f %8.2f %8.2f %8.2f %8.2f %7.1f %7.1f %8.2f %7.1f %7.1f %8.1f\n",
+        config.name, App.GetConfig()->modbus.registers.count,
+        cycles ? Sim.totalCycleMicros / 1000.0 / cycles : 0.0,
+        Sim.worstCycleMicros / 1000.0,
+        cycles ? busMicros / 1000.0 / cycles : 0.0,
+        commands ? latencyTotal / 1000.0 / commands : 0.0,
+        latencyWorst / 1000.0,
+        loop.passes ? static_cast<double>(loop.totalMicros) / loop.passes : 0.0,
+        benchStddev(loop.passes, loop.totalMicros, loop.squareMicros),
+        loop.worstMicros / 1000.0,
+        loop.passes ? static_cast<double>(loop.cpuTotalMicros) / loop.passes : 0.0,
+        benchStddev(loop.passes, loop.cpuTotalMicros, loop.cpuSquareMicros),
+        cycles ? static_cast<double>(allocations) / cycles : 0.0);
+    fflush(stdout);
+}
+
+int main()
+{
+    SyntheticOptions small;
+    SyntheticOptions medium;
+    medium.registers = 500;
+    medium.devices = 4;
+    medium.maxReadGap = 8;
+    medium.baudRate = 115200;
+    SyntheticOptions large;
+    large.registers = 2000;
+    large.devices = 16;
+    large.maxReadGap = 8;
+    large.baudRate = 115200;
+    large.telemetryIntervalSec = 5;
+    SyntheticOptions largePerDevice = large;
+    largePerDevice.telemetryMode = "per_device";
+    const BenchConfig configs[] = {
+        {"fr800", nullptr},
+        {"synthetic-50", &small},
+        {"synthetic-500", &medium},
+        {"synthetic-2000", &large},
+        {"synthetic-2000-device", &largePerDevice},
+    };
+
+    const char* levels[] = {"NONE", "ERROR", "WARN", "INFO", "DEBUG"};
+    printf("firmware built with LOG_LEVEL %s\n", levels[LOG_LEVEL]);
+    printf("%d measured cycles per configuration, one command per cycle, times in ms unless noted\n", MEASURED_CYCLES);
+    printf("bus = rtu bus time per cycle including the command writes, cmd = broker publish to slave write,\n");
+    printf("loop = every loop() pass, cpu = the same passes without simulated bus and broker time\n");
+    printf("%-22s %5s %8s %8s %8s %8s %8s %7s %7s %8s %7s %7s %8s\n", "config", "regs",
+        "cycle", "cyc_max", "bus", "cmd", "cmd_max", "loop_us", "sd_us", "loop_max", "cpu_us", "cpu_sd", "allocs");
+    int failures = 0;
+    for (const BenchConfig& config : configs)
+    {
+        benchConfig = &config;
+        failures += runScenario(config.name, runLoopBench);
+    }
+    return failures;
+}
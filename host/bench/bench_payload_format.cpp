@@ -0,0 +1,198 @@
+#include "Bench.h"
+#include "Check.h"
+#include "../sim/FakeBroker.h"
+#include "../sim/SimClock.h"
+#include <ArduinoJson.h>
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+
+//json against msgpack: bytes per telemetry sample published by the firmware, then serialize and parse
+//time of the same message shapes
+#define SECONDS 1000000ULL
+#define MEASURED_CYCLES 10
+#define ITERATIONS 200000
+
+const SyntheticOptions* formatOptions;
+
+//every read returns a new value so nothing is held back by report by exception
+uint16_t changingValue(SimSlave* slave, int table, uint16_t address, uint64_t now)
+{
+    (void)slave;
+    (void)table;
+    return static_cast<uint16_t>(address * 7 + now / 1000);
+}
+
+void runTelemetryBench()
+{
+    BenchConfig config = {"format", formatOptions};
+    Clock.SetRealTime(true);
+    if (!benchCard(config)){
+        checkFailures++;
+        return;
+    }
+    Sim.Boot();
+    for (int id = 1; id <= formatOptions->devices; id++)
+    {
+        Sim.Slave(id)->generator = changingValue;
+    }
+    if (!Sim.RunCycles(2, 60 * SECONDS)){
+        checkFailures++;
+        return;
+    }
+    size_t first = Broker.published.size();
+    Sim.ResetLoopStats();
+    unsigned long cycles = Sim.cycles;
+    unsigned long sent = App.GetTelemetrySent();
+    if (!Sim.RunCycles(cycles + MEASURED_CYCLES, 600 * SECONDS)){
+        checkFailures++;
+        return;
+    }
+    size_t payloadBytes = 0;
+    size_t topicBytes = 0;
+    size_t messages = 0;
+    for (size_t i = first; i < Broker.published.size(); i++)
+    {
+        const BrokerMessage& message = Broker.published[i];
+        if (message.topic.compare(0, 3, "dt/") != 0 || message.topic.find("/$") != std::string::npos){
+            continue;
+        }
+        payloadBytes += message.payload.size();
+        topicBytes += message.topic.size();
+        messages++;
+    }
+    size_t schemaBytes = 0;
+    for (const BrokerMessage* message : Broker.Find("dt/+/+/+/$schema"))
+    {
+        schemaBytes += message->topic.size() + message->payload.size();
+    }
+    unsigned long samples = App.GetTelemetrySent() - sent;
+    CHECK(samples > 0);
+    printf("%-8s %-13s %-7s %8.1f %8.1f %9.1f %9zu %10.1f\n", formatOptions->payloadFormat, formatOptions->telemetryMode,
+        formatOptions->sampleIntervalMs > 0 ? "window" : "value",
+        samples ? static_cast<double>(payloadBytes) / samples : 0.0,
+        samples ? static_cast<double>(payloadBytes + topicBytes + 4 * messages) / samples : 0.0,
+        messages ? static_cast<double>(payloadBytes) / messages : 0.0, schemaBytes,
+        static_cast<double>(Sim.loopStats.cpuTotalMicros) / MEASURED_CYCLES);
+    fflush(stdout);
+}
+
+/// @brief Mean time of fn over ITERATIONS calls in nanoseconds
+template <typename Fn>
+double timeNs(Fn fn)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < ITERATIONS; i++)
+    {
+        fn(i);
+    }
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / ITERATIONS;
+}
+
+char payload[1024];
+volatile size_t sink;
+
+//the telemetry message as the firmware builds it, msgpack leaves name and units to the schema
+void buildTelemetry(JsonDocument& doc, bool withMeta, bool withWindow, int value)
+{
+    doc.clear();
+    if (withMeta){
+        doc["name"] = "amperage";
+    }
+    doc["value"] = value;
+    if (withMeta){
+        doc["units"] = "A";
+    }
+    if (withWindow){
+        doc["min"] = value - 12;
+        doc["max"] = value + 40;
+        doc["mean"] = value + 3;
+        doc["count"] = 100;
+    }
+}
+
+void serializeRow(const char* shape, bool withWindow)
+{
+    StaticJsonDocument<256> doc;
+    buildTelemetry(doc, true, withWindow, 123);
+    size_t jsonBytes = serializeJson(doc, payload, sizeof(payload));
+    double jsonNs = timeNs([&](int i) {
+        buildTelemetry(doc, true, withWindow, i & 0x3ff);
+        sink = serializeJson(doc, payload, sizeof(payload));
+    });
+    buildTelemetry(doc, false, withWindow, 123);
+    size_t packBytes = serializeMsgPack(doc, payload, sizeof(payload));
+    double packNs = timeNs([&](int i) {
+        buildTelemetry(doc, false, withWindow, i & 0x3ff);
+        sink = serializeMsgPack(doc, payload, sizeof(payload));
+    });
+    printf("%-24s %10zu %10.0f %10zu %10.0f\n", shape, jsonBytes, jsonNs, packBytes, packNs);
+}
+
+void parseRow(const char* shape, const char* json)
+{
+    StaticJsonDocument<1024> doc;
+    deserializeJson(doc, json);
+    char packed[1024];
+    size_t packBytes = serializeMsgPack(doc, packed, sizeof(packed));
+    size_t jsonBytes = strlen(json);
+    double jsonNs = timeNs([&](int) {
+        sink = deserializeJson(doc, json, jsonBytes) ? 0 : doc.memoryUsage();
+    });
+    double packNs = timeNs([&](int) {
+        sink = deserializeMsgPack(doc, packed, packBytes) ? 0 : doc.memoryUsage();
+    });
+    printf("%-24s %10zu %10.0f %10zu %10.0f\n", shape, jsonBytes, jsonNs, packBytes, packNs);
+}
+
+int main()
+{
+    SyntheticOptions configs[8];
+    const char* formats[] = {"json", "msgpack"};
+    const char* modes[] = {"per_register", "per_device"};
+    int n = 0;
+    for (const char* mode : modes)
+    {
+        for (int sampled = 0; sampled < 2; sampled++)
+        {
+            for (const char* format : formats)
+            {
+                configs[n].registers = 40;
+                configs[n].devices = 4;
+                configs[n].commands = 0;
+                configs[n].baudRate = 115200;
+                configs[n].telemetryMode = mode;
+                configs[n].payloadFormat = format;
+                configs[n].sampleIntervalMs = sampled ? 200 : 0;
+                n++;
+            }
+        }
+    }
+
+    printf("firmware telemetry, 40 registers on 4 slaves, %d cycles\n", MEASURED_CYCLES);
+    printf("sample_B = payload per value, wire_B adds topic and mqtt header, schema_B = retained schemas sent once\n");
+    printf("%-8s %-13s %-7s %8s %8s %9s %9s %10s\n", "format", "mode", "carries", "sample_B", "wire_B", "message_B",
+        "schema_B", "cpu_us/cyc");
+    int failures = 0;
+    for (int i = 0; i < n; i++)
+    {
+        formatOptions = &configs[i];
+        scenarioQuiet = true;
+        failures += runScenario("format", runTelemetryBench);
+    }
+
+    printf("\nserialize and parse, host cpu time per message\n");
+    printf("%-24s %10s %10s %10s %10s\n", "message", "json_B", "json_ns", "msgpack_B", "msgpack_ns");
+    serializeRow("telemetry value", false);
+    serializeRow("telemetry window", true);
+    parseRow("registerWriteMsg",
+        "{\"contentType\":\"registerWriteMsg\",\"requestedValue\":40,\"resTopic\":\"res/vfd1\",\"sessionId\":\"s1\"}");
+    parseRow("registerBatchWriteMsg x10",
+        "{\"contentType\":\"registerBatchWriteMsg\",\"allOrNothing\":true,\"resTopic\":\"res/vfd1\",\"sessionId\":\"s1\",\"requests\":["
+        "{\"parameter\":\"c0\",\"requestedValue\":10},{\"parameter\":\"c1\",\"requestedValue\":11},"
+        "{\"parameter\":\"c2\",\"requestedValue\":12},{\"parameter\":\"c3\",\"requestedValue\":13},"
+        "{\"parameter\":\"c4\",\"requestedValue\":14},{\"parameter\":\"c5\",\"requestedValue\":15},"
+        "{\"parameter\":\"c6\",\"requestedValue\":16},{\"parameter\":\"c7\",\"requestedValue\":17},"
+        "{\"parameter\":\"c8\",\"requestedValue\":18},{\"parameter\":\"c9\",\"requestedValue\":19}]}");
+    return failures;
+}
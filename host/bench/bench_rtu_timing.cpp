@@ -0,0 +1,102 @@
+#include "Bench.h"
+#include "Check.h"
+#include "../sim/SimClock.h"
+#include "../sim/SimulatedBus.h"
+#include <stdio.h>
+
+//telemetry cycle time across baud rates and slave response profiles, adapted timeouts against a fixed 1 s
+//a slave that never answered has nothing to adapt to, one that stops answering is timed out on its learned estimate
+#define SECONDS 1000000ULL
+#define SLAVES 4
+#define WARMUP_CYCLES 10
+#define MEASURED_CYCLES 20
+
+/// @brief Response time of each slave in microseconds, 0 = the slave doesn't answer
+struct LatencyProfile
+{
+    const char* name;
+    uint32_t latencyMicros[SLAVES];
+    //slave that stops answering once the warm-up cycles are done, 0 = none
+    int dropsOut;
+};
+
+const LatencyProfile profiles[] = {
+    {"fast", {2000, 2000, 2000, 2000}, 0},
+    {"slow", {40000, 40000, 40000, 40000}, 0},
+    {"mixed", {2000, 5000, 20000, 150000}, 0},
+    {"one-dead", {2000, 2000, 2000, 0}, 0},
+    {"drops-out", {2000, 2000, 2000, 2000}, 4},
+};
+const int bauds[] = {9600, 19200, 38400, 115200};
+
+const LatencyProfile* benchProfile;
+int benchBaud;
+int benchTimeoutMs;
+
+void runTimingBench()
+{
+    SyntheticOptions options;
+    options.registers = 100;
+    options.devices = SLAVES;
+    options.commands = 0;
+    options.baudRate = benchBaud;
+    options.rtuTimeoutMs = benchTimeoutMs;
+    BenchConfig config = {"rtu", &options};
+    if (!benchCard(config)){
+        checkFailures++;
+        return;
+    }
+    Sim.Boot();
+    for (int i = 0; i < SLAVES; i++)
+    {
+        SimSlave* slave = Sim.Slave(i + 1);
+        slave->latencyMicros = benchProfile->latencyMicros[i];
+        slave->online = benchProfile->latencyMicros[i] > 0;
+    }
+    if (!Sim.RunCycles(WARMUP_CYCLES, 600 * SECONDS)){
+        checkFailures++;
+        return;
+    }
+    if (benchProfile->dropsOut > 0){
+        Sim.Slave(benchProfile->dropsOut)->online = false;
+    }
+    Sim.ResetLoopStats();
+    unsigned long first = Sim.cycles;
+    uint64_t busy = RtuBus.busyMicros;
+    unsigned long timeouts = RtuBus.timeouts;
+    unsigned long transactions = RtuBus.transactions;
+    if (!Sim.RunCycles(first + MEASURED_CYCLES, 1200 * SECONDS)){
+        checkFailures++;
+        return;
+    }
+    printf("%7d %-10s %-8s %9.1f %9.1f %9.1f %9.2f %9.2f\n", benchBaud, benchProfile->name,
+        benchTimeoutMs > 0 ? "fixed" : "adaptive",
+        Sim.totalCycleMicros / 1000.0 / MEASURED_CYCLES, Sim.worstCycleMicros / 1000.0,
+        (RtuBus.busyMicros - busy) / 1000.0 / MEASURED_CYCLES,
+        static_cast<double>(RtuBus.transactions - transactions) / MEASURED_CYCLES,
+        static_cast<double>(RtuBus.timeouts - timeouts) / MEASURED_CYCLES);
+    fflush(stdout);
+}
+
+int main()
+{
+    printf("100 registers over %d slaves, one block read each, times in ms per cycle after %d warm-up cycles\n",
+        SLAVES, WARMUP_CYCLES);
+    printf("%7s %-10s %-8s %9s %9s %9s %9s %9s\n", "baud", "profile", "timeout", "cycle", "cyc_max", "bus",
+        "requests", "timeouts");
+    int failures = 0;
+    for (int baud : bauds)
+    {
+        for (const LatencyProfile& profile : profiles)
+        {
+            benchBaud = baud;
+            benchProfile = &profile;
+            for (int timeoutMs : {0, 1000})
+            {
+                benchTimeoutMs = timeoutMs;
+                failures += runScenario(profile.name, runTimingBench);
+            }
+        }
+    }
+    return failures;
+}
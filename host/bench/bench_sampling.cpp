@@ -0,0 +1,96 @@
+#include "Bench.h"
+#include "Check.h"
+#include "../sim/SimClock.h"
+#include "../sim/SimulatedBus.h"
+#include <stdio.h>
+#include <sys/mman.h>
+
+//registers one bus can sample at a given interval, the achieved rate is measured from the slave reads
+#define SECONDS 1000000ULL
+#define MEASURE_SECONDS 20
+//a configuration keeps up when this share of the requested samples is taken
+#define KEEPS_UP 0.95
+
+const int bauds[] = {9600, 38400, 115200};
+const int intervalsMs[] = {100, 250, 1000};
+const int registerCounts[] = {8, 16, 32, 64, 125, 250, 500, 1000};
+#define COUNTS (sizeof(registerCounts) / sizeof(registerCounts[0]))
+
+int benchBaud;
+int benchIntervalMs;
+int benchRegisters;
+int benchSlaves;
+//written by the scenario's child process
+double* achieved;
+
+void runSamplingBench()
+{
+    SyntheticOptions options;
+    options.registers = benchRegisters;
+    options.devices = benchSlaves;
+    options.commands = 0;
+    options.baudRate = benchBaud;
+    options.sampleIntervalMs = benchIntervalMs;
+    options.telemetryIntervalSec = 5;
+    options.journal = false;
+    BenchConfig config = {"sampling", &options};
+    if (!benchCard(config)){
+        checkFailures++;
+        return;
+    }
+    Sim.Boot();
+    if (!Sim.RunCycles(2, 60 * SECONDS)){
+        checkFailures++;
+        return;
+    }
+    int spans = App.GetConfig()->modbus.read_plan.span_count;
+    unsigned long reads = RtuBus.transactions;
+    unsigned long cycles = Sim.cycles;
+    Sim.RunFor(MEASURE_SECONDS * SECONDS);
+    //every span read is one sample of each of its registers, the telemetry cycles read each span once more
+    double requested = static_cast<double>(spans) * MEASURE_SECONDS * 1000 / benchIntervalMs;
+    double samples = static_cast<double>(RtuBus.transactions - reads) - static_cast<double>(Sim.cycles - cycles) * spans;
+    *achieved = samples / requested;
+}
+
+int main()
+{
+    achieved = static_cast<double*>(mmap(nullptr, sizeof(double), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+    scenarioQuiet = true;
+    int failures = 0;
+    for (int slaves : {1, 4})
+    {
+        printf("\nshare of the requested samples taken, registers contiguous over %d slave(s), publishing every 5 s\n", slaves);
+        printf("%7s %8s", "baud", "interval");
+        for (size_t c = 0; c < COUNTS; c++)
+        {
+            printf(" %6d", registerCounts[c]);
+        }
+        printf(" %9s\n", "capacity");
+        for (int baud : bauds)
+        {
+            for (int intervalMs : intervalsMs)
+            {
+                benchBaud = baud;
+                benchIntervalMs = intervalMs;
+                benchSlaves = slaves;
+                int capacity = 0;
+                char row[256];
+                int len = snprintf(row, sizeof(row), "%7d %6dms", baud, intervalMs);
+                for (size_t c = 0; c < COUNTS; c++)
+                {
+                    benchRegisters = registerCounts[c];
+                    *achieved = 0;
+                    failures += runScenario("sampling", runSamplingBench);
+                    len += snprintf(row + len, sizeof(row) - len, " %5.0f%%", *achieved * 100);
+                    if (*achieved >= KEEPS_UP){
+                        capacity = registerCounts[c];
+                    }
+                }
+                printf("%s %9d\n", row, capacity);
+                fflush(stdout);
+            }
+        }
+    }
+    return failures;
+}
@@ -0,0 +1,57 @@
+# Turn the sketch into a C++ translation unit the way the Arduino builder does:
+# Arduino.h is included first and a prototype of every function is placed ahead of the first
+# function definition, so functions can be called before they are defined.
+# Every function in app.ino is defined on a single line starting at column 0, ex: int initModbus(){
+#
+# Usage: cmake -DINO=<sketch.ino> -DOUT=<sketch.ino.cpp> -P InoToCpp.cmake
+
+file(READ "${INO}" sketch)
+# brackets and semicolons would confuse list splitting, they are swapped out until the output is written
+string(REPLACE "[" "@LBR@" sketch "${sketch}")
+string(REPLACE "]" "@RBR@" sketch "${sketch}")
+string(REPLACE ";" "@SEMI@" sketch "${sketch}")
+# keep empty lines, they matter for #line
+string(REPLACE "\n" ";" lines "${sketch}")
+
+set(signature "^([A-Za-z_][A-Za-z0-9_<>:*& ]*[ *&][A-Za-z_][A-Za-z0-9_]*\\([^{}]*\\))[ \t]*{[ \t]*$")
+set(prototypes "")
+set(first_function 0)
+set(line_number 0)
+foreach(line IN LISTS lines)
+  math(EXPR line_number "${line_number} + 1")
+  if(line MATCHES "${signature}")
+    set(declaration "${CMAKE_MATCH_1}")
+    if(NOT declaration MATCHES "@SEMI@")
+      string(APPEND prototypes "${declaration}@SEMI@\n")
+    endif()
+    if(first_function EQUAL 0)
+      set(first_function ${line_number})
+    endif()
+  endif()
+endforeach()
+if(first_function EQUAL 0)
+  message(FATAL_ERROR "no function definitions found in ${INO}")
+endif()
+
+set(output "#include <Arduino.h>\n#line 1 \"${INO}\"\n")
+set(line_number 0)
+foreach(line IN LISTS lines)
+  math(EXPR line_number "${line_number} + 1")
+  if(line_number EQUAL first_function)
+    string(APPEND output "${prototypes}#line ${line_number} \"${INO}\"\n")
+  endif()
+  string(APPEND output "${line}\n")
+endforeach()
+
+string(REPLACE "@LBR@" "[" output "${output}")
+string(REPLACE "@RBR@" "]" output "${output}")
+string(REPLACE "@SEMI@" ";" output "${output}")
+
+# only touch the output when it changes, the app is not rebuilt otherwise
+set(previous "")
+if(EXISTS "${OUT}")
+  file(READ "${OUT}" previous)
+endif()
+if(NOT previous STREQUAL output)
+  file(WRITE "${OUT}" "${output}")
+endif()
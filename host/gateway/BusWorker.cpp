@@ -0,0 +1,239 @@
+#include "BusWorker.h"
+#include <chrono>
+
+BusWorker::BusWorker(){
+    _bus = 0;
+    _config = nullptr;
+    _firstSpan = 0;
+    _spanCount = 0;
+    _registerCount = 0;
+    _running = false;
+    stats.cycles = 0;
+    stats.reads = 0;
+    stats.read_errors = 0;
+    stats.samples = 0;
+    stats.samples_dropped = 0;
+    stats.transactions = 0;
+    stats.writes = 0;
+    stats.write_errors = 0;
+}
+
+BusWorker::~BusWorker()
+{
+    Stop();
+}
+
+bool BusWorker::IsRtu(struct Config* config, int deviceId)
+{
+    for (int i = 0; i < config->modbus.device_count; i++)
+    {
+        ModbusDeviceTransport* device = &config->modbus.devices[i];
+        if (device->device_id == deviceId){
+            return device->transport == eModbusTransport::transport_rtu;
+        }
+    }
+    return true;
+}
+
+int BusWorker::Begin(int bus, const char* path, struct Config* config)
+{
+    _bus = bus;
+    _config = config;
+    SerialPortConfiguration* port = &config->modbus.serial_ports[bus];
+    int res = _port.Open(path, port->baud_rate, port->data_bits, port->parity_bits, port->stop_bits);
+    if (res < 0){
+        return res;
+    }
+    _timing.Begin(config->modbus, bus);
+    _master.Begin(&_port, &_timing);
+
+    //spans are ordered by bus, this bus's spans are contiguous
+    ModbusReadPlan* plan = &config->modbus.read_plan;
+    _firstSpan = 0;
+    while (_firstSpan < plan->span_count && plan->spans[_firstSpan].bus != bus)
+    {
+        _firstSpan++;
+    }
+    _spanCount = 0;
+    _registerCount = 0;
+    while (_firstSpan + _spanCount < plan->span_count && plan->spans[_firstSpan + _spanCount].bus == bus)
+    {
+        ModbusReadSpan* span = &plan->spans[_firstSpan + _spanCount];
+        if (IsRtu(config, span->device_id)){
+            _registerCount += span->member_count;
+        }
+        _spanCount++;
+    }
+    return 0;
+}
+
+void BusWorker::Start()
+{
+    if (_running.exchange(true)){
+        return;
+    }
+    _thread = std::thread(&BusWorker::Run, this);
+}
+
+void BusWorker::Stop()
+{
+    _running = false;
+    if (_thread.joinable()){
+        _thread.join();
+    }
+}
+
+int BusWorker::GetBus()
+{
+    return _bus;
+}
+
+int BusWorker::GetSpanCount()
+{
+    return _spanCount;
+}
+
+int BusWorker::GetRegisterCount()
+{
+    return _registerCount;
+}
+
+bool BusWorker::PushCommand(const BusCommand& command)
+{
+    return _commands.Push(command);
+}
+
+bool BusWorker::PopSample(BusSample* sample)
+{
+    return _samples.Pop(sample);
+}
+
+bool BusWorker::PopResult(BusResult* result)
+{
+    return _results.Pop(result);
+}
+
+void BusWorker::Run()
+{
+    ModbusReadPlan* plan = &_config->modbus.read_plan;
+    uint64_t interval = _config->modbus.telemetry_interval_sec * 1000000ULL;
+    uint64_t cycleStart = steadyMicros();
+    while (_running.load(std::memory_order_acquire))
+    {
+        //a command waits for at most the block read in progress
+        for (int s = 0; s < _spanCount && _running.load(std::memory_order_relaxed); s++)
+        {
+            RunCommands();
+            ReadSpan(&plan->spans[_firstSpan + s]);
+        }
+        stats.cycles++;
+
+        //commands are written while the bus waits for the next cycle
+        uint64_t due = cycleStart + interval;
+        uint64_t now = steadyMicros();
+        while (_running.load(std::memory_order_relaxed) && now < due)
+        {
+            if (RunCommands() == 0){
+                std::this_thread::sleep_for(std::chrono::microseconds(min(static_cast<uint64_t>(BUS_IDLE_WAIT_US), due - now)));
+            }
+            now = steadyMicros();
+        }
+        //a bus without registers only has commands to wait for
+        if (_registerCount == 0 && RunCommands() == 0){
+            std::this_thread::sleep_for(std::chrono::microseconds(BUS_IDLE_WAIT_US));
+        }
+        //a cycle that overran starts the next one right away instead of catching up
+        cycleStart = now - due < interval ? due : now;
+    }
+}
+
+void BusWorker::ReadSpan(ModbusReadSpan* span)
+{
+    if (!IsRtu(_config, span->device_id)){
+        return;
+    }
+    stats.reads++;
+    int res = _master.Read(span->device_id, span->type, span->start_address, span->length, _values);
+    if (res < 0){
+        stats.read_errors++;
+        return;
+    }
+    //split the block back out to each register
+    ModbusReadPlan* plan = &_config->modbus.read_plan;
+    ModbusRegisterTable* regs = &_config->modbus.registers;
+    for (int m = 0; m < span->member_count; m++)
+    {
+        BusSample sample;
+        sample.reg = plan->register_order[span->first_member + m];
+        sample.value = _values[regs->address[sample.reg] - span->start_address];
+        if (_samples.Push(sample)){
+            stats.samples++;
+        }else{
+            stats.samples_dropped++;
+        }
+    }
+}
+
+int BusWorker::RunCommands()
+{
+    int ran = 0;
+    BusCommand command;
+    while (_commands.Pop(&command))
+    {
+        RunCommand(&command);
+        ran++;
+    }
+    return ran;
+}
+
+/// @brief Write each run of consecutive registers or coils on one device with a single request
+void BusWorker::RunCommand(BusCommand* command)
+{
+    BusResult result;
+    result.slot = command->slot;
+    for (int i = 0; i < COMMAND_MAX_WRITES; i++)
+    {
+        result.results[i] = eWriteResult::write_pending;
+    }
+
+    uint16_t values[COMMAND_MAX_WRITES];
+    int next = 0;
+    while (next < command->write_count)
+    {
+        BusWrite* first = &command->writes[next];
+        int length = 1;
+        values[0] = first->value;
+        while (next + length < command->write_count)
+        {
+            BusWrite* write = &command->writes[next + length];
+            if (write->device_id != first->device_id || write->type != first->type || write->address != first->address + length){
+                break;
+            }
+            values[length++] = write->value;
+        }
+
+        stats.transactions++;
+        int res = _master.Write(first->device_id, static_cast<eRegisterType>(first->type), first->address, values, length);
+        bool written = res == static_cast<int>(RtuMasterErrors::SUCCESS);
+        if (!written){
+            stats.write_errors++;
+        }
+        for (int i = 0; i < length; i++)
+        {
+            result.results[command->writes[next + i].index] = written ? eWriteResult::write_ok : eWriteResult::write_failed;
+        }
+        stats.writes += length;
+        next += length;
+
+        //registers already written cannot be rolled back, only the remaining writes are abandoned
+        if (!written && command->all_or_nothing){
+            break;
+        }
+    }
+
+    //the publisher drains results every pass, a full ring only means it is busy publishing
+    while (!_results.Push(result) && _running.load(std::memory_order_relaxed))
+    {
+        std::this_thread::sleep_for(std::chrono::microseconds(BUS_IDLE_WAIT_US));
+    }
+}
@@ -0,0 +1,116 @@
+#ifndef BusWorker_h
+#define BusWorker_h
+
+#include "RtuMaster.h"
+#include "SerialPort.h"
+#include "SpscQueue.h"
+#include "../../app/src/CommandQueue.h"
+#include "../../app/src/ConfigurationManager.h"
+#include "../../app/src/RtuTiming.h"
+#include <atomic>
+#include <thread>
+
+//readings waiting for the publisher, a full ring drops the newest reading
+#define BUS_SAMPLE_QUEUE 4096
+//commands routed to a bus and results waiting for the publisher
+#define BUS_COMMAND_QUEUE 16
+//longest a bus sleeps between checks for commands while it waits for the next cycle
+#define BUS_IDLE_WAIT_US 1000
+
+/// @brief Telemetry register value read by a bus
+struct BusSample
+{
+    //index into ModbusConfiguration::registers
+    uint16_t reg;
+    int32_t value;
+};
+
+/// @brief Register write resolved by the publisher, the bus doesn't look anything up
+struct BusWrite
+{
+    uint8_t device_id;
+    //eRegisterType
+    uint8_t type;
+    uint16_t address;
+    uint16_t value;
+    //position of the write in its Command, results are reported in Command order
+    uint8_t index;
+};
+
+/// @brief Writes of one command, ordered by device, type and address like the controller writes a batch
+struct BusCommand
+{
+    //pending command slot of the publisher
+    uint16_t slot;
+    bool all_or_nothing;
+    uint8_t write_count;
+    BusWrite writes[COMMAND_MAX_WRITES];
+};
+
+/// @brief Outcome of a BusCommand, an eWriteResult per write in Command order
+struct BusResult
+{
+    uint16_t slot;
+    uint8_t results[COMMAND_MAX_WRITES];
+};
+
+/// @brief Counters of a bus, written by its thread and read by anyone
+struct BusStats
+{
+    std::atomic<unsigned long> cycles;
+    std::atomic<unsigned long> reads;
+    std::atomic<unsigned long> read_errors;
+    std::atomic<unsigned long> samples;
+    std::atomic<unsigned long> samples_dropped;
+    std::atomic<unsigned long> transactions;
+    std::atomic<unsigned long> writes;
+    std::atomic<unsigned long> write_errors;
+};
+
+/// @brief Polling thread of one RS-485 bus
+/// Reads the bus's spans of the read plan once per telemetry interval and writes the commands routed to it
+/// between two spans, so a command waits for at most one block read. It only reads the configuration,
+/// everything it learns goes to the publisher through its single producer, single consumer queues.
+class BusWorker
+{
+    public:
+        BusWorker();
+        ~BusWorker();
+        //open the bus's serial port and take its spans of the read plan, call before Start()
+        int Begin(int bus, const char* path, struct Config* config);
+        void Start();
+        void Stop();
+        int GetBus();
+        //spans and registers this bus polls
+        int GetSpanCount();
+        int GetRegisterCount();
+        //publisher side of the queues
+        bool PushCommand(const BusCommand& command);
+        bool PopSample(BusSample* sample);
+        bool PopResult(BusResult* result);
+        BusStats stats;
+        //false for tcp slaves, they share bus 0 in the read plan but the gateway doesn't reach them
+        static bool IsRtu(struct Config* config, int deviceId);
+    private:
+        int _bus;
+        struct Config* _config;
+        int _firstSpan;
+        int _spanCount;
+        int _registerCount;
+        SerialPort _port;
+        RtuTiming _timing;
+        RtuMaster _master;
+        std::thread _thread;
+        std::atomic<bool> _running;
+        SpscQueue<BusCommand, BUS_COMMAND_QUEUE> _commands;
+        SpscQueue<BusSample, BUS_SAMPLE_QUEUE> _samples;
+        SpscQueue<BusResult, BUS_COMMAND_QUEUE> _results;
+        uint16_t _values[MODBUS_MAX_READ_REGISTERS];
+        void Run();
+        void ReadSpan(ModbusReadSpan* span);
+        //write the commands waiting for the bus, returns how many ran
+        int RunCommands();
+        void RunCommand(BusCommand* command);
+};
+
+#endif
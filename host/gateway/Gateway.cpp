@@ -0,0 +1,378 @@
+#include "Gateway.h"
+#include "../sim/SimClock.h"
+#include "../../app/src/CommandParser.h"
+#include "../../app/src/Log.h"
+#include "../../app/src/TelemetryFilter.h"
+#include <chrono>
+
+Gateway::Gateway(){
+    _config = new Config{};
+    _busCount = 0;
+    _running = false;
+    _connected = false;
+    _retryAt = 0;
+    for (int i = 0; i < GATEWAY_MAX_PENDING; i++)
+    {
+        _pending[i].used = false;
+    }
+    stats.samples = 0;
+    stats.published = 0;
+    stats.suppressed = 0;
+    stats.lost = 0;
+    stats.commands = 0;
+    stats.commands_rejected = 0;
+    stats.connects = 0;
+}
+
+Gateway::~Gateway()
+{
+    Stop();
+}
+
+Gateway LinuxGateway;
+
+int Gateway::Begin(const char* configPath, const char* const* ports, int portCount)
+{
+    //millis() follows the wall clock, nothing advances it by hand on the gateway
+    Clock.SetRealTime(true);
+
+    //the directory holding the configuration takes the place of the SD card
+    char root[256];
+    char fileName[64];
+    const char* slash = strrchr(configPath, '/');
+    if (slash == nullptr){
+        strlcpy(root, ".", sizeof(root));
+        strlcpy(fileName, configPath, sizeof(fileName));
+    }else{
+        size_t len = min(static_cast<size_t>(slash - configPath), sizeof(root) - 1);
+        memcpy(root, configPath, len);
+        root[len] = '\0';
+        strlcpy(fileName, slash + 1, sizeof(fileName));
+    }
+    SD.SetRoot(root);
+    if (ConfigMgr.Init(false, SDCARD_SS_PIN) < 0){
+        return static_cast<int>(GatewayErrors::GATEWAY_CONFIG_FAILED);
+    }
+    int res = ConfigMgr.Load(fileName, _config);
+    if (res < 0){
+        LOG_ERROR("failed to load %s: %d", configPath, res);
+        return static_cast<int>(GatewayErrors::GATEWAY_CONFIG_FAILED);
+    }
+
+    if (portCount > _config->modbus.serial_port_count){
+        LOG_ERROR("%d ports given for %d serial_port entries", portCount, _config->modbus.serial_port_count);
+        return static_cast<int>(GatewayErrors::GATEWAY_TOO_MANY_PORTS);
+    }
+    if (portCount < _config->modbus.serial_port_count){
+        LOG_WARN("buses %d and up have no port, their slaves are not polled", portCount);
+    }
+    if (_config->modbus.telemetry_mode != eTelemetryMode::per_register || _config->modbus.payload_format != ePayloadFormat::payload_json){
+        LOG_WARN("the gateway publishes json, one message per register");
+    }
+    for (_busCount = 0; _busCount < portCount; _busCount++)
+    {
+        BusWorker* worker = &_buses[_busCount];
+        res = worker->Begin(_busCount, ports[_busCount], _config);
+        if (res < 0){
+            LOG_ERROR("failed to open %s for bus %d: %d", ports[_busCount], _busCount, res);
+            return static_cast<int>(GatewayErrors::GATEWAY_PORT_FAILED);
+        }
+        LOG_INFO("bus %d on %s polls %d registers in %d block reads", _busCount, ports[_busCount],
+            worker->GetRegisterCount(), worker->GetSpanCount());
+    }
+    return static_cast<int>(GatewayErrors::SUCCESS);
+}
+
+void Gateway::Start()
+{
+    if (_running.exchange(true)){
+        return;
+    }
+    for (int i = 0; i < _busCount; i++)
+    {
+        _buses[i].Start();
+    }
+    _thread = std::thread(&Gateway::Run, this);
+}
+
+void Gateway::Stop()
+{
+    _running = false;
+    if (_thread.joinable()){
+        _thread.join();
+    }
+    for (int i = 0; i < _busCount; i++)
+    {
+        _buses[i].Stop();
+    }
+}
+
+bool Gateway::IsConnected()
+{
+    return _connected;
+}
+
+struct Config* Gateway::GetConfig()
+{
+    return _config;
+}
+
+int Gateway::GetBusCount()
+{
+    return _busCount;
+}
+
+BusWorker* Gateway::GetBus(int bus)
+{
+    return bus >= 0 && bus < _busCount ? &_buses[bus] : nullptr;
+}
+
+/// @brief Publisher thread, the only thread using the broker connection and the firmware's globals
+void Gateway::Run()
+{
+    while (_running.load(std::memory_order_acquire))
+    {
+        if (!_mqtt.IsConnected()){
+            _connected = false;
+            if (static_cast<long>(millis() - _retryAt) >= 0){
+                Connect();
+            }
+        }
+
+        int taken = DrainSamples() + DrainResults();
+        if (_mqtt.IsConnected()){
+            //a pass that found readings only checks the broker, an idle one waits on it
+            int res = _mqtt.Poll(OnMessage, this, taken > 0 ? 0 : GATEWAY_POLL_MS);
+            if (res < 0){
+                LOG_ERROR("lost the connection to the broker: %d", res);
+                _retryAt = millis() + _config->broker.broker_retry_interval_sec * 1000UL;
+            }
+        }else if (taken == 0){
+            std::this_thread::sleep_for(std::chrono::milliseconds(GATEWAY_POLL_MS));
+        }
+        Log.Drain();
+    }
+    _mqtt.Close();
+    _connected = false;
+    Log.Drain();
+}
+
+void Gateway::Connect()
+{
+    BrokerConfiguration* broker = &_config->broker;
+    int res = _mqtt.Connect(broker->broker_url, broker->broker_port, _config->device.device_name, broker->broker_user, broker->broker_pass);
+    if (res == 0){
+        res = _mqtt.Subscribe("cmd/vfdctl/#");
+    }
+    if (res < 0){
+        LOG_ERROR("failed to connect to %s:%d: %d", broker->broker_url, broker->broker_port, res);
+        _retryAt = millis() + broker->broker_retry_interval_sec * 1000UL;
+        return;
+    }
+    LOG_INFO("connected to %s:%d", broker->broker_url, broker->broker_port);
+    stats.connects++;
+    _connected = true;
+}
+
+int Gateway::DrainSamples()
+{
+    int taken = 0;
+    for (int i = 0; i < _busCount; i++)
+    {
+        BusSample sample;
+        for (int n = 0; n < GATEWAY_DRAIN_BATCH && _buses[i].PopSample(&sample); n++)
+        {
+            PublishSample(sample);
+            taken++;
+        }
+    }
+    stats.samples += taken;
+    return taken;
+}
+
+/// @brief Report by exception, then publish the reading on its register's topic, ex: {"name":"amps","value":12,"units":"A"}
+void Gateway::PublishSample(const BusSample& sample)
+{
+    ModbusRegisterTable* regs = &_config->modbus.registers;
+    int reg = sample.reg;
+    regs->value[reg] = sample.value;
+    if (!Reporting.ShouldPublish(regs, reg, sample.value)){
+        stats.suppressed++;
+        return;
+    }
+    if (!_mqtt.IsConnected()){
+        stats.lost++;
+        return;
+    }
+
+    ModbusParameter* param = &regs->meta[reg];
+    StaticJsonDocument<192> doc;
+    doc["name"] = param->name;
+    doc["value"] = sample.value;
+    doc["units"] = param->units;
+    size_t len = serializeJson(doc, _payload, sizeof(_payload));
+    ConfigMgr.FormatTopic(param->topic, _topic, sizeof(_topic));
+    if (_mqtt.Publish(_topic, reinterpret_cast<const uint8_t*>(_payload), len, false) < 0){
+        stats.lost++;
+        return;
+    }
+    Reporting.MarkPublished(regs, reg, sample.value);
+    stats.published++;
+}
+
+int Gateway::DrainResults()
+{
+    int taken = 0;
+    for (int i = 0; i < _busCount; i++)
+    {
+        BusResult result;
+        while (_buses[i].PopResult(&result))
+        {
+            PendingCommand* pending = &_pending[result.slot];
+            for (int w = 0; w < pending->command.write_count; w++)
+            {
+                if (result.results[w] != eWriteResult::write_pending){
+                    pending->results[w] = result.results[w];
+                }
+            }
+            FinishCommand(pending);
+            taken++;
+        }
+    }
+    return taken;
+}
+
+void Gateway::OnMessage(void* context, char* topic, char* payload, int length)
+{
+    static_cast<Gateway*>(context)->RouteCommand(topic, payload, length);
+}
+
+/// @brief Parse a command, settle its limit checks and hand its writes to the bus of its slave
+void Gateway::RouteCommand(char* topic, char* payload, int length)
+{
+    Command cmd;
+    int res = CmdParser.Parse(_config, topic, payload, length, &cmd);
+    if (res <= 0){
+        if (res < 0){
+            stats.commands_rejected++;
+        }
+        return;
+    }
+    stats.commands++;
+
+    int slot = 0;
+    while (slot < GATEWAY_MAX_PENDING && _pending[slot].used)
+    {
+        slot++;
+    }
+    if (slot == GATEWAY_MAX_PENDING){
+        LOG_WARN("too many commands pending, message dropped");
+        stats.commands_rejected++;
+        return;
+    }
+    PendingCommand* pending = &_pending[slot];
+    pending->command = cmd;
+    pending->bus = -1;
+
+    BusCommand busCommand;
+    busCommand.slot = slot;
+    busCommand.all_or_nothing = cmd.all_or_nothing;
+    busCommand.write_count = 0;
+    bool outOfRange = false;
+    bool unreachable = false;
+    ModbusConfigParameter* regs = _config->modbus.configuration_registers;
+    for (int i = 0; i < cmd.write_count; i++)
+    {
+        ModbusConfigParameter* p = &regs[cmd.writes[i].register_index];
+        if (CommandParser::CheckValue(p, cmd.writes[i].value) != 1){
+            pending->results[i] = eWriteResult::write_out_of_range;
+            outOfRange = true;
+            continue;
+        }
+        //every write of a command goes to one bus thread, a batch spanning buses can't be ordered
+        int bus = BusWorker::IsRtu(_config, p->device_id) ? ConfigMgr.GetBus(_config, p->device_id) : -1;
+        if (bus < 0 || bus >= _busCount || (pending->bus >= 0 && bus != pending->bus)){
+            LOG_WARN("device %d is on a serial bus this command can't be routed to", p->device_id);
+            pending->results[i] = eWriteResult::write_failed;
+            unreachable = true;
+            continue;
+        }
+        pending->bus = bus;
+        pending->results[i] = eWriteResult::write_pending;
+
+        //ordered by device, type, then address so consecutive registers go out as one request
+        int j = busCommand.write_count;
+        while (j > 0)
+        {
+            BusWrite* prev = &busCommand.writes[j - 1];
+            if (prev->device_id < p->device_id ||
+                (prev->device_id == p->device_id && (prev->type < p->type || (prev->type == p->type && prev->address <= p->address))))
+            {
+                break;
+            }
+            busCommand.writes[j] = *prev;
+            j--;
+        }
+        BusWrite* write = &busCommand.writes[j];
+        write->device_id = p->device_id;
+        write->type = p->type;
+        write->address = p->address;
+        write->value = cmd.writes[i].value;
+        write->index = i;
+        busCommand.write_count++;
+    }
+
+    if (cmd.content_type != eContentType::register_batch_write && outOfRange){
+        LOG_WARN("Requested value not within allowed range");
+        stats.commands_rejected++;
+        return;
+    }
+    if ((outOfRange || unreachable) && cmd.all_or_nothing){
+        LOG_WARN("Batch rejected, a requested value is not within its allowed range or its slave can't be reached");
+        FinishCommand(pending);
+        return;
+    }
+    if (busCommand.write_count == 0){
+        FinishCommand(pending);
+        return;
+    }
+    if (!_buses[pending->bus].PushCommand(busCommand)){
+        LOG_WARN("bus %d has too many commands waiting, message dropped", pending->bus);
+        stats.commands_rejected++;
+        return;
+    }
+    pending->used = true;
+}
+
+/// @brief Answer a command once every write has a result
+void Gateway::FinishCommand(PendingCommand* pending)
+{
+    pending->used = false;
+    Command* cmd = &pending->command;
+    if (cmd->content_type != eContentType::register_batch_write){
+        if (pending->results[0] != eWriteResult::write_ok){
+            LOG_WARN("failed to write %d for %s", cmd->writes[0].value, _config->modbus.configuration_registers[cmd->writes[0].register_index].name);
+            return;
+        }
+    }
+    for (int i = 0; i < cmd->write_count; i++)
+    {
+        if (pending->results[i] == eWriteResult::write_pending){
+            pending->results[i] = eWriteResult::write_skipped;
+        }
+    }
+    if (cmd->res_topic[0] == '\0'){
+        return;
+    }
+
+    StaticJsonDocument<1024> doc;
+    if (cmd->content_type == eContentType::register_batch_write){
+        CmdParser.BuildBatchResponse(doc, _config, cmd, pending->results);
+    }else{
+        CmdParser.BuildResponse(doc, cmd, cmd->writes[0].value);
+    }
+    size_t len = serializeJson(doc, _payload, sizeof(_payload));
+    if (_mqtt.Publish(cmd->res_topic, reinterpret_cast<const uint8_t*>(_payload), len, false) < 0){
+        LOG_ERROR("failed to publish response message to remote");
+    }
+}
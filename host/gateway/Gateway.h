@@ -0,0 +1,94 @@
+#ifndef Gateway_h
+#define Gateway_h
+
+#include "BusWorker.h"
+#include "MqttConnection.h"
+#include "../../app/src/CommandQueue.h"
+#include "../../app/src/ConfigurationManager.h"
+#include <atomic>
+#include <thread>
+
+//commands written or waiting for a bus at once
+#define GATEWAY_MAX_PENDING 32
+//readings taken from one bus's queue per pass, so a busy bus doesn't starve the others
+#define GATEWAY_DRAIN_BATCH 256
+//longest the publisher waits for the broker when no bus had anything
+#define GATEWAY_POLL_MS 1
+
+enum class GatewayErrors
+{
+    SUCCESS,
+    GATEWAY_CONFIG_FAILED = -100,
+    GATEWAY_TOO_MANY_PORTS,
+    GATEWAY_PORT_FAILED,
+};
+
+/// @brief Command handed to a bus, kept until the bus reports its result
+struct PendingCommand
+{
+    bool used;
+    int bus;
+    Command command;
+    //eWriteResult per write, out of range writes are settled before the command reaches its bus
+    uint8_t results[COMMAND_MAX_WRITES];
+};
+
+/// @brief Counters of the publisher, written by its thread and read by anyone
+struct GatewayStats
+{
+    std::atomic<unsigned long> samples;
+    std::atomic<unsigned long> published;
+    std::atomic<unsigned long> suppressed;
+    //readings taken while the broker was unreachable, they are not journaled
+    std::atomic<unsigned long> lost;
+    std::atomic<unsigned long> commands;
+    std::atomic<unsigned long> commands_rejected;
+    std::atomic<unsigned long> connects;
+};
+
+/// @brief Linux build of the controller: one polling thread per RS-485 bus and a single MQTT publisher thread
+/// The configuration is loaded by ConfigurationManager from the same conf.txt the controller reads, the
+/// serial_port array gives one bus per tty. Each BusWorker hands its readings over a lock-free queue, the
+/// publisher applies report by exception and publishes them, and routes every command to the bus of its slave.
+/// Only the publisher thread touches the firmware's globals (ConfigMgr, CmdParser, Reporting, Log).
+class Gateway
+{
+    public:
+        Gateway();
+        ~Gateway();
+        //load conf.txt from its directory and open a tty per serial_port entry, ports[i] is bus i
+        int Begin(const char* configPath, const char* const* ports, int portCount);
+        //start the bus threads and the publisher thread
+        void Start();
+        void Stop();
+        bool IsConnected();
+        struct Config* GetConfig();
+        int GetBusCount();
+        BusWorker* GetBus(int bus);
+        GatewayStats stats;
+    private:
+        struct Config* _config;
+        BusWorker _buses[MODBUS_MAX_SERIAL_BUSES];
+        int _busCount;
+        MqttConnection _mqtt;
+        std::thread _thread;
+        std::atomic<bool> _running;
+        std::atomic<bool> _connected;
+        unsigned long _retryAt;
+        PendingCommand _pending[GATEWAY_MAX_PENDING];
+        char _topic[128];
+        char _payload[1024];
+        void Run();
+        void Connect();
+        //publish the readings waiting on every bus, returns how many were taken
+        int DrainSamples();
+        int DrainResults();
+        void PublishSample(const BusSample& sample);
+        static void OnMessage(void* context, char* topic, char* payload, int length);
+        void RouteCommand(char* topic, char* payload, int length);
+        void FinishCommand(PendingCommand* pending);
+};
+
+extern Gateway LinuxGateway;	//Default class instance
+
+#endif
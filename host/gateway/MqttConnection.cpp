@@ -0,0 +1,330 @@
+#include "MqttConnection.h"
+#include "SerialPort.h"
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+//control packet types
+#define MQTT_CONNECT 1
+#define MQTT_CONNACK 2
+#define MQTT_PUBLISH 3
+#define MQTT_SUBSCRIBE 8
+#define MQTT_SUBACK 9
+#define MQTT_PINGREQ 12
+#define MQTT_PINGRESP 13
+#define MQTT_DISCONNECT 14
+
+MqttConnection::MqttConnection(){
+    _fd = -1;
+    _rxLength = 0;
+    _txLength = 0;
+    _packetId = 0;
+    _lastSentMicros = 0;
+    published = 0;
+}
+
+MqttConnection::~MqttConnection()
+{
+    Close();
+}
+
+/// @brief Send the whole buffer, false if the socket failed
+bool sendAll(int fd, const uint8_t* data, size_t length)
+{
+    size_t sent = 0;
+    while (sent < length)
+    {
+        ssize_t n = send(fd, data + sent, length - sent, MSG_NOSIGNAL);
+        if (n > 0){
+            sent += n;
+            continue;
+        }
+        if (n < 0 && errno != EAGAIN && errno != EINTR){
+            return false;
+        }
+        struct pollfd pfd = {fd, POLLOUT, 0};
+        if (poll(&pfd, 1, 1000) <= 0){
+            return false;
+        }
+    }
+    return true;
+}
+
+int MqttConnection::Connect(const char* host, int port, const char* clientId, const char* user, const char* pass)
+{
+    Close();
+    char service[8];
+    snprintf(service, sizeof(service), "%d", port);
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo* address = nullptr;
+    if (getaddrinfo(host, service, &hints, &address) != 0 || address == nullptr){
+        return static_cast<int>(MqttConnectionErrors::MQTT_RESOLVE_FAILED);
+    }
+    _fd = socket(address->ai_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    bool connected = _fd >= 0 && connect(_fd, address->ai_addr, address->ai_addrlen) == 0;
+    freeaddrinfo(address);
+    if (!connected){
+        return Fail(MqttConnectionErrors::MQTT_CONNECT_FAILED);
+    }
+    //telemetry is already batched in _tx, don't hold the last segment back
+    int one = 1;
+    setsockopt(_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    //variable header: protocol name, level 4, flags, keep alive, then the payload strings
+    bool credentials = user != nullptr && user[0] != '\0';
+    size_t remaining = 10 + 2 + strlen(clientId);
+    if (credentials){
+        remaining += 2 + strlen(user) + 2 + strlen(pass);
+    }
+    const uint8_t header[] = {0, 4, 'M', 'Q', 'T', 'T', 4,
+        static_cast<uint8_t>(0x02 | (credentials ? 0xC0 : 0)), 0, MQTT_KEEP_ALIVE_SEC};
+    if (AppendHeader(MQTT_CONNECT << 4, remaining) < 0 || Append(header, sizeof(header)) < 0 ||
+        AppendString(clientId) < 0 || (credentials && (AppendString(user) < 0 || AppendString(pass) < 0)) || Flush() < 0){
+        return Fail(MqttConnectionErrors::MQTT_CONNECT_FAILED);
+    }
+
+    //CONNACK: 0x20, 2, session present, return code
+    uint8_t ack[4];
+    size_t received = 0;
+    uint64_t deadline = steadyMicros() + MQTT_CONNECT_TIMEOUT_MS * 1000ULL;
+    while (received < sizeof(ack))
+    {
+        struct pollfd pfd = {_fd, POLLIN, 0};
+        uint64_t now = steadyMicros();
+        if (now >= deadline || poll(&pfd, 1, static_cast<int>((deadline - now) / 1000) + 1) <= 0){
+            return Fail(MqttConnectionErrors::MQTT_CONNECT_FAILED);
+        }
+        ssize_t n = recv(_fd, ack + received, sizeof(ack) - received, 0);
+        if (n <= 0){
+            return Fail(MqttConnectionErrors::MQTT_CONNECT_FAILED);
+        }
+        received += n;
+    }
+    if (ack[0] != (MQTT_CONNACK << 4) || ack[3] != 0){
+        return Fail(MqttConnectionErrors::MQTT_REFUSED);
+    }
+    return static_cast<int>(MqttConnectionErrors::SUCCESS);
+}
+
+bool MqttConnection::IsConnected()
+{
+    return _fd >= 0;
+}
+
+void MqttConnection::Close()
+{
+    if (_fd >= 0){
+        const uint8_t disconnect[] = {MQTT_DISCONNECT << 4, 0};
+        send(_fd, disconnect, sizeof(disconnect), MSG_NOSIGNAL);
+        close(_fd);
+        _fd = -1;
+    }
+    _rxLength = 0;
+    _txLength = 0;
+}
+
+int MqttConnection::Fail(MqttConnectionErrors error)
+{
+    if (_fd >= 0){
+        close(_fd);
+        _fd = -1;
+    }
+    _rxLength = 0;
+    _txLength = 0;
+    return static_cast<int>(error);
+}
+
+int MqttConnection::Subscribe(const char* filter)
+{
+    if (_fd < 0){
+        return static_cast<int>(MqttConnectionErrors::MQTT_NOT_CONNECTED);
+    }
+    _packetId = _packetId == 0xFFFF ? 1 : _packetId + 1;
+    const uint8_t id[] = {static_cast<uint8_t>(_packetId >> 8), static_cast<uint8_t>(_packetId & 0xFF)};
+    const uint8_t qos = 0;
+    if (AppendHeader((MQTT_SUBSCRIBE << 4) | 0x02, 2 + 2 + strlen(filter) + 1) < 0 || Append(id, sizeof(id)) < 0 ||
+        AppendString(filter) < 0 || Append(&qos, 1) < 0){
+        return Fail(MqttConnectionErrors::MQTT_SOCKET_ERROR);
+    }
+    return Flush();
+}
+
+int MqttConnection::Publish(const char* topic, const uint8_t* payload, size_t length, bool retained)
+{
+    if (_fd < 0){
+        return static_cast<int>(MqttConnectionErrors::MQTT_NOT_CONNECTED);
+    }
+    if (AppendHeader((MQTT_PUBLISH << 4) | (retained ? 1 : 0), 2 + strlen(topic) + length) < 0 ||
+        AppendString(topic) < 0 || Append(payload, length) < 0){
+        return Fail(MqttConnectionErrors::MQTT_SOCKET_ERROR);
+    }
+    published++;
+    return static_cast<int>(MqttConnectionErrors::SUCCESS);
+}
+
+int MqttConnection::Flush()
+{
+    if (_fd < 0){
+        return static_cast<int>(MqttConnectionErrors::MQTT_NOT_CONNECTED);
+    }
+    if (_txLength == 0){
+        return static_cast<int>(MqttConnectionErrors::SUCCESS);
+    }
+    bool sent = sendAll(_fd, _tx, _txLength);
+    _txLength = 0;
+    if (!sent){
+        return Fail(MqttConnectionErrors::MQTT_SOCKET_ERROR);
+    }
+    _lastSentMicros = steadyMicros();
+    return static_cast<int>(MqttConnectionErrors::SUCCESS);
+}
+
+/// @brief Queue bytes for the socket, the buffer is flushed first when they don't fit
+int MqttConnection::Append(const uint8_t* data, size_t length)
+{
+    while (length > 0)
+    {
+        if (_txLength == sizeof(_tx) && Flush() < 0){
+            return static_cast<int>(MqttConnectionErrors::MQTT_SOCKET_ERROR);
+        }
+        size_t chunk = length < sizeof(_tx) - _txLength ? length : sizeof(_tx) - _txLength;
+        memcpy(_tx + _txLength, data, chunk);
+        _txLength += chunk;
+        data += chunk;
+        length -= chunk;
+    }
+    return static_cast<int>(MqttConnectionErrors::SUCCESS);
+}
+
+/// @brief Fixed header, the remaining length is 7 bits per byte, low bits first
+int MqttConnection::AppendHeader(uint8_t type, size_t remaining)
+{
+    uint8_t header[5];
+    size_t length = 0;
+    header[length++] = type;
+    do
+    {
+        uint8_t digit = remaining % 128;
+        remaining /= 128;
+        header[length++] = digit | (remaining > 0 ? 0x80 : 0);
+    } while (remaining > 0 && length < sizeof(header));
+    return Append(header, length);
+}
+
+int MqttConnection::AppendString(const char* str)
+{
+    size_t length = strlen(str);
+    const uint8_t prefix[] = {static_cast<uint8_t>(length >> 8), static_cast<uint8_t>(length & 0xFF)};
+    if (Append(prefix, sizeof(prefix)) < 0){
+        return static_cast<int>(MqttConnectionErrors::MQTT_SOCKET_ERROR);
+    }
+    return Append(reinterpret_cast<const uint8_t*>(str), length);
+}
+
+int MqttConnection::Poll(MqttMessageHandler handler, void* context, int timeoutMs)
+{
+    if (Flush() < 0){
+        return static_cast<int>(MqttConnectionErrors::MQTT_NOT_CONNECTED);
+    }
+    //the broker drops a client that stays silent for one and a half keep alive periods
+    if (steadyMicros() - _lastSentMicros >= MQTT_KEEP_ALIVE_SEC * 1000000ULL / 2){
+        const uint8_t ping[] = {MQTT_PINGREQ << 4, 0};
+        if (Append(ping, sizeof(ping)) < 0 || Flush() < 0){
+            return static_cast<int>(MqttConnectionErrors::MQTT_SOCKET_ERROR);
+        }
+    }
+
+    struct pollfd pfd = {_fd, POLLIN, 0};
+    int ready = poll(&pfd, 1, timeoutMs);
+    if (ready < 0 && errno != EINTR){
+        return Fail(MqttConnectionErrors::MQTT_SOCKET_ERROR);
+    }
+    if (ready <= 0){
+        return 0;
+    }
+    ssize_t n = recv(_fd, _rx + _rxLength, MQTT_RX_BUFFER_SIZE - _rxLength, MSG_DONTWAIT);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)){
+        return Fail(MqttConnectionErrors::MQTT_SOCKET_ERROR);
+    }
+    if (n > 0){
+        _rxLength += n;
+    }
+    return Dispatch(handler, context);
+}
+
+int MqttConnection::Dispatch(MqttMessageHandler handler, void* context)
+{
+    int handled = 0;
+    size_t offset = 0;
+    while (offset + 2 <= _rxLength)
+    {
+        //remaining length, up to 4 bytes
+        size_t remaining = 0;
+        size_t headerLength = 1;
+        int shift = 0;
+        bool complete = false;
+        while (offset + headerLength < _rxLength && headerLength <= 4)
+        {
+            uint8_t digit = _rx[offset + headerLength++];
+            remaining |= static_cast<size_t>(digit & 0x7F) << shift;
+            shift += 7;
+            if (!(digit & 0x80)){
+                complete = true;
+                break;
+            }
+        }
+        if (!complete){
+            if (headerLength > 4){
+                return Fail(MqttConnectionErrors::MQTT_PACKET_TOO_LARGE);
+            }
+            break;
+        }
+        if (headerLength + remaining > MQTT_RX_BUFFER_SIZE){
+            return Fail(MqttConnectionErrors::MQTT_PACKET_TOO_LARGE);
+        }
+        if (offset + headerLength + remaining > _rxLength){
+            break;
+        }
+
+        uint8_t* packet = _rx + offset;
+        uint8_t type = packet[0] >> 4;
+        if (type == MQTT_PUBLISH && remaining >= 2){
+            uint8_t* body = packet + headerLength;
+            size_t topicLength = (body[0] << 8) | body[1];
+            //qos 1 and 2 messages carry a packet id, the subscriptions ask for qos 0 only
+            size_t skip = 2 + topicLength + (((packet[0] >> 1) & 0x03) ? 2 : 0);
+            if (skip <= remaining){
+                char topic[256];
+                size_t copied = topicLength < sizeof(topic) - 1 ? topicLength : sizeof(topic) - 1;
+                memcpy(topic, body + 2, copied);
+                topic[copied] = '\0';
+                //terminated in place for the handler, the byte after the payload is put back afterwards
+                char* payload = reinterpret_cast<char*>(body + skip);
+                int length = static_cast<int>(remaining - skip);
+                uint8_t next = payload[length];
+                payload[length] = '\0';
+                handler(context, topic, payload, length);
+                payload[length] = next;
+                handled++;
+                //the handler's publishes may have failed the connection
+                if (_fd < 0){
+                    return handled;
+                }
+            }
+        }
+        //CONNACK, SUBACK and PINGRESP need nothing further
+        offset += headerLength + remaining;
+    }
+    memmove(_rx, _rx + offset, _rxLength - offset);
+    _rxLength -= offset;
+    return handled;
+}
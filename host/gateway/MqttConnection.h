@@ -0,0 +1,66 @@
+#ifndef MqttConnection_h
+#define MqttConnection_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+//largest packet received, the firmware's REMOTE_MQTT_BUFFER_SIZE with room for the topic
+#define MQTT_RX_BUFFER_SIZE 2048
+//publishes are collected here and written to the socket together
+#define MQTT_TX_BUFFER_SIZE 16384
+#define MQTT_KEEP_ALIVE_SEC 60
+#define MQTT_CONNECT_TIMEOUT_MS 5000
+
+enum class MqttConnectionErrors
+{
+    SUCCESS,
+    MQTT_RESOLVE_FAILED = -100,
+    MQTT_CONNECT_FAILED,
+    MQTT_REFUSED,
+    MQTT_NOT_CONNECTED,
+    MQTT_PACKET_TOO_LARGE,
+    MQTT_SOCKET_ERROR,
+};
+
+/// @brief Message handed to the callback given to MqttConnection::Poll()
+/// topic and payload are null terminated and only valid during the call, payload may be parsed in place
+typedef void (*MqttMessageHandler)(void* context, char* topic, char* payload, int length);
+
+/// @brief MQTT 3.1.1 client over a TCP socket, QoS 0 only
+/// Used by the gateway's publisher thread alone. Publishes are buffered and written by Flush() or Poll(),
+/// so a burst of telemetry leaves in a few large writes instead of one system call per message.
+class MqttConnection
+{
+    public:
+        MqttConnection();
+        ~MqttConnection();
+        //connect to a broker and wait for its CONNACK, empty user connects without credentials
+        int Connect(const char* host, int port, const char* clientId, const char* user, const char* pass);
+        bool IsConnected();
+        void Close();
+        int Subscribe(const char* filter);
+        int Publish(const char* topic, const uint8_t* payload, size_t length, bool retained);
+        //write the buffered publishes
+        int Flush();
+        //flush, then handle what the broker sent, waiting at most timeoutMs for it
+        //returns the messages handled or an error, the connection is closed on error
+        int Poll(MqttMessageHandler handler, void* context, int timeoutMs);
+        unsigned long published;
+    private:
+        int _fd;
+        //one spare byte terminates a payload at the end of the buffer
+        uint8_t _rx[MQTT_RX_BUFFER_SIZE + 1];
+        size_t _rxLength;
+        uint8_t _tx[MQTT_TX_BUFFER_SIZE];
+        size_t _txLength;
+        uint16_t _packetId;
+        uint64_t _lastSentMicros;
+        int Append(const uint8_t* data, size_t length);
+        int AppendHeader(uint8_t type, size_t remaining);
+        int AppendString(const char* str);
+        int Fail(MqttConnectionErrors error);
+        //handle complete packets in _rx, returns the messages handled
+        int Dispatch(MqttMessageHandler handler, void* context);
+};
+
+#endif
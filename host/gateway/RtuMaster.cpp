@@ -0,0 +1,187 @@
+#include "RtuMaster.h"
+#include <time.h>
+
+RtuMaster::RtuMaster(){
+    _port = nullptr;
+    _timing = nullptr;
+    _lastException = 0;
+    _idleAt = 0;
+}
+
+void RtuMaster::Begin(SerialPort* port, RtuTiming* timing)
+{
+    _port = port;
+    _timing = timing;
+    _idleAt = steadyMicros();
+}
+
+uint16_t RtuMaster::Crc(const uint8_t* data, size_t length)
+{
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < length; i++)
+    {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+        }
+    }
+    return crc;
+}
+
+/// @brief Function code reading a table
+uint8_t readFunction(eRegisterType type)
+{
+    switch (type)
+    {
+        case eRegisterType::coil: return 0x01;
+        case eRegisterType::discrete_input: return 0x02;
+        case eRegisterType::input_register: return 0x04;
+        default: return 0x03;
+    }
+}
+
+void putWord(uint8_t* frame, uint16_t value)
+{
+    frame[0] = value >> 8;
+    frame[1] = value & 0xFF;
+}
+
+void sleepMicros(uint64_t micros)
+{
+    struct timespec ts;
+    ts.tv_sec = micros / 1000000;
+    ts.tv_nsec = (micros % 1000000) * 1000;
+    nanosleep(&ts, nullptr);
+}
+
+int RtuMaster::Read(int deviceId, eRegisterType type, int address, int count, uint16_t* values)
+{
+    if (count <= 0 || count > MODBUS_MAX_READ_REGISTERS){
+        return static_cast<int>(RtuMasterErrors::RTU_BAD_RESPONSE);
+    }
+    bool bits = type == eRegisterType::coil || type == eRegisterType::discrete_input;
+    size_t dataBytes = bits ? (count + 7) / 8 : count * 2;
+    _frame[0] = deviceId;
+    _frame[1] = readFunction(type);
+    putWord(&_frame[2], address);
+    putWord(&_frame[4], count);
+    int res = Transact(deviceId, 6, 3 + dataBytes + 2);
+    if (res < 0){
+        return res;
+    }
+    if (_frame[2] != dataBytes){
+        return static_cast<int>(RtuMasterErrors::RTU_BAD_RESPONSE);
+    }
+    for (int i = 0; i < count; i++)
+    {
+        if (bits){
+            values[i] = (_frame[3 + i / 8] >> (i % 8)) & 1;
+        }else{
+            values[i] = (_frame[3 + i * 2] << 8) | _frame[4 + i * 2];
+        }
+    }
+    return static_cast<int>(RtuMasterErrors::SUCCESS);
+}
+
+int RtuMaster::Write(int deviceId, eRegisterType type, int address, const uint16_t* values, int count)
+{
+    bool isCoil = type == eRegisterType::coil;
+    if (count <= 0 || count > (isCoil ? 1968 : 123)){
+        return static_cast<int>(RtuMasterErrors::RTU_BAD_RESPONSE);
+    }
+    _frame[0] = deviceId;
+    putWord(&_frame[2], address);
+    size_t length;
+    if (count == 1){
+        //a single coil is written as 0xFF00 or 0x0000
+        _frame[1] = isCoil ? 0x05 : 0x06;
+        putWord(&_frame[4], isCoil ? (values[0] ? 0xFF00 : 0x0000) : values[0]);
+        length = 6;
+    }else if (isCoil){
+        _frame[1] = 0x0F;
+        putWord(&_frame[4], count);
+        _frame[6] = (count + 7) / 8;
+        for (int i = 0; i < _frame[6]; i++)
+        {
+            _frame[7 + i] = 0;
+        }
+        for (int i = 0; i < count; i++)
+        {
+            if (values[i]){
+                _frame[7 + i / 8] |= 1 << (i % 8);
+            }
+        }
+        length = 7 + _frame[6];
+    }else{
+        _frame[1] = 0x10;
+        putWord(&_frame[4], count);
+        _frame[6] = count * 2;
+        for (int i = 0; i < count; i++)
+        {
+            putWord(&_frame[7 + i * 2], values[i]);
+        }
+        length = 7 + _frame[6];
+    }
+    //every write function echoes the address and value or count
+    return Transact(deviceId, length, 8);
+}
+
+uint8_t RtuMaster::GetLastException()
+{
+    return _lastException;
+}
+
+/// @brief Send the request in _frame and read the response into it
+/// @param responseLength Length of a normal response, crc included
+int RtuMaster::Transact(int deviceId, size_t requestLength, size_t responseLength)
+{
+    uint16_t crc = Crc(_frame, requestLength);
+    _frame[requestLength] = crc & 0xFF;
+    _frame[requestLength + 1] = crc >> 8;
+    uint8_t function = _frame[1];
+
+    //t3.5 of silence since the last frame on the bus
+    uint64_t quietAt = _idleAt + _timing->GetFrameGapMicros();
+    uint64_t now = steadyMicros();
+    if (now < quietAt){
+        sleepMicros(quietAt - now);
+    }
+    _port->Discard();
+    if (_port->Write(_frame, requestLength + 2) < 0){
+        _idleAt = steadyMicros();
+        return static_cast<int>(RtuMasterErrors::RTU_IO_ERROR);
+    }
+    uint64_t sentAt = steadyMicros();
+
+    //the response must start within the slave's timeout, then arrive at the line rate
+    unsigned long timeoutMicros = _timing->GetTimeout(deviceId) * 1000UL;
+    unsigned long lineMicros = responseLength * _timing->GetCharMicros() + _timing->GetCharGapMicros();
+    int n = _port->Read(_frame, 2, timeoutMicros + lineMicros);
+    if (n < 2){
+        _idleAt = steadyMicros();
+        _timing->RecordTimeout(deviceId);
+        return static_cast<int>(n < 0 ? RtuMasterErrors::RTU_IO_ERROR : RtuMasterErrors::RTU_TIMEOUT);
+    }
+    //an exception response is the function code with its high bit set, the code and the crc
+    size_t expected = (_frame[1] & 0x80) ? 5 : responseLength;
+    n = _port->Read(_frame + 2, expected - 2, lineMicros);
+    _idleAt = steadyMicros();
+    if (n < static_cast<int>(expected - 2)){
+        _port->Discard();
+        return static_cast<int>(n < 0 ? RtuMasterErrors::RTU_IO_ERROR : RtuMasterErrors::RTU_TIMEOUT);
+    }
+    uint16_t received = _frame[expected - 2] | (_frame[expected - 1] << 8);
+    if (Crc(_frame, expected - 2) != received){
+        return static_cast<int>(RtuMasterErrors::RTU_CRC_ERROR);
+    }
+    if (_frame[0] != deviceId || (_frame[1] & 0x7F) != function){
+        return static_cast<int>(RtuMasterErrors::RTU_BAD_RESPONSE);
+    }
+    _timing->RecordResponse(deviceId, static_cast<unsigned long>(_idleAt - sentAt));
+    if (_frame[1] & 0x80){
+        _lastException = _frame[2];
+        return static_cast<int>(RtuMasterErrors::RTU_EXCEPTION);
+    }
+    return static_cast<int>(RtuMasterErrors::SUCCESS);
+}
@@ -0,0 +1,47 @@
+#ifndef RtuMaster_h
+#define RtuMaster_h
+
+#include "SerialPort.h"
+#include "../../app/src/RtuTiming.h"
+
+//function code, address, up to 125 registers and the crc
+#define RTU_MAX_FRAME 256
+
+enum class RtuMasterErrors
+{
+    SUCCESS,
+    RTU_TIMEOUT = -100,
+    RTU_CRC_ERROR,
+    //the slave answered with an exception, see GetLastException()
+    RTU_EXCEPTION,
+    RTU_BAD_RESPONSE,
+    RTU_IO_ERROR,
+};
+
+/// @brief Modbus RTU client of a single serial bus
+/// Frames are separated by the t3.5 silence of the bus's RtuTiming and every slave is given the
+/// response timeout RtuTiming adapted to it. Each bus worker owns one, nothing is shared between buses.
+class RtuMaster
+{
+    public:
+        RtuMaster();
+        void Begin(SerialPort* port, RtuTiming* timing);
+        //read count registers or bits of a table starting at address (functions 0x01-0x04), bits are unpacked one per value
+        int Read(int deviceId, eRegisterType type, int address, int count, uint16_t* values);
+        //write one (0x05, 0x06) or several (0x0F, 0x10) consecutive coils or holding registers
+        int Write(int deviceId, eRegisterType type, int address, const uint16_t* values, int count);
+        //exception code of the last RTU_EXCEPTION
+        uint8_t GetLastException();
+        //crc16 of a frame, polynomial 0xA001, sent low byte first
+        static uint16_t Crc(const uint8_t* data, size_t length);
+    private:
+        SerialPort* _port;
+        RtuTiming* _timing;
+        uint8_t _frame[RTU_MAX_FRAME];
+        uint8_t _lastException;
+        //steadyMicros() the bus went quiet, the next request waits out t3.5 from here
+        uint64_t _idleAt;
+        int Transact(int deviceId, size_t requestLength, size_t responseLength);
+};
+
+#endif
@@ -0,0 +1,150 @@
+#include "SerialPort.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+SerialPort::SerialPort(){
+    _fd = -1;
+}
+
+SerialPort::~SerialPort()
+{
+    Close();
+}
+
+uint64_t steadyMicros()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+/// @brief termios speed of a baud rate, B0 if the rate isn't one termios knows
+speed_t speedOf(long baud)
+{
+    switch (baud)
+    {
+        case 1200: return B1200;
+        case 2400: return B2400;
+        case 4800: return B4800;
+        case 9600: return B9600;
+        case 19200: return B19200;
+        case 38400: return B38400;
+        case 57600: return B57600;
+        case 115200: return B115200;
+        case 230400: return B230400;
+        default: return B0;
+    }
+}
+
+int SerialPort::Open(const char* path, long baud, int dataBits, int parity, int stopBits)
+{
+    Close();
+    speed_t speed = speedOf(baud);
+    if (speed == B0){
+        return static_cast<int>(SerialPortErrors::PORT_UNSUPPORTED_BAUD);
+    }
+    _fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (_fd < 0){
+        return static_cast<int>(SerialPortErrors::PORT_OPEN_FAILED);
+    }
+
+    //raw frames, no line discipline, reads return whatever has arrived
+    struct termios tio;
+    if (tcgetattr(_fd, &tio) != 0){
+        Close();
+        return static_cast<int>(SerialPortErrors::PORT_CONFIG_FAILED);
+    }
+    cfmakeraw(&tio);
+    tio.c_cflag |= CLOCAL | CREAD;
+    tio.c_cflag &= ~(CSIZE | PARENB | PARODD | CSTOPB | CRTSCTS);
+    tio.c_cflag |= dataBits == 7 ? CS7 : CS8;
+    if (parity != 0){
+        tio.c_cflag |= PARENB | (parity == 1 ? PARODD : 0);
+    }
+    if (stopBits == 2){
+        tio.c_cflag |= CSTOPB;
+    }
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
+    cfsetispeed(&tio, speed);
+    cfsetospeed(&tio, speed);
+    if (tcsetattr(_fd, TCSANOW, &tio) != 0){
+        Close();
+        return static_cast<int>(SerialPortErrors::PORT_CONFIG_FAILED);
+    }
+    tcflush(_fd, TCIOFLUSH);
+    return static_cast<int>(SerialPortErrors::SUCCESS);
+}
+
+void SerialPort::Close()
+{
+    if (_fd >= 0){
+        close(_fd);
+        _fd = -1;
+    }
+}
+
+bool SerialPort::IsOpen()
+{
+    return _fd >= 0;
+}
+
+int SerialPort::Write(const uint8_t* data, size_t size)
+{
+    size_t sent = 0;
+    while (sent < size)
+    {
+        ssize_t n = write(_fd, data + sent, size - sent);
+        if (n > 0){
+            sent += n;
+            continue;
+        }
+        if (n < 0 && errno != EAGAIN && errno != EINTR){
+            return static_cast<int>(SerialPortErrors::PORT_WRITE_FAILED);
+        }
+        //the driver's buffer is full, wait until it takes more
+        struct pollfd pfd = {_fd, POLLOUT, 0};
+        if (poll(&pfd, 1, 100) < 0 && errno != EINTR){
+            return static_cast<int>(SerialPortErrors::PORT_WRITE_FAILED);
+        }
+    }
+    //an RS-485 adapter turns the line around once the frame has left
+    tcdrain(_fd);
+    return static_cast<int>(SerialPortErrors::SUCCESS);
+}
+
+int SerialPort::Read(uint8_t* buffer, size_t size, unsigned long timeoutMicros)
+{
+    size_t received = 0;
+    uint64_t deadline = steadyMicros() + timeoutMicros;
+    while (received < size)
+    {
+        ssize_t n = read(_fd, buffer + received, size - received);
+        if (n > 0){
+            received += n;
+            continue;
+        }
+        if (n < 0 && errno != EAGAIN && errno != EINTR){
+            return static_cast<int>(SerialPortErrors::PORT_READ_FAILED);
+        }
+        uint64_t now = steadyMicros();
+        if (now >= deadline){
+            break;
+        }
+        struct pollfd pfd = {_fd, POLLIN, 0};
+        int waitMs = static_cast<int>((deadline - now + 999) / 1000);
+        if (poll(&pfd, 1, waitMs) < 0 && errno != EINTR){
+            return static_cast<int>(SerialPortErrors::PORT_READ_FAILED);
+        }
+    }
+    return static_cast<int>(received);
+}
+
+void SerialPort::Discard()
+{
+    tcflush(_fd, TCIFLUSH);
+}
@@ -0,0 +1,41 @@
+#ifndef SerialPort_h
+#define SerialPort_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum class SerialPortErrors
+{
+    SUCCESS,
+    PORT_OPEN_FAILED = -100,
+    PORT_UNSUPPORTED_BAUD,
+    PORT_CONFIG_FAILED,
+    PORT_WRITE_FAILED,
+    PORT_READ_FAILED,
+};
+
+/// @brief RS-485 adapter or pseudo-terminal driven through termios, raw frames
+/// Kept apart from the firmware headers, the SD stand-in's open flags clash with fcntl.h.
+class SerialPort
+{
+    public:
+        SerialPort();
+        ~SerialPort();
+        //open a tty, ex: /dev/ttyUSB0, parity is 0 = none, 1 = odd, 2 = even like a serial_port entry
+        int Open(const char* path, long baud, int dataBits, int parity, int stopBits);
+        void Close();
+        bool IsOpen();
+        //write the whole buffer, returns SUCCESS or PORT_WRITE_FAILED
+        int Write(const uint8_t* data, size_t size);
+        //read until size bytes arrived or timeoutMicros passed, returns the bytes read or PORT_READ_FAILED
+        int Read(uint8_t* buffer, size_t size, unsigned long timeoutMicros);
+        //drop anything received and not read, ex: the rest of a corrupt frame
+        void Discard();
+    private:
+        int _fd;
+};
+
+//monotonic microseconds, the bus threads time frames with it instead of the millis() of the publisher
+uint64_t steadyMicros();
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef SpscQueue_h
+#define SpscQueue_h
+
+#include <atomic>
+#include <stddef.h>
+
+/// @brief Bounded lock-free ring between exactly one producer thread and one consumer thread
+/// Head and tail are running totals on their own cache lines, each side keeps a stale copy of the
+/// other's index and only reloads it when the ring looks full or empty.
+template <typename T, size_t Capacity>
+class SpscQueue
+{
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+
+    public:
+        SpscQueue() : _head(0), _tailCache(0), _tail(0), _headCache(0) {}
+
+        //producer side, false when the ring is full
+        bool Push(const T& item)
+        {
+            size_t tail = _tail.load(std::memory_order_relaxed);
+            if (tail - _headCache == Capacity){
+                _headCache = _head.load(std::memory_order_acquire);
+                if (tail - _headCache == Capacity){
+                    return false;
+                }
+            }
+            _items[tail & (Capacity - 1)] = item;
+            _tail.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        //consumer side, false when the ring is empty
+        bool Pop(T* item)
+        {
+            size_t head = _head.load(std::memory_order_relaxed);
+            if (head == _tailCache){
+                _tailCache = _tail.load(std::memory_order_acquire);
+                if (head == _tailCache){
+                    return false;
+                }
+            }
+            *item = _items[head & (Capacity - 1)];
+            _head.store(head + 1, std::memory_order_release);
+            return true;
+        }
+
+        //items waiting, exact only on the consumer side
+        size_t Size()
+        {
+            return _tail.load(std::memory_order_acquire) - _head.load(std::memory_order_acquire);
+        }
+
+    private:
+        //consumer's index and its copy of the producer's
+        alignas(64) std::atomic<size_t> _head;
+        size_t _tailCache;
+        //producer's index and its copy of the consumer's
+        alignas(64) std::atomic<size_t> _tail;
+        size_t _headCache;
+        alignas(64) T _items[Capacity];
+};
+
+#endif
@@ -0,0 +1,44 @@
+#include "Gateway.h"
+#include "../../app/src/Log.h"
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+//vfdctl_gateway <conf.txt> <bus 0 tty> [<bus 1 tty> ...]
+//  ex: vfdctl_gateway /etc/vfdctl/conf.txt /dev/ttyUSB0 /dev/ttyUSB1
+
+volatile sig_atomic_t stopRequested = 0;
+
+void onSignal(int signal)
+{
+    (void)signal;
+    stopRequested = 1;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3){
+        fprintf(stderr, "usage: %s <conf.txt> <bus 0 tty> [<bus 1 tty> ...]\n", argv[0]);
+        return 2;
+    }
+    //log lines go to stdout
+    setenv("HOST_SERIAL", "1", 0);
+
+    int res = LinuxGateway.Begin(argv[1], argv + 2, argc - 2);
+    Log.Drain();
+    if (res < 0){
+        fflush(stdout);
+        return 1;
+    }
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+    LinuxGateway.Start();
+    while (!stopRequested)
+    {
+        sleep(1);
+    }
+    LinuxGateway.Stop();
+    fflush(stdout);
+    return 0;
+}
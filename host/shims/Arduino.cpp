@@ -0,0 +1,244 @@
+#include "Arduino.h"
+#include "../sim/SimClock.h"
+#include "../sim/AllocCounter.h"
+
+HostSerial Serial;
+
+unsigned long millis()
+{
+    return static_cast<unsigned long>(Clock.Micros() / 1000);
+}
+
+unsigned long micros()
+{
+    return static_cast<unsigned long>(Clock.Micros());
+}
+
+void delay(unsigned long ms)
+{
+    Clock.Advance(static_cast<uint64_t>(ms) * 1000);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+    Clock.Advance(us);
+}
+
+void yield()
+{
+}
+
+//same sequence on every run, tests compare jittered backoffs against fixed values
+uint32_t randomState = 1;
+
+long random(long howBig)
+{
+    if (howBig <= 0){
+        return 0;
+    }
+    randomState = randomState * 1103515245UL + 12345UL;
+    return static_cast<long>((randomState >> 1) % static_cast<uint32_t>(howBig));
+}
+
+long random(long howSmall, long howBig)
+{
+    if (howSmall >= howBig){
+        return howSmall;
+    }
+    return howSmall + random(howBig - howSmall);
+}
+
+void randomSeed(unsigned long seed)
+{
+    randomState = seed == 0 ? 1 : static_cast<uint32_t>(seed);
+}
+
+uint8_t pinLevels[64];
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+    (void)pin;
+    (void)mode;
+}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+    if (pin < sizeof(pinLevels)){
+        pinLevels[pin] = value;
+    }
+}
+
+int digitalRead(uint8_t pin)
+{
+    return pin < sizeof(pinLevels) ? pinLevels[pin] : LOW;
+}
+
+#ifdef HOST_NEEDS_STRLCPY
+size_t strlcpy(char* dst, const char* src, size_t size)
+{
+    size_t len = strlen(src);
+    if (size > 0){
+        size_t n = len < size - 1 ? len : size - 1;
+        memcpy(dst, src, n);
+        dst[n] = '\0';
+    }
+    return len;
+}
+#endif
+
+String::String(const char* str)
+{
+    if (str == nullptr){
+        str = "";
+    }
+    _length = strlen(str);
+    _buffer = static_cast<char*>(malloc(_length + 1));
+    memcpy(_buffer, str, _length + 1);
+}
+
+String::String(const String& other) : String(other._buffer)
+{
+}
+
+String::~String()
+{
+    free(_buffer);
+}
+
+String& String::operator=(const String& other)
+{
+    if (this != &other){
+        *this = other._buffer;
+    }
+    return *this;
+}
+
+String& String::operator=(const char* str)
+{
+    if (str == nullptr){
+        str = "";
+    }
+    size_t len = strlen(str);
+    char* buffer = static_cast<char*>(malloc(len + 1));
+    memcpy(buffer, str, len + 1);
+    free(_buffer);
+    _buffer = buffer;
+    _length = len;
+    return *this;
+}
+
+bool String::concat(const char* str)
+{
+    return str == nullptr || concat(str, strlen(str));
+}
+
+bool String::concat(const char* str, unsigned int length)
+{
+    char* buffer = static_cast<char*>(realloc(_buffer, _length + length + 1));
+    if (buffer == nullptr){
+        return false;
+    }
+    memcpy(buffer + _length, str, length);
+    _length += length;
+    buffer[_length] = '\0';
+    _buffer = buffer;
+    return true;
+}
+
+bool String::concat(char c)
+{
+    return concat(&c, 1);
+}
+
+bool String::equals(const char* str) const
+{
+    return strcmp(_buffer, str == nullptr ? "" : str) == 0;
+}
+
+size_t Print::write(const uint8_t* buffer, size_t size)
+{
+    size_t n = 0;
+    while (n < size && write(buffer[n]))
+    {
+        n++;
+    }
+    return n;
+}
+
+size_t Print::print(long value)
+{
+    char text[24];
+    snprintf(text, sizeof(text), "%ld", value);
+    return write(text);
+}
+
+bool Stream::find(const char* target)
+{
+    return findUntil(target, nullptr);
+}
+
+bool Stream::findUntil(const char* target, const char* terminator)
+{
+    size_t targetLen = strlen(target);
+    size_t terminatorLen = terminator == nullptr ? 0 : strlen(terminator);
+    size_t matched = 0;
+    size_t terminatorMatched = 0;
+    if (targetLen == 0){
+        return true;
+    }
+    int c;
+    while ((c = read()) >= 0)
+    {
+        //the core restarts a partial match from scratch, its targets here never overlap themselves
+        matched = c == target[matched] ? matched + 1 : (c == target[0] ? 1 : 0);
+        if (matched == targetLen){
+            return true;
+        }
+        if (terminatorLen > 0){
+            terminatorMatched = c == terminator[terminatorMatched] ? terminatorMatched + 1 : (c == terminator[0] ? 1 : 0);
+            if (terminatorMatched == terminatorLen){
+                return false;
+            }
+        }
+    }
+    return false;
+}
+
+size_t Stream::readBytes(char* buffer, size_t length)
+{
+    size_t n = 0;
+    while (n < length)
+    {
+        int c = read();
+        if (c < 0){
+            break;
+        }
+        buffer[n++] = static_cast<char>(c);
+    }
+    return n;
+}
+
+bool serialEcho()
+{
+    static int echo = -1;
+    if (echo < 0){
+        AllocCounter::Pause pause;
+        echo = getenv("HOST_SERIAL") != nullptr ? 1 : 0;
+    }
+    return echo == 1;
+}
+
+size_t HostSerial::write(uint8_t c)
+{
+    return write(&c, 1);
+}
+
+size_t HostSerial::write(const uint8_t* buffer, size_t size)
+{
+    if (serialEcho()){
+        AllocCounter::Pause pause;
+        fwrite(buffer, 1, size, stdout);
+    }
+    written += size;
+    return size;
+}
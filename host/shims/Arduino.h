@@ -0,0 +1,167 @@
+#ifndef Arduino_h
+#define Arduino_h
+
+//host stand-in for the Arduino core, only what the firmware uses
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <math.h>
+#include <type_traits>
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define HIGH 0x1
+#define LOW 0x0
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define LED_BUILTIN 32
+//P1AM-100ETH SD card chip select
+#define SDCARD_SS_PIN 28
+
+//serial frame formats, same encoding as the SAMD core
+#define SERIAL_PARITY_EVEN (0x1ul)
+#define SERIAL_PARITY_ODD (0x2ul)
+#define SERIAL_PARITY_NONE (0x3ul)
+#define SERIAL_STOP_BIT_1 (0x10ul)
+#define SERIAL_STOP_BIT_2 (0x30ul)
+#define SERIAL_DATA_7 (0x200ul)
+#define SERIAL_DATA_8 (0x300ul)
+#define SERIAL_7N1 (SERIAL_STOP_BIT_1 | SERIAL_PARITY_NONE | SERIAL_DATA_7)
+#define SERIAL_8N1 (SERIAL_STOP_BIT_1 | SERIAL_PARITY_NONE | SERIAL_DATA_8)
+#define SERIAL_7N2 (SERIAL_STOP_BIT_2 | SERIAL_PARITY_NONE | SERIAL_DATA_7)
+#define SERIAL_8N2 (SERIAL_STOP_BIT_2 | SERIAL_PARITY_NONE | SERIAL_DATA_8)
+#define SERIAL_7E1 (SERIAL_STOP_BIT_1 | SERIAL_PARITY_EVEN | SERIAL_DATA_7)
+#define SERIAL_8E1 (SERIAL_STOP_BIT_1 | SERIAL_PARITY_EVEN | SERIAL_DATA_8)
+#define SERIAL_7E2 (SERIAL_STOP_BIT_2 | SERIAL_PARITY_EVEN | SERIAL_DATA_7)
+#define SERIAL_8E2 (SERIAL_STOP_BIT_2 | SERIAL_PARITY_EVEN | SERIAL_DATA_8)
+#define SERIAL_7O1 (SERIAL_STOP_BIT_1 | SERIAL_PARITY_ODD | SERIAL_DATA_7)
+#define SERIAL_8O1 (SERIAL_STOP_BIT_1 | SERIAL_PARITY_ODD | SERIAL_DATA_8)
+#define SERIAL_7O2 (SERIAL_STOP_BIT_2 | SERIAL_PARITY_ODD | SERIAL_DATA_7)
+#define SERIAL_8O2 (SERIAL_STOP_BIT_2 | SERIAL_PARITY_ODD | SERIAL_DATA_8)
+
+#define F(str) (str)
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+//the core's min/max accept mixed argument types
+template <typename A, typename B>
+inline typename std::common_type<A, B>::type min(const A& a, const B& b)
+{
+    return b < a ? b : a;
+}
+template <typename A, typename B>
+inline typename std::common_type<A, B>::type max(const A& a, const B& b)
+{
+    return a < b ? b : a;
+}
+
+//the host clock, simulated bus and network time is added on top of real time, see sim/SimClock.h
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+long random(long howBig);
+long random(long howSmall, long howBig);
+void randomSeed(unsigned long seed);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+
+//strlcpy only joined glibc in 2.38
+#if defined(__GLIBC__) && (__GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 38))
+#define HOST_NEEDS_STRLCPY 1
+size_t strlcpy(char* dst, const char* src, size_t size);
+#endif
+
+/// @brief Heap backed string, the subset of the core's String the firmware and ArduinoJson use
+class String
+{
+    public:
+        String(const char* str = "");
+        String(const String& other);
+        ~String();
+        String& operator=(const String& other);
+        String& operator=(const char* str);
+        const char* c_str() const { return _buffer; }
+        unsigned int length() const { return _length; }
+        bool concat(const char* str);
+        bool concat(const char* str, unsigned int length);
+        bool concat(char c);
+        String& operator+=(const char* str) { concat(str); return *this; }
+        String& operator+=(const String& str) { concat(str._buffer, str._length); return *this; }
+        String& operator+=(char c) { concat(c); return *this; }
+        bool operator==(const String& other) const { return equals(other._buffer); }
+        bool operator==(const char* str) const { return equals(str); }
+        bool operator!=(const String& other) const { return !equals(other._buffer); }
+        bool operator!=(const char* str) const { return !equals(str); }
+        char operator[](unsigned int index) const { return index < _length ? _buffer[index] : '\0'; }
+    private:
+        char* _buffer;
+        unsigned int _length;
+        bool equals(const char* str) const;
+};
+
+class Print
+{
+    public:
+        virtual ~Print() {}
+        virtual size_t write(uint8_t c) = 0;
+        virtual size_t write(const uint8_t* buffer, size_t size);
+        size_t write(const char* str) { return str == nullptr ? 0 : write(reinterpret_cast<const uint8_t*>(str), strlen(str)); }
+        virtual int availableForWrite() { return 0; }
+        virtual void flush() {}
+        size_t print(const char* str) { return write(str); }
+        size_t print(const String& str) { return write(str.c_str()); }
+        size_t print(long value);
+        size_t println(const char* str) { return write(str) + write("\r\n"); }
+        size_t println(const String& str) { return println(str.c_str()); }
+        size_t println(long value) { return print(value) + write("\r\n"); }
+        size_t println() { return write("\r\n"); }
+};
+
+class Stream : public Print
+{
+    public:
+        virtual int available() = 0;
+        virtual int read() = 0;
+        virtual int peek() = 0;
+        void setTimeout(unsigned long timeout) { _timeout = timeout; }
+        //read until target is found, true if it was
+        bool find(const char* target);
+        bool find(char* target) { return find(const_cast<const char*>(target)); }
+        //read until target or terminator is found, true if target was found first
+        bool findUntil(const char* target, const char* terminator);
+        bool findUntil(char* target, char* terminator) { return findUntil(const_cast<const char*>(target), const_cast<const char*>(terminator)); }
+        size_t readBytes(char* buffer, size_t length);
+        size_t readBytes(uint8_t* buffer, size_t length) { return readBytes(reinterpret_cast<char*>(buffer), length); }
+    protected:
+        unsigned long _timeout = 1000;
+};
+
+/// @brief USB serial, written to stdout when HOST_SERIAL is set in the environment, dropped otherwise
+class HostSerial : public Stream
+{
+    public:
+        void begin(unsigned long baud) { (void)baud; }
+        void end() {}
+        operator bool() const { return true; }
+        size_t write(uint8_t c) override;
+        size_t write(const uint8_t* buffer, size_t size) override;
+        using Print::write;
+        int availableForWrite() override { return 4096; }
+        int available() override { return 0; }
+        int read() override { return -1; }
+        int peek() override { return -1; }
+        //bytes written since boot
+        unsigned long written = 0;
+};
+
+extern HostSerial Serial;
+
+#endif
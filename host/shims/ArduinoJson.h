@@ -0,0 +1,13 @@
+#ifndef HOST_ArduinoJson_h
+#define HOST_ArduinoJson_h
+
+//the real ArduinoJson, found after this directory on the include path
+#include_next <ArduinoJson.h>
+
+//a variant slot takes 16 bytes on the 32 bit target and 32 bytes on a 64 bit host, capacities the firmware
+//sizes by hand for the target are scaled up so the same documents fit, JSON_OBJECT_SIZE() already scales itself
+template <size_t desiredCapacity>
+using HostStaticJsonDocument = ArduinoJson::StaticJsonDocument<desiredCapacity * sizeof(void*) / 4>;
+#define StaticJsonDocument HostStaticJsonDocument
+
+#endif
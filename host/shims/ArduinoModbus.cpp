@@ -0,0 +1,144 @@
+#include "ArduinoModbus.h"
+#include "../sim/SimulatedBus.h"
+
+ModbusRTUClientClass ModbusRTUClient;
+
+//libmodbus error texts
+const char* modbusExceptionText(uint8_t code)
+{
+    switch (code)
+    {
+        case SIM_ILLEGAL_FUNCTION:
+            return "Illegal function";
+        case SIM_ILLEGAL_DATA_ADDRESS:
+            return "Illegal data address";
+        case SIM_ILLEGAL_DATA_VALUE:
+            return "Illegal data value";
+        default:
+            return "Slave device or server failure";
+    }
+}
+
+bool modbusIsBitTable(int type)
+{
+    return type == COILS || type == DISCRETE_INPUTS;
+}
+
+ModbusRTUClientClass::ModbusRTUClientClass()
+{
+    _timeoutMs = 1000;
+    _lastError = "Success";
+    _readCount = 0;
+    _readNext = 0;
+    _txId = 0;
+    _txType = 0;
+    _txAddress = 0;
+    _txCount = 0;
+    _txWritten = 0;
+}
+
+int ModbusRTUClientClass::begin(unsigned long baudrate, uint16_t config)
+{
+    if (RtuBus.failBegin){
+        return 0;
+    }
+    RtuBus.Configure(baudrate, config);
+    return 1;
+}
+
+int ModbusRTUClientClass::Transact(int id, bool write, int type, int address, int nb, int requestBytes, int responseBytes)
+{
+    uint8_t exception;
+    eSimResult result = RtuBus.Transact(id, write, type, static_cast<uint16_t>(address), static_cast<uint16_t>(nb),
+        _values, requestBytes, responseBytes, _timeoutMs, &exception);
+    switch (result)
+    {
+        case sim_ok:
+            return 1;
+        case sim_timeout:
+            _lastError = "Connection timed out";
+            return 0;
+        case sim_crc_error:
+            _lastError = "Invalid CRC";
+            return 0;
+        default:
+            _lastError = modbusExceptionText(exception);
+            return 0;
+    }
+}
+
+int ModbusRTUClientClass::requestFrom(int id, int type, int address, int nb)
+{
+    _readCount = 0;
+    _readNext = 0;
+    if (nb <= 0 || nb > HOST_MODBUS_MAX_VALUES){
+        _lastError = "Invalid argument";
+        return 0;
+    }
+    //address, function, start, count, crc and the answer's address, function, byte count, data and crc
+    int dataBytes = modbusIsBitTable(type) ? (nb + 7) / 8 : nb * 2;
+    if (!Transact(id, false, type, address, nb, 8, 5 + dataBytes)){
+        return 0;
+    }
+    _readCount = nb;
+    return nb;
+}
+
+long ModbusRTUClientClass::read()
+{
+    if (_readNext >= _readCount){
+        return -1;
+    }
+    return _values[_readNext++];
+}
+
+int ModbusRTUClientClass::coilWrite(int id, int address, uint8_t value)
+{
+    //function 5 echoes the request
+    _values[0] = value != 0;
+    return Transact(id, true, COILS, address, 1, 8, 8);
+}
+
+int ModbusRTUClientClass::holdingRegisterWrite(int id, int address, uint16_t value)
+{
+    //function 6 echoes the request
+    _values[0] = value;
+    return Transact(id, true, HOLDING_REGISTERS, address, 1, 8, 8);
+}
+
+int ModbusRTUClientClass::beginTransmission(int id, int type, int address, int nb)
+{
+    if ((type != COILS && type != HOLDING_REGISTERS) || nb <= 0 || nb > HOST_MODBUS_MAX_VALUES){
+        _lastError = "Invalid argument";
+        return 0;
+    }
+    _txId = id;
+    _txType = type;
+    _txAddress = address;
+    _txCount = nb;
+    _txWritten = 0;
+    return 1;
+}
+
+int ModbusRTUClientClass::write(unsigned int value)
+{
+    if (_txWritten >= _txCount){
+        return 0;
+    }
+    _values[_txWritten++] = static_cast<uint16_t>(value);
+    return 1;
+}
+
+int ModbusRTUClientClass::endTransmission()
+{
+    if (_txCount == 0 || _txWritten != _txCount){
+        _lastError = "Invalid argument";
+        _txCount = 0;
+        return 0;
+    }
+    int count = _txCount;
+    _txCount = 0;
+    //address, function, start, count, byte count, data and crc, answered with the start and count
+    int dataBytes = _txType == COILS ? (count + 7) / 8 : count * 2;
+    return Transact(_txId, true, _txType, _txAddress, count, 9 + dataBytes, 8);
+}
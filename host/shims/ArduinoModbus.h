@@ -0,0 +1,54 @@
+#ifndef ArduinoModbus_h
+#define ArduinoModbus_h
+
+//host stand-in for ArduinoModbus, RTU transactions run against the slaves on sim/SimulatedBus.h
+#include "Arduino.h"
+
+#define COILS 0
+#define DISCRETE_INPUTS 1
+#define HOLDING_REGISTERS 2
+#define INPUT_REGISTERS 3
+
+//most values a single request carries
+#define HOST_MODBUS_MAX_VALUES 2000
+
+class ModbusRTUClientClass
+{
+    public:
+        ModbusRTUClientClass();
+        //1 = success, 0 = failure
+        int begin(unsigned long baudrate, uint16_t config = SERIAL_8N1);
+        void end() {}
+        void setTimeout(unsigned long ms) { _timeoutMs = ms; }
+        //function 1 to 4, returns nb or 0 on failure, the values are then taken with read()
+        int requestFrom(int id, int type, int address, int nb);
+        int available() { return _readCount - _readNext; }
+        //next value of the last requestFrom(), -1 when none is left
+        long read();
+        //function 5 and 6, 1 = success, 0 = failure
+        int coilWrite(int id, int address, uint8_t value);
+        int holdingRegisterWrite(int id, int address, uint16_t value);
+        //function 15 and 16, values are added with write() and sent by endTransmission()
+        int beginTransmission(int id, int type, int address, int nb);
+        int write(unsigned int value);
+        int endTransmission();
+        //libmodbus error text of the last failed transaction
+        const char* lastError() { return _lastError; }
+    private:
+        unsigned long _timeoutMs;
+        const char* _lastError;
+        uint16_t _values[HOST_MODBUS_MAX_VALUES];
+        int _readCount;
+        int _readNext;
+        //pending function 15/16 request
+        int _txId;
+        int _txType;
+        int _txAddress;
+        int _txCount;
+        int _txWritten;
+        int Transact(int id, bool write, int type, int address, int nb, int requestBytes, int responseBytes);
+};
+
+extern ModbusRTUClientClass ModbusRTUClient;
+
+#endif
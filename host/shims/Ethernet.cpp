@@ -0,0 +1,179 @@
+#include "Ethernet.h"
+#include "../sim/SimNetwork.h"
+#include "../sim/SimClock.h"
+
+//a lease takes a discover, offer, request and ack on the segment
+#define HOST_DHCP_MICROS 4000
+//the library's connect timeout when none is set
+#define HOST_DEFAULT_CONNECT_TIMEOUT_MS 1000
+
+EthernetClass Ethernet;
+
+IPAddress::IPAddress()
+{
+    memset(_bytes, 0, sizeof(_bytes));
+}
+
+IPAddress::IPAddress(uint8_t b1, uint8_t b2, uint8_t b3, uint8_t b4)
+{
+    _bytes[0] = b1;
+    _bytes[1] = b2;
+    _bytes[2] = b3;
+    _bytes[3] = b4;
+}
+
+bool IPAddress::fromString(const char* address)
+{
+    uint8_t bytes[4];
+    int index = 0;
+    int value = -1;
+    for (const char* c = address; ; c++)
+    {
+        if (*c >= '0' && *c <= '9'){
+            value = (value < 0 ? 0 : value * 10) + (*c - '0');
+            if (value > 255){
+                return false;
+            }
+        }else if (*c == '.' || *c == '\0'){
+            if (value < 0 || index > 3){
+                return false;
+            }
+            bytes[index++] = static_cast<uint8_t>(value);
+            value = -1;
+            if (*c == '\0'){
+                break;
+            }
+        }else{
+            return false;
+        }
+    }
+    if (index != 4){
+        return false;
+    }
+    memcpy(_bytes, bytes, sizeof(_bytes));
+    return true;
+}
+
+void IPAddress::toString(char* buffer, size_t size) const
+{
+    snprintf(buffer, size, "%u.%u.%u.%u", _bytes[0], _bytes[1], _bytes[2], _bytes[3]);
+}
+
+EthernetClient::EthernetClient()
+{
+    _conn = nullptr;
+    _connectTimeout = HOST_DEFAULT_CONNECT_TIMEOUT_MS;
+}
+
+EthernetClient::~EthernetClient()
+{
+    stop();
+}
+
+int EthernetClient::connect(IPAddress ip, uint16_t port)
+{
+    char host[16];
+    ip.toString(host, sizeof(host));
+    return connect(host, port);
+}
+
+int EthernetClient::connect(const char* host, uint16_t port)
+{
+    stop();
+    _conn = Network.Connect(host, port);
+    if (_conn == nullptr){
+        //nobody answers the SYN, the W5500 retries until the connection timeout
+        Clock.Advance(static_cast<uint64_t>(_connectTimeout) * 1000);
+        return 0;
+    }
+    Clock.Advance(2 * Network.latencyMicros);
+    return 1;
+}
+
+size_t EthernetClient::write(uint8_t c)
+{
+    return write(&c, 1);
+}
+
+size_t EthernetClient::write(const uint8_t* buffer, size_t size)
+{
+    if (_conn == nullptr || !_conn->open){
+        return 0;
+    }
+    _conn->endpoint->Receive(_conn, buffer, size);
+    return size;
+}
+
+int EthernetClient::available()
+{
+    return _conn == nullptr ? 0 : static_cast<int>(_conn->Available());
+}
+
+int EthernetClient::read()
+{
+    uint8_t c;
+    return read(&c, 1) == 1 ? c : -1;
+}
+
+int EthernetClient::read(uint8_t* buffer, size_t size)
+{
+    if (_conn == nullptr){
+        return -1;
+    }
+    size_t n = _conn->Read(buffer, size);
+    return n == 0 ? -1 : static_cast<int>(n);
+}
+
+int EthernetClient::peek()
+{
+    return _conn == nullptr ? -1 : _conn->Peek();
+}
+
+void EthernetClient::stop()
+{
+    if (_conn != nullptr){
+        Network.Close(_conn);
+        _conn = nullptr;
+    }
+}
+
+uint8_t EthernetClient::connected()
+{
+    //like the library, a closed socket counts as connected while it still holds unread bytes
+    return _conn != nullptr && (_conn->open || _conn->Available() > 0);
+}
+
+EthernetClient::operator bool()
+{
+    return _conn != nullptr;
+}
+
+EthernetClass::EthernetClass()
+{
+    dhcpAttempts = 0;
+}
+
+int EthernetClass::begin(uint8_t* mac, unsigned long timeout, unsigned long responseTimeout)
+{
+    (void)mac;
+    (void)responseTimeout;
+    dhcpAttempts++;
+    if (!Network.IsLinkUp() || !Network.IsDhcpAvailable()){
+        Clock.Advance(static_cast<uint64_t>(timeout) * 1000);
+        return 0;
+    }
+    Clock.Advance(HOST_DHCP_MICROS);
+    _ip = IPAddress(192, 168, 1, 50);
+    return 1;
+}
+
+int EthernetClass::maintain()
+{
+    //0 = nothing happened, the lease never expires on the host
+    return 0;
+}
+
+EthernetLinkStatus EthernetClass::linkStatus()
+{
+    return Network.IsLinkUp() ? LinkON : LinkOFF;
+}
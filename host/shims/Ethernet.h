@@ -0,0 +1,88 @@
+#ifndef Ethernet_h
+#define Ethernet_h
+
+//host stand-in for the Ethernet library, connections go to the endpoints listening on sim/SimNetwork.h
+#include "Arduino.h"
+
+class SimConnection;
+
+class IPAddress
+{
+    public:
+        IPAddress();
+        IPAddress(uint8_t b1, uint8_t b2, uint8_t b3, uint8_t b4);
+        bool fromString(const char* address);
+        uint8_t operator[](int index) const { return _bytes[index]; }
+        uint8_t& operator[](int index) { return _bytes[index]; }
+        bool operator==(const IPAddress& other) const { return memcmp(_bytes, other._bytes, 4) == 0; }
+        bool operator!=(const IPAddress& other) const { return !(*this == other); }
+        //dotted form, ex: 192.168.1.18
+        void toString(char* buffer, size_t size) const;
+    private:
+        uint8_t _bytes[4];
+};
+
+class Client : public Stream
+{
+    public:
+        virtual int connect(IPAddress ip, uint16_t port) = 0;
+        virtual int connect(const char* host, uint16_t port) = 0;
+        using Print::write;
+        virtual int read(uint8_t* buffer, size_t size) = 0;
+        using Stream::read;
+        virtual void stop() = 0;
+        virtual uint8_t connected() = 0;
+        virtual operator bool() = 0;
+};
+
+class EthernetClient : public Client
+{
+    public:
+        EthernetClient();
+        ~EthernetClient();
+        int connect(IPAddress ip, uint16_t port) override;
+        int connect(const char* host, uint16_t port) override;
+        size_t write(uint8_t c) override;
+        size_t write(const uint8_t* buffer, size_t size) override;
+        using Print::write;
+        int available() override;
+        int read() override;
+        int read(uint8_t* buffer, size_t size) override;
+        int peek() override;
+        void flush() override {}
+        void stop() override;
+        uint8_t connected() override;
+        operator bool() override;
+        void setConnectionTimeout(uint16_t timeout) { _connectTimeout = timeout; }
+    private:
+        //copies would share the socket, the library's copies share the W5500 socket number the same way
+        SimConnection* _conn;
+        uint16_t _connectTimeout;
+};
+
+enum EthernetLinkStatus
+{
+    Unknown,
+    LinkON,
+    LinkOFF
+};
+
+class EthernetClass
+{
+    public:
+        EthernetClass();
+        void init(uint8_t sspin = 10) { (void)sspin; }
+        //1 = lease obtained, 0 = no DHCP answer within timeout
+        int begin(uint8_t* mac, unsigned long timeout = 60000, unsigned long responseTimeout = 4000);
+        int maintain();
+        EthernetLinkStatus linkStatus();
+        IPAddress localIP() { return _ip; }
+        //DHCP exchanges attempted since boot
+        unsigned long dhcpAttempts;
+    private:
+        IPAddress _ip;
+};
+
+extern EthernetClass Ethernet;
+
+#endif
@@ -0,0 +1,163 @@
+#include "MQTT.h"
+#include "../sim/FakeBroker.h"
+#include "../sim/SimClock.h"
+
+MQTTClient::MQTTClient(int bufSize)
+{
+    _bufSize = bufSize;
+    _readBuf = static_cast<char*>(malloc(bufSize + 1));
+    _writeBuf = static_cast<char*>(malloc(bufSize + 1));
+    _topicBuf = static_cast<char*>(malloc(bufSize + 1));
+    _host = nullptr;
+    _port = 1883;
+    _client = nullptr;
+    _callback = nullptr;
+    _timeout = 1000;
+    _connected = false;
+    _lastError = LWMQTT_SUCCESS;
+    _returnCode = LWMQTT_CONNECTION_ACCEPTED;
+}
+
+MQTTClient::~MQTTClient()
+{
+    free(_readBuf);
+    free(_writeBuf);
+    free(_topicBuf);
+}
+
+void MQTTClient::begin(const char hostname[], int port, Client& client)
+{
+    _host = hostname;
+    _port = port;
+    _client = &client;
+}
+
+size_t MQTTClient::PacketSize(size_t topicLen, size_t payloadLen)
+{
+    size_t remaining = 2 + topicLen + payloadLen;
+    return 1 + (remaining < 128 ? 1 : remaining < 16384 ? 2 : 3) + remaining;
+}
+
+bool MQTTClient::connect(const char clientId[], const char username[], const char password[], bool skip)
+{
+    if (_client == nullptr){
+        return false;
+    }
+    if (connected()){
+        Close();
+    }
+    if (!skip && !_client->connect(_host, static_cast<uint16_t>(_port))){
+        _lastError = LWMQTT_NETWORK_FAILED_CONNECT;
+        return false;
+    }
+    int code = 0;
+    if (!Broker.Connect(this, clientId, username, password, &code)){
+        _returnCode = static_cast<lwmqtt_return_code_t>(code);
+        _lastError = LWMQTT_CONNECTION_DENIED;
+        _client->stop();
+        return false;
+    }
+    //CONNECT and CONNACK
+    Clock.Advance(2 * Network.latencyMicros);
+    _returnCode = LWMQTT_CONNECTION_ACCEPTED;
+    _lastError = LWMQTT_SUCCESS;
+    _connected = true;
+    return true;
+}
+
+bool MQTTClient::publish(const char topic[], const char payload[], int length, bool retained, int qos)
+{
+    (void)qos;
+    if (!connected()){
+        return false;
+    }
+    size_t topicLen = strlen(topic);
+    if (PacketSize(topicLen, length) > static_cast<size_t>(_bufSize)){
+        _lastError = LWMQTT_BUFFER_TOO_SHORT;
+        return false;
+    }
+    //the packet is encoded into the write buffer before it is sent
+    memcpy(_writeBuf, payload, length);
+    Broker.Receive(this, topic, reinterpret_cast<const uint8_t*>(_writeBuf), length, retained);
+    _lastError = LWMQTT_SUCCESS;
+    return true;
+}
+
+bool MQTTClient::subscribe(const char topic[], int qos)
+{
+    (void)qos;
+    if (!connected()){
+        return false;
+    }
+    Broker.Subscribe(this, topic);
+    //SUBSCRIBE and SUBACK
+    Clock.Advance(2 * Network.latencyMicros);
+    return true;
+}
+
+bool MQTTClient::unsubscribe(const char topic[])
+{
+    (void)topic;
+    return connected();
+}
+
+bool MQTTClient::loop()
+{
+    if (!connected()){
+        return false;
+    }
+    BrokerMessage message;
+    while (Broker.Next(this, &message))
+    {
+        size_t topicLen = message.topic.size();
+        size_t payloadLen = message.payload.size();
+        if (PacketSize(topicLen, payloadLen) > static_cast<size_t>(_bufSize)){
+            //lwmqtt_yield fails on a packet larger than the read buffer and the client closes the connection
+            _lastError = LWMQTT_BUFFER_TOO_SHORT;
+            Close();
+            return false;
+        }
+        memcpy(_topicBuf, message.topic.c_str(), topicLen + 1);
+        memcpy(_readBuf, message.payload.data(), payloadLen);
+        _readBuf[payloadLen] = '\0';
+        if (_callback != nullptr){
+            _callback(this, _topicBuf, _readBuf, static_cast<int>(payloadLen));
+        }
+        if (!_connected){
+            return false;
+        }
+    }
+    return true;
+}
+
+bool MQTTClient::connected()
+{
+    if (!_connected){
+        return false;
+    }
+    //the broker went away, the library only notices when the socket reports it
+    if (!_client->connected() || !Broker.IsConnected(this)){
+        _lastError = LWMQTT_NETWORK_FAILED_READ;
+        Close();
+        return false;
+    }
+    return true;
+}
+
+bool MQTTClient::disconnect()
+{
+    if (!_connected){
+        return false;
+    }
+    Close();
+    return true;
+}
+
+void MQTTClient::Close()
+{
+    _connected = false;
+    Broker.Disconnect(this);
+    if (_client != nullptr){
+        _client->stop();
+    }
+}
@@ -0,0 +1,82 @@
+#ifndef MQTT_h
+#define MQTT_h
+
+//host stand-in for arduino-mqtt (256dpi), messages go to the in-process broker of sim/FakeBroker.h
+#include "Arduino.h"
+#include "Ethernet.h"
+
+typedef enum {
+    LWMQTT_SUCCESS = 0,
+    LWMQTT_BUFFER_TOO_SHORT = -1,
+    LWMQTT_VARNUM_OVERFLOW = -2,
+    LWMQTT_NETWORK_FAILED_CONNECT = -3,
+    LWMQTT_NETWORK_TIMEOUT = -4,
+    LWMQTT_NETWORK_FAILED_READ = -5,
+    LWMQTT_NETWORK_FAILED_WRITE = -6,
+    LWMQTT_REMAINING_LENGTH_OVERFLOW = -7,
+    LWMQTT_REMAINING_LENGTH_MISMATCH = -8,
+    LWMQTT_MISSING_OR_WRONG_PACKET = -9,
+    LWMQTT_CONNECTION_DENIED = -10,
+    LWMQTT_FAILED_SUBSCRIPTION = -11,
+    LWMQTT_SUBACK_ARRAY_OVERFLOW = -12,
+    LWMQTT_PONG_TIMEOUT = -13,
+} lwmqtt_err_t;
+
+typedef enum {
+    LWMQTT_CONNECTION_ACCEPTED = 0,
+    LWMQTT_UNACCEPTABLE_PROTOCOL = 1,
+    LWMQTT_IDENTIFIER_REJECTED = 2,
+    LWMQTT_SERVER_UNAVAILABLE = 3,
+    LWMQTT_BAD_USERNAME_OR_PASSWORD = 4,
+    LWMQTT_NOT_AUTHORIZED = 5,
+    LWMQTT_UNKNOWN_RETURN_CODE = 6
+} lwmqtt_return_code_t;
+
+class MQTTClient;
+typedef void (*MQTTClientCallbackAdvanced)(MQTTClient* client, char topic[], char bytes[], int length);
+
+class MQTTClient
+{
+    public:
+        //read and write buffers are allocated here like the library, a packet must fit in bufSize
+        explicit MQTTClient(int bufSize = 128);
+        ~MQTTClient();
+        void begin(const char hostname[], int port, Client& client);
+        void begin(const char hostname[], Client& client) { begin(hostname, 1883, client); }
+        void onMessageAdvanced(MQTTClientCallbackAdvanced cb) { _callback = cb; }
+        void setTimeout(int timeout) { _timeout = timeout; }
+        void setKeepAlive(int keepAlive) { (void)keepAlive; }
+        bool connect(const char clientId[], bool skip = false) { return connect(clientId, nullptr, nullptr, skip); }
+        bool connect(const char clientId[], const char username[], bool skip = false) { return connect(clientId, username, nullptr, skip); }
+        bool connect(const char clientId[], const char username[], const char password[], bool skip = false);
+        bool publish(const char topic[]) { return publish(topic, "", 0, false, 0); }
+        bool publish(const char topic[], const char payload[]) { return publish(topic, payload, static_cast<int>(strlen(payload)), false, 0); }
+        bool publish(const char topic[], const String& payload) { return publish(topic, payload.c_str(), static_cast<int>(payload.length()), false, 0); }
+        bool publish(const char topic[], const char payload[], int length) { return publish(topic, payload, length, false, 0); }
+        bool publish(const char topic[], const char payload[], int length, bool retained, int qos);
+        bool subscribe(const char topic[], int qos = 0);
+        bool unsubscribe(const char topic[]);
+        bool loop();
+        bool connected();
+        bool disconnect();
+        lwmqtt_err_t lastError() { return _lastError; }
+        lwmqtt_return_code_t returnCode() { return _returnCode; }
+    private:
+        int _bufSize;
+        char* _readBuf;
+        char* _writeBuf;
+        char* _topicBuf;
+        const char* _host;
+        int _port;
+        Client* _client;
+        MQTTClientCallbackAdvanced _callback;
+        int _timeout;
+        bool _connected;
+        lwmqtt_err_t _lastError;
+        lwmqtt_return_code_t _returnCode;
+        //bytes a packet takes in the buffer: fixed header, remaining length, topic and payload
+        static size_t PacketSize(size_t topicLen, size_t payloadLen);
+        void Close();
+};
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef P1AM_h
+#define P1AM_h
+
+//host stand-in for the P1AM library, the firmware doesn't use the base controller's IO modules
+#include "Arduino.h"
+
+class P1AM
+{
+    public:
+        //true once the base controller has signed on
+        bool init() { return true; }
+};
+
+#endif
@@ -0,0 +1,306 @@
+#include "SD.h"
+#include "../sim/AllocCounter.h"
+#include <sys/stat.h>
+#include <errno.h>
+
+SdCard SD;
+
+/// @brief Host file shared by every copy of a File
+struct HostFileHandle
+{
+    FILE* fp;
+    int refs;
+    bool append;
+    char name[64];
+};
+
+File::File()
+{
+    _handle = nullptr;
+}
+
+File::File(const File& other)
+{
+    _handle = nullptr;
+    Attach(other._handle);
+}
+
+File& File::operator=(const File& other)
+{
+    if (this != &other){
+        HostFileHandle* handle = other._handle;
+        if (handle != nullptr){
+            handle->refs++;
+        }
+        Detach();
+        _handle = handle;
+    }
+    return *this;
+}
+
+File::~File()
+{
+    Detach();
+}
+
+void File::Attach(HostFileHandle* handle)
+{
+    Detach();
+    _handle = handle;
+    if (_handle != nullptr){
+        _handle->refs++;
+    }
+}
+
+void File::Detach()
+{
+    if (_handle == nullptr){
+        return;
+    }
+    //the library leaves the file open when a File goes out of scope, only close() releases it
+    if (--_handle->refs == 0 && _handle->fp == nullptr){
+        AllocCounter::Pause pause;
+        delete _handle;
+    }
+    _handle = nullptr;
+}
+
+size_t File::write(uint8_t c)
+{
+    return write(&c, 1);
+}
+
+size_t File::write(const uint8_t* buffer, size_t size)
+{
+    //a pulled card fails every transfer, the handle stays open until close()
+    if (!*this || !SD.IsMounted()){
+        return 0;
+    }
+    AllocCounter::Pause pause;
+    if (_handle->append){
+        fseek(_handle->fp, 0, SEEK_END);
+    }
+    size_t n = fwrite(buffer, 1, size, _handle->fp);
+    SD.bytesWritten += n;
+    return n;
+}
+
+int File::read()
+{
+    uint8_t c;
+    return read(&c, 1) == 1 ? c : -1;
+}
+
+int File::read(void* buffer, uint16_t size)
+{
+    if (!*this || !SD.IsMounted()){
+        return -1;
+    }
+    AllocCounter::Pause pause;
+    size_t n = fread(buffer, 1, size, _handle->fp);
+    SD.bytesRead += n;
+    return static_cast<int>(n);
+}
+
+int File::peek()
+{
+    if (!*this){
+        return -1;
+    }
+    AllocCounter::Pause pause;
+    int c = fgetc(_handle->fp);
+    if (c != EOF){
+        ungetc(c, _handle->fp);
+    }
+    return c == EOF ? -1 : c;
+}
+
+int File::available()
+{
+    if (!*this){
+        return 0;
+    }
+    uint32_t end = size();
+    uint32_t pos = position();
+    return end > pos ? static_cast<int>(min(end - pos, static_cast<uint32_t>(INT32_MAX))) : 0;
+}
+
+void File::flush()
+{
+    if (*this){
+        AllocCounter::Pause pause;
+        fflush(_handle->fp);
+    }
+}
+
+bool File::seek(uint32_t position)
+{
+    if (!*this || !SD.IsMounted()){
+        return false;
+    }
+    AllocCounter::Pause pause;
+    //seeking past the end fails on the card
+    if (position > size()){
+        return false;
+    }
+    return fseek(_handle->fp, position, SEEK_SET) == 0;
+}
+
+uint32_t File::position()
+{
+    if (!*this){
+        return 0;
+    }
+    long pos = ftell(_handle->fp);
+    return pos < 0 ? 0 : static_cast<uint32_t>(pos);
+}
+
+uint32_t File::size()
+{
+    if (!*this){
+        return 0;
+    }
+    AllocCounter::Pause pause;
+    long pos = ftell(_handle->fp);
+    fseek(_handle->fp, 0, SEEK_END);
+    long end = ftell(_handle->fp);
+    fseek(_handle->fp, pos, SEEK_SET);
+    return end < 0 ? 0 : static_cast<uint32_t>(end);
+}
+
+void File::close()
+{
+    if (_handle == nullptr){
+        return;
+    }
+    if (_handle->fp != nullptr){
+        AllocCounter::Pause pause;
+        fclose(_handle->fp);
+        _handle->fp = nullptr;
+    }
+    Detach();
+}
+
+File::operator bool()
+{
+    return _handle != nullptr && _handle->fp != nullptr;
+}
+
+const char* File::name()
+{
+    return _handle != nullptr ? _handle->name : "";
+}
+
+SdCard::SdCard(){
+    strlcpy(_root, ".", sizeof(_root));
+    _inserted = true;
+    _mounted = false;
+    bytesRead = 0;
+    bytesWritten = 0;
+    opens = 0;
+}
+
+bool SdCard::begin(uint8_t csPin)
+{
+    (void)csPin;
+    struct stat info;
+    _mounted = _inserted && stat(_root, &info) == 0 && S_ISDIR(info.st_mode);
+    return _mounted;
+}
+
+void SdCard::SetRoot(const char* path)
+{
+    strlcpy(_root, path, sizeof(_root));
+}
+
+const char* SdCard::GetRoot()
+{
+    return _root;
+}
+
+bool SdCard::IsMounted()
+{
+    return _mounted;
+}
+
+void SdCard::SetInserted(bool inserted)
+{
+    _inserted = inserted;
+    if (!inserted){
+        _mounted = false;
+    }
+}
+
+void SdCard::Path(const char* fileName, char* buffer, size_t size)
+{
+    while (*fileName == '/')
+    {
+        fileName++;
+    }
+    snprintf(buffer, size, "%s/%s", _root, fileName);
+}
+
+bool SdCard::exists(const char* fileName)
+{
+    if (!_mounted){
+        return false;
+    }
+    char path[320];
+    Path(fileName, path, sizeof(path));
+    struct stat info;
+    return stat(path, &info) == 0;
+}
+
+File SdCard::open(const char* fileName, uint8_t mode)
+{
+    File file;
+    if (!_mounted){
+        return file;
+    }
+    AllocCounter::Pause pause;
+    char path[320];
+    Path(fileName, path, sizeof(path));
+
+    FILE* fp;
+    if (!(mode & O_WRITE)){
+        fp = fopen(path, "rb");
+    }else{
+        //r+ keeps the contents, a missing file is created first when O_CREAT allows it
+        fp = fopen(path, (mode & O_TRUNC) ? "w+b" : "r+b");
+        if (fp == nullptr && errno == ENOENT && (mode & O_CREAT)){
+            fp = fopen(path, "w+b");
+        }
+    }
+    if (fp == nullptr){
+        return file;
+    }
+    if (mode & O_APPEND){
+        fseek(fp, 0, SEEK_END);
+    }
+
+    HostFileHandle* handle = new HostFileHandle;
+    handle->fp = fp;
+    handle->refs = 0;
+    handle->append = (mode & O_APPEND) != 0;
+    strlcpy(handle->name, fileName, sizeof(handle->name));
+    file.Attach(handle);
+    opens++;
+    return file;
+}
+
+bool SdCard::remove(const char* fileName)
+{
+    if (!_mounted){
+        return false;
+    }
+    char path[320];
+    Path(fileName, path, sizeof(path));
+    return ::remove(path) == 0;
+}
+
+bool SdCard::mkdir(const char* path)
+{
+    char full[320];
+    Path(path, full, sizeof(full));
+    return ::mkdir(full, 0755) == 0 || errno == EEXIST;
+}
@@ -0,0 +1,83 @@
+#ifndef SD_h
+#define SD_h
+
+//host stand-in for the SD library, the card is a directory on the host, see SdCard::SetRoot()
+#include "Arduino.h"
+
+//open flags, same values as the library's SdFat layer
+#define O_READ 0x01
+#define O_RDONLY O_READ
+#define O_WRITE 0x02
+#define O_WRONLY O_WRITE
+#define O_RDWR (O_READ | O_WRITE)
+#define O_APPEND 0x04
+#define O_SYNC 0x08
+#define O_CREAT 0x10
+#define O_EXCL 0x20
+#define O_TRUNC 0x40
+
+#define FILE_READ O_READ
+#define FILE_WRITE (O_READ | O_WRITE | O_CREAT | O_APPEND)
+
+struct HostFileHandle;
+
+/// @brief Open file on the card, copies share the same handle like the library's File
+class File : public Stream
+{
+    public:
+        File();
+        File(const File& other);
+        File& operator=(const File& other);
+        ~File();
+        size_t write(uint8_t c) override;
+        size_t write(const uint8_t* buffer, size_t size) override;
+        using Print::write;
+        int read() override;
+        int read(void* buffer, uint16_t size);
+        int peek() override;
+        int available() override;
+        void flush() override;
+        bool seek(uint32_t position);
+        uint32_t position();
+        uint32_t size();
+        void close();
+        operator bool();
+        const char* name();
+    private:
+        friend class SdCard;
+        HostFileHandle* _handle;
+        void Attach(HostFileHandle* handle);
+        void Detach();
+};
+
+/// @brief SD card backed by a host directory
+class SdCard
+{
+    public:
+        SdCard();
+        bool begin(uint8_t csPin = SDCARD_SS_PIN);
+        bool exists(const char* fileName);
+        File open(const char* fileName, uint8_t mode = FILE_READ);
+        bool remove(const char* fileName);
+        bool mkdir(const char* path);
+        //directory holding the card's files
+        void SetRoot(const char* path);
+        const char* GetRoot();
+        //begin() fails and every open fails while the card is pulled, so does I/O on files already open
+        void SetInserted(bool inserted);
+        //begin() succeeded and the card hasn't been pulled since
+        bool IsMounted();
+        //bytes read and written through every file since the counters were cleared
+        unsigned long bytesRead;
+        unsigned long bytesWritten;
+        unsigned long opens;
+    private:
+        char _root[256];
+        bool _inserted;
+        bool _mounted;
+        void Path(const char* fileName, char* buffer, size_t size);
+};
+
+extern SdCard SD;	//Default class instance
+
+#endif
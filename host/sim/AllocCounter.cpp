@@ -0,0 +1,141 @@
+#include "AllocCounter.h"
+#include <atomic>
+#include <new>
+#include <stdlib.h>
+
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* ptr, size_t size);
+extern "C" void __libc_free(void* ptr);
+
+std::atomic<uint64_t> allocations(0);
+std::atomic<uint64_t> frees(0);
+std::atomic<uint64_t> allocatedBytes(0);
+void (*allocHook)(size_t size) = nullptr;
+thread_local int pauseDepth = 0;
+
+void countAllocation(size_t size)
+{
+    if (pauseDepth > 0){
+        return;
+    }
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    if (allocHook != nullptr){
+        pauseDepth++;
+        allocHook(size);
+        pauseDepth--;
+    }
+}
+
+void countFree(void* ptr)
+{
+    if (ptr != nullptr && pauseDepth == 0){
+        frees.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+AllocCounter::Pause::Pause()
+{
+    pauseDepth++;
+}
+
+AllocCounter::Pause::~Pause()
+{
+    pauseDepth--;
+}
+
+void AllocCounter::Reset()
+{
+    allocations = 0;
+    frees = 0;
+    allocatedBytes = 0;
+}
+
+uint64_t AllocCounter::GetAllocations()
+{
+    return allocations.load(std::memory_order_relaxed);
+}
+
+uint64_t AllocCounter::GetFrees()
+{
+    return frees.load(std::memory_order_relaxed);
+}
+
+uint64_t AllocCounter::GetBytes()
+{
+    return allocatedBytes.load(std::memory_order_relaxed);
+}
+
+void AllocCounter::SetHook(void (*hook)(size_t size))
+{
+    allocHook = hook;
+}
+
+extern "C" void* malloc(size_t size)
+{
+    countAllocation(size);
+    return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size)
+{
+    countAllocation(count * size);
+    return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* ptr, size_t size)
+{
+    countAllocation(size);
+    return __libc_realloc(ptr, size);
+}
+
+extern "C" void free(void* ptr)
+{
+    countFree(ptr);
+    __libc_free(ptr);
+}
+
+void* operator new(size_t size)
+{
+    void* ptr = malloc(size);
+    if (ptr == nullptr){
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    return malloc(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    return malloc(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+    free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept
+{
+    free(ptr);
+}
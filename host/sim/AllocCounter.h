@@ -0,0 +1,28 @@
+#ifndef AllocCounter_h
+#define AllocCounter_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// @brief Counts every heap allocation made by the process, malloc/free and new/delete are replaced
+/// The sims and shims pause counting around their own bookkeeping, so the counters only see the
+/// firmware and the libraries it would also link on the device.
+class AllocCounter
+{
+    public:
+        /// @brief Allocations made while an instance is alive on this thread are not counted
+        struct Pause
+        {
+            Pause();
+            ~Pause();
+        };
+        static void Reset();
+        static uint64_t GetAllocations();
+        static uint64_t GetFrees();
+        //bytes requested by the counted allocations
+        static uint64_t GetBytes();
+        //called for every counted allocation, a test may break or log in it
+        static void SetHook(void (*hook)(size_t size));
+};
+
+#endif
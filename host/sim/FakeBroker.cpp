@@ -0,0 +1,259 @@
+#include "FakeBroker.h"
+#include "SimClock.h"
+#include "AllocCounter.h"
+#include <string.h>
+
+FakeBroker::FakeBroker(){
+    onPublish = nullptr;
+    publishes = 0;
+    publishedBytes = 0;
+    connects = 0;
+    refusedConnects = 0;
+    publishMicros = 150;
+    publishByteMicros = 1;
+    _port = 0;
+    _online = true;
+    _started = false;
+    _logging = true;
+}
+
+FakeBroker Broker;
+
+void FakeBroker::Start(const char* host, uint16_t port)
+{
+    AllocCounter::Pause pause;
+    _host = host;
+    _port = port;
+    _started = true;
+    if (_online){
+        Network.Listen(host, port, this);
+    }
+}
+
+void FakeBroker::SetOnline(bool online)
+{
+    AllocCounter::Pause pause;
+    if (online == _online){
+        return;
+    }
+    _online = online;
+    if (!online){
+        Network.Unlisten(this);
+        Network.DropConnections(this);
+        _sessions.clear();
+    }else if (_started){
+        Network.Listen(_host.c_str(), _port, this);
+    }
+}
+
+bool FakeBroker::IsOnline()
+{
+    return _online;
+}
+
+void FakeBroker::SetCredentials(const char* user, const char* pass)
+{
+    AllocCounter::Pause pause;
+    _user = user;
+    _pass = pass;
+}
+
+void FakeBroker::SetLogging(bool enabled)
+{
+    _logging = enabled;
+}
+
+void FakeBroker::Publish(const char* topic, const char* payload, bool retained)
+{
+    Publish(topic, reinterpret_cast<const uint8_t*>(payload), strlen(payload), retained);
+}
+
+void FakeBroker::Publish(const char* topic, const uint8_t* payload, size_t len, bool retained)
+{
+    AllocCounter::Pause pause;
+    BrokerMessage message{topic, std::string(reinterpret_cast<const char*>(payload), len), retained, Clock.Micros()};
+    if (retained){
+        _retained[message.topic] = message;
+    }
+    Route(message, nullptr);
+}
+
+std::vector<const BrokerMessage*> FakeBroker::Find(const char* filter)
+{
+    AllocCounter::Pause pause;
+    std::vector<const BrokerMessage*> found;
+    for (const BrokerMessage& message : published)
+    {
+        if (Matches(filter, message.topic.c_str())){
+            found.push_back(&message);
+        }
+    }
+    return found;
+}
+
+const BrokerMessage* FakeBroker::Last(const char* filter)
+{
+    for (size_t i = published.size(); i > 0; i--)
+    {
+        if (Matches(filter, published[i - 1].topic.c_str())){
+            return &published[i - 1];
+        }
+    }
+    return nullptr;
+}
+
+const BrokerMessage* FakeBroker::Retained(const char* topic)
+{
+    auto it = _retained.find(topic);
+    return it == _retained.end() ? nullptr : &it->second;
+}
+
+bool FakeBroker::Connect(MQTTClient* client, const char* clientId, const char* user, const char* pass, int* returnCode)
+{
+    AllocCounter::Pause pause;
+    if (!_online){
+        *returnCode = 3;
+        refusedConnects++;
+        return false;
+    }
+    if (!_user.empty() && (_user != (user != nullptr ? user : "") || _pass != (pass != nullptr ? pass : ""))){
+        //bad user name or password
+        *returnCode = 4;
+        refusedConnects++;
+        return false;
+    }
+    Disconnect(client);
+    //a clean session, no subscriptions survive a reconnect
+    _sessions.push_back(Session{client, clientId != nullptr ? clientId : "", {}, {}});
+    *returnCode = 0;
+    connects++;
+    return true;
+}
+
+void FakeBroker::Disconnect(MQTTClient* client)
+{
+    AllocCounter::Pause pause;
+    for (size_t i = 0; i < _sessions.size(); i++)
+    {
+        if (_sessions[i].client == client){
+            _sessions.erase(_sessions.begin() + i);
+            return;
+        }
+    }
+}
+
+bool FakeBroker::IsConnected(MQTTClient* client)
+{
+    return Find(client) != nullptr;
+}
+
+FakeBroker::Session* FakeBroker::Find(MQTTClient* client)
+{
+    for (Session& session : _sessions)
+    {
+        if (session.client == client){
+            return &session;
+        }
+    }
+    return nullptr;
+}
+
+void FakeBroker::Subscribe(MQTTClient* client, const char* filter)
+{
+    AllocCounter::Pause pause;
+    Session* session = Find(client);
+    if (session == nullptr){
+        return;
+    }
+    session->filters.push_back(filter);
+    //retained messages go to a new subscriber straight away
+    for (const auto& entry : _retained)
+    {
+        if (Matches(filter, entry.first.c_str())){
+            BrokerMessage message = entry.second;
+            message.at = Clock.Micros() + Network.latencyMicros;
+            session->inbox.push_back(message);
+        }
+    }
+}
+
+void FakeBroker::Receive(MQTTClient* client, const char* topic, const uint8_t* payload, size_t len, bool retained)
+{
+    AllocCounter::Pause pause;
+    Clock.Advance(publishMicros + publishByteMicros * len);
+    BrokerMessage message{topic, std::string(reinterpret_cast<const char*>(payload), len), retained, Clock.Micros()};
+    publishes++;
+    publishedBytes += len;
+    if (retained){
+        //an empty retained message clears the topic
+        if (len == 0){
+            _retained.erase(message.topic);
+        }else{
+            _retained[message.topic] = message;
+        }
+    }
+    if (_logging){
+        published.push_back(message);
+    }
+    if (onPublish != nullptr){
+        onPublish(message);
+    }
+    Route(message, client);
+}
+
+void FakeBroker::Route(const BrokerMessage& message, MQTTClient* sender)
+{
+    (void)sender;
+    for (Session& session : _sessions)
+    {
+        for (const std::string& filter : session.filters)
+        {
+            if (Matches(filter.c_str(), message.topic.c_str())){
+                BrokerMessage delivery = message;
+                //retain flag is only kept for messages sent on subscribe
+                delivery.retained = false;
+                delivery.at = Clock.Micros() + Network.latencyMicros;
+                session.inbox.push_back(delivery);
+                break;
+            }
+        }
+    }
+}
+
+bool FakeBroker::Next(MQTTClient* client, BrokerMessage* message)
+{
+    AllocCounter::Pause pause;
+    Session* session = Find(client);
+    if (session == nullptr || session->inbox.empty() || session->inbox.front().at > Clock.Micros()){
+        return false;
+    }
+    *message = session->inbox.front();
+    session->inbox.pop_front();
+    return true;
+}
+
+bool FakeBroker::Matches(const char* filter, const char* topic)
+{
+    while (*filter != '\0')
+    {
+        if (*filter == '#'){
+            return true;
+        }
+        if (*filter == '+'){
+            //one whole level
+            while (*topic != '\0' && *topic != '/')
+            {
+                topic++;
+            }
+            filter++;
+            continue;
+        }
+        if (*filter != *topic){
+            //a/# also matches a
+            return *topic == '\0' && filter[0] == '/' && filter[1] == '#' && filter[2] == '\0';
+        }
+        filter++;
+        topic++;
+    }
+    return *topic == '\0';
+}
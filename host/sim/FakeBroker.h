@@ -0,0 +1,91 @@
+#ifndef FakeBroker_h
+#define FakeBroker_h
+
+#include "SimNetwork.h"
+#include <stdint.h>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+class MQTTClient;
+
+/// @brief Message seen by the broker
+struct BrokerMessage
+{
+    std::string topic;
+    std::string payload;
+    bool retained;
+    //Clock time the broker received it
+    uint64_t at;
+};
+
+/// @brief In-process MQTT broker the MQTTClient shim talks to
+/// The MQTT packets themselves are not encoded, clients hand whole messages over. The broker listens
+/// on the simulated network so connects still see link, address and outage failures.
+class FakeBroker : public SimEndpoint
+{
+    public:
+        FakeBroker();
+        //accept connections on host:port, ex: the broker_url and broker_port of the configuration
+        void Start(const char* host, uint16_t port);
+        //an offline broker refuses connections and drops every client, retained messages are kept
+        void SetOnline(bool online);
+        bool IsOnline();
+        //empty user accepts any credentials
+        void SetCredentials(const char* user, const char* pass);
+        //publish to the subscribed clients as if another client had sent it
+        void Publish(const char* topic, const char* payload, bool retained = false);
+        void Publish(const char* topic, const uint8_t* payload, size_t len, bool retained = false);
+        //messages published by clients, only recorded while logging is on
+        std::vector<BrokerMessage> published;
+        void SetLogging(bool enabled);
+        //published messages whose topic matches the filter, wildcards included
+        std::vector<const BrokerMessage*> Find(const char* filter);
+        const BrokerMessage* Last(const char* filter);
+        //retained message of a topic, nullptr if none
+        const BrokerMessage* Retained(const char* topic);
+        //called for every message published by a client, even with logging off
+        void (*onPublish)(const BrokerMessage& message);
+        unsigned long publishes;
+        unsigned long publishedBytes;
+        unsigned long connects;
+        unsigned long refusedConnects;
+        //time a client spends handing a publish to the W5500, per message and per byte of payload
+        uint32_t publishMicros;
+        uint32_t publishByteMicros;
+
+        //used by the MQTTClient shim
+        bool Connect(MQTTClient* client, const char* clientId, const char* user, const char* pass, int* returnCode);
+        void Disconnect(MQTTClient* client);
+        bool IsConnected(MQTTClient* client);
+        void Subscribe(MQTTClient* client, const char* filter);
+        void Receive(MQTTClient* client, const char* topic, const uint8_t* payload, size_t len, bool retained);
+        //next message due for the client by now, false when none
+        bool Next(MQTTClient* client, BrokerMessage* message);
+
+        static bool Matches(const char* filter, const char* topic);
+    private:
+        struct Session
+        {
+            MQTTClient* client;
+            std::string id;
+            std::vector<std::string> filters;
+            std::deque<BrokerMessage> inbox;
+        };
+        std::vector<Session> _sessions;
+        std::map<std::string, BrokerMessage> _retained;
+        std::string _user;
+        std::string _pass;
+        std::string _host;
+        uint16_t _port;
+        bool _online;
+        bool _started;
+        bool _logging;
+        Session* Find(MQTTClient* client);
+        void Route(const BrokerMessage& message, MQTTClient* sender);
+};
+
+extern FakeBroker Broker;	//Default class instance
+
+#endif
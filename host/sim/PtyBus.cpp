@@ -0,0 +1,276 @@
+#include "PtyBus.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+//longest request a master sends, write multiple registers with 123 values
+#define PTY_MAX_FRAME 256
+
+PtyBus::PtyBus(){
+    _master = -1;
+    _path[0] = '\0';
+    _charMicros = 0;
+    _running = false;
+    requests = 0;
+    crcErrors = 0;
+}
+
+PtyBus::~PtyBus()
+{
+    Stop();
+    if (_master >= 0){
+        close(_master);
+    }
+}
+
+/// @brief crc16 of a frame, computed here rather than taken from the gateway it checks
+uint16_t ptyCrc(const uint8_t* data, size_t length)
+{
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < length; i++)
+    {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+        }
+    }
+    return crc;
+}
+
+void ptySleep(uint64_t micros)
+{
+    struct timespec ts;
+    ts.tv_sec = micros / 1000000;
+    ts.tv_nsec = (micros % 1000000) * 1000;
+    nanosleep(&ts, nullptr);
+}
+
+bool PtyBus::Open()
+{
+    _master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (_master < 0 || grantpt(_master) != 0 || unlockpt(_master) != 0 || ptsname_r(_master, _path, sizeof(_path)) != 0){
+        return false;
+    }
+    //raw on this end too, the line discipline would otherwise echo and translate bytes
+    struct termios tio;
+    tcgetattr(_master, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(_master, TCSANOW, &tio);
+    fcntl(_master, F_SETFL, fcntl(_master, F_GETFL) | O_NONBLOCK);
+    return true;
+}
+
+const char* PtyBus::GetPath()
+{
+    return _path;
+}
+
+void PtyBus::Attach(SimSlave* slave)
+{
+    _slaves[slave->id] = slave;
+}
+
+void PtyBus::SetCharMicros(unsigned long micros)
+{
+    _charMicros = micros;
+}
+
+void PtyBus::Start()
+{
+    if (_running.exchange(true)){
+        return;
+    }
+    _thread = std::thread(&PtyBus::Run, this);
+}
+
+void PtyBus::Stop()
+{
+    _running = false;
+    if (_thread.joinable()){
+        _thread.join();
+    }
+}
+
+/// @brief Length of the request starting in frame, 0 while more bytes are needed to tell
+size_t requestLength(const uint8_t* frame, size_t received)
+{
+    if (received < 2){
+        return 0;
+    }
+    switch (frame[1])
+    {
+        case 0x0F:
+        case 0x10:
+            //address, count and byte count precede the values
+            return received < 7 ? 0 : 9 + frame[6];
+        default:
+            return 8;
+    }
+}
+
+void PtyBus::Run()
+{
+    uint8_t request[PTY_MAX_FRAME];
+    uint8_t response[PTY_MAX_FRAME];
+    size_t received = 0;
+    while (_running.load(std::memory_order_relaxed))
+    {
+        struct pollfd pfd = {_master, POLLIN, 0};
+        if (poll(&pfd, 1, 10) <= 0){
+            //a partial request followed by silence is noise, the next byte starts a new frame
+            received = 0;
+            continue;
+        }
+        ssize_t n = read(_master, request + received, sizeof(request) - received);
+        if (n <= 0){
+            //nothing has the other end open yet
+            if (n < 0 && errno == EIO){
+                ptySleep(1000);
+            }
+            continue;
+        }
+        received += n;
+        size_t length = requestLength(request, received);
+        if (length == 0 || received < length){
+            if (length > sizeof(request)){
+                received = 0;
+            }
+            continue;
+        }
+        requests++;
+
+        size_t responseLength;
+        uint64_t latency;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            responseLength = Serve(request, length, response);
+            SimSlave* slave = _slaves.count(request[0]) ? _slaves[request[0]] : nullptr;
+            latency = slave != nullptr ? slave->latencyMicros : 0;
+        }
+        //anything after the request was sent too early, a master waits for the response
+        received = 0;
+        if (responseLength == 0){
+            continue;
+        }
+        ptySleep((length + responseLength) * _charMicros + latency);
+        size_t sent = 0;
+        while (sent < responseLength && _running.load(std::memory_order_relaxed))
+        {
+            n = write(_master, response + sent, responseLength - sent);
+            if (n > 0){
+                sent += n;
+            }else{
+                ptySleep(100);
+            }
+        }
+    }
+}
+
+size_t PtyBus::Serve(const uint8_t* request, size_t length, uint8_t* response)
+{
+    if (ptyCrc(request, length - 2) != (request[length - 2] | (request[length - 1] << 8))){
+        crcErrors++;
+        return 0;
+    }
+    auto it = _slaves.find(request[0]);
+    if (it == _slaves.end()){
+        return 0;
+    }
+    SimSlave* slave = it->second;
+    if (!slave->online){
+        return 0;
+    }
+    if (slave->timeoutsPending > 0){
+        slave->timeoutsPending--;
+        return 0;
+    }
+    slave->transactions++;
+
+    uint8_t function = request[1];
+    uint16_t address = (request[2] << 8) | request[3];
+    uint16_t count = (request[4] << 8) | request[5];
+    uint16_t values[2000];
+    uint8_t exception = 0;
+    size_t responseLength = 0;
+    response[0] = request[0];
+    response[1] = function;
+    switch (function)
+    {
+        case 0x01:
+        case 0x02:
+            exception = slave->Read(function == 0x01 ? SIM_COILS : SIM_DISCRETE_INPUTS, address, count, values);
+            if (exception == 0){
+                response[2] = (count + 7) / 8;
+                memset(&response[3], 0, response[2]);
+                for (int i = 0; i < count; i++)
+                {
+                    response[3 + i / 8] |= (values[i] ? 1 : 0) << (i % 8);
+                }
+                responseLength = 3 + response[2];
+            }
+            break;
+        case 0x03:
+        case 0x04:
+            exception = slave->Read(function == 0x03 ? SIM_HOLDING_REGISTERS : SIM_INPUT_REGISTERS, address, count, values);
+            if (exception == 0){
+                response[2] = count * 2;
+                for (int i = 0; i < count; i++)
+                {
+                    response[3 + i * 2] = values[i] >> 8;
+                    response[4 + i * 2] = values[i] & 0xFF;
+                }
+                responseLength = 3 + response[2];
+            }
+            break;
+        case 0x05:
+        case 0x06:
+            //the value takes the place of the count, a coil is on at 0xFF00
+            values[0] = function == 0x05 ? (count == 0xFF00 ? 1 : 0) : count;
+            exception = slave->Write(function == 0x05 ? SIM_COILS : SIM_HOLDING_REGISTERS, address, 1, values);
+            memcpy(&response[2], &request[2], 4);
+            responseLength = 6;
+            break;
+        case 0x0F:
+            for (int i = 0; i < count && i < 2000; i++)
+            {
+                values[i] = (request[7 + i / 8] >> (i % 8)) & 1;
+            }
+            exception = slave->Write(SIM_COILS, address, count, values);
+            memcpy(&response[2], &request[2], 4);
+            responseLength = 6;
+            break;
+        case 0x10:
+            for (int i = 0; i < count && i < 123; i++)
+            {
+                values[i] = (request[7 + i * 2] << 8) | request[8 + i * 2];
+            }
+            exception = slave->Write(SIM_HOLDING_REGISTERS, address, count, values);
+            memcpy(&response[2], &request[2], 4);
+            responseLength = 6;
+            break;
+        default:
+            exception = SIM_ILLEGAL_FUNCTION;
+            break;
+    }
+    if (exception != 0){
+        response[1] = function | 0x80;
+        response[2] = exception;
+        responseLength = 3;
+    }
+
+    uint16_t crc = ptyCrc(response, responseLength);
+    if (slave->crcErrorsPending > 0){
+        slave->crcErrorsPending--;
+        crc ^= 0xFFFF;
+    }
+    response[responseLength] = crc & 0xFF;
+    response[responseLength + 1] = crc >> 8;
+    return responseLength + 2;
+}
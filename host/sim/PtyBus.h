@@ -0,0 +1,45 @@
+#ifndef PtyBus_h
+#define PtyBus_h
+
+#include "SimSlave.h"
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <thread>
+
+/// @brief RS-485 segment on a pseudo-terminal pair, its slaves answer real RTU frames
+/// The gateway opens GetPath() like any tty, a thread on the other end decodes each request, serves it
+/// from a SimSlave and writes the response. A pty moves bytes instantly, so the thread waits out the
+/// request and response characters at the configured character time plus the slave's latency first.
+class PtyBus
+{
+    public:
+        PtyBus();
+        ~PtyBus();
+        //create the pty pair, false if the system has none left
+        bool Open();
+        //tty the gateway opens, ex: /dev/pts/4
+        const char* GetPath();
+        //the bus doesn't own the slave, attach before Start()
+        void Attach(SimSlave* slave);
+        //wire time of one character, 0 = answer as soon as the request is decoded
+        void SetCharMicros(unsigned long micros);
+        void Start();
+        void Stop();
+        //held while a request is served, lock it to look at a slave while the bus runs
+        std::mutex lock;
+        std::atomic<unsigned long> requests;
+        std::atomic<unsigned long> crcErrors;
+    private:
+        int _master;
+        char _path[64];
+        std::map<int, SimSlave*> _slaves;
+        unsigned long _charMicros;
+        std::thread _thread;
+        std::atomic<bool> _running;
+        void Run();
+        //answer a complete request, returns the response length, 0 = no answer
+        size_t Serve(const uint8_t* request, size_t length, uint8_t* response);
+};
+
+#endif
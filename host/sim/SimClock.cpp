@@ -0,0 +1,56 @@
+#include "SimClock.h"
+#include <time.h>
+
+uint64_t monotonicMicros()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+SimClock::SimClock(){
+    _realTime = false;
+    _simulated = 0;
+    _realStart = monotonicMicros();
+}
+
+SimClock Clock;
+
+void SimClock::Reset()
+{
+    _simulated = 0;
+    _realStart = monotonicMicros();
+}
+
+void SimClock::SetRealTime(bool enabled)
+{
+    //the clock never runs backwards, real time already counted is kept as simulated time
+    if (_realTime && !enabled){
+        _simulated += monotonicMicros() - _realStart;
+    }
+    _realStart = monotonicMicros();
+    _realTime = enabled;
+}
+
+bool SimClock::IsRealTime()
+{
+    return _realTime;
+}
+
+void SimClock::Advance(uint64_t micros)
+{
+    _simulated += micros;
+}
+
+uint64_t SimClock::Micros()
+{
+    if (!_realTime){
+        return _simulated;
+    }
+    return _simulated + monotonicMicros() - _realStart;
+}
+
+uint64_t SimClock::GetSimulatedMicros()
+{
+    return _simulated;
+}
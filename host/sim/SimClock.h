@@ -0,0 +1,30 @@
+#ifndef SimClock_h
+#define SimClock_h
+
+#include <stdint.h>
+
+/// @brief Time source behind millis() and micros() on the host
+/// Simulated time (bus wire time, slave latency, timeouts, idle passes) is added by the sims with Advance().
+/// With real time enabled the CPU time spent running the firmware is added on top, so loop and cycle
+/// timings include the cost of the code itself. Tests leave it off and get the same timings on every run.
+class SimClock
+{
+    public:
+        SimClock();
+        //back to 0, keeps the real time setting
+        void Reset();
+        void SetRealTime(bool enabled);
+        bool IsRealTime();
+        void Advance(uint64_t micros);
+        uint64_t Micros();
+        //time added by Advance() since Reset(), and real time already counted when it was turned off
+        uint64_t GetSimulatedMicros();
+    private:
+        bool _realTime;
+        uint64_t _simulated;
+        uint64_t _realStart;
+};
+
+extern SimClock Clock;	//Default class instance
+
+#endif
@@ -0,0 +1,188 @@
+#include "SimNetwork.h"
+#include "SimClock.h"
+#include "AllocCounter.h"
+#include <string.h>
+#include <algorithm>
+
+SimConnection::SimConnection(SimEndpoint* endpoint)
+{
+    this->endpoint = endpoint;
+    open = true;
+}
+
+void SimConnection::Deliver(const uint8_t* data, size_t len, uint64_t readyAt)
+{
+    AllocCounter::Pause pause;
+    if (!open || len == 0){
+        return;
+    }
+    //tcp keeps the order, a quick response can't overtake a slow one
+    if (!_chunks.empty() && _chunks.back().readyAt > readyAt){
+        readyAt = _chunks.back().readyAt;
+    }
+    _chunks.push_back(Chunk{readyAt, std::vector<uint8_t>(data, data + len), 0});
+}
+
+size_t SimConnection::Available()
+{
+    uint64_t now = Clock.Micros();
+    size_t total = 0;
+    for (const Chunk& chunk : _chunks)
+    {
+        if (chunk.readyAt > now){
+            break;
+        }
+        total += chunk.bytes.size() - chunk.offset;
+    }
+    return total;
+}
+
+size_t SimConnection::Read(uint8_t* buffer, size_t len)
+{
+    AllocCounter::Pause pause;
+    uint64_t now = Clock.Micros();
+    size_t done = 0;
+    while (done < len && !_chunks.empty() && _chunks.front().readyAt <= now)
+    {
+        Chunk& chunk = _chunks.front();
+        size_t n = std::min(len - done, chunk.bytes.size() - chunk.offset);
+        memcpy(buffer + done, chunk.bytes.data() + chunk.offset, n);
+        chunk.offset += n;
+        done += n;
+        if (chunk.offset == chunk.bytes.size()){
+            _chunks.pop_front();
+        }
+    }
+    return done;
+}
+
+int SimConnection::Peek()
+{
+    if (_chunks.empty() || _chunks.front().readyAt > Clock.Micros()){
+        return -1;
+    }
+    const Chunk& chunk = _chunks.front();
+    return chunk.bytes[chunk.offset];
+}
+
+void SimConnection::Drop()
+{
+    open = false;
+}
+
+SimNetwork::SimNetwork(){
+    latencyMicros = 100;
+    connects = 0;
+    failedConnects = 0;
+    _link = true;
+    _dhcp = true;
+}
+
+SimNetwork Network;
+
+void SimNetwork::Reset()
+{
+    AllocCounter::Pause pause;
+    _listeners.clear();
+    _link = true;
+    _dhcp = true;
+    connects = 0;
+    failedConnects = 0;
+}
+
+void SimNetwork::SetLink(bool up)
+{
+    _link = up;
+    if (!up){
+        for (SimConnection* conn : _connections)
+        {
+            conn->Drop();
+        }
+    }
+}
+
+bool SimNetwork::IsLinkUp()
+{
+    return _link;
+}
+
+void SimNetwork::SetDhcp(bool available)
+{
+    _dhcp = available;
+}
+
+bool SimNetwork::IsDhcpAvailable()
+{
+    return _dhcp;
+}
+
+void SimNetwork::Listen(const char* host, uint16_t port, SimEndpoint* endpoint)
+{
+    AllocCounter::Pause pause;
+    Listener listener;
+    strncpy(listener.host, host, sizeof(listener.host) - 1);
+    listener.host[sizeof(listener.host) - 1] = '\0';
+    listener.port = port;
+    listener.endpoint = endpoint;
+    _listeners.push_back(listener);
+}
+
+void SimNetwork::Unlisten(SimEndpoint* endpoint)
+{
+    _listeners.erase(std::remove_if(_listeners.begin(), _listeners.end(),
+        [endpoint](const Listener& l){ return l.endpoint == endpoint; }), _listeners.end());
+}
+
+SimEndpoint* SimNetwork::Find(const char* host, uint16_t port)
+{
+    for (const Listener& listener : _listeners)
+    {
+        if (listener.port == port && strcmp(listener.host, host) == 0){
+            return listener.endpoint;
+        }
+    }
+    return nullptr;
+}
+
+SimConnection* SimNetwork::Connect(const char* host, uint16_t port)
+{
+    AllocCounter::Pause pause;
+    SimEndpoint* endpoint = _link ? Find(host, port) : nullptr;
+    if (endpoint == nullptr){
+        failedConnects++;
+        return nullptr;
+    }
+    SimConnection* conn = new SimConnection(endpoint);
+    if (!endpoint->Accept(conn)){
+        delete conn;
+        failedConnects++;
+        return nullptr;
+    }
+    _connections.push_back(conn);
+    connects++;
+    return conn;
+}
+
+void SimNetwork::Close(SimConnection* conn)
+{
+    AllocCounter::Pause pause;
+    if (conn == nullptr){
+        return;
+    }
+    if (conn->open){
+        conn->open = false;
+        conn->endpoint->Closed(conn);
+    }
+    _connections.erase(std::remove(_connections.begin(), _connections.end(), conn), _connections.end());
+    delete conn;
+}
+
+void SimNetwork::DropConnections(SimEndpoint* endpoint)
+{
+    for (SimConnection* conn : _connections)
+    {
+        if (conn->endpoint == endpoint){
+            conn->Drop();
+        }
+    }
+}
@@ -0,0 +1,91 @@
+#ifndef SimNetwork_h
+#define SimNetwork_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <deque>
+#include <vector>
+
+class SimEndpoint;
+
+/// @brief One TCP connection between an EthernetClient and a simulated server
+/// Bytes sent by the server are held until the simulated time they would arrive at.
+class SimConnection
+{
+    public:
+        SimConnection(SimEndpoint* endpoint);
+        SimEndpoint* endpoint;
+        bool open;
+        //queue bytes for the client, readable once Clock reaches readyAt
+        void Deliver(const uint8_t* data, size_t len, uint64_t readyAt);
+        //bytes that have arrived by now
+        size_t Available();
+        size_t Read(uint8_t* buffer, size_t len);
+        int Peek();
+        //the server dropped the connection, bytes already delivered stay readable
+        void Drop();
+        //endpoint scratch space, ex: a partially received request
+        std::vector<uint8_t> rx;
+    private:
+        struct Chunk
+        {
+            uint64_t readyAt;
+            std::vector<uint8_t> bytes;
+            size_t offset;
+        };
+        std::deque<Chunk> _chunks;
+};
+
+/// @brief Server side of simulated TCP, ex: the fake broker or a Modbus TCP slave
+class SimEndpoint
+{
+    public:
+        virtual ~SimEndpoint() {}
+        //false refuses the connection
+        virtual bool Accept(SimConnection* conn) { (void)conn; return true; }
+        //bytes written by the client, they arrive at Clock's current time
+        virtual void Receive(SimConnection* conn, const uint8_t* data, size_t len) { (void)conn; (void)data; (void)len; }
+        //the client closed the connection
+        virtual void Closed(SimConnection* conn) { (void)conn; }
+};
+
+/// @brief The segment the controller's Ethernet port is plugged into
+class SimNetwork
+{
+    public:
+        SimNetwork();
+        //everything back to a working link with a DHCP server and no listeners
+        void Reset();
+        void SetLink(bool up);
+        bool IsLinkUp();
+        void SetDhcp(bool available);
+        bool IsDhcpAvailable();
+        //accept connections to host:port, host is a name or dotted address as the firmware gives it
+        void Listen(const char* host, uint16_t port, SimEndpoint* endpoint);
+        void Unlisten(SimEndpoint* endpoint);
+        SimEndpoint* Find(const char* host, uint16_t port);
+        //open a connection, nullptr when nothing listens there or the endpoint refuses
+        SimConnection* Connect(const char* host, uint16_t port);
+        void Close(SimConnection* conn);
+        //drop every open connection to the endpoint, ex: a broker outage
+        void DropConnections(SimEndpoint* endpoint);
+        //one way latency of the segment, added to connects and to every response
+        uint32_t latencyMicros;
+        unsigned long connects;
+        unsigned long failedConnects;
+    private:
+        struct Listener
+        {
+            char host[64];
+            uint16_t port;
+            SimEndpoint* endpoint;
+        };
+        std::vector<Listener> _listeners;
+        std::vector<SimConnection*> _connections;
+        bool _link;
+        bool _dhcp;
+};
+
+extern SimNetwork Network;	//Default class instance
+
+#endif
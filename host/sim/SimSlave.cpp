@@ -0,0 +1,79 @@
+#include "SimSlave.h"
+#include "SimClock.h"
+#include "AllocCounter.h"
+
+SimSlave::SimSlave(int id)
+{
+    this->id = id;
+    latencyMicros = 2000;
+    online = true;
+    timeoutsPending = 0;
+    crcErrorsPending = 0;
+    addressLimit = 0x10000;
+    generator = nullptr;
+    reads = 0;
+    writes = 0;
+    transactions = 0;
+}
+
+uint32_t simRegisterKey(int table, uint16_t address)
+{
+    return static_cast<uint32_t>(table) << 16 | address;
+}
+
+uint16_t SimSlave::Get(int table, uint16_t address)
+{
+    auto it = _values.find(simRegisterKey(table, address));
+    return it == _values.end() ? 0 : it->second;
+}
+
+void SimSlave::Set(int table, uint16_t address, uint16_t value)
+{
+    AllocCounter::Pause pause;
+    //coils and discrete inputs only hold 0 or 1
+    if (table == SIM_COILS || table == SIM_DISCRETE_INPUTS){
+        value = value != 0;
+    }
+    _values[simRegisterKey(table, address)] = value;
+}
+
+uint8_t SimSlave::Read(int table, uint16_t address, uint16_t count, uint16_t* values)
+{
+    uint16_t maxCount = (table == SIM_COILS || table == SIM_DISCRETE_INPUTS) ? 2000 : 125;
+    if (count == 0 || count > maxCount){
+        return SIM_ILLEGAL_DATA_VALUE;
+    }
+    if (static_cast<uint32_t>(address) + count > addressLimit){
+        return SIM_ILLEGAL_DATA_ADDRESS;
+    }
+    uint64_t now = Clock.Micros();
+    for (uint16_t i = 0; i < count; i++)
+    {
+        uint16_t at = address + i;
+        values[i] = generator != nullptr ? generator(this, table, at, now) : Get(table, at);
+    }
+    reads++;
+    return 0;
+}
+
+uint8_t SimSlave::Write(int table, uint16_t address, uint16_t count, const uint16_t* values)
+{
+    if (table != SIM_COILS && table != SIM_HOLDING_REGISTERS){
+        return SIM_ILLEGAL_FUNCTION;
+    }
+    if (count == 0 || count > 123){
+        return SIM_ILLEGAL_DATA_VALUE;
+    }
+    if (static_cast<uint32_t>(address) + count > addressLimit){
+        return SIM_ILLEGAL_DATA_ADDRESS;
+    }
+    AllocCounter::Pause pause;
+    uint64_t now = Clock.Micros();
+    for (uint16_t i = 0; i < count; i++)
+    {
+        Set(table, address + i, values[i]);
+        writeLog.push_back(SimWrite{table, static_cast<uint16_t>(address + i), Get(table, address + i), now});
+    }
+    writes++;
+    return 0;
+}
@@ -0,0 +1,64 @@
+#ifndef SimSlave_h
+#define SimSlave_h
+
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+//modbus tables, same numbering as ArduinoModbus
+#define SIM_COILS 0
+#define SIM_DISCRETE_INPUTS 1
+#define SIM_HOLDING_REGISTERS 2
+#define SIM_INPUT_REGISTERS 3
+
+//exception codes a slave answers with
+#define SIM_ILLEGAL_FUNCTION 1
+#define SIM_ILLEGAL_DATA_ADDRESS 2
+#define SIM_ILLEGAL_DATA_VALUE 3
+
+/// @brief Value written to a slave
+struct SimWrite
+{
+    int table;
+    uint16_t address;
+    uint16_t value;
+    //Clock time the write reached the slave
+    uint64_t at;
+};
+
+/// @brief Simulated Modbus slave, its register map and the faults it should show
+/// Slaves are reached over the RTU bus of sim/SimulatedBus.h or over TCP through sim/SimTcpSlave.h.
+class SimSlave
+{
+    public:
+        SimSlave(int id);
+        int id;
+        //time from the end of the request to the start of the response
+        uint32_t latencyMicros;
+        //an offline slave never answers
+        bool online;
+        //the next n requests go unanswered, then the slave answers again
+        int timeoutsPending;
+        //the next n responses arrive with a bad CRC
+        int crcErrorsPending;
+        //registers at or above this address answer with an illegal data address exception
+        uint32_t addressLimit;
+        //register value, unset registers read as 0 unless a generator is set
+        uint16_t Get(int table, uint16_t address);
+        void Set(int table, uint16_t address, uint16_t value);
+        //computes every register read from the slave, ex: a drifting current reading, nullptr = the register map
+        uint16_t (*generator)(SimSlave* slave, int table, uint16_t address, uint64_t now);
+        //0 = done, or the exception code the slave answers with
+        uint8_t Read(int table, uint16_t address, uint16_t count, uint16_t* values);
+        uint8_t Write(int table, uint16_t address, uint16_t count, const uint16_t* values);
+        unsigned long reads;
+        unsigned long writes;
+        //requests answered, exceptions included
+        unsigned long transactions;
+        //every value written, in order
+        std::vector<SimWrite> writeLog;
+    private:
+        std::unordered_map<uint32_t, uint16_t> _values;
+};
+
+#endif
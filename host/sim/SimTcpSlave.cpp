@@ -0,0 +1,169 @@
+#include "SimTcpSlave.h"
+#include "SimClock.h"
+#include "AllocCounter.h"
+#include <string.h>
+#include <algorithm>
+
+//transaction id, protocol id, length and unit id
+#define SIM_MBAP_SIZE 7
+
+SimTcpSlave::SimTcpSlave(int id) : slave(id)
+{
+    accepting = true;
+    concurrency = 1;
+    reorder = 1;
+    requests = 0;
+    _busyUntil = 0;
+}
+
+void SimTcpSlave::Start(const char* host, uint16_t port)
+{
+    Network.Listen(host, port, this);
+}
+
+void SimTcpSlave::Stop()
+{
+    Network.Unlisten(this);
+    Network.DropConnections(this);
+    _held.clear();
+}
+
+bool SimTcpSlave::Accept(SimConnection* conn)
+{
+    (void)conn;
+    return accepting && slave.online;
+}
+
+uint16_t mbapReadWord(const uint8_t* bytes)
+{
+    return static_cast<uint16_t>(bytes[0] << 8 | bytes[1]);
+}
+
+void mbapWriteWord(uint8_t* bytes, uint16_t value)
+{
+    bytes[0] = value >> 8;
+    bytes[1] = value & 0xFF;
+}
+
+void SimTcpSlave::Receive(SimConnection* conn, const uint8_t* data, size_t len)
+{
+    AllocCounter::Pause pause;
+    conn->rx.insert(conn->rx.end(), data, data + len);
+    while (conn->rx.size() >= SIM_MBAP_SIZE)
+    {
+        int frameLen = 6 + mbapReadWord(&conn->rx[4]);
+        if (static_cast<int>(conn->rx.size()) < frameLen){
+            break;
+        }
+        Serve(conn, conn->rx.data(), frameLen);
+        conn->rx.erase(conn->rx.begin(), conn->rx.begin() + frameLen);
+    }
+}
+
+void SimTcpSlave::Serve(SimConnection* conn, const uint8_t* frame, int len)
+{
+    requests++;
+    if (!slave.online || slave.timeoutsPending > 0){
+        if (slave.timeoutsPending > 0){
+            slave.timeoutsPending--;
+        }
+        return;
+    }
+
+    uint8_t function = frame[7];
+    uint16_t address = len >= 10 ? mbapReadWord(&frame[8]) : 0;
+    uint16_t count = len >= 12 ? mbapReadWord(&frame[10]) : 0;
+    uint16_t values[125];
+    uint8_t response[260];
+    int pduLen = 0;
+    uint8_t code = 0;
+    bool bits = function == 1 || function == 2 || function == 5 || function == 15;
+    int table = function == 1 || function == 5 || function == 15 ? SIM_COILS :
+        function == 2 ? SIM_DISCRETE_INPUTS : function == 4 ? SIM_INPUT_REGISTERS : SIM_HOLDING_REGISTERS;
+
+    switch (function)
+    {
+        case 1:
+        case 2:
+        case 3:
+        case 4:
+        {
+            uint16_t limit = bits ? 125 * 16 : 125;
+            std::vector<uint16_t> read(count > 0 && count <= limit ? count : 1);
+            code = count == 0 || count > limit ? SIM_ILLEGAL_DATA_VALUE : slave.Read(table, address, count, read.data());
+            if (code != 0){
+                break;
+            }
+            int byteCount = bits ? (count + 7) / 8 : count * 2;
+            response[7] = function;
+            response[8] = static_cast<uint8_t>(byteCount);
+            memset(&response[9], 0, byteCount);
+            for (int i = 0; i < count; i++)
+            {
+                if (bits){
+                    response[9 + i / 8] |= (read[i] ? 1 : 0) << (i % 8);
+                }else{
+                    mbapWriteWord(&response[9 + i * 2], read[i]);
+                }
+            }
+            pduLen = 2 + byteCount;
+            break;
+        }
+        case 5:
+        case 6:
+            values[0] = function == 5 ? (mbapReadWord(&frame[10]) == 0xFF00) : mbapReadWord(&frame[10]);
+            code = slave.Write(table, address, 1, values);
+            if (code == 0){
+                //echo of the request
+                memcpy(&response[7], &frame[7], 5);
+                pduLen = 5;
+            }
+            break;
+        case 15:
+        case 16:
+        {
+            int n = std::min<int>(count, 125);
+            for (int i = 0; i < n; i++)
+            {
+                values[i] = bits ? (frame[13 + i / 8] >> (i % 8)) & 1 : mbapReadWord(&frame[13 + i * 2]);
+            }
+            code = slave.Write(table, address, count, values);
+            if (code == 0){
+                memcpy(&response[7], &frame[7], 5);
+                pduLen = 5;
+            }
+            break;
+        }
+        default:
+            code = SIM_ILLEGAL_FUNCTION;
+            break;
+    }
+    if (code != 0){
+        response[7] = function | 0x80;
+        response[8] = code;
+        pduLen = 2;
+    }
+    slave.transactions++;
+
+    //same transaction and unit id, length counts the unit id and the pdu
+    memcpy(response, frame, 4);
+    mbapWriteWord(&response[4], static_cast<uint16_t>(pduLen + 1));
+    response[6] = frame[6];
+
+    uint64_t arrived = Clock.Micros() + Network.latencyMicros;
+    uint64_t start = concurrency > 1 ? arrived : std::max(arrived, _busyUntil);
+    _busyUntil = start + slave.latencyMicros;
+    if (reorder <= 1){
+        conn->Deliver(response, 7 + pduLen, _busyUntil + Network.latencyMicros);
+        return;
+    }
+    _held.emplace_back(response, response + 7 + pduLen);
+    if (static_cast<int>(_held.size()) < reorder){
+        return;
+    }
+    for (auto held = _held.rbegin(); held != _held.rend(); ++held)
+    {
+        conn->Deliver(held->data(), held->size(), _busyUntil + Network.latencyMicros);
+    }
+    _held.clear();
+}
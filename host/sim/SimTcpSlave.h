@@ -0,0 +1,34 @@
+#ifndef SimTcpSlave_h
+#define SimTcpSlave_h
+
+#include "SimNetwork.h"
+#include "SimSlave.h"
+#include <vector>
+
+/// @brief Modbus TCP server in front of a simulated slave
+/// Requests are served in the order they arrive, each response becomes readable after the slave's
+/// latency plus the network latency, and a slave busy with one request delays the next.
+class SimTcpSlave : public SimEndpoint
+{
+    public:
+        SimTcpSlave(int id);
+        SimSlave slave;
+        //listen on host:port, ex: the host and port of a tcp device in the configuration
+        void Start(const char* host, uint16_t port);
+        void Stop();
+        bool Accept(SimConnection* conn) override;
+        void Receive(SimConnection* conn, const uint8_t* data, size_t len) override;
+        //false refuses connections
+        bool accepting;
+        //most requests answered at once, later ones queue behind them
+        int concurrency;
+        //responses are held until this many are ready, then sent newest first, ex: a gateway to several slaves
+        int reorder;
+        unsigned long requests;
+    private:
+        uint64_t _busyUntil;
+        std::vector<std::vector<uint8_t>> _held;
+        void Serve(SimConnection* conn, const uint8_t* frame, int len);
+};
+
+#endif
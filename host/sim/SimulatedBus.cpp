@@ -0,0 +1,108 @@
+#include "SimulatedBus.h"
+#include "SimClock.h"
+#include "AllocCounter.h"
+
+//frame format bits, same encoding as the SAMD core's SERIAL_* values
+#define SIM_PARITY_MASK 0xF
+#define SIM_PARITY_NONE 0x3
+#define SIM_STOP_MASK 0xF0
+#define SIM_STOP_BIT_2 0x30
+#define SIM_DATA_MASK 0xF00
+#define SIM_DATA_7 0x200
+
+SimulatedBus::SimulatedBus(){
+    _baud = 9600;
+    _charBits = 10;
+    failBegin = false;
+    Reset();
+}
+
+SimulatedBus RtuBus;
+
+void SimulatedBus::Reset()
+{
+    AllocCounter::Pause pause;
+    _slaves.clear();
+    transactions = 0;
+    timeouts = 0;
+    crcErrors = 0;
+    exceptions = 0;
+    busyMicros = 0;
+}
+
+void SimulatedBus::Attach(SimSlave* slave)
+{
+    AllocCounter::Pause pause;
+    _slaves[slave->id] = slave;
+}
+
+void SimulatedBus::Detach(int id)
+{
+    _slaves.erase(id);
+}
+
+SimSlave* SimulatedBus::Find(int id)
+{
+    auto it = _slaves.find(id);
+    return it == _slaves.end() ? nullptr : it->second;
+}
+
+void SimulatedBus::Configure(unsigned long baud, uint16_t config)
+{
+    _baud = baud > 0 ? baud : 9600;
+    int dataBits = (config & SIM_DATA_MASK) == SIM_DATA_7 ? 7 : 8;
+    int parityBits = (config & SIM_PARITY_MASK) == SIM_PARITY_NONE ? 0 : 1;
+    int stopBits = (config & SIM_STOP_MASK) == SIM_STOP_BIT_2 ? 2 : 1;
+    _charBits = 1 + dataBits + parityBits + stopBits;
+}
+
+unsigned long SimulatedBus::GetBaud()
+{
+    return _baud;
+}
+
+double SimulatedBus::GetCharMicros()
+{
+    return _charBits * 1000000.0 / _baud;
+}
+
+eSimResult SimulatedBus::Transact(int id, bool write, int table, uint16_t address, uint16_t count, uint16_t* values,
+    int requestBytes, int responseBytes, unsigned long timeoutMs, uint8_t* exception)
+{
+    transactions++;
+    *exception = 0;
+    uint64_t requestMicros = static_cast<uint64_t>(requestBytes * GetCharMicros());
+    SimSlave* slave = Find(id);
+    if (slave == nullptr || !slave->online || slave->timeoutsPending > 0){
+        if (slave != nullptr && slave->timeoutsPending > 0){
+            slave->timeoutsPending--;
+        }
+        uint64_t elapsed = requestMicros + static_cast<uint64_t>(timeoutMs) * 1000;
+        Clock.Advance(elapsed);
+        busyMicros += elapsed;
+        timeouts++;
+        return sim_timeout;
+    }
+
+    //the slave acts on the request once it has been received
+    Clock.Advance(requestMicros + slave->latencyMicros);
+    uint8_t code = write ? slave->Write(table, address, count, values) : slave->Read(table, address, count, values);
+    slave->transactions++;
+    //an exception response is function, code, crc and the address
+    int answerBytes = code != 0 ? 5 : responseBytes;
+    uint64_t responseMicros = static_cast<uint64_t>(answerBytes * GetCharMicros());
+    Clock.Advance(responseMicros);
+    busyMicros += requestMicros + slave->latencyMicros + responseMicros;
+
+    if (slave->crcErrorsPending > 0){
+        slave->crcErrorsPending--;
+        crcErrors++;
+        return sim_crc_error;
+    }
+    if (code != 0){
+        *exception = code;
+        exceptions++;
+        return sim_exception;
+    }
+    return sim_ok;
+}
@@ -0,0 +1,54 @@
+#ifndef SimulatedBus_h
+#define SimulatedBus_h
+
+#include "SimSlave.h"
+#include <stdint.h>
+#include <map>
+
+/// @brief Outcome of a transaction on the simulated RTU bus
+enum eSimResult
+{
+    sim_ok,
+    sim_timeout,
+    sim_crc_error,
+    sim_exception
+};
+
+/// @brief RS-485 segment behind the ModbusRTUClient shim
+/// Every transaction advances Clock by its time on the wire, request and response characters at the
+/// configured baud and frame format, plus the slave's latency. Unanswered requests cost the client's timeout.
+class SimulatedBus
+{
+    public:
+        SimulatedBus();
+        //remove every slave and clear the counters
+        void Reset();
+        //the bus doesn't own the slave
+        void Attach(SimSlave* slave);
+        void Detach(int id);
+        SimSlave* Find(int id);
+        //serial settings given to ModbusRTUClient.begin()
+        void Configure(unsigned long baud, uint16_t config);
+        unsigned long GetBaud();
+        //start, data, parity and stop bits of one character at the configured baud
+        double GetCharMicros();
+        //run one transaction, values are read into or written from values
+        eSimResult Transact(int id, bool write, int table, uint16_t address, uint16_t count, uint16_t* values,
+            int requestBytes, int responseBytes, unsigned long timeoutMs, uint8_t* exception);
+        unsigned long transactions;
+        unsigned long timeouts;
+        unsigned long crcErrors;
+        unsigned long exceptions;
+        //time the bus spent on transactions, timeouts included
+        uint64_t busyMicros;
+        //begin() fails while set, ex: a missing RS-485 port
+        bool failBegin;
+    private:
+        std::map<int, SimSlave*> _slaves;
+        unsigned long _baud;
+        int _charBits;
+};
+
+extern SimulatedBus RtuBus;	//Default class instance
+
+#endif
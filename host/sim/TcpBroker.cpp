@@ -0,0 +1,353 @@
+#include "TcpBroker.h"
+#include "SimClock.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+//packet types, high nibble of the fixed header
+#define BROKER_CONNECT 1
+#define BROKER_CONNACK 2
+#define BROKER_PUBLISH 3
+#define BROKER_SUBSCRIBE 8
+#define BROKER_SUBACK 9
+#define BROKER_PINGREQ 12
+#define BROKER_PINGRESP 13
+#define BROKER_DISCONNECT 14
+
+//most clients served at once
+#define BROKER_MAX_CLIENTS 16
+
+TcpBroker::TcpBroker(){
+    _listen = -1;
+    _port = 0;
+    _logging = true;
+    _running = false;
+    publishes = 0;
+    publishedBytes = 0;
+    connects = 0;
+}
+
+TcpBroker::~TcpBroker()
+{
+    Stop();
+}
+
+bool TcpBroker::Start(uint16_t port)
+{
+    _listen = socket(AF_INET, SOCK_STREAM, 0);
+    if (_listen < 0){
+        return false;
+    }
+    int on = 1;
+    setsockopt(_listen, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    socklen_t len = sizeof(addr);
+    if (bind(_listen, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0 ||
+        listen(_listen, BROKER_MAX_CLIENTS) != 0 ||
+        getsockname(_listen, reinterpret_cast<struct sockaddr*>(&addr), &len) != 0)
+    {
+        close(_listen);
+        _listen = -1;
+        return false;
+    }
+    _port = ntohs(addr.sin_port);
+    _running = true;
+    _thread = std::thread(&TcpBroker::Run, this);
+    return true;
+}
+
+void TcpBroker::Stop()
+{
+    _running = false;
+    if (_thread.joinable()){
+        _thread.join();
+    }
+    for (Client& client : _clients)
+    {
+        close(client.fd);
+    }
+    _clients.clear();
+    if (_listen >= 0){
+        close(_listen);
+        _listen = -1;
+    }
+}
+
+uint16_t TcpBroker::GetPort()
+{
+    return _port;
+}
+
+void TcpBroker::Publish(const char* topic, const char* payload)
+{
+    std::lock_guard<std::mutex> guard(_lock);
+    //handed to the broker thread, it owns the client sockets
+    _outbox.push_back(BrokerMessage{topic, payload, false, Clock.Micros()});
+}
+
+std::vector<BrokerMessage> TcpBroker::Find(const char* filter)
+{
+    std::lock_guard<std::mutex> guard(_lock);
+    std::vector<BrokerMessage> found;
+    for (const BrokerMessage& message : _published)
+    {
+        if (FakeBroker::Matches(filter, message.topic.c_str())){
+            found.push_back(message);
+        }
+    }
+    return found;
+}
+
+size_t TcpBroker::Count(const char* filter)
+{
+    std::lock_guard<std::mutex> guard(_lock);
+    size_t count = 0;
+    for (const BrokerMessage& message : _published)
+    {
+        if (FakeBroker::Matches(filter, message.topic.c_str())){
+            count++;
+        }
+    }
+    return count;
+}
+
+bool TcpBroker::WaitFor(const char* filter, size_t count, unsigned long timeoutMs)
+{
+    for (unsigned long waited = 0; waited < timeoutMs; waited++)
+    {
+        if (Count(filter) >= count){
+            return true;
+        }
+        struct timespec ts = {0, 1000000};
+        nanosleep(&ts, nullptr);
+    }
+    return Count(filter) >= count;
+}
+
+int TcpBroker::GetSubscriberCount()
+{
+    std::lock_guard<std::mutex> guard(_lock);
+    int count = 0;
+    for (const Client& client : _clients)
+    {
+        if (!client.filters.empty()){
+            count++;
+        }
+    }
+    return count;
+}
+
+void TcpBroker::SetLogging(bool enabled)
+{
+    std::lock_guard<std::mutex> guard(_lock);
+    _logging = enabled;
+}
+
+void TcpBroker::Run()
+{
+    uint8_t buffer[4096];
+    while (_running.load(std::memory_order_relaxed))
+    {
+        std::vector<BrokerMessage> outbox;
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            outbox.swap(_outbox);
+        }
+        for (const BrokerMessage& message : outbox)
+        {
+            Route(message.topic, message.payload);
+        }
+
+        struct pollfd fds[BROKER_MAX_CLIENTS + 1];
+        size_t count = 0;
+        fds[count++] = {_listen, POLLIN, 0};
+        for (size_t i = 0; i < _clients.size(); i++)
+        {
+            fds[count++] = {_clients[i].fd, POLLIN, 0};
+        }
+        if (poll(fds, count, 1) <= 0){
+            continue;
+        }
+        if ((fds[0].revents & POLLIN) != 0){
+            int fd = accept(_listen, nullptr, nullptr);
+            if (fd >= 0 && _clients.size() < BROKER_MAX_CLIENTS){
+                int on = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+                std::lock_guard<std::mutex> guard(_lock);
+                _clients.push_back(Client{fd, {}, {}});
+            }else if (fd >= 0){
+                close(fd);
+            }
+        }
+        //clients accepted above were not polled, the count keeps them out of this pass
+        for (size_t i = count - 1; i >= 1; i--)
+        {
+            if (fds[i].revents == 0){
+                continue;
+            }
+            Client* client = &_clients[i - 1];
+            ssize_t n = recv(client->fd, buffer, sizeof(buffer), 0);
+            bool alive = n > 0;
+            if (alive){
+                client->rx.insert(client->rx.end(), buffer, buffer + n);
+                alive = Process(client);
+            }
+            if (!alive){
+                close(client->fd);
+                std::lock_guard<std::mutex> guard(_lock);
+                _clients.erase(_clients.begin() + (i - 1));
+            }
+        }
+    }
+}
+
+bool TcpBroker::Process(Client* client)
+{
+    while (true)
+    {
+        std::vector<uint8_t>& rx = client->rx;
+        //remaining length, up to four bytes of seven bits
+        size_t remaining = 0;
+        size_t header = 1;
+        int shift = 0;
+        while (true)
+        {
+            if (header >= rx.size()){
+                return true;
+            }
+            uint8_t byte = rx[header++];
+            remaining |= static_cast<size_t>(byte & 0x7F) << shift;
+            shift += 7;
+            if ((byte & 0x80) == 0){
+                break;
+            }
+            if (shift > 21){
+                return false;
+            }
+        }
+        if (rx.size() < header + remaining){
+            return true;
+        }
+        uint8_t type = rx[0] >> 4;
+        const uint8_t* body = rx.data() + header;
+        switch (type)
+        {
+            case BROKER_CONNECT:
+            {
+                uint8_t connack[] = {BROKER_CONNACK << 4, 2, 0, 0};
+                Send(client, connack, sizeof(connack));
+                connects++;
+                break;
+            }
+            case BROKER_PUBLISH:
+            {
+                size_t topicLength = (body[0] << 8) | body[1];
+                size_t offset = 2 + topicLength;
+                //QoS 1 and 2 carry a packet id, this broker is never sent those
+                if (((rx[0] >> 1) & 0x03) != 0){
+                    offset += 2;
+                }
+                if (offset > remaining){
+                    return false;
+                }
+                std::string topic(reinterpret_cast<const char*>(body + 2), topicLength);
+                std::string payload(reinterpret_cast<const char*>(body + offset), remaining - offset);
+                publishes++;
+                publishedBytes += payload.size();
+                {
+                    std::lock_guard<std::mutex> guard(_lock);
+                    if (_logging){
+                        _published.push_back(BrokerMessage{topic, payload, (rx[0] & 0x01) != 0, Clock.Micros()});
+                    }
+                }
+                Route(topic, payload);
+                break;
+            }
+            case BROKER_SUBSCRIBE:
+            {
+                //packet id, then filter and requested QoS pairs
+                std::vector<uint8_t> suback = {BROKER_SUBACK << 4, 2, body[0], body[1]};
+                size_t offset = 2;
+                std::lock_guard<std::mutex> guard(_lock);
+                while (offset + 2 <= remaining)
+                {
+                    size_t filterLength = (body[offset] << 8) | body[offset + 1];
+                    if (offset + 2 + filterLength + 1 > remaining){
+                        return false;
+                    }
+                    client->filters.emplace_back(reinterpret_cast<const char*>(body + offset + 2), filterLength);
+                    offset += 2 + filterLength + 1;
+                    suback.push_back(0);
+                    suback[1]++;
+                }
+                Send(client, suback.data(), suback.size());
+                break;
+            }
+            case BROKER_PINGREQ:
+            {
+                uint8_t pingresp[] = {BROKER_PINGRESP << 4, 0};
+                Send(client, pingresp, sizeof(pingresp));
+                break;
+            }
+            case BROKER_DISCONNECT:
+                return false;
+            default:
+                break;
+        }
+        rx.erase(rx.begin(), rx.begin() + header + remaining);
+    }
+}
+
+void TcpBroker::Route(const std::string& topic, const std::string& payload)
+{
+    std::vector<uint8_t> packet;
+    size_t remaining = 2 + topic.size() + payload.size();
+    packet.push_back(BROKER_PUBLISH << 4);
+    do
+    {
+        uint8_t byte = remaining & 0x7F;
+        remaining >>= 7;
+        packet.push_back(remaining > 0 ? byte | 0x80 : byte);
+    } while (remaining > 0);
+    packet.push_back(topic.size() >> 8);
+    packet.push_back(topic.size() & 0xFF);
+    packet.insert(packet.end(), topic.begin(), topic.end());
+    packet.insert(packet.end(), payload.begin(), payload.end());
+
+    for (Client& client : _clients)
+    {
+        for (const std::string& filter : client.filters)
+        {
+            if (FakeBroker::Matches(filter.c_str(), topic.c_str())){
+                Send(&client, packet.data(), packet.size());
+                break;
+            }
+        }
+    }
+}
+
+void TcpBroker::Send(Client* client, const uint8_t* packet, size_t length)
+{
+    size_t sent = 0;
+    while (sent < length)
+    {
+        ssize_t n = send(client->fd, packet + sent, length - sent, MSG_NOSIGNAL);
+        if (n <= 0){
+            if (n < 0 && errno == EINTR){
+                continue;
+            }
+            return;
+        }
+        sent += n;
+    }
+}
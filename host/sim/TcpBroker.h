@@ -0,0 +1,61 @@
+#ifndef TcpBroker_h
+#define TcpBroker_h
+
+#include "FakeBroker.h"
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/// @brief MQTT 3.1.1 broker on a loopback TCP port for the Linux gateway, QoS 0 only
+/// FakeBroker stands in for the broker of the simulated network, the gateway opens real sockets so this
+/// one speaks the wire protocol on 127.0.0.1. One thread serves every client, messages are routed to the
+/// subscribed clients and recorded the way FakeBroker records them.
+class TcpBroker
+{
+    public:
+        TcpBroker();
+        ~TcpBroker();
+        //listen on 127.0.0.1, port 0 picks a free one, false if it can't listen
+        bool Start(uint16_t port = 0);
+        void Stop();
+        uint16_t GetPort();
+        //publish to the subscribed clients as if another client had sent it
+        void Publish(const char* topic, const char* payload);
+        //messages published by clients whose topic matches the filter, wildcards included
+        std::vector<BrokerMessage> Find(const char* filter);
+        size_t Count(const char* filter);
+        //wait until count messages matching the filter were published, false on timeout
+        bool WaitFor(const char* filter, size_t count, unsigned long timeoutMs);
+        //subscribed clients, ex: to wait for the gateway before publishing commands
+        int GetSubscriberCount();
+        //stop recording messages, a benchmark only needs the counters
+        void SetLogging(bool enabled);
+        std::atomic<unsigned long> publishes;
+        std::atomic<unsigned long> publishedBytes;
+        std::atomic<unsigned long> connects;
+    private:
+        struct Client
+        {
+            int fd;
+            std::vector<uint8_t> rx;
+            std::vector<std::string> filters;
+        };
+        int _listen;
+        uint16_t _port;
+        std::vector<Client> _clients;
+        std::vector<BrokerMessage> _published;
+        std::vector<BrokerMessage> _outbox;
+        bool _logging;
+        std::mutex _lock;
+        std::thread _thread;
+        std::atomic<bool> _running;
+        void Run();
+        //handle the complete packets a client sent, false when the client is gone
+        bool Process(Client* client);
+        void Route(const std::string& topic, const std::string& payload);
+        void Send(Client* client, const uint8_t* packet, size_t length);
+};
+
+#endif
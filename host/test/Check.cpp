@@ -0,0 +1,40 @@
+#include "Check.h"
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+int checkFailures = 0;
+bool scenarioQuiet = false;
+
+int runScenario(const char* name, void (*scenario)())
+{
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid < 0){
+        perror("fork");
+        return 1;
+    }
+    if (pid == 0){
+        scenario();
+        fflush(stdout);
+        _exit(checkFailures > 0 ? 1 : 0);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    bool passed = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    if (WIFSIGNALED(status)){
+        fprintf(stderr, "%s: killed by signal %d\n", name, WTERMSIG(status));
+    }
+    if (!passed || !scenarioQuiet){
+        printf("%s %s\n", passed ? "PASS" : "FAIL", name);
+    }
+    return passed ? 0 : 1;
+}
+
+const char* repoPath(const char* relative)
+{
+    static char path[512];
+    snprintf(path, sizeof(path), "%s/%s", VFDCTL_SOURCE_DIR, relative);
+    return path;
+}
@@ -0,0 +1,29 @@
+#ifndef Check_h
+#define Check_h
+
+#include <stdio.h>
+
+//failed checks in the running scenario
+extern int checkFailures;
+
+#define CHECK(condition) \
+    do { if (!(condition)) { checkFailures++; fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); } } while (0)
+
+#define CHECK_EQ(actual, expected) \
+    do { long long a_ = (long long)(actual); long long e_ = (long long)(expected); \
+        if (a_ != e_) { checkFailures++; fprintf(stderr, "%s:%d: CHECK_EQ(%s, %s) failed: %lld != %lld\n", \
+            __FILE__, __LINE__, #actual, #expected, a_, e_); } } while (0)
+
+/// @brief Run a scenario in a child process so it starts from freshly initialised firmware globals
+/// @return 0 = passed, 1 = a check failed or the scenario crashed
+int runScenario(const char* name, void (*scenario)());
+
+//only failed scenarios are reported, for benchmarks printing a table
+extern bool scenarioQuiet;
+
+#define SCENARIO(scenario) runScenario(#scenario, scenario)
+
+//path of a file in the repository, ex: config-fr800.txt
+const char* repoPath(const char* relative);
+
+#endif
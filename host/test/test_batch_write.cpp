@@ -0,0 +1,164 @@
+#include "Check.h"
+#include "../app/Harness.h"
+#include "../app/SyntheticConfig.h"
+#include "../sim/FakeBroker.h"
+#include "../sim/SimulatedBus.h"
+#include <stdio.h>
+#include <string>
+
+#define SECONDS 1000000ULL
+//c0..c9 are holding registers 1000-1009 of slave 1, 999-1008 on the wire with the offset of -1
+#define FIRST_COMMAND_ADDRESS 999
+
+bool commandIdle()
+{
+    return App.IsCommandIdle();
+}
+
+//boot a slave with ten contiguous command registers, returns the bus transactions so far
+unsigned long bootIdle()
+{
+    SyntheticOptions options;
+    options.registers = 4;
+    options.commands = 10;
+    options.telemetryIntervalSec = 60;
+    CHECK(Sim.CreateCard());
+    CHECK(Sim.WriteFile("conf.txt", buildSyntheticConfig(options)));
+    Sim.Boot();
+    CHECK(Sim.RunCycles(1, 90 * SECONDS));
+    return RtuBus.transactions;
+}
+
+//send a batch to slave 1 and wait for its response, requests are "name":value pairs
+const BrokerMessage* sendBatch(const char* requests, bool allOrNothing)
+{
+    std::string payload = "{\"contentType\":\"registerBatchWriteMsg\",\"resTopic\":\"res/batch\",\"sessionId\":\"b1\",";
+    payload += allOrNothing ? "\"allOrNothing\":true," : "";
+    payload += "\"requests\":[";
+    payload += requests;
+    payload += "]}";
+    Sim.Command("cmd/vfdctl/vfd1/config", payload.c_str());
+    Sim.RunFor(100000);
+    CHECK(Sim.RunUntil(commandIdle, 5 * SECONDS));
+    return Broker.Last("res/batch");
+}
+
+bool hasResult(const BrokerMessage* response, const char* parameter, const char* result)
+{
+    if (response == nullptr){
+        return false;
+    }
+    char text[96];
+    snprintf(text, sizeof(text), "\"parameter\":\"%s\",", parameter);
+    size_t at = response->payload.find(text);
+    snprintf(text, sizeof(text), "\"result\":\"%s\"", result);
+    return at != std::string::npos && response->payload.find(text, at) == response->payload.find("\"result\"", at);
+}
+
+//ten contiguous parameters go out as a single write multiple registers request
+void contiguousParametersShareOneWrite()
+{
+    unsigned long before = bootIdle();
+    std::string requests;
+    for (int i = 0; i < 10; i++)
+    {
+        char request[64];
+        snprintf(request, sizeof(request), "%s{\"parameter\":\"c%d\",\"requestedValue\":%d}", i > 0 ? "," : "", i, 10 + i);
+        requests += request;
+    }
+    const BrokerMessage* response = sendBatch(requests.c_str(), false);
+    CHECK_EQ(RtuBus.transactions - before, 1);
+    CHECK_EQ(App.GetCommandTransactions(), 1);
+    SimSlave* slave = Sim.Slave(1);
+    CHECK_EQ(slave->writes, 1);
+    CHECK_EQ(slave->writeLog.size(), 10);
+    for (int i = 0; i < 10; i++)
+    {
+        CHECK_EQ(slave->Get(SIM_HOLDING_REGISTERS, FIRST_COMMAND_ADDRESS + i), 10 + i);
+    }
+    CHECK(hasResult(response, "c0", "written"));
+    CHECK(hasResult(response, "c9", "written"));
+}
+
+//parameters are sorted by address, each contiguous run is one request
+void gapsSplitTheWrite()
+{
+    unsigned long before = bootIdle();
+    const BrokerMessage* response = sendBatch(
+        "{\"parameter\":\"c5\",\"requestedValue\":5},{\"parameter\":\"c0\",\"requestedValue\":1},"
+        "{\"parameter\":\"c1\",\"requestedValue\":2},{\"parameter\":\"c6\",\"requestedValue\":6},"
+        "{\"parameter\":\"c9\",\"requestedValue\":9}", false);
+    CHECK_EQ(RtuBus.transactions - before, 3);
+    CHECK_EQ(Sim.Slave(1)->writeLog.size(), 5);
+    CHECK(hasResult(response, "c9", "written"));
+}
+
+//one value outside its limits holds back the whole batch
+void allOrNothingWritesNothing()
+{
+    unsigned long before = bootIdle();
+    const BrokerMessage* response = sendBatch(
+        "{\"parameter\":\"c0\",\"requestedValue\":1},{\"parameter\":\"c1\",\"requestedValue\":5000}", true);
+    CHECK_EQ(RtuBus.transactions - before, 0);
+    CHECK_EQ(Sim.Slave(1)->writeLog.size(), 0);
+    CHECK(hasResult(response, "c0", "skipped"));
+    CHECK(hasResult(response, "c1", "out_of_range"));
+}
+
+//without allOrNothing the valid values are still written
+void partialBatchWritesValidValues()
+{
+    unsigned long before = bootIdle();
+    const BrokerMessage* response = sendBatch(
+        "{\"parameter\":\"c0\",\"requestedValue\":1},{\"parameter\":\"c1\",\"requestedValue\":5000},"
+        "{\"parameter\":\"c2\",\"requestedValue\":3}", false);
+    CHECK_EQ(RtuBus.transactions - before, 2);
+    CHECK_EQ(Sim.Slave(1)->writeLog.size(), 2);
+    CHECK(hasResult(response, "c0", "written"));
+    CHECK(hasResult(response, "c1", "out_of_range"));
+    CHECK(hasResult(response, "c2", "written"));
+}
+
+//a slave that rejects the request fails every parameter of it
+void rejectedWriteIsReported()
+{
+    unsigned long before = bootIdle();
+    Sim.Slave(1)->addressLimit = FIRST_COMMAND_ADDRESS + 2;
+    const BrokerMessage* response = sendBatch(
+        "{\"parameter\":\"c0\",\"requestedValue\":1},{\"parameter\":\"c1\",\"requestedValue\":2},"
+        "{\"parameter\":\"c2\",\"requestedValue\":3}", false);
+    CHECK_EQ(RtuBus.exceptions, 1);
+    CHECK(RtuBus.transactions - before >= 1);
+    CHECK(hasResult(response, "c0", "write_failed"));
+    CHECK(hasResult(response, "c2", "write_failed"));
+}
+
+//the same ten values as single register commands take ten transactions
+void singleWritesForComparison()
+{
+    unsigned long before = bootIdle();
+    char payload[128];
+    for (int i = 0; i < 10; i++)
+    {
+        char topic[48];
+        snprintf(topic, sizeof(topic), "cmd/vfdctl/vfd1/c%d/config", i);
+        snprintf(payload, sizeof(payload), "{\"contentType\":\"registerWriteMsg\",\"requestedValue\":%d}", 10 + i);
+        Sim.Command(topic, payload);
+        Sim.RunFor(100000);
+        CHECK(Sim.RunUntil(commandIdle, 5 * SECONDS));
+    }
+    CHECK_EQ(RtuBus.transactions - before, 10);
+    CHECK_EQ(Sim.Slave(1)->writeLog.size(), 10);
+}
+
+int main()
+{
+    int failures = 0;
+    failures += SCENARIO(contiguousParametersShareOneWrite);
+    failures += SCENARIO(gapsSplitTheWrite);
+    failures += SCENARIO(allOrNothingWritesNothing);
+    failures += SCENARIO(partialBatchWritesValidValues);
+    failures += SCENARIO(rejectedWriteIsReported);
+    failures += SCENARIO(singleWritesForComparison);
+    return failures;
+}
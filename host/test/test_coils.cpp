@@ -0,0 +1,155 @@
+#include "Check.h"
+#include "../app/Harness.h"
+#include "../app/SyntheticConfig.h"
+#include "../sim/FakeBroker.h"
+#include "../sim/SimulatedBus.h"
+#include <stdio.h>
+#include <string>
+
+#define SECONDS 1000000ULL
+//wire address of r0 and c0, the synthetic configuration has an offset of -1
+#define FIRST_ADDRESS 199
+#define FIRST_COMMAND_ADDRESS 999
+#define POINTS 16
+
+bool commandIdle()
+{
+    return App.IsCommandIdle();
+}
+
+void bootBits(const char* registerType, const char* commandType)
+{
+    SyntheticOptions options;
+    options.registers = POINTS;
+    options.commands = 4;
+    options.registerType = registerType;
+    options.commandType = commandType;
+    options.journal = false;
+    CHECK(Sim.CreateCard());
+    CHECK(Sim.WriteFile("conf.txt", buildSyntheticConfig(options)));
+    Sim.Boot();
+    CHECK(Sim.RunCycles(1, 30 * SECONDS));
+    CHECK(App.IsRemoteConnected());
+}
+
+bool publishedValue(int point, int value)
+{
+    char topic[32];
+    snprintf(topic, sizeof(topic), "dt/vfdctl/vfd1/r%d", point);
+    char text[32];
+    snprintf(text, sizeof(text), "\"value\":%d", value);
+    const BrokerMessage* message = Broker.Last(topic);
+    return message != nullptr && message->payload.find(text) != std::string::npos;
+}
+
+//every point of the block comes back in one request, eight points to a response byte
+void readPacked(int table)
+{
+    for (int i = 0; i < POINTS; i++)
+    {
+        Sim.Slave(1)->Set(table, FIRST_ADDRESS + i, i % 3 == 0 ? 1 : 0);
+    }
+    unsigned long transactions = RtuBus.transactions;
+    uint64_t busy = RtuBus.busyMicros;
+    CHECK(Sim.RunCycles(Sim.cycles + 1, 5 * SECONDS));
+    CHECK_EQ(RtuBus.transactions - transactions, 1);
+    //8 byte request, address, function, byte count, two data bytes and the crc back
+    double charMicros = RtuBus.GetCharMicros();
+    uint64_t expected = static_cast<uint64_t>(8 * charMicros) + Sim.Slave(1)->latencyMicros + static_cast<uint64_t>(7 * charMicros);
+    CHECK_EQ(RtuBus.busyMicros - busy, expected);
+    for (int i = 0; i < POINTS; i++)
+    {
+        CHECK(publishedValue(i, i % 3 == 0 ? 1 : 0));
+    }
+}
+
+//function 0x01
+void coilsReadPacked()
+{
+    bootBits("coil", "coil");
+    readPacked(SIM_COILS);
+}
+
+//function 0x02
+void discreteInputsReadPacked()
+{
+    bootBits("discrete_input", "coil");
+    readPacked(SIM_DISCRETE_INPUTS);
+}
+
+//bit points are report by exception, a cycle publishes only the bits that changed
+void onlyChangedBitsPublished()
+{
+    bootBits("coil", "coil");
+    CHECK(Sim.RunCycles(Sim.cycles + 1, 5 * SECONDS));
+    size_t published = Broker.Find("dt/#").size();
+    CHECK(Sim.RunCycles(Sim.cycles + 2, 5 * SECONDS));
+    CHECK_EQ(Broker.Find("dt/#").size(), published);
+
+    //the harness starts every point at 1
+    Sim.Slave(1)->Set(SIM_COILS, FIRST_ADDRESS + 5, 0);
+    Sim.Slave(1)->Set(SIM_COILS, FIRST_ADDRESS + 11, 0);
+    CHECK(Sim.RunCycles(Sim.cycles + 3, 5 * SECONDS));
+    CHECK_EQ(Broker.Find("dt/#").size(), published + 2);
+    CHECK(publishedValue(5, 0));
+    CHECK(publishedValue(11, 0));
+    CHECK_EQ(Broker.Find("dt/vfdctl/vfd1/r6").size(), 1);
+}
+
+//a coilWriteMsg is one function 5 write, consecutive coils of a batch go out as one function 15 write
+void coilWritesUseCoilFunctions()
+{
+    bootBits("coil", "coil");
+    SimSlave* slave = Sim.Slave(1);
+    unsigned long transactions = RtuBus.transactions;
+    Sim.Command("cmd/vfdctl/vfd1/c2/config",
+        "{\"contentType\":\"coilWriteMsg\",\"requestedValue\":1,\"resTopic\":\"res/coil\",\"sessionId\":\"s1\"}");
+    Sim.RunFor(100000);
+    CHECK(Sim.RunUntil(commandIdle, 5 * SECONDS));
+    CHECK_EQ(RtuBus.transactions - transactions, 1);
+    CHECK_EQ(slave->writes, 1);
+    CHECK_EQ(slave->writeLog.size(), 1);
+    CHECK_EQ(slave->Get(SIM_COILS, FIRST_COMMAND_ADDRESS + 2), 1);
+    const BrokerMessage* response = Broker.Last("res/coil");
+    CHECK(response != nullptr && response->payload.find("\"actualValue\":1") != std::string::npos);
+
+    transactions = RtuBus.transactions;
+    Sim.Command("cmd/vfdctl/vfd1/config",
+        "{\"contentType\":\"registerBatchWriteMsg\",\"resTopic\":\"res/batch\",\"sessionId\":\"b1\",\"requests\":["
+        "{\"parameter\":\"c3\",\"requestedValue\":1},{\"parameter\":\"c0\",\"requestedValue\":1},"
+        "{\"parameter\":\"c1\",\"requestedValue\":0},{\"parameter\":\"c2\",\"requestedValue\":0}]}");
+    Sim.RunFor(100000);
+    CHECK(Sim.RunUntil(commandIdle, 5 * SECONDS));
+    CHECK_EQ(RtuBus.transactions - transactions, 1);
+    CHECK_EQ(slave->writes, 2);
+    CHECK_EQ(slave->writeLog.size(), 5);
+    for (size_t i = 1; i < slave->writeLog.size(); i++)
+    {
+        CHECK_EQ(slave->writeLog[i].table, SIM_COILS);
+        CHECK_EQ(slave->writeLog[i].address, FIRST_COMMAND_ADDRESS + i - 1);
+    }
+    CHECK_EQ(slave->Get(SIM_COILS, FIRST_COMMAND_ADDRESS), 1);
+    CHECK_EQ(slave->Get(SIM_COILS, FIRST_COMMAND_ADDRESS + 2), 0);
+    CHECK_EQ(slave->Get(SIM_COILS, FIRST_COMMAND_ADDRESS + 3), 1);
+    response = Broker.Last("res/batch");
+    CHECK(response != nullptr && response->payload.find("\"result\":\"written\"") != std::string::npos);
+
+    //a coil only accepts 0 or 1, and only from a coilWriteMsg
+    transactions = RtuBus.transactions;
+    Sim.Command("cmd/vfdctl/vfd1/c0/config", "{\"contentType\":\"coilWriteMsg\",\"requestedValue\":2}");
+    Sim.Command("cmd/vfdctl/vfd1/c1/config", "{\"contentType\":\"registerWriteMsg\",\"requestedValue\":1}");
+    Sim.RunFor(100000);
+    CHECK(Sim.RunUntil(commandIdle, 5 * SECONDS));
+    CHECK_EQ(RtuBus.transactions - transactions, 0);
+    CHECK_EQ(slave->writes, 2);
+}
+
+int main()
+{
+    int failures = 0;
+    failures += SCENARIO(coilsReadPacked);
+    failures += SCENARIO(discreteInputsReadPacked);
+    failures += SCENARIO(onlyChangedBitsPublished);
+    failures += SCENARIO(coilWritesUseCoilFunctions);
+    return failures;
+}
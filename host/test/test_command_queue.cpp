@@ -0,0 +1,144 @@
+#include "Check.h"
+#include "../app/Harness.h"
+#include "../app/SyntheticConfig.h"
+#include "../../app/src/CommandQueue.h"
+#include "../sim/FakeBroker.h"
+#include "../sim/SimulatedBus.h"
+#include <string.h>
+#include <string>
+
+#define SECONDS 1000000ULL
+//c0 is holding register 1000 of slave 1, 999 on the wire with the offset of -1
+#define FIRST_COMMAND_ADDRESS 999
+
+Command singleWrite(uint16_t registerIndex, int32_t value, const char* sessionId)
+{
+    Command cmd;
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.content_type = eContentType::register_write;
+    cmd.write_count = 1;
+    cmd.writes[0] = CommandWrite{registerIndex, value};
+    strlcpy(cmd.session_id, sessionId, sizeof(cmd.session_id));
+    return cmd;
+}
+
+bool commandIdle()
+{
+    return App.IsCommandIdle();
+}
+
+//a second write to a pending register replaces it in place and hands the replaced command back
+void writesToOneRegisterCoalesce()
+{
+    CommandQueue queue;
+    Command first = singleWrite(3, 10, "s1");
+    Command other = singleWrite(4, 20, "s2");
+    Command second = singleWrite(3, 30, "s3");
+    CHECK_EQ(queue.Push(&first), static_cast<int>(CommandQueueErrors::SUCCESS));
+    CHECK_EQ(queue.Push(&other), static_cast<int>(CommandQueueErrors::SUCCESS));
+    CHECK_EQ(queue.Push(&second), static_cast<int>(CommandQueueErrors::COALESCED));
+    CHECK_EQ(second.writes[0].value, 10);
+    CHECK(strcmp(second.session_id, "s1") == 0);
+    CHECK_EQ(queue.GetDepth(), 2);
+    CHECK_EQ(queue.GetCoalesceCount(), 1);
+
+    //the newer value kept the older one's place in line
+    Command popped;
+    CHECK(queue.Pop(&popped));
+    CHECK_EQ(popped.writes[0].register_index, 3);
+    CHECK_EQ(popped.writes[0].value, 30);
+    CHECK(strcmp(popped.session_id, "s3") == 0);
+    CHECK(queue.Pop(&popped));
+    CHECK_EQ(popped.writes[0].register_index, 4);
+    CHECK(queue.IsEmpty());
+    CHECK_EQ(queue.GetMaxDepth(), 2);
+}
+
+//a pending batch touching the register must still run before a later single write
+void batchIsABarrier()
+{
+    CommandQueue queue;
+    Command first = singleWrite(3, 10, "s1");
+    Command batch = singleWrite(3, 0, "b1");
+    batch.content_type = eContentType::register_batch_write;
+    batch.write_count = 2;
+    batch.writes[1] = CommandWrite{5, 50};
+    Command second = singleWrite(3, 30, "s2");
+    Command coil = singleWrite(3, 1, "s3");
+    coil.content_type = eContentType::coil_write;
+    CHECK_EQ(queue.Push(&first), static_cast<int>(CommandQueueErrors::SUCCESS));
+    CHECK_EQ(queue.Push(&batch), static_cast<int>(CommandQueueErrors::SUCCESS));
+    CHECK_EQ(queue.Push(&second), static_cast<int>(CommandQueueErrors::SUCCESS));
+    //only writes of the same kind replace each other
+    CHECK_EQ(queue.Push(&coil), static_cast<int>(CommandQueueErrors::SUCCESS));
+    CHECK_EQ(queue.GetDepth(), 4);
+    CHECK_EQ(queue.GetCoalesceCount(), 0);
+}
+
+//a full queue still coalesces, anything new is dropped and counted
+void fullQueueDrops()
+{
+    CommandQueue queue;
+    for (int i = 0; i < COMMAND_QUEUE_CAPACITY; i++)
+    {
+        Command cmd = singleWrite(i, i, "s");
+        CHECK_EQ(queue.Push(&cmd), static_cast<int>(CommandQueueErrors::SUCCESS));
+    }
+    Command extra = singleWrite(COMMAND_QUEUE_CAPACITY, 0, "s");
+    CHECK_EQ(queue.Push(&extra), static_cast<int>(CommandQueueErrors::QUEUE_FULL));
+    Command repeat = singleWrite(0, 99, "s");
+    CHECK_EQ(queue.Push(&repeat), static_cast<int>(CommandQueueErrors::COALESCED));
+    CHECK_EQ(queue.GetDropCount(), 1);
+    CHECK_EQ(queue.GetDepth(), COMMAND_QUEUE_CAPACITY);
+}
+
+//two writes to c0 arriving in one pass reach the bus once, the first requester is told it was superseded
+void supersededWriteIsAnswered()
+{
+    SyntheticOptions options;
+    options.registers = 4;
+    options.commands = 4;
+    options.telemetryIntervalSec = 60;
+    CHECK(Sim.CreateCard());
+    CHECK(Sim.WriteFile("conf.txt", buildSyntheticConfig(options)));
+    Sim.Boot();
+    CHECK(Sim.RunCycles(1, 90 * SECONDS));
+    CHECK(App.IsRemoteConnected());
+
+    Sim.Command("cmd/vfdctl/vfd1/c0/config",
+        "{\"contentType\":\"registerWriteMsg\",\"requestedValue\":40,\"resTopic\":\"res/first\",\"sessionId\":\"s1\"}");
+    Sim.Command("cmd/vfdctl/vfd1/c0/config",
+        "{\"contentType\":\"registerWriteMsg\",\"requestedValue\":75,\"resTopic\":\"res/second\",\"sessionId\":\"s2\"}");
+    Sim.RunFor(100000);
+    CHECK(Sim.RunUntil(commandIdle, 5 * SECONDS));
+
+    SimSlave* slave = Sim.Slave(1);
+    CHECK_EQ(slave->writes, 1);
+    CHECK_EQ(slave->Get(SIM_HOLDING_REGISTERS, FIRST_COMMAND_ADDRESS), 75);
+    CHECK_EQ(CommandQ.GetCoalesceCount(), 1);
+
+    const BrokerMessage* first = Broker.Last("res/first");
+    CHECK(first != nullptr);
+    if (first != nullptr){
+        CHECK(first->payload.find("\"result\":\"superseded\"") != std::string::npos);
+        CHECK(first->payload.find("\"sessionId\":\"s1\"") != std::string::npos);
+        CHECK(first->payload.find("\"requestedValue\":40") != std::string::npos);
+    }
+    const BrokerMessage* second = Broker.Last("res/second");
+    CHECK(second != nullptr);
+    if (second != nullptr){
+        CHECK(second->payload.find("\"sessionId\":\"s2\"") != std::string::npos);
+        CHECK(second->payload.find("\"actualValue\":75") != std::string::npos);
+    }
+    CHECK_EQ(Broker.Find("res/#").size(), 2);
+}
+
+int main()
+{
+    int failures = 0;
+    failures += SCENARIO(writesToOneRegisterCoalesce);
+    failures += SCENARIO(batchIsABarrier);
+    failures += SCENARIO(fullQueueDrops);
+    failures += SCENARIO(supersededWriteIsAnswered);
+    return failures;
+}
@@ -0,0 +1,266 @@
+#include "Check.h"
+#include "../app/SyntheticConfig.h"
+#include "../gateway/Gateway.h"
+#include "../sim/PtyBus.h"
+#include "../sim/SimSlave.h"
+#include "../sim/TcpBroker.h"
+#include <stdlib.h>
+#include <string>
+#include <unistd.h>
+
+//the gateway end to end: each bus is a pty pair with simulated slaves behind it, the broker listens on loopback
+#define MAX_BUSES 4
+#define MAX_SLAVES 8
+//wire address of the first telemetry and command register, the synthetic configuration has an offset of -1
+#define FIRST_ADDRESS 199
+#define FIRST_COMMAND_ADDRESS 999
+//character time at 115200 baud, 8N1
+#define CHAR_MICROS 87
+
+TcpBroker broker;
+PtyBus buses[MAX_BUSES];
+SimSlave* slaves[MAX_SLAVES];
+//holds conf.txt and the snapshot the gateway writes next to it
+char configDir[] = "/tmp/vfdctl_gatewayXXXXXX";
+
+//start the broker, the buses and their slaves, then the gateway on a conf.txt built from options
+void startGateway(SyntheticOptions& options)
+{
+    CHECK(broker.Start());
+    options.brokerUrl = "127.0.0.1";
+    options.brokerPort = broker.GetPort();
+    options.baudRate = 115200;
+    options.journal = false;
+
+    const char* ports[MAX_BUSES];
+    for (int bus = 0; bus < options.buses; bus++)
+    {
+        CHECK(buses[bus].Open());
+        buses[bus].SetCharMicros(CHAR_MICROS);
+        ports[bus] = buses[bus].GetPath();
+    }
+    for (int id = 1; id <= options.devices; id++)
+    {
+        slaves[id - 1] = new SimSlave(id);
+        slaves[id - 1]->latencyMicros = 500;
+        buses[(id - 1) % options.buses].Attach(slaves[id - 1]);
+    }
+    for (int bus = 0; bus < options.buses; bus++)
+    {
+        buses[bus].Start();
+    }
+
+    CHECK(mkdtemp(configDir) != nullptr);
+    std::string path = std::string(configDir) + "/conf.txt";
+    FILE* file = fopen(path.c_str(), "w");
+    CHECK(file != nullptr);
+    std::string config = buildSyntheticConfig(options);
+    fwrite(config.data(), 1, config.size(), file);
+    fclose(file);
+
+    CHECK_EQ(LinuxGateway.Begin(path.c_str(), ports, options.buses), 0);
+    LinuxGateway.Start();
+    for (int waited = 0; waited < 5000 && broker.GetSubscriberCount() == 0; waited++)
+    {
+        usleep(1000);
+    }
+    CHECK(LinuxGateway.IsConnected());
+}
+
+void stopGateway(int busCount)
+{
+    LinuxGateway.Stop();
+    for (int bus = 0; bus < busCount; bus++)
+    {
+        buses[bus].Stop();
+    }
+    broker.Stop();
+    std::string command = std::string("rm -rf ") + configDir;
+    CHECK_EQ(system(command.c_str()), 0);
+}
+
+//value of a slave's holding register, read under its bus's lock while the bus runs
+uint16_t slaveValue(int id, uint16_t address, int busCount)
+{
+    std::lock_guard<std::mutex> guard(buses[(id - 1) % busCount].lock);
+    return slaves[id - 1]->Get(SIM_HOLDING_REGISTERS, address);
+}
+
+unsigned long slaveWrites(int id, int busCount)
+{
+    std::lock_guard<std::mutex> guard(buses[(id - 1) % busCount].lock);
+    return slaves[id - 1]->writes;
+}
+
+bool hasResult(const BrokerMessage& response, const char* parameter, const char* result)
+{
+    char text[96];
+    snprintf(text, sizeof(text), "\"parameter\":\"%s\",", parameter);
+    size_t at = response.payload.find(text);
+    snprintf(text, sizeof(text), "\"result\":\"%s\"", result);
+    return at != std::string::npos && response.payload.find(text, at) == response.payload.find("\"result\"", at);
+}
+
+//every register of every bus reaches the broker on its own topic with the value read from its slave
+void telemetryFromEveryBus()
+{
+    SyntheticOptions options;
+    options.buses = 3;
+    options.devices = 3;
+    options.registers = 9;
+    options.commands = 0;
+    startGateway(options);
+    //the first cycle may read zeros, the next ones publish these
+    for (int i = 0; i < 9; i++)
+    {
+        std::lock_guard<std::mutex> guard(buses[i % 3].lock);
+        slaves[i % 3]->Set(SIM_HOLDING_REGISTERS, FIRST_ADDRESS + i / 3, 100 + i);
+    }
+    for (int i = 0; i < 9; i++)
+    {
+        char filter[32];
+        snprintf(filter, sizeof(filter), "dt/vfdctl/vfd%d/r%d", 1 + i % 3, i);
+        char value[32];
+        snprintf(value, sizeof(value), "\"value\":%d", 100 + i);
+        bool seen = false;
+        for (int waited = 0; waited < 50 && !seen; waited++)
+        {
+            for (const BrokerMessage& message : broker.Find(filter))
+            {
+                seen = seen || message.payload.find(value) != std::string::npos;
+            }
+            if (!seen){
+                usleep(100000);
+            }
+        }
+        CHECK(seen);
+    }
+    for (int bus = 0; bus < 3; bus++)
+    {
+        CHECK_EQ(LinuxGateway.GetBus(bus)->GetRegisterCount(), 3);
+        CHECK(LinuxGateway.GetBus(bus)->stats.reads > 0);
+        CHECK_EQ(LinuxGateway.GetBus(bus)->stats.read_errors, 0);
+        CHECK(buses[bus].requests > 0);
+    }
+    stopGateway(3);
+}
+
+//a register write is written by the thread of the bus its slave is on and answered on resTopic
+void commandRoutedToOwningBus()
+{
+    SyntheticOptions options;
+    options.buses = 3;
+    options.devices = 3;
+    options.registers = 3;
+    options.commands = 6;
+    startGateway(options);
+    //c1 is the first command register of slave 2, on bus 1
+    broker.Publish("cmd/vfdctl/vfd2/c1/config",
+        "{\"contentType\":\"registerWriteMsg\",\"requestedValue\":75,\"resTopic\":\"res/test\",\"sessionId\":\"s1\"}");
+    CHECK(broker.WaitFor("res/test", 1, 5000));
+    std::vector<BrokerMessage> responses = broker.Find("res/test");
+    CHECK(!responses.empty() && responses[0].payload.find("75") != std::string::npos);
+    CHECK(!responses.empty() && responses[0].payload.find("s1") != std::string::npos);
+    CHECK_EQ(slaveValue(2, FIRST_COMMAND_ADDRESS, 3), 75);
+    CHECK_EQ(slaveWrites(1, 3), 0);
+    CHECK_EQ(slaveWrites(2, 3), 1);
+    CHECK_EQ(slaveWrites(3, 3), 0);
+    CHECK_EQ(LinuxGateway.GetBus(1)->stats.writes, 1);
+    CHECK_EQ(LinuxGateway.stats.commands, 1);
+    stopGateway(3);
+}
+
+//consecutive registers of a batch go out as one write multiple registers request
+void batchWriteGroupsRegisters()
+{
+    SyntheticOptions options;
+    options.buses = 2;
+    options.devices = 2;
+    options.registers = 2;
+    options.commands = 6;
+    startGateway(options);
+    //c0, c2 and c4 are consecutive registers of slave 1
+    broker.Publish("cmd/vfdctl/vfd1/config",
+        "{\"contentType\":\"registerBatchWriteMsg\",\"resTopic\":\"res/batch\",\"sessionId\":\"b1\",\"requests\":["
+        "{\"parameter\":\"c4\",\"requestedValue\":12},{\"parameter\":\"c0\",\"requestedValue\":10},{\"parameter\":\"c2\",\"requestedValue\":11}]}");
+    CHECK(broker.WaitFor("res/batch", 1, 5000));
+    std::vector<BrokerMessage> responses = broker.Find("res/batch");
+    CHECK(!responses.empty());
+    if (!responses.empty()){
+        CHECK(hasResult(responses[0], "c0", "written"));
+        CHECK(hasResult(responses[0], "c2", "written"));
+        CHECK(hasResult(responses[0], "c4", "written"));
+    }
+    CHECK_EQ(slaveWrites(1, 2), 1);
+    for (int k = 0; k < 3; k++)
+    {
+        CHECK_EQ(slaveValue(1, FIRST_COMMAND_ADDRESS + k, 2), 10 + k);
+    }
+    stopGateway(2);
+}
+
+//an out of range value never reaches the bus, an all or nothing batch holding one is answered without writing
+void outOfRangeIsRejected()
+{
+    SyntheticOptions options;
+    options.buses = 2;
+    options.devices = 2;
+    options.registers = 2;
+    options.commands = 4;
+    startGateway(options);
+    broker.Publish("cmd/vfdctl/vfd1/c0/config",
+        "{\"contentType\":\"registerWriteMsg\",\"requestedValue\":5000,\"resTopic\":\"res/single\",\"sessionId\":\"s1\"}");
+    broker.Publish("cmd/vfdctl/vfd1/config",
+        "{\"contentType\":\"registerBatchWriteMsg\",\"resTopic\":\"res/batch\",\"sessionId\":\"b1\",\"allOrNothing\":true,\"requests\":["
+        "{\"parameter\":\"c0\",\"requestedValue\":10},{\"parameter\":\"c2\",\"requestedValue\":5000}]}");
+    CHECK(broker.WaitFor("res/batch", 1, 5000));
+    std::vector<BrokerMessage> responses = broker.Find("res/batch");
+    if (!responses.empty()){
+        CHECK(hasResult(responses[0], "c0", "skipped"));
+        CHECK(hasResult(responses[0], "c2", "out_of_range"));
+    }
+    CHECK_EQ(broker.Count("res/single"), 0);
+    CHECK_EQ(slaveWrites(1, 2), 0);
+    CHECK_EQ(LinuxGateway.GetBus(0)->stats.writes, 0);
+    stopGateway(2);
+}
+
+//a slave that stops answering only slows its own bus, the other bus keeps its rate
+void offlineSlaveStaysOnItsBus()
+{
+    SyntheticOptions options;
+    options.buses = 2;
+    options.devices = 2;
+    options.registers = 4;
+    options.commands = 0;
+    options.telemetryIntervalSec = 0;
+    options.rtuTimeoutMs = 50;
+    startGateway(options);
+    {
+        std::lock_guard<std::mutex> guard(buses[1].lock);
+        slaves[1]->online = false;
+    }
+    usleep(300000);
+    unsigned long healthy = LinuxGateway.GetBus(0)->stats.cycles;
+    unsigned long stalled = LinuxGateway.GetBus(1)->stats.cycles;
+    usleep(1000000);
+    healthy = LinuxGateway.GetBus(0)->stats.cycles - healthy;
+    stalled = LinuxGateway.GetBus(1)->stats.cycles - stalled;
+    CHECK(LinuxGateway.GetBus(1)->stats.read_errors > 0);
+    CHECK_EQ(LinuxGateway.GetBus(0)->stats.read_errors, 0);
+    //a healthy cycle is two short reads, a stalled one waits out the 50 ms timeout
+    CHECK(healthy > 10 * stalled);
+    CHECK(broker.Count("dt/vfdctl/vfd1/#") > 0);
+    stopGateway(2);
+}
+
+int main()
+{
+    int failures = 0;
+    failures += SCENARIO(telemetryFromEveryBus);
+    failures += SCENARIO(commandRoutedToOwningBus);
+    failures += SCENARIO(batchWriteGroupsRegisters);
+    failures += SCENARIO(outOfRangeIsRejected);
+    failures += SCENARIO(offlineSlaveStaysOnItsBus);
+    return failures;
+}
@@ -0,0 +1,157 @@
+#include "Check.h"
+#include "../app/Harness.h"
+#include "../app/SyntheticConfig.h"
+#include "../sim/AllocCounter.h"
+#include "../sim/FakeBroker.h"
+#include "../sim/SimulatedBus.h"
+#include <stdio.h>
+
+#define SECONDS 1000000ULL
+
+//size of every allocation counted since the last reset, printed when a check fails
+size_t allocationSizes[16];
+int allocationCount;
+
+void recordAllocation(size_t size)
+{
+    if (allocationCount < 16){
+        allocationSizes[allocationCount] = size;
+    }
+    allocationCount++;
+}
+
+void startCounting()
+{
+    AllocCounter::Reset();
+    allocationCount = 0;
+    AllocCounter::SetHook(recordAllocation);
+}
+
+void expectNoAllocations(const char* what)
+{
+    uint64_t allocations = AllocCounter::GetAllocations();
+    CHECK_EQ(allocations, 0);
+    for (int i = 0; i < allocationCount && i < 16; i++)
+    {
+        fprintf(stderr, "%s: allocation of %zu bytes\n", what, allocationSizes[i]);
+    }
+}
+
+bool bootWarm(const SyntheticOptions* options)
+{
+    CHECK(Sim.CreateCard());
+    if (options == nullptr){
+        CHECK(Sim.CopyFile(repoPath("config-fr800.txt"), "conf.txt"));
+    }else{
+        CHECK(Sim.WriteFile("conf.txt", buildSyntheticConfig(*options)));
+    }
+    Sim.Boot();
+    CHECK(App.IsConfigLoaded());
+    //connection, schema and first publishes are allowed to set things up
+    bool warm = Sim.RunCycles(3, 60 * SECONDS);
+    CHECK(warm);
+    return warm;
+}
+
+//changing values are published every cycle without touching the heap
+uint16_t rampingValue(SimSlave* slave, int table, uint16_t address, uint64_t now)
+{
+    (void)slave;
+    (void)table;
+    return static_cast<uint16_t>(address + now / 100000);
+}
+
+void runTelemetry(const SyntheticOptions* options)
+{
+    if (!bootWarm(options)){
+        return;
+    }
+    Sim.Slave(1)->generator = rampingValue;
+    unsigned long sent = App.GetTelemetrySent();
+    startCounting();
+    CHECK(Sim.RunCycles(Sim.cycles + 20, 600 * SECONDS));
+    expectNoAllocations("telemetry");
+    CHECK(App.GetTelemetrySent() > sent);
+}
+
+void fr800TelemetryIsHeapFree()
+{
+    runTelemetry(nullptr);
+}
+
+void perDeviceMsgPackTelemetryIsHeapFree()
+{
+    SyntheticOptions options;
+    options.telemetryMode = "per_device";
+    options.payloadFormat = "msgpack";
+    options.sampleIntervalMs = 200;
+    runTelemetry(&options);
+}
+
+bool commandIdle()
+{
+    return App.IsCommandIdle();
+}
+
+//deliver a command and run until it has been answered
+void sendCommand(const char* topic, const char* payload)
+{
+    Sim.Command(topic, payload);
+    Sim.RunFor(100000);
+    CHECK(Sim.RunUntil(commandIdle, 5 * SECONDS));
+}
+
+//single writes, batches and their responses reuse fixed buffers
+void commandsAreHeapFree()
+{
+    SyntheticOptions options;
+    if (!bootWarm(&options)){
+        return;
+    }
+    startCounting();
+    char payload[256];
+    for (int i = 0; i < 10; i++)
+    {
+        snprintf(payload, sizeof(payload),
+            "{\"contentType\":\"registerWriteMsg\",\"requestedValue\":%d,\"resTopic\":\"res/heap\",\"sessionId\":\"s%d\"}", i, i);
+        sendCommand("cmd/vfdctl/vfd1/c0/config", payload);
+        snprintf(payload, sizeof(payload),
+            "{\"contentType\":\"registerBatchWriteMsg\",\"resTopic\":\"res/heap\",\"requests\":["
+            "{\"parameter\":\"c1\",\"requestedValue\":%d},{\"parameter\":\"c2\",\"requestedValue\":%d}]}", i, i + 1);
+        sendCommand("cmd/vfdctl/vfd1/config", payload);
+        //no sessionId, one is generated, and a value outside the limits is dropped without a write or response
+        sendCommand("cmd/vfdctl/vfd1/c3/config", "{\"contentType\":\"registerWriteMsg\",\"requestedValue\":2000,\"resTopic\":\"res/heap\"}");
+    }
+    expectNoAllocations("commands");
+    CHECK_EQ(Broker.Find("res/heap").size(), 20);
+    CHECK_EQ(Sim.Slave(1)->writeLog.size(), 30);
+}
+
+//buffered telemetry while the broker is away and its replay afterwards
+void outageIsHeapFree()
+{
+    SyntheticOptions options;
+    if (!bootWarm(&options)){
+        return;
+    }
+    Sim.Slave(1)->generator = rampingValue;
+    startCounting();
+    Broker.SetOnline(false);
+    Sim.RunFor(30 * SECONDS);
+    CHECK(!App.IsRemoteConnected());
+    Broker.SetOnline(true);
+    Sim.RunFor(60 * SECONDS);
+    CHECK(App.IsRemoteConnected());
+    expectNoAllocations("outage");
+    CHECK(App.GetTelemetryJournaled() > 0);
+}
+
+int main()
+{
+    int failures = 0;
+    failures += SCENARIO(fr800TelemetryIsHeapFree);
+    failures += SCENARIO(perDeviceMsgPackTelemetryIsHeapFree);
+    failures += SCENARIO(commandsAreHeapFree);
+    failures += SCENARIO(outageIsHeapFree);
+    return failures;
+}
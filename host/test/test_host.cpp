@@ -0,0 +1,67 @@
+#include "Check.h"
+#include "../app/Harness.h"
+#include "../sim/FakeBroker.h"
+#include "../sim/SimClock.h"
+#include "../sim/SimulatedBus.h"
+
+//simulated time, the telemetry interval of config-fr800.txt is the 10 s default
+#define SECONDS 1000000ULL
+
+void bootFr800()
+{
+    CHECK(Sim.CreateCard());
+    CHECK(Sim.CopyFile(repoPath("config-fr800.txt"), "conf.txt"));
+    Sim.Boot();
+}
+
+//the shipped configuration loads, connects and publishes every telemetry register on the first cycle
+void fr800PublishesEveryRegister()
+{
+    bootFr800();
+    CHECK(App.IsConfigLoaded());
+    CHECK_EQ(App.GetConfig()->modbus.registers.count, 10);
+    CHECK_EQ(App.GetConfig()->modbus.configuration_register_count, 11);
+    CHECK(Sim.RunCycles(1, 30 * SECONDS));
+    CHECK(App.IsRemoteConnected());
+    CHECK_EQ(Broker.Find("dt/vfdctl/vfd1/+").size(), 10);
+    CHECK_EQ(App.GetTelemetrySent(), 10);
+    //registers 201-208 and 213 are two block reads with max_read_gap 4
+    CHECK_EQ(RtuBus.transactions, 2);
+}
+
+bool commandIdle()
+{
+    return App.IsCommandIdle();
+}
+
+//a register write sent to the broker reaches the slave and is answered on resTopic
+void commandReachesSlave()
+{
+    bootFr800();
+    CHECK(Sim.RunCycles(1, 30 * SECONDS));
+    Sim.Command("cmd/vfdctl/vfd1/ratedhp/config",
+        "{\"contentType\":\"registerWriteMsg\",\"requestedValue\":75,\"resTopic\":\"res/test\",\"sessionId\":\"s1\"}");
+    Sim.RunFor(100000);
+    CHECK(Sim.RunUntil(commandIdle, SECONDS));
+    SimSlave* slave = Sim.Slave(1);
+    CHECK(slave != nullptr);
+    CHECK_EQ(slave->writeLog.size(), 1);
+    if (!slave->writeLog.empty()){
+        //address 1080 with the configuration's offset of -1
+        CHECK_EQ(slave->writeLog[0].address, 1079);
+        CHECK_EQ(slave->writeLog[0].value, 75);
+    }
+    const BrokerMessage* response = Broker.Last("res/test");
+    CHECK(response != nullptr);
+    if (response != nullptr){
+        CHECK(response->payload.find("\"actualValue\":75") != std::string::npos);
+    }
+}
+
+int main()
+{
+    int failures = 0;
+    failures += SCENARIO(fr800PublishesEveryRegister);
+    failures += SCENARIO(commandReachesSlave);
+    return failures;
+}
@@ -0,0 +1,242 @@
+#include "Check.h"
+#include "../app/Harness.h"
+#include "../app/SyntheticConfig.h"
+#include "../../app/src/ModbusTcpTransport.h"
+#include "../sim/FakeBroker.h"
+#include "../sim/SimClock.h"
+#include "../sim/SimNetwork.h"
+#include "../sim/SimTcpSlave.h"
+#include <string.h>
+
+#define SECONDS 1000000ULL
+#define SLAVE_ID 7
+#define SLAVE_HOST "192.168.1.40"
+#define FIRST_ADDRESS 100
+
+//the transport on its own against one simulated slave, the firmware is not booted
+ModbusConfiguration modbus;
+SimTcpSlave server(SLAVE_ID);
+
+void beginTransport(int maxInflight, int timeoutMs)
+{
+    ModbusDeviceTransport* device = &modbus.devices[0];
+    device->device_id = SLAVE_ID;
+    device->transport = eModbusTransport::transport_tcp;
+    strlcpy(device->host, SLAVE_HOST, sizeof(device->host));
+    device->port = 502;
+    device->max_inflight = maxInflight;
+    device->timeout_ms = timeoutMs;
+    modbus.device_count = 1;
+    server.Start(SLAVE_HOST, 502);
+    for (int i = 0; i < 16; i++)
+    {
+        server.slave.Set(SIM_HOLDING_REGISTERS, FIRST_ADDRESS + i, 1000 + i);
+    }
+    CHECK_EQ(ModbusTcp.Begin(modbus), 1);
+    CHECK(ModbusTcp.IsTcp(SLAVE_ID));
+}
+
+//poll until a transaction completes, false if none did within timeoutMicros
+bool pollFor(ModbusTcpResponse* response, uint64_t timeoutMicros)
+{
+    uint64_t until = Clock.Micros() + timeoutMicros;
+    while (Clock.Micros() <= until)
+    {
+        if (ModbusTcp.Poll(response)){
+            return true;
+        }
+        Clock.Advance(100);
+    }
+    return false;
+}
+
+//a read of two registers at FIRST_ADDRESS + 2 * tag, answered with the values set by beginTransport
+void requestPair(int tag)
+{
+    CHECK_EQ(ModbusTcp.RequestRead(SLAVE_ID, eRegisterType::holding_register, FIRST_ADDRESS + 2 * tag, 2, tag),
+        static_cast<int>(ModbusTcpErrors::SUCCESS));
+}
+
+void checkPair(const ModbusTcpResponse& response)
+{
+    CHECK_EQ(response.result, static_cast<int>(ModbusTcpErrors::SUCCESS));
+    CHECK_EQ(response.count, 2);
+    if (response.count == 2){
+        CHECK_EQ(response.values[0], 1000 + 2 * response.tag);
+        CHECK_EQ(response.values[1], 1001 + 2 * response.tag);
+    }
+}
+
+//max_inflight reads go out back to back and come back within one slave latency, a write still fits behind them
+void pipelinedReads()
+{
+    beginTransport(4, 1000);
+    server.concurrency = 4;
+    server.slave.latencyMicros = 5000;
+    uint64_t start = Clock.Micros();
+    for (int tag = 0; tag < 4; tag++)
+    {
+        requestPair(tag);
+    }
+    CHECK_EQ(ModbusTcp.GetInFlight(), 4);
+    CHECK_EQ(server.requests, 4);
+    CHECK_EQ(ModbusTcp.RequestRead(SLAVE_ID, eRegisterType::holding_register, FIRST_ADDRESS, 1, 9),
+        static_cast<int>(ModbusTcpErrors::TCP_BUSY));
+    uint16_t value = 55;
+    CHECK_EQ(ModbusTcp.RequestWrite(SLAVE_ID, eRegisterType::holding_register, FIRST_ADDRESS + 15, &value, 1, 8),
+        static_cast<int>(ModbusTcpErrors::SUCCESS));
+
+    bool seen[9] = {};
+    ModbusTcpResponse response;
+    for (int n = 0; n < 5; n++)
+    {
+        CHECK(pollFor(&response, 100000));
+        CHECK(response.tag >= 0 && response.tag <= 8 && !seen[response.tag]);
+        seen[response.tag] = true;
+        if (response.tag < 4){
+            checkPair(response);
+        }else{
+            CHECK_EQ(response.result, static_cast<int>(ModbusTcpErrors::SUCCESS));
+        }
+    }
+    CHECK(seen[0] && seen[1] && seen[2] && seen[3] && seen[8]);
+    CHECK_EQ(ModbusTcp.GetInFlight(), 0);
+    CHECK_EQ(server.slave.Get(SIM_HOLDING_REGISTERS, FIRST_ADDRESS + 15), 55);
+    //one slave latency and the round trip, not five of them
+    CHECK(Clock.Micros() - start < 2 * server.slave.latencyMicros);
+}
+
+//responses are matched by transaction id, not by the order they arrive in
+void outOfOrderResponses()
+{
+    beginTransport(4, 1000);
+    server.concurrency = 4;
+    server.reorder = 3;
+    for (int tag = 0; tag < 3; tag++)
+    {
+        requestPair(tag);
+    }
+    ModbusTcpResponse response;
+    for (int expected = 2; expected >= 0; expected--)
+    {
+        CHECK(pollFor(&response, 100000));
+        CHECK_EQ(response.tag, expected);
+        checkPair(response);
+    }
+    CHECK_EQ(ModbusTcp.GetInFlight(), 0);
+}
+
+//an unanswered request fails after the slave's timeout, a late answer to it is dropped
+void timeoutAndLateResponse()
+{
+    beginTransport(4, 100);
+    server.slave.latencyMicros = 150000;
+    uint64_t start = Clock.Micros();
+    requestPair(0);
+    ModbusTcpResponse response;
+    CHECK(pollFor(&response, 200000));
+    CHECK_EQ(response.tag, 0);
+    CHECK_EQ(response.result, static_cast<int>(ModbusTcpErrors::TCP_TIMEOUT));
+    CHECK(Clock.Micros() - start >= 100000);
+    CHECK(Clock.Micros() - start < 150000);
+    CHECK_EQ(ModbusTcp.GetInFlight(), 0);
+
+    //the next request waits behind the late response, which is read and thrown away
+    server.slave.latencyMicros = 1000;
+    requestPair(1);
+    CHECK(pollFor(&response, 200000));
+    CHECK_EQ(response.tag, 1);
+    checkPair(response);
+    CHECK(!ModbusTcp.Poll(&response));
+
+    //a slave that swallows the request
+    server.slave.timeoutsPending = 1;
+    requestPair(2);
+    CHECK(pollFor(&response, 200000));
+    CHECK_EQ(response.tag, 2);
+    CHECK_EQ(response.result, static_cast<int>(ModbusTcpErrors::TCP_TIMEOUT));
+}
+
+//a dropped connection fails what was in flight, the slave is retried after MODBUS_TCP_RETRY_MS
+void reconnectAfterDrop()
+{
+    beginTransport(4, 1000);
+    requestPair(0);
+    CHECK_EQ(Network.connects, 1);
+    //the answer is never sent, the slave goes away with the request in flight
+    server.slave.timeoutsPending = 1;
+    requestPair(1);
+    ModbusTcpResponse response;
+    CHECK(pollFor(&response, 100000));
+    checkPair(response);
+    server.Stop();
+    CHECK(pollFor(&response, 100000));
+    CHECK_EQ(response.tag, 1);
+    CHECK_EQ(response.result, static_cast<int>(ModbusTcpErrors::TCP_NOT_CONNECTED));
+
+    //nothing listens, the attempt fails and the next one waits for the retry interval
+    CHECK_EQ(ModbusTcp.RequestRead(SLAVE_ID, eRegisterType::holding_register, FIRST_ADDRESS, 2, 2),
+        static_cast<int>(ModbusTcpErrors::TCP_NOT_CONNECTED));
+    unsigned long failed = Network.failedConnects;
+    server.Start(SLAVE_HOST, 502);
+    CHECK_EQ(ModbusTcp.RequestRead(SLAVE_ID, eRegisterType::holding_register, FIRST_ADDRESS, 2, 2),
+        static_cast<int>(ModbusTcpErrors::TCP_NOT_CONNECTED));
+    CHECK_EQ(Network.failedConnects, failed);
+    CHECK_EQ(Network.connects, 1);
+
+    Clock.Advance(MODBUS_TCP_RETRY_MS * 1000ULL);
+    requestPair(3);
+    CHECK_EQ(Network.connects, 2);
+    CHECK(pollFor(&response, 100000));
+    CHECK_EQ(response.tag, 3);
+    checkPair(response);
+}
+
+bool telemetryFromTcpSlave()
+{
+    return Broker.Last("dt/vfdctl/vfd2/r1") != nullptr;
+}
+
+//end to end, a tcp slave going offline fails its reads without holding up the rtu slave, and is polled again once back
+void firmwareRecoversTcpSlave()
+{
+    SyntheticOptions options;
+    options.devices = 2;
+    options.tcpDevices = 1;
+    options.registers = 4;
+    options.commands = 0;
+    CHECK(Sim.CreateCard());
+    CHECK(Sim.WriteFile("conf.txt", buildSyntheticConfig(options)));
+    Sim.Boot();
+    CHECK(Sim.RunUntil(telemetryFromTcpSlave, 30 * SECONDS));
+    SimSlave* tcp = Sim.Slave(2);
+    CHECK(tcp != nullptr);
+    if (tcp == nullptr){
+        return;
+    }
+
+    tcp->online = false;
+    Sim.RunFor(10 * SECONDS);
+    size_t rtuPublished = Broker.Find("dt/vfdctl/vfd1/#").size();
+    size_t tcpPublished = Broker.Find("dt/vfdctl/vfd2/#").size();
+    tcp->Set(SIM_HOLDING_REGISTERS, 199, 4242);
+    Sim.RunFor(10 * SECONDS);
+    CHECK(Broker.Find("dt/vfdctl/vfd1/#").size() > rtuPublished);
+    CHECK_EQ(Broker.Find("dt/vfdctl/vfd2/#").size(), tcpPublished);
+
+    tcp->online = true;
+    Sim.RunFor(30 * SECONDS);
+    const BrokerMessage* message = Broker.Last("dt/vfdctl/vfd2/r1");
+    CHECK(message != nullptr && message->payload.find("\"value\":4242") != std::string::npos);
+}
+
+int main()
+{
+    int failures = 0;
+    failures += SCENARIO(pipelinedReads);
+    failures += SCENARIO(outOfOrderResponses);
+    failures += SCENARIO(timeoutAndLateResponse);
+    failures += SCENARIO(reconnectAfterDrop);
+    failures += SCENARIO(firmwareRecoversTcpSlave);
+    return failures;
+}
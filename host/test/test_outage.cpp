@@ -0,0 +1,121 @@
+#include "Check.h"
+#include "../app/Harness.h"
+#include "../app/SyntheticConfig.h"
+#include "../../app/src/RemoteConnectionManager.h"
+#include "../sim/FakeBroker.h"
+#include "../sim/SimClock.h"
+#include "../sim/SimNetwork.h"
+#include <vector>
+
+#define SECONDS 1000000ULL
+
+void bootOnline(const SyntheticOptions& options)
+{
+    CHECK(Sim.CreateCard());
+    CHECK(Sim.WriteFile("conf.txt", buildSyntheticConfig(options)));
+    Sim.Boot();
+    CHECK(Sim.RunCycles(2, 30 * SECONDS));
+    CHECK(App.IsRemoteConnected());
+}
+
+//Clock time of every refused connection attempt made while running for micros
+std::vector<uint64_t> runRecordingAttempts(uint64_t micros)
+{
+    std::vector<uint64_t> attempts;
+    uint64_t until = Clock.Micros() + micros;
+    unsigned long failed = Network.failedConnects;
+    while (Clock.Micros() < until)
+    {
+        uint64_t before = Clock.Micros();
+        Sim.Step();
+        if (Network.failedConnects != failed){
+            failed = Network.failedConnects;
+            attempts.push_back(before);
+        }
+    }
+    return attempts;
+}
+
+//polling keeps its rate while the broker is down, values are journaled instead
+void pollingContinuesOffline()
+{
+    SyntheticOptions options;
+    bootOnline(options);
+    unsigned long cycles = Sim.cycles;
+    unsigned long journaled = App.GetTelemetryJournaled();
+    Broker.SetOnline(false);
+    Sim.ResetLoopStats();
+    std::vector<uint64_t> attempts = runRecordingAttempts(120 * SECONDS);
+    CHECK(!App.IsRemoteConnected());
+    CHECK(!attempts.empty());
+    //one cycle a second, less the few seconds spent in connection attempts
+    CHECK(Sim.cycles - cycles >= 110);
+    CHECK(App.GetTelemetryJournaled() > journaled);
+    //no pass blocks longer than one bounded connection attempt plus a block read
+    CHECK(Sim.loopStats.worstMicros < REMOTE_CONNECT_TIMEOUT_MS * 1000ULL + 200000);
+}
+
+//attempts back off exponentially with jitter and settle at broker_retry_interval_sec
+void reconnectBacksOff()
+{
+    SyntheticOptions options;
+    options.brokerRetryIntervalSec = 30;
+    bootOnline(options);
+    Broker.SetOnline(false);
+    std::vector<uint64_t> attempts = runRecordingAttempts(600 * SECONDS);
+    CHECK(attempts.size() >= 10);
+    //30 s cap, minus up to half of it for jitter, plus the attempt itself
+    CHECK(attempts.size() <= 600 / 15 + 6);
+    for (size_t i = 1; i < attempts.size(); i++)
+    {
+        uint64_t gap = attempts[i] - attempts[i - 1];
+        CHECK(gap <= 31 * SECONDS + REMOTE_CONNECT_TIMEOUT_MS * 1000ULL);
+        if (i >= 8){
+            CHECK(gap >= 15 * SECONDS);
+        }
+    }
+    if (attempts.size() >= 3){
+        CHECK(attempts[2] - attempts[1] < 5 * SECONDS);
+    }
+}
+
+bool remoteConnected()
+{
+    return App.IsRemoteConnected();
+}
+
+//the broker coming back is picked up within one retry interval and nothing is lost
+void reconnectsWhenBrokerReturns()
+{
+    SyntheticOptions options;
+    options.brokerRetryIntervalSec = 20;
+    bootOnline(options);
+    Broker.SetOnline(false);
+    Sim.RunFor(90 * SECONDS);
+    unsigned long publishes = Broker.publishes;
+    Broker.SetOnline(true);
+    CHECK(Sim.RunUntil(remoteConnected, 21 * SECONDS + REMOTE_CONNECT_TIMEOUT_MS * 1000ULL));
+    Sim.RunFor(60 * SECONDS);
+    CHECK(Broker.publishes > publishes);
+    CHECK_EQ(App.GetTelemetryLost(), 0);
+}
+
+//the configured broker_port is the one connected to
+void configuredPortIsUsed()
+{
+    SyntheticOptions options;
+    options.brokerPort = 8883;
+    bootOnline(options);
+    CHECK(Network.Find("192.168.1.18", 8883) != nullptr);
+    CHECK(Network.Find("192.168.1.18", 1883) == nullptr);
+}
+
+int main()
+{
+    int failures = 0;
+    failures += SCENARIO(pollingContinuesOffline);
+    failures += SCENARIO(reconnectBacksOff);
+    failures += SCENARIO(reconnectsWhenBrokerReturns);
+    failures += SCENARIO(configuredPortIsUsed);
+    return failures;
+}
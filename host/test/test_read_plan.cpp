@@ -0,0 +1,112 @@
+#include "Check.h"
+#include "../app/Harness.h"
+#include "../app/SyntheticConfig.h"
+#include "../sim/FakeBroker.h"
+#include "../sim/SimulatedBus.h"
+
+#define SECONDS 1000000ULL
+
+void bootSynthetic(const SyntheticOptions& options)
+{
+    CHECK(Sim.CreateCard());
+    CHECK(Sim.WriteFile("conf.txt", buildSyntheticConfig(options)));
+    Sim.Boot();
+    CHECK(App.IsConfigLoaded());
+}
+
+//transactions of the first telemetry cycle
+unsigned long firstCycleTransactions()
+{
+    CHECK(Sim.RunCycles(1, 30 * SECONDS));
+    return RtuBus.transactions;
+}
+
+//eight contiguous registers of one slave are a single function 0x03 request
+void contiguousRegistersShareOneRead()
+{
+    SyntheticOptions options;
+    options.registers = 8;
+    bootSynthetic(options);
+    CHECK_EQ(App.GetConfig()->modbus.read_plan.span_count, 1);
+    CHECK_EQ(firstCycleTransactions(), 1);
+    CHECK_EQ(Sim.Slave(1)->reads, 1);
+    //every value is split back out to its own topic
+    CHECK_EQ(Broker.Find("dt/vfdctl/vfd1/+").size(), 8);
+    const BrokerMessage* message = Broker.Last("dt/vfdctl/vfd1/r5");
+    CHECK(message != nullptr);
+    if (message != nullptr){
+        CHECK(message->payload.find("\"value\":105") != std::string::npos);
+    }
+}
+
+//unused registers up to max_read_gap are read through, one more splits the block
+void gapDecidesTheSplit()
+{
+    SyntheticOptions options;
+    options.registers = 10;
+    options.spacing = 5;
+    options.maxReadGap = 4;
+    bootSynthetic(options);
+    CHECK_EQ(firstCycleTransactions(), 1);
+}
+
+void gapBeyondLimitSplits()
+{
+    SyntheticOptions options;
+    options.registers = 10;
+    options.spacing = 6;
+    options.maxReadGap = 4;
+    bootSynthetic(options);
+    CHECK_EQ(App.GetConfig()->modbus.read_plan.span_count, 10);
+    CHECK_EQ(firstCycleTransactions(), 10);
+}
+
+//registers of different slaves are never read together
+void slavesAreReadSeparately()
+{
+    SyntheticOptions options;
+    options.registers = 40;
+    options.devices = 4;
+    bootSynthetic(options);
+    CHECK_EQ(firstCycleTransactions(), 4);
+    for (int id = 1; id <= 4; id++)
+    {
+        CHECK_EQ(Sim.Slave(id)->reads, 1);
+    }
+    CHECK_EQ(Broker.Find("dt/vfdctl/+/+").size(), 40);
+}
+
+//a span is held to the 125 registers a single request may return
+void longBlocksSplitAtTheRequestLimit()
+{
+    SyntheticOptions options;
+    options.registers = 300;
+    options.baudRate = 115200;
+    bootSynthetic(options);
+    CHECK_EQ(firstCycleTransactions(), 3);
+    CHECK_EQ(RtuBus.exceptions, 0);
+    CHECK_EQ(Broker.Find("dt/vfdctl/vfd1/+").size(), 300);
+}
+
+//later cycles take the same number of requests
+void transactionsPerCycleStayFlat()
+{
+    SyntheticOptions options;
+    options.registers = 50;
+    options.devices = 2;
+    bootSynthetic(options);
+    CHECK(Sim.RunCycles(5, 30 * SECONDS));
+    CHECK_EQ(RtuBus.transactions, 10);
+}
+
+int main()
+{
+    int failures = 0;
+    failures += SCENARIO(contiguousRegistersShareOneRead);
+    failures += SCENARIO(gapDecidesTheSplit);
+    failures += SCENARIO(gapBeyondLimitSplits);
+    failures += SCENARIO(slavesAreReadSeparately);
+    failures += SCENARIO(longBlocksSplitAtTheRequestLimit);
+    failures += SCENARIO(transactionsPerCycleStayFlat);
+    return failures;
+}
@@ -0,0 +1,232 @@
+#include "Check.h"
+#include "../app/Harness.h"
+#include "../app/SyntheticConfig.h"
+#include "../../app/src/Health.h"
+#include "../sim/FakeBroker.h"
+#include "../sim/SimClock.h"
+#include "../sim/SimNetwork.h"
+#include "../sim/SimulatedBus.h"
+#include <SD.h>
+#include <stdio.h>
+#include <sys/mman.h>
+
+//fault injection: each failure class is taken down, held down, restored, and must come back on its own
+//without the others being touched. Every class is run once per outage length and its mean time to recovery reported.
+#define SECONDS 1000000ULL
+#define FAULT_CLASSES 5
+#define REPETITIONS 3
+
+const char* faultNames[FAULT_CLASSES] = {"storage", "modbus", "slave", "ethernet", "mqtt"};
+const int outageSeconds[REPETITIONS] = {5, 15, 40};
+
+/// @brief One fault, timed by the scenario's child process
+struct FaultResult
+{
+    bool recovered;
+    //fault injected to the failure being noticed
+    double detectMs;
+    //fault cleared to the class working again
+    double restoreMs;
+    //failure to recovery as HealthMonitor recorded it, the outage included
+    double healthMs;
+};
+
+FaultResult* results;
+int faultClass;
+int repetition;
+//failure class the predicates below watch
+eSubsystem watched;
+
+bool watchedFailed()
+{
+    return watched == eSubsystem::subsystem_slave ? Health.GetDegradedCount() > 0 : Health.IsFailed(watched);
+}
+
+bool watchedWorking()
+{
+    return !watchedFailed();
+}
+
+bool remoteDisconnected()
+{
+    return !App.IsRemoteConnected();
+}
+
+void bootWith(const SyntheticOptions& options)
+{
+    CHECK(Sim.CreateCard());
+    CHECK(Sim.WriteFile("conf.txt", buildSyntheticConfig(options)));
+    Sim.Boot();
+}
+
+//time to the failure being noticed, ms since the fault was injected
+double waitForFailure(uint64_t injectedAt, uint64_t timeoutMicros)
+{
+    CHECK(Sim.RunUntil(watchedFailed, timeoutMicros));
+    return (Clock.Micros() - injectedAt) / 1000.0;
+}
+
+//hold the fault for the outage, clear it with restore() and time the recovery
+void holdAndRestore(void (*restore)(), FaultResult* result)
+{
+    Sim.RunFor(outageSeconds[repetition] * SECONDS);
+    CHECK(watchedFailed());
+    uint64_t restoredAt = Clock.Micros();
+    restore();
+    result->recovered = Sim.RunUntil(watchedWorking, 600 * SECONDS);
+    CHECK(result->recovered);
+    result->restoreMs = (Clock.Micros() - restoredAt) / 1000.0;
+    RecoveryStats stats = Health.GetStats(watched);
+    CHECK_EQ(stats.failures, 1);
+    CHECK_EQ(stats.recoveries, 1);
+    result->healthMs = stats.recoveries > 0 ? static_cast<double>(stats.total_ms) / stats.recoveries : 0;
+}
+
+void insertCard()
+{
+    SD.SetInserted(true);
+}
+
+void openPort()
+{
+    RtuBus.failBegin = false;
+}
+
+void restartSlave()
+{
+    Sim.Slave(2)->online = true;
+}
+
+void plugLink()
+{
+    Network.SetLink(true);
+}
+
+void startBroker()
+{
+    Broker.SetOnline(true);
+}
+
+//the card is pulled while the broker is down, the journal's next flush fails and the card is remounted once back
+void storageFault()
+{
+    FaultResult* result = &results[faultClass * REPETITIONS + repetition];
+    SyntheticOptions options;
+    bootWith(options);
+    CHECK(Sim.RunCycles(2, 30 * SECONDS));
+    Broker.SetOnline(false);
+    CHECK(Sim.RunUntil(remoteDisconnected, 30 * SECONDS));
+    watched = eSubsystem::subsystem_storage;
+    uint64_t injectedAt = Clock.Micros();
+    SD.SetInserted(false);
+    result->detectMs = waitForFailure(injectedAt, 60 * SECONDS);
+    holdAndRestore(insertCard, result);
+    //the bus kept polling through it
+    CHECK(!Health.IsFailed(eSubsystem::subsystem_modbus));
+}
+
+//the serial port can't be opened at boot, recovery opens it once it is there, the network is up meanwhile
+void modbusFault()
+{
+    FaultResult* result = &results[faultClass * REPETITIONS + repetition];
+    SyntheticOptions options;
+    watched = eSubsystem::subsystem_modbus;
+    RtuBus.failBegin = true;
+    uint64_t injectedAt = Clock.Micros();
+    bootWith(options);
+    result->detectMs = waitForFailure(injectedAt, 30 * SECONDS);
+    holdAndRestore(openPort, result);
+    CHECK(Sim.RunCycles(Sim.cycles + 1, 30 * SECONDS));
+    CHECK(App.IsRemoteConnected());
+    CHECK_EQ(Health.GetStats(eSubsystem::subsystem_ethernet).failures, 0);
+}
+
+//one of two slaves stops answering, it is degraded and polled again on its backoff
+void slaveFault()
+{
+    FaultResult* result = &results[faultClass * REPETITIONS + repetition];
+    SyntheticOptions options;
+    options.devices = 2;
+    options.registers = 8;
+    options.commands = 0;
+    bootWith(options);
+    CHECK(Sim.RunCycles(2, 30 * SECONDS));
+    watched = eSubsystem::subsystem_slave;
+    uint64_t injectedAt = Clock.Micros();
+    Sim.Slave(2)->online = false;
+    result->detectMs = waitForFailure(injectedAt, 60 * SECONDS);
+    size_t published = Broker.Find("dt/vfdctl/vfd1/#").size();
+    holdAndRestore(restartSlave, result);
+    CHECK(Broker.Find("dt/vfdctl/vfd1/#").size() > published);
+}
+
+//the link drops, the broker connection goes with it, both come back once it is plugged in again
+void ethernetFault()
+{
+    FaultResult* result = &results[faultClass * REPETITIONS + repetition];
+    SyntheticOptions options;
+    bootWith(options);
+    CHECK(Sim.RunCycles(2, 30 * SECONDS));
+    watched = eSubsystem::subsystem_ethernet;
+    uint64_t injectedAt = Clock.Micros();
+    Network.SetLink(false);
+    result->detectMs = waitForFailure(injectedAt, 60 * SECONDS);
+    holdAndRestore(plugLink, result);
+    CHECK(Sim.RunUntil(watchedWorking, 120 * SECONDS));
+    CHECK_EQ(Health.GetStats(eSubsystem::subsystem_storage).failures, 0);
+    CHECK_EQ(Health.GetStats(eSubsystem::subsystem_modbus).failures, 0);
+}
+
+//the broker goes away, reconnects back off until it is there again
+void mqttFault()
+{
+    FaultResult* result = &results[faultClass * REPETITIONS + repetition];
+    SyntheticOptions options;
+    bootWith(options);
+    CHECK(Sim.RunCycles(2, 30 * SECONDS));
+    watched = eSubsystem::subsystem_mqtt;
+    uint64_t injectedAt = Clock.Micros();
+    Broker.SetOnline(false);
+    result->detectMs = waitForFailure(injectedAt, 60 * SECONDS);
+    holdAndRestore(startBroker, result);
+    CHECK(App.IsRemoteConnected());
+    CHECK_EQ(Health.GetStats(eSubsystem::subsystem_ethernet).failures, 0);
+}
+
+int main()
+{
+    void (*faults[FAULT_CLASSES])() = {storageFault, modbusFault, slaveFault, ethernetFault, mqttFault};
+    results = static_cast<FaultResult*>(mmap(nullptr, sizeof(FaultResult) * FAULT_CLASSES * REPETITIONS,
+        PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+    int failures = 0;
+    for (faultClass = 0; faultClass < FAULT_CLASSES; faultClass++)
+    {
+        for (repetition = 0; repetition < REPETITIONS; repetition++)
+        {
+            results[faultClass * REPETITIONS + repetition] = FaultResult{};
+            failures += runScenario(faultNames[faultClass], faults[faultClass]);
+        }
+    }
+
+    printf("\nmean time to recovery, %d outages of %d, %d and %d s per class\n", REPETITIONS,
+        outageSeconds[0], outageSeconds[1], outageSeconds[2]);
+    printf("%-9s %9s %12s %14s %14s\n", "class", "recovered", "detect (ms)", "restore (ms)", "health (ms)");
+    for (int c = 0; c < FAULT_CLASSES; c++)
+    {
+        int recovered = 0;
+        double detect = 0;
+        double restore = 0;
+        double health = 0;
+        for (int r = 0; r < REPETITIONS; r++)
+        {
+            FaultResult* result = &results[c * REPETITIONS + r];
+            recovered += result->recovered ? 1 : 0;
+            detect += result->detectMs;
+            restore += result->restoreMs;
+            health += result->healthMs;
+        }
+        printf("%-9s %7d/%d %12.0f %14.0f %14.0f\n", faultNames[c], recovered, REPETITIONS,
+            detect / REPETITIONS, restore / REPETITIONS, health / REPETITIONS);
+    }
+    return failures;
+}
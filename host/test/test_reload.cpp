@@ -0,0 +1,243 @@
+#include "Check.h"
+#include "../app/Harness.h"
+#include "../app/SyntheticConfig.h"
+#include "../sim/FakeBroker.h"
+#include <ArduinoJson.h>
+#include <string>
+
+#define SECONDS 1000000ULL
+#define RELOAD_TOPIC "cmd/vfdctl/prime/config/reload"
+#define PATCH_TOPIC "cmd/vfdctl/prime/config/patch"
+#define RESULT_TOPIC "dt/vfdctl/prime/$config"
+
+bool reloadIdle()
+{
+    return !App.IsReloadPending();
+}
+
+bool reloadPending()
+{
+    return App.IsReloadPending();
+}
+
+void boot(const SyntheticOptions& options)
+{
+    CHECK(Sim.CreateCard());
+    CHECK(Sim.WriteFile("conf.txt", buildSyntheticConfig(options)));
+    Sim.Boot();
+    CHECK(Sim.RunCycles(2, 30 * SECONDS));
+    CHECK(App.IsRemoteConnected());
+}
+
+//send a reload or patch and wait for its result on dt/vfdctl/prime/$config
+bool reload(const char* topic, const char* payload, JsonDocument& result)
+{
+    size_t results = Broker.Find(RESULT_TOPIC).size();
+    Sim.Command(topic, payload);
+    Sim.RunFor(100000);
+    if (!Sim.RunUntil(reloadIdle, 60 * SECONDS)){
+        return false;
+    }
+    Sim.RunFor(100000);
+    std::vector<const BrokerMessage*> messages = Broker.Find(RESULT_TOPIC);
+    if (messages.size() == results){
+        return false;
+    }
+    return !deserializeJson(result, messages.back()->payload.c_str());
+}
+
+std::string replaceAll(std::string text, const std::string& from, const std::string& to)
+{
+    for (size_t at = text.find(from); at != std::string::npos; at = text.find(from, at + to.size()))
+    {
+        text.replace(at, from.size(), to);
+    }
+    return text;
+}
+
+//a file with one renamed and two dropped registers is diffed entry by entry
+void reloadAppliesChangedFile()
+{
+    SyntheticOptions options;
+    boot(options);
+    int32_t value = App.GetConfig()->modbus.registers.value[10];
+    SyntheticOptions smaller = options;
+    smaller.registers = 48;
+    CHECK(Sim.WriteFile("conf.txt", replaceAll(buildSyntheticConfig(smaller), "\"name\":\"r3\"", "\"name\":\"speed\"")));
+
+    StaticJsonDocument<512> result;
+    CHECK(reload(RELOAD_TOPIC, "", result));
+    CHECK(result["result"] == "applied");
+    CHECK_EQ(result["registers"]["unchanged"].as<int>(), 47);
+    CHECK_EQ(result["registers"]["changed"].as<int>(), 1);
+    CHECK_EQ(result["registers"]["added"].as<int>(), 0);
+    CHECK_EQ(result["registers"]["removed"].as<int>(), 2);
+    CHECK_EQ(result["commands_changed"].as<int>(), 0);
+    ModbusRegisterTable* regs = &App.GetConfig()->modbus.registers;
+    CHECK_EQ(regs->count, 48);
+    CHECK(strcmp(regs->meta[3].name, "speed") == 0);
+    //values read before the swap carry over
+    CHECK_EQ(regs->value[10], value);
+
+    //the same file again changes nothing
+    CHECK(reload(RELOAD_TOPIC, "", result));
+    CHECK(result["result"] == "unchanged");
+    CHECK(Sim.RunCycles(Sim.cycles + 2, 30 * SECONDS));
+}
+
+//entries sharing a device, type and address each claim their own live register
+void duplicateRegistersAreCounted()
+{
+    SyntheticOptions options;
+    boot(options);
+    std::string file = buildSyntheticConfig(options);
+    std::string duplicate = "{\"name\":\"r0b\",\"units\":\"u0\",\"address\":200,\"value\":0,\"device_id\":1,\"topic\":\"dt/vfdctl/vfd1/r0b\"},\n";
+    std::string withDuplicate = file;
+    withDuplicate.insert(withDuplicate.find("{\"name\":\"r0\""), duplicate);
+
+    StaticJsonDocument<512> result;
+    CHECK(Sim.WriteFile("conf.txt", withDuplicate));
+    CHECK(reload(RELOAD_TOPIC, "", result));
+    CHECK(result["result"] == "applied");
+    CHECK_EQ(result["registers"]["unchanged"].as<int>(), 50);
+    CHECK_EQ(result["registers"]["changed"].as<int>(), 0);
+    CHECK_EQ(result["registers"]["added"].as<int>(), 1);
+    CHECK_EQ(result["registers"]["removed"].as<int>(), 0);
+
+    CHECK(Sim.WriteFile("conf.txt", file));
+    CHECK(reload(RELOAD_TOPIC, "", result));
+    CHECK(result["result"] == "applied");
+    CHECK_EQ(result["registers"]["unchanged"].as<int>(), 50);
+    CHECK_EQ(result["registers"]["added"].as<int>(), 0);
+    CHECK_EQ(result["registers"]["removed"].as<int>(), 1);
+    CHECK_EQ(App.GetConfig()->modbus.registers.count, 50);
+}
+
+//a file that doesn't parse leaves the live configuration running
+void invalidFileIsRejected()
+{
+    SyntheticOptions options;
+    boot(options);
+    Config* live = App.GetConfig();
+    std::string file = buildSyntheticConfig(options);
+    CHECK(Sim.WriteFile("conf.txt", file.substr(0, file.size() / 2)));
+
+    StaticJsonDocument<512> result;
+    CHECK(reload(RELOAD_TOPIC, "", result));
+    CHECK(result["result"] == "rejected");
+    CHECK(App.GetConfig() == live);
+    CHECK_EQ(App.GetConfig()->modbus.registers.count, 50);
+    CHECK(Sim.RunCycles(Sim.cycles + 2, 30 * SECONDS));
+}
+
+//the load is spread over scheduler passes, commands are written while it is staged
+void pollingContinuesDuringReload()
+{
+    SyntheticOptions options;
+    options.registers = 500;
+    options.devices = 4;
+    options.baudRate = 115200;
+    boot(options);
+    SyntheticOptions larger = options;
+    larger.registers = 520;
+    CHECK(Sim.WriteFile("conf.txt", buildSyntheticConfig(larger)));
+
+    Sim.Command(RELOAD_TOPIC, "");
+    CHECK(Sim.RunUntil(reloadPending, SECONDS));
+    SimSlave* slave = Sim.Slave(1);
+    size_t writes = slave->writeLog.size();
+    Sim.Command("cmd/vfdctl/vfd1/c0/config", "{\"contentType\":\"registerWriteMsg\",\"requestedValue\":40}");
+    unsigned long passes = 0;
+    bool writtenWhilePending = false;
+    while (App.IsReloadPending() && passes < 1000000)
+    {
+        Sim.Step();
+        passes++;
+        writtenWhilePending = writtenWhilePending || (slave->writeLog.size() > writes && App.IsReloadPending());
+    }
+    CHECK(!App.IsReloadPending());
+    CHECK(writtenWhilePending);
+    //sizing, filling and matching 520 registers a step at a time
+    CHECK(passes >= 3 * 520 / CONFIG_RELOAD_STEP);
+    CHECK_EQ(App.GetConfig()->modbus.registers.count, 520);
+}
+
+//a patch merges entries into the live registers by device, type and address
+void patchAppliesChanges()
+{
+    SyntheticOptions options;
+    boot(options);
+    StaticJsonDocument<512> result;
+    CHECK(reload(PATCH_TOPIC,
+        "{\"telemetry_registers\":["
+        "{\"device_id\":1,\"address\":203,\"deadband\":5},"
+        "{\"device_id\":1,\"address\":249,\"remove\":true},"
+        "{\"device_id\":1,\"address\":300,\"name\":\"extra\",\"units\":\"A\",\"topic\":\"dt/vfdctl/vfd1/extra\"}],"
+        "\"configuration_registers\":[{\"device_id\":1,\"address\":1000,\"upper_limit\":500}]}",
+        result));
+    CHECK(result["result"] == "applied");
+    CHECK_EQ(result["registers"]["unchanged"].as<int>(), 48);
+    CHECK_EQ(result["registers"]["changed"].as<int>(), 1);
+    CHECK_EQ(result["registers"]["added"].as<int>(), 1);
+    CHECK_EQ(result["registers"]["removed"].as<int>(), 1);
+    CHECK_EQ(result["commands_changed"].as<int>(), 1);
+
+    Config* config = App.GetConfig();
+    ModbusRegisterTable* regs = &config->modbus.registers;
+    CHECK_EQ(regs->count, 50);
+    CHECK_EQ(regs->deadband[3], 5);
+    CHECK(regs->flags[3] & REGISTER_REPORT_BY_EXCEPTION);
+    CHECK(strcmp(regs->meta[3].name, "r3") == 0);
+    //added registers follow the live ones
+    CHECK(strcmp(regs->meta[49].name, "extra") == 0);
+    CHECK_EQ(regs->address[49], 299);
+    CHECK_EQ(config->modbus.configuration_registers[0].upper_limit, 500);
+    CHECK_EQ(config->modbus.configuration_registers[0].lower_limit, 0);
+    CHECK(Sim.RunCycles(Sim.cycles + 2, 30 * SECONDS));
+    CHECK(Broker.Last("dt/vfdctl/vfd1/extra") != nullptr);
+}
+
+//patches that can't be applied are refused whole, as is a second reload while one is staged
+void invalidPatchIsRejected()
+{
+    SyntheticOptions options;
+    boot(options);
+    Config* live = App.GetConfig();
+    StaticJsonDocument<512> result;
+    CHECK(reload(PATCH_TOPIC, "{\"telemetry_registers\":[{\"device_id\":1,\"address\":999,\"remove\":true}]}", result));
+    CHECK(result["result"] == "rejected");
+    CHECK_EQ(result["error"].as<int>(), static_cast<int>(ConfigurationManagerErrors::CONFIG_PATCH_INVALID));
+    CHECK(reload(PATCH_TOPIC, "{\"modbus\":{\"telemetry_interval_sec\":5}}", result));
+    CHECK(result["result"] == "rejected");
+    CHECK(reload(PATCH_TOPIC, "{\"telemetry_registers\":[{\"address\":203,\"deadband\":5}]}", result));
+    CHECK(result["result"] == "rejected");
+    CHECK(reload(PATCH_TOPIC, "not json", result));
+    CHECK(result["result"] == "rejected");
+    CHECK(App.GetConfig() == live);
+
+    Sim.Command(RELOAD_TOPIC, "");
+    CHECK(Sim.RunUntil(reloadPending, SECONDS));
+    Sim.Command(PATCH_TOPIC, "{\"telemetry_registers\":[{\"device_id\":1,\"address\":203,\"deadband\":5}]}");
+    CHECK(Sim.RunUntil(reloadIdle, 60 * SECONDS));
+    Sim.RunFor(100000);
+    bool busy = false;
+    for (const BrokerMessage* message : Broker.Find(RESULT_TOPIC))
+    {
+        StaticJsonDocument<256> doc;
+        deserializeJson(doc, message->payload.c_str());
+        busy = busy || doc["error"].as<int>() == static_cast<int>(ConfigurationManagerErrors::CONFIG_RELOAD_BUSY);
+    }
+    CHECK(busy);
+}
+
+int main()
+{
+    int failures = 0;
+    failures += SCENARIO(reloadAppliesChangedFile);
+    failures += SCENARIO(duplicateRegistersAreCounted);
+    failures += SCENARIO(invalidFileIsRejected);
+    failures += SCENARIO(pollingContinuesDuringReload);
+    failures += SCENARIO(patchAppliesChanges);
+    failures += SCENARIO(invalidPatchIsRejected);
+    return failures;
+}
@@ -0,0 +1,112 @@
+#include "Check.h"
+#include "../app/Harness.h"
+#include "../app/SyntheticConfig.h"
+#include "../../app/src/Log.h"
+#include <SD.h>
+#include <stdio.h>
+#include <string.h>
+
+char configName[] = "conf.txt";
+
+//a line still held in the log ring contains text
+bool logContains(const char* text)
+{
+    static char buffer[LOG_BUFFER_SIZE + 1];
+    size_t len = Log.Copy(0, buffer, LOG_BUFFER_SIZE);
+    buffer[len] = '\0';
+    return strstr(buffer, text) != nullptr;
+}
+
+//the log line of a snapshot rejected with error
+bool snapshotRejected(ConfigurationManagerErrors error)
+{
+    char text[48];
+    snprintf(text, sizeof(text), "Snapshot unavailable (%d)", static_cast<int>(error));
+    return logContains(text);
+}
+
+Config* loadFresh()
+{
+    Config* config = new Config{};
+    CHECK_EQ(ConfigMgr.Load(configName, config), 0);
+    return config;
+}
+
+void prepare(const SyntheticOptions& options)
+{
+    CHECK(Sim.CreateCard());
+    CHECK(Sim.WriteFile("conf.txt", buildSyntheticConfig(options)));
+    CHECK_EQ(ConfigMgr.Init(true, SDCARD_SS_PIN), 0);
+}
+
+//the first load parses json and leaves a snapshot, the second one reads it back
+void secondLoadUsesSnapshot()
+{
+    SyntheticOptions options;
+    prepare(options);
+    Config* parsed = loadFresh();
+    CHECK(logContains("parsed from json"));
+    CHECK(SD.exists("conf.bin"));
+    Config* restored = loadFresh();
+    CHECK(logContains("loaded from snapshot"));
+    CHECK_EQ(restored->modbus.registers.count, parsed->modbus.registers.count);
+    CHECK_EQ(restored->modbus.read_plan.span_count, parsed->modbus.read_plan.span_count);
+    CHECK(strcmp(restored->modbus.registers.meta[7].name, "r7") == 0);
+    CHECK(ConfigMgr.GetParameter("cmd/vfdctl/vfd1/c3/config", restored) == &restored->modbus.configuration_registers[3]);
+}
+
+//register tables larger than a single 16-bit SD read still load from the snapshot
+void largeSnapshotLoads()
+{
+    SyntheticOptions options;
+    options.registers = 2000;
+    options.devices = 16;
+    options.commands = 200;
+    prepare(options);
+    loadFresh();
+    CHECK(Sim.ReadFile("conf.bin").size() > 0x10000);
+    Config* restored = loadFresh();
+    CHECK(logContains("loaded from snapshot"));
+    CHECK_EQ(restored->modbus.registers.count, 2000);
+    CHECK(strcmp(restored->modbus.registers.meta[1999].name, "r1999") == 0);
+    CHECK_EQ(restored->modbus.registers.address[1999], 199 + 1999 / 16);
+}
+
+//an edited conf.txt is parsed again and replaces the snapshot
+void editedConfigIsParsed()
+{
+    SyntheticOptions options;
+    prepare(options);
+    loadFresh();
+    options.registers = 60;
+    CHECK(Sim.WriteFile("conf.txt", buildSyntheticConfig(options)));
+    Config* config = loadFresh();
+    CHECK(snapshotRejected(ConfigurationManagerErrors::SNAPSHOT_STALE));
+    CHECK_EQ(config->modbus.registers.count, 60);
+    loadFresh();
+    CHECK(logContains("loaded from snapshot"));
+}
+
+//a damaged snapshot fails its crc and the json is used
+void corruptSnapshotFallsBack()
+{
+    SyntheticOptions options;
+    prepare(options);
+    loadFresh();
+    std::string image = Sim.ReadFile("conf.bin");
+    image[image.size() - 10] ^= 0x5A;
+    CHECK(Sim.WriteFile("conf.bin", image));
+    Config* config = loadFresh();
+    CHECK(snapshotRejected(ConfigurationManagerErrors::SNAPSHOT_INVALID));
+    CHECK_EQ(config->modbus.registers.count, 50);
+}
+
+int main()
+{
+    int failures = 0;
+    failures += SCENARIO(secondLoadUsesSnapshot);
+    failures += SCENARIO(largeSnapshotLoads);
+    failures += SCENARIO(editedConfigIsParsed);
+    failures += SCENARIO(corruptSnapshotFallsBack);
+    return failures;
+}